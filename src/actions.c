@@ -4,153 +4,388 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "nesutils.h"
+#include "nesrom.h"
 #include "commandline.h"
 #include "verbosity.h"
 #include "nesromtool.h"
+#include "functions.h"
+#include "pathfunc.h"
+#include "formats.h"
+#include "patching.h"
+#include "jobs.h"
+#include "records.h"
+#include "catalog.h"
+#include "query.h"
+#include "hash.h"
+#include "dat.h"
+#include "verify.h"
+#include "trim.h"
+#include "store.h"
+#include "similar.h"
+#include "derive.h"
+#include "tileindex.h"
+#include "sheet.h"
 
-void parse_cli_info(char **argv) {
+typedef struct infoOptions {
+	bool print_all;
+	RecordFormat format;
+} InfoOptions;
+
+static bool parse_format_option(char ***argv_ref, char *current_arg, RecordFormat *format) {
 	/*
-	**	parses program arguments for the info command
-	**	prints out various info about the ROM file...
-	**		Filesize
-	**		PRG/CHR counts
-	**		title info
-	**		filename
-	**		
+	**	handles --format=<name> and --format <name> for the actions that write records
+	**	returns false if current_arg isn't a --format option; exits on an unknown format
 	*/
 	
-	//takes no options... so get right into reading filename(s)
-		
-	char *current_arg = GET_NEXT_ARG;
-	bool print_all = false;
+	char **argv = *argv_ref;
 	
-	if (IS_OPT(current_arg)) {
-		if (strcmp(current_arg, ACTION_INFO_ALL) == 0) {
-			print_all = true;
-		}
+	if (strncmp(current_arg, ACTION_INFO_FORMAT, strlen(ACTION_INFO_FORMAT)) != 0) return false;
+	
+	char *format_name = current_arg + strlen(ACTION_INFO_FORMAT);
+	bool ok = false;
+	
+	//either --format=csv or --format csv
+	if (*format_name == '=') {
+		format_name++;
+	} else if (*format_name == '\0') {
 		current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected an output format (text, ndjson or csv)!");
+		format_name = current_arg;
+	} else {
+		return false;
 	}
 	
-	if (current_arg == NULL) {
-		printf("no filenames specified!\n");
+	*format = record_format_from_name(format_name, &ok);
+	if (!ok) {
+		fprintf(stderr, "Unknown output format '%s'. Please use text, ndjson or csv.\n\n", format_name);
 		exit(EXIT_FAILURE);
 	}
 	
-	for (; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-		//current_arg is a filepath...
-		FILE *ifile = NULL;
+	*argv_ref = argv;
+	
+	return true;
+}
+
+static bool info_record_job(Job *job) {
+	/*
+	**	writes the NDJSON/CSV record for a single file
+	**	(files we can't open still get a record, with the error in it)
+	*/
+	
+	InfoOptions *options = (InfoOptions *)job->context;
+	NESRom *rom = NULL;
+	StrBuf record;
+	bool ok = true;
+	
+	strbuf_init(&record);
+	
+	if ((rom = NESRomOpen(job->path))) {
+		NESRecordAppend(&record, options->format, job->path, rom);
+		NESRomClose(rom);
+	} else {
+		NESRecordAppendError(&record, options->format, job->path, strerror(errno));
+		ok = false;
+	}
+	
+	strbuf_write(&record, job->out);
+	strbuf_free(&record);
+	
+	return ok;
+}
+
+static void print_bank_digest(FILE *ofile, NESRom *rom, NESBankType bank_type, int bank_index) {
+	/*
+	**	finishes a bank's line in info -a with its CRC32 and SHA-1 (or a note if it's not in the file)
+	*/
+	
+	NESDigest digest;
+	char hex[(SHA1_DIGEST_LENGTH * 2) + 1];
+	
+	if (!NESRomBankDigest(rom, bank_type, bank_index, &digest)) {
+		fprintf(ofile, "  [missing]\n");
+		return;
+	}
+	
+	fprintf(ofile, "  CRC32: %08X  SHA-1: %s\n", digest.crc32, hex_digest(hex, digest.sha1, SHA1_DIGEST_LENGTH));
+}
+
+static bool info_job(Job *job) {
+	/*
+	**	prints the info for a single file
+	*/
+	
+	InfoOptions *options = (InfoOptions *)job->context;
+	
+	NESRom *rom = NULL;
+	
+	//open and map the file...
+	if (!(rom = NESRomOpen(job->path))) {
+		fprintf(job->err, "Error opening file: %s\n", job->path);
+		return false;
+	}
+	
+	u64 filesize = rom->size; //get the filesize
+	char human_filesize[32];
+	hr_filesize(human_filesize, (double)filesize);
+	
+	//print info about the file
+	fprintf(job->out, "Filename:           %s\n", lastPathComponent(job->path));
+	fprintf(job->out, "Filesize:           %llu bytes (%s)\n", filesize, human_filesize);
+	
+	//the same check the verify action makes, so the two always agree
+	NESVerifyResult verify;
+	bool readable = NESVerifyOpenRom(&verify, rom);
+	
+	fprintf(job->out, "Verify:             ");
+	if (readable && !(verify.problems & NES_VERIFY_ERRORS)) {
+		fprintf(job->out, "OK\n");
+	} else {
+		//the file isn't a usable NES ROM... so stop printing info and move on to the next file
+		char description[256];
 		
-		//open the file for reading...
-		if (!(ifile = fopen(current_arg, "r"))) {
-			printf("Error opening file: %s\n", current_arg);
-			exit(EXIT_FAILURE);
-		}
+		NESVerifyDescribeError(description, sizeof(description), &verify);
+		fprintf(job->out, "ERROR (%s)\n", description);
+		NESRomClose(rom);
+		return true;
+	}
+	
+	//everything else comes out of the decoded header
+	NESHeader *header = &(rom->info);
+	
+	fprintf(job->out, "Header Format:      %s\n", NESHeaderFormatName(header->format));
+	
+	//print bank info
+	fprintf(job->out, "PRG Banks:          %d\n", header->prg_count);
+	fprintf(job->out, "CHR Banks:          %d\n", header->chr_count);
+	
+	if (header->format == nes_format_nes2) {
+		char human_size[32];
 		
-		u32 filesize = NESGetFilesize(ifile); //get the filesize
-		char human_filesize[32];
-		hr_filesize(human_filesize, (double)filesize);
+		hr_filesize(human_size, (double)header->prg_size);
+		fprintf(job->out, "PRG-ROM Size:       %s\n", human_size);
+		hr_filesize(human_size, (double)header->chr_size);
+		fprintf(job->out, "CHR-ROM Size:       %s\n", human_size);
 		
-		//print info about the file
-		printf("Filename:           %s\n", lastPathComponent(current_arg));
-		printf("Filesize:           %ld bytes (%s)\n", filesize, human_filesize);
+		if (header->prg_ram_size || header->prg_nvram_size) {
+			fprintf(job->out, "PRG-RAM/NVRAM:      %llu/%llu bytes\n", header->prg_ram_size, header->prg_nvram_size);
+		}
 		
-		printf("Verify:             ");
-		if (NESVerifyROM(ifile)) {
-			printf("OK\n");
-		} else {
-			//the file does not appear to be an NES ROM... so stop printing info and move on to next iteration of loop
-			printf("ERROR (does not appear to be a valid NES ROM)\n");
-			fclose(ifile);
-			continue;
+		if (header->chr_ram_size || header->chr_nvram_size) {
+			fprintf(job->out, "CHR-RAM/NVRAM:      %llu/%llu bytes\n", header->chr_ram_size, header->chr_nvram_size);
 		}
+	}
+	
+	fprintf(job->out, "Mirror Mode:        %s\n", header->four_screen ? "4-Screen" : (header->mirroring == NES_VERTICAL_MIRROR_MODE ? "Vertical" : "Horizontal"));
+	fprintf(job->out, "Battery-backed RAM: %s\n", header->battery ? "YES" : "NO");
+	fprintf(job->out, "Trainer Present:    %s\n", header->trainer ? "YES" : "NO");
+	
+	if (header->format == nes_format_nes2) {
+		fprintf(job->out, "Mapper:             %d (submapper %d)\n", header->mapper, header->submapper);
+	} else {
+		fprintf(job->out, "Mapper:             %d\n", header->mapper);
+	}
+	
+	//print title info
+	//outputs '[n/a]' if no title is found...
+	char title[NES_TITLE_BLOCK_LENGTH];
+	if (NESRomHasTitle(rom)) {
+		NESRomGetTitle(rom, title, true);
+		fprintf(job->out, "Title:              %s\n", title);
+	} else {
+		fprintf(job->out, "Title:              [n/a]\n");
+	}
+	
+	//hashes of the whole file, then of just the PRG and CHR data
+	NESRomHashes hashes;
+	char hex[(SHA1_DIGEST_LENGTH * 2) + 1];
+	
+	NESRomComputeHashes(rom, &hashes);
+	
+	fprintf(job->out, "CRC32:              %08X\n", hashes.file.crc32);
+	fprintf(job->out, "MD5:                %s\n", hex_digest(hex, hashes.file.md5, MD5_DIGEST_LENGTH));
+	fprintf(job->out, "SHA-1:              %s\n", hex_digest(hex, hashes.file.sha1, SHA1_DIGEST_LENGTH));
+	fprintf(job->out, "Payload CRC32:      %08X\n", hashes.payload.crc32);
+	fprintf(job->out, "Payload MD5:        %s\n", hex_digest(hex, hashes.payload.md5, MD5_DIGEST_LENGTH));
+	fprintf(job->out, "Payload SHA-1:      %s\n", hex_digest(hex, hashes.payload.sha1, SHA1_DIGEST_LENGTH));
+	
+	if (options->print_all) {
+		// print offsets, too (straight out of the ROM's directory)
+		int i = 0;
+		int prg_count = rom->prg_count;
+		int chr_count = rom->chr_count;
 		
-		//print bank info
-		printf("PRG Banks:          %d\n", NESGetPrgBankCount(ifile));
-		printf("CHR Banks:          %d\n", NESGetChrBankCount(ifile));
+		//pad the bank numbers with zeros so the offsets line up (big NES 2.0 ROMs can have thousands of banks)
+		int prg_width = 1;
+		int chr_width = 1;
 		
-		char rom_control_bytes[2];
+		for (i = prg_count - 1; i > 9; i /= 10) prg_width++;
+		for (i = chr_count - 1; i > 9; i /= 10) chr_width++;
 		
-		if (!NESGetRomControlBytes(rom_control_bytes, ifile)) {
-			printf("%s: Error reading ROM control bytes\n", current_arg);
-			continue;
+		if (rom->dir.trainer_length) {
+			fprintf(job->out, "  Trainer offset:    0x%08llX\n", rom->dir.trainer_offset);
 		}
 		
-		//get the mirror info
-		char mirror_type[] = "Horizontal";
-		if (rom_control_bytes[0] && NES_ROM_CONTROL_MIRROR_TYPE_MASK) {
-			strcpy(mirror_type, "Vertical");
+		for (i = 0; i < prg_count; i++) {
+			fprintf(job->out, "  PRG Bank %0*d offset: 0x%08llX", prg_width, i, NESRomBankOffset(rom, nes_prg_bank, i));
+			print_bank_digest(job->out, rom, nes_prg_bank, i);
 		}
 		
-		//get the presense of battery-backed RAM
-		bool battery = (rom_control_bytes[0] && NES_ROM_CONTROL_BATT_RAM_MASK);
-		
-		//get the presense of a trainer
-		bool trainer = (rom_control_bytes[0] && NES_ROM_CONTROL_TRAINER_MASK);
+		for (i = 0; i < chr_count; i++) {
+			fprintf(job->out, "  CHR Bank %0*d offset: 0x%08llX", chr_width, i, NESRomBankOffset(rom, nes_chr_bank, i));
+			print_bank_digest(job->out, rom, nes_chr_bank, i);
+		}
 		
-		//get the 4-screen mask info
-		bool four_screen = (rom_control_bytes[0] && NES_ROM_CONTROL_4_SCREEN_MASK);
+		if (rom->dir.title_length) {
+			fprintf(job->out, "  Title offset:      0x%08llX\n", rom->dir.title_offset);
+		}
 		
-		//get the mapper info (gotta read the HI and the LO separately, and shift them together)
-		char mapper = (rom_control_bytes[0] && NES_ROM_CONTROL_MAPPER_HIGH_MASK);
-		mapper <<= 4;
-		mapper += (rom_control_bytes[1] && NES_ROM_CONTROL_MAPPER_LOW_MASK);
+		if (rom->dir.overdump_length) {
+			fprintf(job->out, "  Overdump offset:   0x%08llX (%llu bytes)\n", rom->dir.overdump_offset, rom->dir.overdump_length);
+		}
+	}
+	
+	fprintf(job->out, "\n");
+	
+	NESRomClose(rom);
+	
+	return true;
+}
+
+void parse_cli_info(char **argv) {
+	/*
+	**	parses program arguments for the info command
+	**	prints out various info about the ROM file...
+	**		Filesize
+	**		PRG/CHR counts
+	**		title info
+	**		filename
+	**		
+	*/
+	
+	//options: -a (print offsets too), --format=<text|ndjson|csv>
 		
-		printf("Mirror Mode:        %s\n", four_screen ? "4-Screen" : mirror_type);
-		printf("Battery-backed RAM: %s\n", battery ? "YES" : "NO");
-		printf("Trainer Present:    %s\n", trainer ? "YES" : "NO");
-		printf("Mapper:             %02X\n", mapper);
+	char *current_arg = NULL;
+	InfoOptions options;
+	
+	options.print_all = false;
+	options.format = record_format_text;
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
 		
-		//print title info
-		//outputs '[n/a]' if no title is found...
-		char *title = (char*)malloc(NES_TITLE_BLOCK_LENGTH);
-		if (NESHasTitle(ifile)) {
-			NESGetTitle(title, ifile, 1);
-			printf("Title:              %s\n", title);
-		} else {
-			printf("Title:              [n/a]\n");
+		if (strcmp(current_arg, ACTION_INFO_ALL) == 0) {
+			options.print_all = true;
+			continue;
 		}
-				
-		free(title);
 		
-		if (print_all) {
-			// print offsets, too
-			int i = 0;
-			int prg_count = NESGetPrgBankCount(ifile);
-			int chr_count = NESGetChrBankCount(ifile);
-			
-			char *format = NULL; //placeholder for the format of the offset output
-			
-			//if there are more than 9 PRG banks, then pad the output with a zero
-			if (prg_count > 9) {
-				format = "  PRG Bank %02d offset: 0x%08X\n";
-			} else {
-				format = "  PRG Bank %d offset: 0x%08X\n";
-			}
-			
-			for (i = 1; i <= prg_count; i++) {
-				NESSeekToBank(ifile, nes_prg_bank, i);
-				printf(format, i, (unsigned int)ftell(ifile));
-			}
-			
-			//if there are more than 9 CHR banks, then pad the output with a zero
-			if (chr_count > 9) {
-				format = "  CHR Bank %02d offset: 0x%08X\n";
-			} else {
-				format = "  CHR Bank %d offset: 0x%08X\n";
-			}
-			
-			for (i = 1; i <= chr_count; i++) {
-				NESSeekToBank(ifile, nes_chr_bank, i);
-				printf(format, i, (unsigned int)ftell(ifile));
-			}
+		if (parse_format_option(&argv, current_arg, &(options.format))) {
+			continue;
 		}
 		
-		printf("\n");
-		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_INFO, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf("no filenames specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if (options.format == record_format_text) {
+		if (run_jobs(argv, info_job, &options, 0)) {
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
+	
+	//machine-readable: records go out through a big stdout buffer (one fwrite per record)
+	StrBuf header;
+	int failed = 0;
+	
+	setvbuf(stdout, NULL, _IOFBF, RECORD_OUTPUT_BUFFER_SIZE);
+	
+	strbuf_init(&header);
+	NESRecordHeader(&header, options.format);
+	strbuf_write(&header, stdout);
+	strbuf_free(&header);
+	
+	failed = run_jobs(argv, info_record_job, &options, 0);
+	
+	fflush(stdout);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static bool title_print_job(Job *job) {
+	FILE *ifile = NULL;
+	
+	//if an error happens while trying to open the file,
+	//print an error and move on to the next file
+	if (!(ifile = fopen(job->path, "r"))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	//fetch the title...
+	char title[NES_TITLE_BLOCK_LENGTH];
+	NESGetTitle(title, ifile, true);
+	
+	//if the title is blank...
+	if (title[0] == 0) {
+		strcpy(title, "[n/a]");
+	}
+	
+	//print "filename: title"
+	fprintf(job->out, "%s: %s\n", lastPathComponent(job->path), title);
+	
+	fclose(ifile);
+	
+	return true;
+}
+
+static bool title_set_job(Job *job) {
+	char *new_title = (char *)job->context;
+	FILE *ifile = NULL;
+	
+	if (!(ifile = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	//set the new title
+	if (!NESSetTitle(ifile, new_title)) {
+		fprintf(job->err, "%s: An error occurred while setting the title\n", job->path);
 		fclose(ifile);
+		return false;
+	}
+	
+	fclose(ifile);
+	
+	return true;
+}
+
+static bool title_remove_job(Job *job) {
+	FILE *ifile = NULL;
+	
+	if (!(ifile = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		return false;
 	}
+	
+	//remove the titledata
+	NESRemoveTitle(ifile);
+	
+	fclose(ifile);
+	
+	return true;
 }
 
 void parse_cli_title(char **argv) {
@@ -165,164 +400,525 @@ void parse_cli_title(char **argv) {
 	//	-print (default)
 	
 	char title_command[10] = ACTION_TITLE_PRINT; //default
+	int failed = 0;
 	
 	char *current_arg = GET_NEXT_ARG;
 	
 	CHECK_ARG_ERROR("Expected a sub-action (set, remove or print)!");
 	
-	strcpy(title_command, current_arg);
-	current_arg = GET_NEXT_ARG;
+	strncpy(title_command, current_arg, sizeof(title_command) - 1);
 			
 	#pragma mark **Print Title
 	if (strcmp(title_command, ACTION_TITLE_PRINT) == 0) {
 		//print the title:
-		for ( ; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-			FILE *ifile = NULL;
-			
-			//if an error happens while trying to open the file,
-			//print an error and move on to next iteration
-			if (!(ifile = fopen(current_arg, "r"))) {
-				perror(current_arg);
-				continue;
-			}
-			
-			//fetch the title...
-			char *title = (char*)malloc(NES_TITLE_BLOCK_LENGTH);
-			NESGetTitle(title, ifile, true);
-			
-			//if the title is blank...
-			if (title[0] == 0) {
-				strcpy(title, "[n/a]");
-			}
-			
-			//print "filename: title"
-			printf("%s: %s\n", lastPathComponent(current_arg), title);
-			
-			fclose(ifile);
-		}
+		failed = run_jobs(argv, title_print_job, NULL, 0);
 		
 	#pragma mark **Set Title
 	} else if (strcmp(title_command, ACTION_TITLE_SET) == 0) {
 		//set a new title
-		char *new_title = current_arg;
 		current_arg = GET_NEXT_ARG;
-				
-		for ( ; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-			FILE *ifile = NULL;
-			
-			//if an error happens while trying to open the file,
-			//print an error and move on to next iteration
-			if (!(ifile = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue;
-			}
-						
-			//set the new title
-			if (!NESSetTitle(ifile, new_title)) {
-				printf("An error occurred while setting the title\n");
-			}
-			
-			fclose(ifile);
-		}
+		CHECK_ARG_ERROR("Expected a new title!");
+		
+		char *new_title = current_arg;
+		
+		failed = run_jobs(argv, title_set_job, new_title, 0);
+		
 	#pragma mark **Remove Title
 	} else if (strcmp(title_command, ACTION_TITLE_REMOVE) == 0) {
 		//remove the title
-		for (; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-			FILE *ifile = NULL;
-			
-			//if an error occurs while opening the file,
-			//print an error and move on to next iteration
-			if (!(ifile = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue;
-			}
-			
-			//remove the titledata
-			NESRemoveTitle(ifile);
-			
-			fclose(ifile);
-		}
+		failed = run_jobs(argv, title_remove_job, NULL, 0);
+		
 	} else {
 		//unknown command
 		printf("Unknown command %s\n", title_command);
 		exit(EXIT_FAILURE);
 	}
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
 }
 
-void parse_cli_extract(char **argv) {
+typedef struct extractTileOptions {
+	NESBankType bank_type;
+	int bank_index;
+	Range *tile_range;
+	char order;
+	char *type;
+	char *output_filepath;					/* "" to name the output after the input */
+	int threads;							/* for compressing images; more than one only when there's one file */
+} ExtractTileOptions;
+
+static NESSheetWriter sheet_writer_for_type(char *type) {
 	/*
-	**	extraction stuff
-	**	takes one required argument:
-	**	-tile (for tile extraction)
-	**	-chr (for chr extraction)
-	**	-prg (for prg extraction, duh)
+	**	the sheet writer for an image -t type, or NULL if type isn't one
 	*/
 	
-	char *current_arg = GET_NEXT_ARG;
-	CHECK_ARG_ERROR("Expected extraction type!");
+	if (strcmp(type, PNG_TYPE) == 0) return NESSheetWritePng;
+	if (strcmp(type, GIF_TYPE) == 0) return NESSheetWriteGif;
+	if (strcmp(type, HTML_TYPE) == 0) return NESSheetWriteHTML;
+	if (strcmp(type, SVG_TYPE) == 0) return NESSheetWriteSVG;
 	
-	char *extract_command = current_arg; //should be oe of tile, chr, prg
+	return NULL;
+}
+
+static bool extract_tile_job(Job *job) {
+	/*
+	**	extracts options->tile_range from one file
+	*/
 	
-	v_printf(VERBOSE_NOTICE, "Extracting (%s)", extract_command);
+	ExtractTileOptions *options = (ExtractTileOptions *)job->context;
+	NESRom *rom = NULL;
+	char *input_filename = job->path;
 	
-	//if the first modifier doesnt' start with a '-', then something's wrong
-	// so bail.
-	if (!IS_OPT(extract_command)) {
-		printf("No modifier specified for extract command.\nSee usage (%s --help)\n\n", program_name);
-		exit(EXIT_FAILURE);
+	v_printf(VERBOSE_NOTICE, "Opening file: %s", input_filename);
+	
+	//if an error occurs while opening the file,
+	//print an error and move on to the next file
+	if (!(rom = NESRomOpen(input_filename))) {
+		job_perror(job, input_filename);
+		return false;
 	}
 	
-	#pragma mark **Extract Tile
-	if (strcmp(extract_command, ACTION_EXTRACT_TILE) == 0) {
-		//extract tile
-		//usage: tile [ prg | chr ] <bank index> <range> [-h | -v] [-f <output_filename>] [-t <type>]
-		// new usage: tile <bank index> <tile range> [ options ]
-		//	options:
-		//		-b <bank>				-- default to CHR
-		//		-o <output_filename>	-- default to FILENAME.EXT in CWD
-		//		-f <file format>		-- default to NATIVE
-		//*		-v | -h					-- default to horizontal (for compound extraction)
-		//*		-c						-- turn on compound extraction?
-		
-		v_printf(VERBOSE_NOTICE, "Extract tile.");
-		
-		//where we store our arguments...
-		char *current_arg = GET_NEXT_ARG;
-		
-		NESBankType target_bank_type = nes_chr_bank; //default
-		int bank_index = 0;
-		Range *tile_range = (Range*)malloc(sizeof(Range));
-		char order = nes_horizontal; //default
-		char *type = NATIVE_TYPE; //default
-		char output_filepath[255] = ""; //default
+	//point bank_data at the bank we are going to pull from (no copy is made)
+	char *bank_data = (char*)NESRomGetBank(rom, options->bank_type, options->bank_index);
+	
+	if (!bank_data) {
+		// error reading bank... non-fatal... clean up and move on...
+		fprintf(job->out, "%s: Error reading %s bank. Either it does not exist or something went terribly wrong.\n\n",
+			input_filename, (options->bank_type == nes_prg_bank) ? "PRG" : "CHR");
+		NESRomClose(rom);
+		return false;
+	}
+	
+	// bank_data now contains the bank that we're going to read from
+	
+	v_printf(VERBOSE_DEBUG, "Pulling tile data...");
+	
+	//pull the tile data out... (The native tile data is stored here)
+	int tile_data_length = NES_ROM_TILE_LENGTH * range_count(options->tile_range);
+	char *tile_data = (char*)malloc(tile_data_length);
+	
+	//error detection
+	if ( !NESGetTilesFromData(tile_data, bank_data, options->tile_range, 0) ) {
+		fprintf(job->err, "%s: An error occurred while reading tile data from the bank.\n\n", input_filename);
+		NESRomClose(rom);
+		free(tile_data);
+		return false;
+	}
+	
+	v_printf(VERBOSE_DEBUG, "Pulled tile data.");
+	
+	NESRomClose(rom);
+	
+	v_printf(VERBOSE_DEBUG, "Tile data ready to write...");
+	
+	//open the output file:
+	//if a filename was not specified, we need to specify one.
+	//for now, we'll just use the inputfilename.out (ie: SMB1.NES.out)
+	char output_filepath[255];
+	
+	if (strlen(options->output_filepath) == 0) {
+		snprintf(output_filepath, sizeof(output_filepath), "%s.out", input_filename);
+	} else {
+		snprintf(output_filepath, sizeof(output_filepath), "%s", options->output_filepath);
+	}
+	
+	FILE *ofile = NULL;
+	if (!(ofile = fopen(output_filepath, "w"))) {
+		job_perror(job, output_filepath);
+		free(tile_data);
+		return false;
+	}
+	
+	v_printf(VERBOSE_DEBUG, "Writing data to file...");
+	
+	size_t data_written = 0; //where we store how much data was written to the file
+	
+	//now, we convert the tile data, if needed, and write it out to a file...
+	if (strcmp(options->type, RAW_TYPE) == 0) {
+		//extract as raw
 		
-		//read the bank index
-		CHECK_ARG_ERROR("Expected bank index!");
-		bank_index = atoi(current_arg);
+		data_written = NESWriteTileAsRaw(ofile, tile_data, tile_data_length, options->order);
 		
-		//read the range:
-		current_arg = GET_NEXT_ARG;
+	} else if (strcmp(options->type, NATIVE_TYPE) == 0) {
+		//extract as native tile data
 		
-		if (check_is_range(current_arg)) {
-			str_to_range(tile_range, current_arg);
-		} else {
-			tile_range->start = atoi(current_arg);
-			tile_range->end = tile_range->start;
-		}
-		v_printf(VERBOSE_DEBUG, "Tile range: %d -> %d", tile_range->start, tile_range->end);
+		data_written = NESWriteTileAsNative(ofile, tile_data, tile_data_length);
+	} else if (sheet_writer_for_type(options->type)) {
+		//extract as an image sheet (html, png, gif or svg)
+		
+		data_written = NESWriteTileAsImage(ofile, tile_data, tile_data_length, NES_SHEET_BANK_COLUMNS, sheet_writer_for_type(options->type), options->threads);
+	}
+	
+	//clean up
+	fclose(ofile);
+	free(tile_data);
+	
+	//make sure we wrote to the file like we hoped
+	// if nothing was written, then something went wrong... so let's report it
+	if (data_written == 0) {
+		fprintf(job->err, "An error occurred while writing to %s.\n", output_filepath);
+		return false;
+	}
+	
+	//only the raw writer counts bytes; the others just say whether they worked
+	v_printf(VERBOSE_NOTICE, "Wrote %s.", output_filepath);
+	
+	return true;
+}
+
+typedef struct extractBankOptions {
+	NESBankType bank_type;
+	Range *bank_range;						/* end is -1 for "through the last bank" */
+	char *output_filepath;					/* "" to name the output after the input */
+	bool output_single_file;
+	char *type;								/* NATIVE_TYPE for the bank data itself, or an image type */
+	int threads;							/* for compressing images; more than one only when there's one file */
+	bool animate;							/* GIF only: the banks as the frames of one animation */
+	int *sequence;							/* the frames' banks, in order (NULL to animate bank_range) */
+	int sequence_count;
+	int delay;								/* hundredths of a second between frames, 0 for the default */
+} ExtractBankOptions;
+
+static bool extract_bank_image(Job *job, ExtractBankOptions *options, NESRom *rom, Range *bank_range, char *filepath) {
+	/*
+	**	writes the banks in bank_range as one image, NES_SHEET_BANK_COLUMNS tiles wide, each bank below the last
+	*/
+	
+	int tiles = NESRomBankLength(options->bank_type) / NES_ROM_TILE_LENGTH;
+	int bank_height = NESSheetRows(tiles, NES_SHEET_BANK_COLUMNS) * NES_TILE_HEIGHT;
+	int i = 0;
+	bool ok = true;
+	
+	NESSheet *sheet = NESSheetNew(NES_SHEET_BANK_COLUMNS * NES_TILE_WIDTH, bank_height * range_count(bank_range));
+	
+	if (!sheet) {
+		job_perror(job, filepath);
+		return false;
+	}
+	
+	for (i = bank_range->start; i <= bank_range->end; i++) {
+		uchar *bank = NESRomGetBank(rom, options->bank_type, i);
+		
+		if (!bank) {
+			fprintf(job->err, "error reading %s data from: %s\n", (options->bank_type == nes_prg_bank) ? "PRG" : "CHR", job->path);
+			ok = false;
+			continue;
+		}
+		
+		NESSheetDrawTiles(sheet, bank, tiles, 0, (i - bank_range->start) * bank_height, NES_SHEET_BANK_COLUMNS, 1);
+	}
+	
+	FILE *ofile = fopen(filepath, "w");
+	bool written = (ofile != NULL);
+	
+	sheet->threads = options->threads;
+	if (written) written = sheet_writer_for_type(options->type)(sheet, ofile);
+	
+	if (ofile && fclose(ofile) != 0) written = false;
+	
+	if (!written) {
+		job_perror(job, filepath);
+		if (ofile) unlink(filepath);
+	}
+	
+	NESSheetFree(sheet);
+	
+	return ok && written;
+}
+
+static bool extract_bank_animation(Job *job, ExtractBankOptions *options, NESRom *rom, Range *bank_range, char *filepath) {
+	/*
+	**	writes the sequence (or every bank in bank_range, in order) as the frames of an animated GIF
+	*/
+	
+	int count = options->sequence ? options->sequence_count : range_count(bank_range);
+	int *banks = options->sequence;
+	int bank_count = (options->bank_type == nes_prg_bank) ? rom->prg_count : rom->chr_count;
+	int i = 0;
+	
+	if (count <= 0) {
+		fprintf(job->err, "%s: no banks to animate\n", job->path);
+		return false;
+	}
+	
+	if (!banks) {
+		banks = (int*)malloc(sizeof(int) * count);
+		
+		for (i = 0; i < count; i++) {
+			banks[i] = bank_range->start + i;
+		}
+	}
+	
+	for (i = 0; i < count; i++) {
+		if (banks[i] < 0 || banks[i] >= bank_count) {
+			fprintf(job->err, "%s: no %s bank %d (it will be a blank frame)\n", job->path, (options->bank_type == nes_prg_bank) ? "PRG" : "CHR", banks[i]);
+		}
+	}
+	
+	FILE *ofile = fopen(filepath, "w");
+	bool written = (ofile != NULL) && NESSheetWriteBankAnimation(rom, options->bank_type, banks, count, 1, options->delay, ofile);
+	
+	if (ofile && fclose(ofile) != 0) written = false;
+	
+	if (!written) {
+		job_perror(job, filepath);
+		if (ofile) unlink(filepath);
+	}
+	
+	if (banks != options->sequence) free(banks);
+	
+	return written;
+}
+
+static bool extract_bank_job(Job *job) {
+	/*
+	**	extracts options->bank_range from one file
+	*/
+	
+	ExtractBankOptions *options = (ExtractBankOptions *)job->context;
+	NESBankType bank_type = options->bank_type;
+	NESRom *rom = NULL;
+	bool ok = true;
+	
+	//if an error occurs while opening the file,
+	//print an error and move on to the next file
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	char *extension = (bank_type == nes_prg_bank) ? "prg" : "chr"; //for generated filenames
+	int bank_data_size = NESRomBankLength(bank_type);
+	char *bank_data = NULL;
+	
+	//resolve "all" against this file's bank count (the range is shared between files)
+	Range bank_range = *(options->bank_range);
+	
+	if (bank_range.end == -1) {
+		bank_range.end = ((bank_type == nes_prg_bank) ? rom->prg_count : rom->chr_count) - 1;
+	}
+	
+	v_printf(VERBOSE_DEBUG, "extension: %s", extension);
+	v_printf(VERBOSE_DEBUG, "bank_data_size: %d", bank_data_size);
+	v_printf(VERBOSE_DEBUG, "Range: %d->%d", bank_range.start, bank_range.end);
+	
+	int i = 0;
+	bool image = (strcmp(options->type, NATIVE_TYPE) != 0);
+	char *image_extension = PNG_TYPE_EXT;
+	
+	if (strcmp(options->type, GIF_TYPE) == 0) image_extension = GIF_TYPE_EXT;
+	if (strcmp(options->type, HTML_TYPE) == 0) image_extension = HTML_TYPE_EXT;
+	if (strcmp(options->type, SVG_TYPE) == 0) image_extension = SVG_TYPE_EXT;
+	
+	if (image && (options->output_single_file || options->animate)) {
+		//the whole range as one image (or animation): FILENAME.chr.png
+		char filepath[255];
+		
+		if (options->output_filepath[0] == '\0') {
+			snprintf(filepath, sizeof(filepath), "%s.%s.%s", lastPathComponent(job->path), extension, image_extension);
+		} else {
+			snprintf(filepath, sizeof(filepath), "%s", options->output_filepath);
+		}
+		
+		if (options->animate) {
+			ok = extract_bank_animation(job, options, rom, &bank_range, filepath);
+		} else {
+			ok = extract_bank_image(job, options, rom, &bank_range, filepath);
+		}
+		NESRomClose(rom);
+		
+		return ok;
+	}
+	
+	for (i = bank_range.start; i <= bank_range.end; i++) {
+		//point bank_data at the bank in the mapped file
+		if (!(bank_data = (char*)NESRomGetBank(rom, bank_type, i))) {
+			fprintf(job->err, "error reading %s data from: %s\n", (bank_type == nes_prg_bank) ? "PRG" : "CHR", job->path);
+			ok = false;
+			continue;
+		}
+		
+		//default is to write to files in current working directory
+		// default filename is NESROMNAME.NES.#.prg
+		char filepath[255];
+		
+		//if a filepath wasn't specified, use the default
+		if (options->output_filepath[0] == '\0') {
+			if (options->output_single_file) {
+				//if single-file, then FILENAME.prg
+				snprintf(filepath, sizeof(filepath), "%s.%s", lastPathComponent(job->path), extension);
+			} else if (image) {
+				//an image per bank: FILENAME.#.prg.png
+				snprintf(filepath, sizeof(filepath), "%s.%d.%s.%s", lastPathComponent(job->path), i, extension, image_extension);
+			} else {
+				//if multi-file, then FILENAME.#.prg
+				snprintf(filepath, sizeof(filepath), "%s.%d.%s", lastPathComponent(job->path), i, extension);
+			}
+		} else { //otherwise, use the specified one
+			snprintf(filepath, sizeof(filepath), "%s", options->output_filepath);
+		}
+		
+		if (image) {
+			Range single = { i, i };
+			
+			if (!extract_bank_image(job, options, rom, &single, filepath)) ok = false;
+			continue;
+		}
+		
+		//write the data to the files
+		if (options->output_single_file) {
+			if (!append_data_to_file(bank_data, bank_data_size, filepath)) {
+				fprintf(job->err, "An error occurred while writing a bank (%s)\n", filepath);
+				ok = false;
+				continue;
+			}
+		} else {
+			if (!write_data_to_file(bank_data, bank_data_size, filepath)) {
+				fprintf(job->err, "An error occurred while writing a bank (%s)\n", filepath);
+				ok = false;
+				continue;
+			}
+		}
+	}
+	
+	NESRomClose(rom);
+	
+	return ok;
+}
+
+static int *parse_bank_sequence(char *list, int *count) {
+	/*
+	**	a comma-separated list of banks and ranges ("0-3,2,1" or "3-0" for backwards)
+	**	returns NULL if list isn't one
+	*/
+	
+	int *banks = NULL;
+	int capacity = 0;
+	char *p = list;
+	
+	*count = 0;
+	
+	while (*p) {
+		char *end = NULL;
+		long first = strtol(p, &end, 10);
+		long last = first;
+		
+		if (end == p || first < 0) break;
+		p = end;
+		
+		if (*p == '-') {
+			last = strtol(++p, &end, 10);
+			if (end == p || last < 0) break;
+			p = end;
+		}
+		
+		long step = (last >= first) ? 1 : -1;
+		long bank = 0;
+		
+		for (bank = first; bank != last + step; bank += step) {
+			if (*count == capacity) {
+				capacity = capacity ? capacity * 2 : 16;
+				banks = (int*)realloc(banks, sizeof(int) * capacity);
+			}
+			
+			banks[(*count)++] = (int)bank;
+		}
+		
+		if (*p == ',') p++;
+		else if (*p) break;
+	}
+	
+	if (*p || *count == 0) {
+		free(banks);
+		*count = 0;
+		return NULL;
+	}
+	
+	return banks;
+}
+
+void parse_cli_extract(char **argv) {
+	/*
+	**	extraction stuff
+	**	takes one required argument:
+	**	-tile (for tile extraction)
+	**	-chr (for chr extraction)
+	**	-prg (for prg extraction, duh)
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected extraction type!");
+	
+	char *extract_command = current_arg; //should be oe of tile, chr, prg
+	int failed = 0;
+	
+	v_printf(VERBOSE_NOTICE, "Extracting (%s)", extract_command);
+	
+	//if the first modifier doesnt' start with a '-', then something's wrong
+	// so bail.
+	if (!IS_OPT(extract_command)) {
+		printf("No modifier specified for extract command.\nSee usage (%s --help)\n\n", program_name);
+		exit(EXIT_FAILURE);
+	}
+	
+	#pragma mark **Extract Tile
+	if (strcmp(extract_command, ACTION_EXTRACT_TILE) == 0) {
+		//extract tile
+		//usage: tile [ prg | chr ] <bank index> <range> [-h | -v] [-f <output_filename>] [-t <type>]
+		// new usage: tile <bank index> <tile range> [ options ]
+		//	options:
+		//		-b <bank>				-- default to CHR
+		//		-o <output_filename>	-- default to FILENAME.EXT in CWD
+		//		-f <file format>		-- default to NATIVE
+		//*		-v | -h					-- default to horizontal (for compound extraction)
+		//*		-c						-- turn on compound extraction?
+		
+		v_printf(VERBOSE_NOTICE, "Extract tile.");
+		
+		//where we store our arguments...
+		char *current_arg = GET_NEXT_ARG;
+		
+		ExtractTileOptions options;
+		char output_filepath[255] = ""; //default
+		
+		options.bank_type = nes_chr_bank; //default
+		options.bank_index = 0;
+		options.tile_range = (Range*)malloc(sizeof(Range));
+		options.order = nes_horizontal; //default
+		options.type = NATIVE_TYPE; //default
+		options.output_filepath = output_filepath;
+		
+		//read the bank index
+		CHECK_ARG_ERROR("Expected bank index!");
+		options.bank_index = atoi(current_arg);
+		
+		//read the range:
+		current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected tile range!");
+		
+		if (check_is_range(current_arg)) {
+			str_to_range(options.tile_range, current_arg);
+		} else {
+			options.tile_range->start = atoi(current_arg);
+			options.tile_range->end = options.tile_range->start;
+		}
+		v_printf(VERBOSE_DEBUG, "Tile range: %d -> %d", options.tile_range->start, options.tile_range->end);
 		
 		//now, let's loop until we hit something that's not an option
 		// we've gotta read all the options:
-		for(current_arg = PEEK_ARG; IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		for(current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
 			current_arg = GET_NEXT_ARG;
 			
 			// read the bank info
 			if (MATCH_OPT(current_arg, OPT_BANK)) {
 				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected bank type!");
 				if (strcmp(current_arg, ARG_PRG_BANK) == 0) {
-					target_bank_type = nes_prg_bank;
+					options.bank_type = nes_prg_bank;
 				} else if (strcmp(current_arg, ARG_CHR_BANK) == 0) {
-					target_bank_type = nes_chr_bank;
+					options.bank_type = nes_chr_bank;
 				} else {
 					fprintf(stderr, "%s is an invalid bank-type. Please use '%s' or '%s'\n\n",
 						current_arg, ARG_PRG_BANK, ARG_CHR_BANK);
@@ -334,23 +930,28 @@ void parse_cli_extract(char **argv) {
 			
 			// read the output file
 			if (MATCH_OPT(current_arg, OPT_OUTPUT_FILE)) {
-				strcpy(output_filepath, GET_NEXT_ARG);
+				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected output filename!");
+				snprintf(output_filepath, sizeof(output_filepath), "%s", current_arg);
 				continue;
 			}
 			
 			// read the filetype
 			if (MATCH_OPT(current_arg, OPT_FILETYPE)) {
 				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected filetype!");
 				if (strcmp(current_arg, RAW_TYPE) == 0) {
-					type = RAW_TYPE;
+					options.type = RAW_TYPE;
 				} else if (strcmp(current_arg, GIF_TYPE) == 0) {
-					type = GIF_TYPE;
+					options.type = GIF_TYPE;
 				} else if (strcmp(current_arg, PNG_TYPE) == 0) {
-					type = PNG_TYPE;
+					options.type = PNG_TYPE;
 				} else if (strcmp(current_arg, NATIVE_TYPE) == 0) {
-					type = NATIVE_TYPE;
+					options.type = NATIVE_TYPE;
 				} else if (strcmp(current_arg, HTML_TYPE) == 0) {
-					type = HTML_TYPE;
+					options.type = HTML_TYPE;
+				} else if (strcmp(current_arg, SVG_TYPE) == 0) {
+					options.type = SVG_TYPE;
 				} else {
 					fprintf(stderr, "%s is an invalid filetype. Please see the help for a list of valid types.\n\n", current_arg);
 					exit(EXIT_FAILURE);
@@ -359,146 +960,23 @@ void parse_cli_extract(char **argv) {
 				continue;
 			}
 		}
-	
+		
 		//now for options (which are optional... duh);
 		current_arg = PEEK_ARG;
 		CHECK_ARG_ERROR("No filenames specified.");
 		
-		v_printf(VERBOSE_DEBUG, "Order: %c", order);
+		v_printf(VERBOSE_DEBUG, "Order: %c", options.order);
 		v_printf(VERBOSE_DEBUG, "Output file: %s", output_filepath);
-		v_printf(VERBOSE_DEBUG, "Type: %s", type);
+		v_printf(VERBOSE_DEBUG, "Type: %s", options.type);
 		
-		//v_printf(2, "PEEK_ARG: %s (%s): %x", current_arg, PEEK_ARG, &current_arg);
+		//a lone file gets the threads for its compression instead
+		options.threads = (argv[1] == NULL) ? get_job_count() : 1;
 		
 		//ok, now we're finally onto looping over input files!
-		for (current_arg = GET_NEXT_ARG; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-			FILE *ifile = NULL;
-			char *input_filename = current_arg;
-			
-			v_printf(VERBOSE_NOTICE, "Opening file: %s", input_filename);
-			
-			//if an error occurs while opening the file,
-			//print an error and move on to next iteration
-			if (!(ifile = fopen(input_filename, "r"))) {
-				perror(input_filename);
-				continue;
-			}
-			
-			char *bank_data = NULL; //where we store the bank we are going to pull from
-			
-			//read the appropriate bank into bank_data
-			if (target_bank_type == nes_chr_bank) {
-				//read CHR bank
-				bank_data = (char*)malloc(NES_CHR_BANK_LENGTH);
-				
-				if ( !NESGetChrBank(bank_data, ifile, bank_index) ) {
-					// error reading bank... non-fatal... clean up and move on...
-					printf("%s: Error reading CHR bank. Either it does not exist or something went terribly wrong.\n\n", current_arg);
-					free(bank_data);
-					fclose(ifile);
-					continue;
-				}
-				
-			} else if (target_bank_type == nes_prg_bank) {
-				//read PRG bank
-				bank_data = (char*)malloc(NES_PRG_BANK_LENGTH);
-				
-				if ( !NESGetPrgBank(bank_data, ifile, bank_index) ) {
-					// error reading bank... non-fatal... clean up and move on...
-					printf("%s: Error reading PRG bank. Either it does not exist or something went terribly wrong.\n\n", current_arg);
-					free(bank_data);
-					fclose(ifile);
-					continue;
-				}
-				
-			} else {
-				//this shouldn't happen, since we should have caught this earlier.
-				printf("FATAL ERROR: Unknown bank type!\n\n");
-				exit(EXIT_FAILURE);
-			} // endif check bank_type
-			
-			// bank_data now contains the bank that we're going to read from
-			
-			v_printf(VERBOSE_DEBUG, "Pulling tile data...");
-			
-			//pull the tile data out... (The native tile data is stored here)
-			u16 tile_data_length = NES_ROM_TILE_LENGTH * range_count(tile_range);
-			char *tile_data = (char*)malloc(tile_data_length);
-									
-			//error detection
-			if ( !NESGetTilesFromData(tile_data, bank_data, tile_range, 0) ) {
-				//if this happens, it's BAD... we're reading something from internal memory
-				//and if the memory failed to populate, we should have caught this much earlier
-				free(bank_data);
-				free(tile_data);
-				free(tile_range);
-				fprintf(stderr, "FATAL ERROR: An error occurred while reading tile data from bank in memory.\n\n");
-				exit(EXIT_FAILURE);
-			}
-			
-			v_printf(VERBOSE_DEBUG, "Pulled tile data.");
-			
-			free(bank_data);
-			
-			v_printf(VERBOSE_DEBUG, "Tile data ready to write...");
-			
-			//open the output file:
-			//if a filename was not specified, we need to specify one.
-			//for now, we'll just use the inputfilename.out (ie: SMB1.NES.out)
-			
-			if (strlen(output_filepath) == 0) {
-				strcpy(output_filepath, input_filename);
-				strcat(output_filepath, ".out");
-			}
-			
-			FILE *ofile = NULL;
-			if (!(ofile = fopen(output_filepath, "w"))) {
-				perror(output_filepath);
-				exit(EXIT_FAILURE);
-			}
-			
-			v_printf(VERBOSE_DEBUG, "Writing data to file...");
-			
-			size_t data_written = 0; //where we store how much data was written to the file
-			
-			//now, we convert the tile data, if needed, and write it out to a file...
-			if (strcmp(type, RAW_TYPE) == 0) {
-				//extract as raw
-				
-				data_written = NESWriteTileAsRaw(ofile, tile_data, tile_data_length, order);
-				
-			} else if (strcmp(type, PNG_TYPE) == 0) {
-				//extract as png
-				//not implemented
-				printf("PNG extraction is not yet implemented!\n\n");
-				exit(EXIT_FAILURE);
-			} else if (strcmp(type, GIF_TYPE) == 0) {
-				//extract as gif
-				//not implemented
-				printf("GIF extraction is not yet implemented!\n\n");
-				exit(EXIT_FAILURE);
-			} else if (strcmp(type, NATIVE_TYPE) == 0) {
-				//extract as native tile data
-				
-				data_written = NESWriteTileAsNative(ofile, tile_data, tile_data_length);
-			} else if (strcmp(type, HTML_TYPE) == 0) {
-				//extract as HTML
-				
-				data_written = NESWriteTileAsHTML(ofile, tile_data, tile_data_length, order);
-			}
-						
-			//clean up
-			fclose(ofile);
-			
-			//make sure we wrote to the file like we hoped
-			// if nothing was written, then something went wrong... so let's report it and bail
-			if (data_written == 0) {
-				fprintf(stderr, "An error occurred while writing to %s.\n", output_filepath);
-				exit(EXIT_FAILURE);
-			}
-			
-			v_printf(VERBOSE_NOTICE, "%d bytes written to %s.", data_written, output_filepath);
-		} // end for() loop over files
+		//every file writes to the same place if -o was given, so those have to go one at a time
+		failed = run_jobs(argv, extract_tile_job, &options, output_filepath[0] ? 1 : 0);
+		
+		free(options.tile_range);
 		
 		v_printf(VERBOSE_DEBUG, "Done extracting tile.");
 				
@@ -511,23 +989,35 @@ void parse_cli_extract(char **argv) {
 		//	options:
 		//		-o <filename>
 		//		-s
+		//		-t <native | png | gif | html | svg>	-- the image types draw the banks as tile sheets, 16 tiles wide
+		//		-A						-- gif: animate, one bank per frame
+		//		-q <banks>				-- gif: animate these banks in this order (ie: 0-3,2,1)
+		//		-d <delay>				-- gif: hundredths of a second between frames
 		
 		//options:
 		char *current_arg = NULL;
 		
 		v_printf(VERBOSE_DEBUG, "extract_command: %s", extract_command);
 		
-		NESBankType bank_type = nes_chr_bank;
-		Range *bank_range = (Range*)malloc(sizeof(Range));
+		ExtractBankOptions options;
 		char output_filepath[255] = "";
-		bool output_single_file = false;
+		
+		options.bank_type = nes_chr_bank;
+		options.bank_range = (Range*)malloc(sizeof(Range));
+		options.output_filepath = output_filepath;
+		options.output_single_file = false;
+		options.type = NATIVE_TYPE;
+		options.animate = false;
+		options.sequence = NULL;
+		options.sequence_count = 0;
+		options.delay = 0;
 		
 		//first, read required params:
 		//we already read the bank-type (it's in extract_command), so let's set that properly
 		if (strcmp(extract_command, ACTION_EXTRACT_PRG) == 0) {
-			bank_type = nes_prg_bank;
+			options.bank_type = nes_prg_bank;
 		} else if (strcmp(extract_command, ACTION_EXTRACT_CHR) == 0) {
-			bank_type = nes_chr_bank;
+			options.bank_type = nes_chr_bank;
 		} else {
 			fprintf(stderr, "%s is not a valid bank-type! Please use '%s' or '%s'\n\n",
 				extract_command, ACTION_EXTRACT_PRG, ACTION_EXTRACT_CHR);
@@ -538,135 +1028,178 @@ void parse_cli_extract(char **argv) {
 		CHECK_ARG_ERROR("Expected bank range!");
 		
 		if (strcmp(current_arg, OPT_ALL) == 0) {
-			bank_range->start = 0;
-			if (bank_type == nes_prg_bank) {
-				bank_range->end = -1;
-			} else {
-				bank_range->end = -1;
-			}
+			//the end gets filled in per file
+			options.bank_range->start = 0;
+			options.bank_range->end = -1;
 		} else {
 			//if it's a range, parse it and create
 			if (check_is_range(current_arg)) {
-				str_to_range(bank_range, current_arg);
+				str_to_range(options.bank_range, current_arg);
 			} else {
 				int bank_index = atoi(current_arg);
-				bank_range->start = bank_index;
-				bank_range->end = bank_index;
+				options.bank_range->start = bank_index;
+				options.bank_range->end = bank_index;
 			}
 		}
 		
 		//check additional options (optional):
 		
-		for(current_arg = PEEK_ARG; IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		for(current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
 			current_arg = GET_NEXT_ARG;
 			
 			//output to a single file?
 			if (MATCH_OPT(current_arg, OPT_SINGLE_FILE)) {
-				output_single_file = true;
+				options.output_single_file = true;
 				continue;
 			}
 			
 			if (MATCH_OPT(current_arg, OPT_OUTPUT_FILE)) {
-				strcpy(output_filepath, GET_NEXT_ARG);
+				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected output filename!");
+				snprintf(output_filepath, sizeof(output_filepath), "%s", current_arg);
 				continue;
 			}
-		}
-	
-		//loop over files...
-		for (; (current_arg != NULL) ; current_arg = GET_NEXT_ARG) {
-			FILE *ifile = NULL;
 			
-			//if an error occurs while opening the file,
-			//print an error and move on to next iteration
-			if (!(ifile = fopen(current_arg, "r"))) {
-				perror(current_arg);
+			//the bank data as it is, or drawn as a tile sheet
+			if (MATCH_OPT(current_arg, OPT_FILETYPE)) {
+				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected filetype!");
+				if (strcmp(current_arg, NATIVE_TYPE) == 0) {
+					options.type = NATIVE_TYPE;
+				} else if (strcmp(current_arg, PNG_TYPE) == 0) {
+					options.type = PNG_TYPE;
+				} else if (strcmp(current_arg, GIF_TYPE) == 0) {
+					options.type = GIF_TYPE;
+				} else if (strcmp(current_arg, HTML_TYPE) == 0) {
+					options.type = HTML_TYPE;
+				} else if (strcmp(current_arg, SVG_TYPE) == 0) {
+					options.type = SVG_TYPE;
+				} else {
+					fprintf(stderr, "%s is an invalid filetype for banks. Please use '%s', '%s', '%s', '%s' or '%s'\n\n", current_arg, NATIVE_TYPE, PNG_TYPE, GIF_TYPE, HTML_TYPE, SVG_TYPE);
+					exit(EXIT_FAILURE);
+				}
 				continue;
 			}
 			
-			char extension[10] = ""; //placeholder for generated file extensions
-			int bank_data_size = 0;
-			char *bank_data = NULL;
+			if (MATCH_OPT(current_arg, OPT_ANIMATE)) {
+				options.animate = true;
+				continue;
+			}
 			
-			if (bank_type == nes_prg_bank) {
-				strcpy(extension, "prg");
-				
-				if (bank_range->end == -1) {
-					bank_range->end = NESGetPrgBankCount(ifile) - 1;
-				}
+			if (MATCH_OPT(current_arg, OPT_SEQUENCE)) {
+				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected a list of banks!");
 				
-				bank_data_size = NES_PRG_BANK_LENGTH;
-			} else {
-				strcpy(extension, "chr");
+				free(options.sequence);
 				
-				if (bank_range->end == -1) {
-					bank_range->end = NESGetChrBankCount(ifile) - 1;
+				if (!(options.sequence = parse_bank_sequence(current_arg, &options.sequence_count))) {
+					fprintf(stderr, "%s: expected a list of banks (ie: 0-3,2,1)\n", current_arg);
+					exit(EXIT_FAILURE);
 				}
 				
-				bank_data_size = NES_CHR_BANK_LENGTH;
+				options.animate = true;
+				continue;
 			}
 			
-			bank_data = (char*)malloc(bank_data_size);
-			
-			v_printf(VERBOSE_DEBUG, "extension: %s", extension);
-			v_printf(VERBOSE_DEBUG, "bank_data_size: %d", bank_data_size);
-			v_printf(VERBOSE_DEBUG, "Range: %d->%d", bank_range->start, bank_range->end);
-			
-			int i = 0;
-			
-			for (i = bank_range->start; i <= bank_range->end; i++) {
-				if (bank_type == nes_prg_bank) {
-					if (!NESGetPrgBank(bank_data, ifile, i)) {
-						printf("error reading PRG data from: %s\n", current_arg);
-						continue;
-					}
-				} else {
-					if (!NESGetChrBank(bank_data, ifile, i)) {
-						printf("error reading CHR data from: %s\n", current_arg);
-						continue;
-					}
-				}
-				
-				//default is to write to files in current working directory
-				// default filename is NESROMNAME.NES.#.prg
-				char filepath[255];
-				
-				//if a filepath wasn't specified, use the default
-				if (output_filepath[0] == '\0') {
-					if (output_single_file) {
-						//if single-file, then FILENAME.prg
-						sprintf(filepath, "%s.%s", lastPathComponent(current_arg));
-					} else {
-						//if multi-file, then FILENAME.#.prg
-						sprintf(filepath, "%s.%d.%s", lastPathComponent(current_arg), i, extension);
-					}
-				} else { //otherwise, use the specified one		
-					strcpy(filepath, output_filepath);
-				}
+			if (MATCH_OPT(current_arg, OPT_DELAY)) {
+				current_arg = GET_NEXT_ARG;
+				CHECK_ARG_ERROR("Expected a delay!");
 				
-				//write the data to the files
-				if (output_single_file) {
-					if (!append_data_to_file(bank_data, bank_data_size, filepath)) {
-						printf("An error occurred while writing a bank (%s)\n", filepath);
-						continue;
-					}
-				} else {
-					if (!write_data_to_file(bank_data, bank_data_size, filepath)) {
-						printf("An error occurred while writing a bank (%s)\n", filepath);
-						continue;
-					}
+				if ((options.delay = atoi(current_arg)) <= 0 || options.delay > 0xFFFF) {
+					fprintf(stderr, "%s: expected a delay in hundredths of a second\n", current_arg);
+					exit(EXIT_FAILURE);
 				}
+				continue;
 			}
-			
-			fclose(ifile);
 		}
-	}	else {
-		//illegal command
-		printf("unknown extraction type (%s)\n", extract_command);
-		exit(EXIT_FAILURE);
-	}
-}
-
-void parse_cli_inject(char **argv) {
+		
+		//animation is a GIF thing, and asking for one is asking for a GIF
+		if (options.animate && strcmp(options.type, NATIVE_TYPE) == 0) {
+			options.type = GIF_TYPE;
+		} else if (options.animate && strcmp(options.type, GIF_TYPE) != 0) {
+			fprintf(stderr, "Only %s output can be animated.\n\n", GIF_TYPE);
+			exit(EXIT_FAILURE);
+		}
+		
+		current_arg = PEEK_ARG;
+		CHECK_ARG_ERROR("No filenames specified.");
+		
+		//a lone file gets the threads for its compression instead
+		options.threads = (argv[1] == NULL) ? get_job_count() : 1;
+		
+		//loop over files...
+		//every file writes to the same place if -o was given, so those have to go one at a time
+		failed = run_jobs(argv, extract_bank_job, &options, output_filepath[0] ? 1 : 0);
+		
+		free(options.bank_range);
+		free(options.sequence);
+	}	else {
+		//illegal command
+		printf("unknown extraction type (%s)\n", extract_command);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+typedef struct injectOptions {
+	NESBankType bank_type;
+	int bank_index;
+	int start_tile;							/* tile injection only */
+	char *data;								/* what we're injecting (read once, shared by every job) */
+	u64 data_size;
+} InjectOptions;
+
+static bool inject_tile_job(Job *job) {
+	InjectOptions *options = (InjectOptions *)job->context;
+	FILE *rom_file = NULL; //the file we're injecting
+	
+	if (!(rom_file = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESInjectTileData(rom_file, options->data, 1, options->bank_type, options->bank_index, options->start_tile)) {
+		fprintf(job->err, "Error injecting tile into %s!\n", job->path);
+		fclose(rom_file);
+		return false;
+	}
+	
+	fclose(rom_file);
+	
+	return true;
+}
+
+static bool inject_bank_job(Job *job) {
+	InjectOptions *options = (InjectOptions *)job->context;
+	FILE *rom_file = NULL; //the file we're injecting
+	bool injected = false;
+	
+	if (!(rom_file = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		return false; // if it fails, just continue to the next file...
+	}
+	
+	if (options->bank_type == nes_prg_bank) {
+		injected = NESInjectPrgBank(rom_file, options->data, options->bank_index);
+	} else {
+		injected = NESInjectChrBank(rom_file, options->data, options->bank_index);
+	}
+	
+	if (!injected) {
+		fprintf(job->err, "Error injecting %s bank into %s!\n", (options->bank_type == nes_prg_bank) ? "PRG" : "CHR", job->path);
+		fclose(rom_file);
+		return false; //if it fails, just move on to the next one.
+	}
+	
+	fclose(rom_file);
+	
+	return true;
+}
+
+void parse_cli_inject(char **argv) {
 	/*
 	**	parse argv for injection options
 	**	has one required parameter followed by options specific to that parameter
@@ -677,6 +1210,8 @@ void parse_cli_inject(char **argv) {
 	CHECK_ARG_ERROR("Expected an injection type (tile, chr or prg)!");
 	
 	char *inject_type = current_arg; //should be oe of -tile, -chr, -prg
+	InjectOptions options;
+	int failed = 0;
 	
 	v_printf(VERBOSE_NOTICE, "Injecting (%s)", inject_type);
 	
@@ -695,9 +1230,6 @@ void parse_cli_inject(char **argv) {
 		// inject -tile <filename> <bank_type> <bank_offset> <start_at_nth_tile>
 		
 		char *input_filename;
-		NESBankType bank_type;
-		int bank_index;
-		int start_tile;
 		
 		//read input filename (the tile we're injecting)
 		current_arg = GET_NEXT_ARG;
@@ -708,9 +1240,9 @@ void parse_cli_inject(char **argv) {
 		current_arg = GET_NEXT_ARG;
 		CHECK_ARG_ERROR("Expected bank type!");
 		if (strcmp(current_arg, ARG_CHR_BANK) == 0) {
-			bank_type = nes_chr_bank;
+			options.bank_type = nes_chr_bank;
 		} else if (strcmp(current_arg, ARG_PRG_BANK) == 0) {
-			bank_type = nes_prg_bank;
+			options.bank_type = nes_prg_bank;
 		} else {
 			fprintf(stderr, "Unknown banktype (%s)!\n", current_arg);
 			exit(EXIT_FAILURE);
@@ -719,12 +1251,12 @@ void parse_cli_inject(char **argv) {
 		//read bank-offset (which bank we're injecting into)
 		current_arg = GET_NEXT_ARG;
 		CHECK_ARG_ERROR("Expected bank offset!");
-		bank_index = atoi(current_arg);
+		options.bank_index = atoi(current_arg);
 		
 		//read the tile offset
 		current_arg = GET_NEXT_ARG;
 		CHECK_ARG_ERROR("Expected start-at-tile!");
-		start_tile = atoi(current_arg);
+		options.start_tile = atoi(current_arg);
 		
 		FILE *tile_file = NULL;
 		
@@ -734,15 +1266,15 @@ void parse_cli_inject(char **argv) {
 		}
 		
 		v_printf(VERBOSE_DEBUG, "filename: %s", input_filename);
-		v_printf(VERBOSE_DEBUG, "bank_type: %c", bank_type);
-		v_printf(VERBOSE_DEBUG, "bank_index: %d", bank_index);
-		v_printf(VERBOSE_DEBUG, "start_tile: %d", start_tile);
+		v_printf(VERBOSE_DEBUG, "bank_type: %c", options.bank_type);
+		v_printf(VERBOSE_DEBUG, "bank_index: %d", options.bank_index);
+		v_printf(VERBOSE_DEBUG, "start_tile: %d", options.start_tile);
 		
-		int tile_data_length = NESGetFilesize(tile_file);
+		options.data_size = NESGetFilesize(tile_file);
 		rewind(tile_file);
-		char *tile_data = (char*)malloc(tile_data_length);
+		options.data = (char*)malloc(options.data_size);
 		
-		if (fread(tile_data, 1, tile_data_length, tile_file) != tile_data_length) {
+		if (fread(options.data, 1, options.data_size, tile_file) != options.data_size) {
 			fclose(tile_file);
 			perror(input_filename);
 			exit(EXIT_FAILURE);
@@ -751,158 +1283,105 @@ void parse_cli_inject(char **argv) {
 		fclose(tile_file);
 		
 		//now, process the file(s):
-		while((current_arg = GET_NEXT_ARG) != NULL) {
-			FILE *rom_file = NULL; //the file we're injecting
-			
-			if (!(rom_file = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue; // just continue...
-			}
-			
-			if (!NESInjectTileData(rom_file, tile_data, 1, bank_type, bank_index, start_tile)) {
-				fprintf(stderr, "Error injecting tile!\n");
-				fclose(rom_file);
-				exit(EXIT_FAILURE);
-			}
-			
-			fclose(rom_file);
-		}
+		failed = run_jobs(argv, inject_tile_job, &options, 0);
 		
+		free(options.data);
 		
-	#pragma mark **Inject PRG
-	} else if (strcmp(inject_type, ACTION_INJECT_PRG) == 0) {
+	#pragma mark **Inject PRG/CHR
+	} else if (strcmp(inject_type, ACTION_INJECT_PRG) == 0 || strcmp(inject_type, ACTION_INJECT_CHR) == 0) {
 		// usage:
 		// inject prg <bank index> <prg file> [ target rom file(s) ]
-		
-		int bank_index = 0;
-		FILE *prg_file = NULL;
-		char *prg_data = NULL;
-		int prg_data_size = 0;
-		
-		current_arg = GET_NEXT_ARG;
-		CHECK_ARG_ERROR("Expected bank index!");
-		
-		bank_index = atoi(current_arg);
-		
-		current_arg = GET_NEXT_ARG;
-		CHECK_ARG_ERROR("Expected PRG file path!");
-		
-		//open the prg_file
-		if (!(prg_file = fopen(current_arg, "r"))) {
-			perror(current_arg);
-			exit(EXIT_FAILURE);
-		}
-		
-		//alocate and read the prg_data in
-		prg_data_size = NESGetFilesize(prg_file);
-		
-		if (prg_data_size != NES_PRG_BANK_LENGTH) {
-			fprintf(stderr, "Injecting only a single PRG bank is currently supported.\n\n");
-			EXIT_FAILURE;
-		}
-		
-		prg_data = (char*)malloc(prg_data_size);
-		
-		//rewind the file...
-		rewind(prg_file);
-		
-		//read the prg bank in...
-		if (fread(prg_data, 1, prg_data_size, prg_file) != prg_data_size) {
-			fprintf(stderr, "Error reading in PRG data!\n\n");
-			exit(EXIT_FAILURE);
-		}
-		
-		fclose(prg_file); //close the file
-		
-		//now, process the file(s):
-		while((current_arg = GET_NEXT_ARG) != NULL) {
-			FILE *rom_file = NULL; //the file we're injecting
-			
-			if (!(rom_file = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue; // if it fails, just continue to the next file...
-			}
-			
-			if (!NESInjectPrgBank(rom_file, prg_data, bank_index)) {
-				fprintf(stderr, "Error injecting PRG bank into %s!\n", current_arg);
-				fclose(rom_file);
-				continue; //if it fails, just move on to the next one.
-			}
-			
-			fclose(rom_file);
-		}
-		
-		free(prg_data);
-		
-	#pragma mark **Inject CHR
-	} else if (strcmp(inject_type, ACTION_INJECT_CHR) == 0) {
-		// usage:
 		// inject chr <bank index> <chr file> [ target rom file(s) ]
 		
-		int bank_index = 0;
-		FILE *chr_file = NULL;
-		char *chr_data = NULL;
-		int chr_data_size = 0;
+		FILE *bank_file = NULL;
+		
+		options.bank_type = (strcmp(inject_type, ACTION_INJECT_PRG) == 0) ? nes_prg_bank : nes_chr_bank;
 		
 		current_arg = GET_NEXT_ARG;
 		CHECK_ARG_ERROR("Expected bank index!");
 		
-		bank_index = atoi(current_arg);
+		options.bank_index = atoi(current_arg);
 		
 		current_arg = GET_NEXT_ARG;
-		CHECK_ARG_ERROR("Expected CHR file path!");
+		CHECK_ARG_ERROR((options.bank_type == nes_prg_bank) ? "Expected PRG file path!" : "Expected CHR file path!");
 		
-		//open the chr_file
-		if (!(chr_file = fopen(current_arg, "r"))) {
+		//open the bank_file
+		if (!(bank_file = fopen(current_arg, "r"))) {
 			perror(current_arg);
 			exit(EXIT_FAILURE);
 		}
 		
-		//alocate and read the chr_data in
-		chr_data_size = NESGetFilesize(chr_file);
+		//alocate and read the bank data in
+		options.data_size = NESGetFilesize(bank_file);
 		
-		if (chr_data_size != NES_CHR_BANK_LENGTH) {
-			fprintf(stderr, "Injecting only a single CHR bank is currently supported.\n\n");
-			EXIT_FAILURE;
+		if (options.data_size != NESRomBankLength(options.bank_type)) {
+			fprintf(stderr, "Injecting only a single %s bank is currently supported.\n\n", (options.bank_type == nes_prg_bank) ? "PRG" : "CHR");
+			exit(EXIT_FAILURE);
 		}
 		
-		chr_data = (char*)malloc(chr_data_size);
+		options.data = (char*)malloc(options.data_size);
 		
 		//rewind the file...
-		rewind(chr_file);
+		rewind(bank_file);
 		
-		//read the chr bank in...
-		if (fread(chr_data, 1, chr_data_size, chr_file) != chr_data_size) {
-			fprintf(stderr, "Error reading in CHR data!\n\n");
+		//read the bank in...
+		if (fread(options.data, 1, options.data_size, bank_file) != options.data_size) {
+			fprintf(stderr, "Error reading in %s data!\n\n", (options.bank_type == nes_prg_bank) ? "PRG" : "CHR");
 			exit(EXIT_FAILURE);
 		}
 		
-		fclose(chr_file); //close the file
+		fclose(bank_file); //close the file
 		
 		//now, process the file(s):
-		while((current_arg = GET_NEXT_ARG) != NULL) {
-			FILE *rom_file = NULL; //the file we're injecting
-			
-			if (!(rom_file = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue; // if it fails, just continue to the next file...
-			}
-			
-			if (!NESInjectChrBank(rom_file, chr_data, bank_index)) {
-				fprintf(stderr, "Error injecting CHR bank into %s!\n", current_arg);
-				fclose(rom_file);
-				continue; //if it fails, just move on to the next one.
-			}
-			
-			fclose(rom_file);
-		}
+		failed = run_jobs(argv, inject_bank_job, &options, 0);
+		
+		free(options.data);
 		
-		free(chr_data);
 	} else {
 		//illegal type
 		fprintf(stderr, "Unknown injection type (%s)\n", inject_type);
 		exit(EXIT_FAILURE);
 	}
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static bool patch_apply_job(Job *job) {
+	/*
+	**	every job opens the patch itself; IPS_apply() reads it from the start each time
+	*/
+	
+	char *patch_path = (char *)job->context;
+	FILE *rom_file = NULL; //the file we're patching
+	FILE *patch = NULL;
+	
+	if (!(patch = fopen(patch_path, "r"))) {
+		job_perror(job, patch_path);
+		return false;
+	}
+	
+	if (!(rom_file = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		fclose(patch);
+		return false; // if it fails, just continue to the next file...
+	}
+	
+	//apply the patch...
+	int err = 0;
+	if ((err = IPS_apply(rom_file, patch)) <= 0) {
+		//if IPS_apply returns anything <= 0, something went wrong.
+		fprintf(job->err, "An error occurred while applying the patch to %s (%d)!\n\n", job->path, err);
+		fclose(rom_file);
+		fclose(patch);
+		return false;
+	}
+	
+	fclose(rom_file);
+	fclose(patch);
+	
+	return true;
 }
 
 void parse_cli_patch(char **argv) {
@@ -937,42 +1416,2403 @@ void parse_cli_patch(char **argv) {
 		
 		FILE *patch = NULL;
 		
+		//make sure the patch is there before we start on the ROMs
 		if (!(patch = fopen(current_arg, "r"))) {
 			perror(current_arg);
 			exit(EXIT_FAILURE);
 		}
 		
+		fclose(patch);
+		
 		//now, process the file(s):
-		while((current_arg = GET_NEXT_ARG) != NULL) {
-			FILE *rom_file = NULL; //the file we're injecting
-			
-			if (!(rom_file = fopen(current_arg, "r+"))) {
-				perror(current_arg);
-				continue; // if it fails, just continue to the next file...
-			}
-			
-			//apply the patch...
-			int err = 0;
-			if ((err = IPS_apply(rom_file, patch)) <= 0) {
-				//if IPS_apply returns anything <= 0, something went wrong.
-				fprintf(stderr, "An error occurred while applying the patch to %s (%d)!\n\n", current_arg, err);
-				fclose(rom_file);
-				continue;
-			}
-			
-			fclose(rom_file);
+		if (run_jobs(argv, patch_apply_job, current_arg, 0)) {
+			exit(EXIT_FAILURE);
 		}
 		
-		fclose(patch);
-		
 	} else if (strcmp(patch_method, ACTION_PATCH_CREATE) == 0) {
 		//create a patch
 		//usage: patch <type> create <original_file> <modified_file> <patch_output_file>
-		fprintf(stderr, "Creating patches is not yet implemented.\n\n");
-		exit(EXIT_FAILURE);
+		
+		char *original_path = current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected original file!");
+		
+		char *modified_path = current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected modified file!");
+		
+		char *patch_path = current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected patch output file!");
+		
+		FILE *original = NULL;
+		FILE *modified = NULL;
+		FILE *patch = NULL;
+		
+		if (!(original = fopen(original_path, "r"))) {
+			perror(original_path);
+			exit(EXIT_FAILURE);
+		}
+		
+		if (!(modified = fopen(modified_path, "r"))) {
+			perror(modified_path);
+			exit(EXIT_FAILURE);
+		}
+		
+		if (!(patch = fopen(patch_path, "w"))) {
+			perror(patch_path);
+			exit(EXIT_FAILURE);
+		}
+		
+		int err = IPS_create(original, modified, patch, 1);
+		
+		if (fclose(patch) != 0 && err >= 0) {
+			err = -40;
+		}
+		
+		if (err < 0) {
+			fprintf(stderr, "An error occurred while creating %s (%d)!\n\n", patch_path, err);
+			unlink(patch_path);
+			exit(EXIT_FAILURE);
+		}
+		
+		if (NESGetFilesize(modified) < NESGetFilesize(original)) {
+			fprintf(stderr, "Warning: %s is smaller than %s; IPS patches can't shrink a file\n", modified_path, original_path);
+		}
+		
+		v_printf(VERBOSE_NOTICE, "%s: %d records", patch_path, err);
+		
+		fclose(original);
+		fclose(modified);
 	} else {
 		//unknown patch method
 		fprintf(stderr, "Unknown patch method '%s'! Please use either '%s' or '%s'\n\n", patch_method, ACTION_PATCH_APPLY, ACTION_PATCH_CREATE);
 		exit(EXIT_FAILURE);
 	}
 }
+
+#pragma mark -
+#pragma mark *** Catalog ***
+
+typedef struct catalogScan {
+	NESCatalogEntry *entries;			/* one per scanned file */
+	int *slots;							/* job index -> entry (each job writes only its own entry) */
+} CatalogScan;
+
+static bool catalog_read_job(Job *job) {
+	/*
+	**	reads a new or changed file into its catalog entry
+	*/
+	
+	CatalogScan *scan = (CatalogScan *)job->context;
+	NESCatalogEntry *entry = &(scan->entries[scan->slots[job->index]]);
+	NESRom *rom = NULL;
+	struct stat st;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	//stat what we actually mapped, in case the file was replaced since the scan
+	if (fstat(rom->fd, &st) != 0) {
+		job_perror(job, job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	NESCatalogEntryFromRom(entry, job->path, rom, &st);
+	NESRomClose(rom);
+	
+	return true;
+}
+
+static NESCatalog *catalog_open(char *catalog_path) {
+	/*
+	**	opens a catalog for reading, or exits saying why it couldn't
+	*/
+	
+	NESCatalog *catalog = NULL;
+	
+	if (!(catalog = NESCatalogOpen(catalog_path))) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s: not a catalog (or one from another version; run '%s %s' again)\n", catalog_path, ACTION_CATALOG, ACTION_CATALOG_UPDATE);
+			exit(EXIT_FAILURE);
+		}
+		perror(catalog_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	return catalog;
+}
+
+static bool catalog_path_in_roots(char *path, char **roots) {
+	/*
+	**	true if path is one of roots, or somewhere underneath one
+	*/
+	
+	int i = 0;
+	
+	for (i = 0; roots[i]; i++) {
+		size_t length = strlen(roots[i]);
+		
+		if (strncmp(path, roots[i], length) != 0) continue;
+		if (path[length] == '\0' || path[length] == '/' || (length && roots[i][length - 1] == '/')) return true;
+	}
+	
+	return false;
+}
+
+static void catalog_update(char *catalog_path, char **roots) {
+	/*
+	**	rescans roots into the catalog
+	**	files whose size, mtime, inode and device match their old entry are copied over without being opened
+	**	old entries outside roots are kept as they are; old entries under roots that weren't found again are removed
+	*/
+	
+	NESCatalog *catalog = NULL;
+	char resolved[PATH_MAX];
+	int count = 0;
+	int root_count = 0;
+	int reused = 0;
+	int read_count = 0;
+	int failed = 0;
+	int i = 0;
+	
+	if (!(catalog = NESCatalogOpen(catalog_path))) {
+		if (errno == EINVAL && NESCatalogHasMagic(catalog_path)) {
+			fprintf(stderr, "%s: catalog is from another version; rebuilding it\n", catalog_path);
+		} else if (errno == EINVAL) {
+			fprintf(stderr, "%s: not a catalog; refusing to overwrite it\n", catalog_path);
+			exit(EXIT_FAILURE);
+		} else if (errno != ENOENT) {
+			perror(catalog_path);
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	//resolve the roots first so every path we walk (and store) is absolute and canonical
+	for (i = 0; roots[i]; i++);
+	char **resolved_roots = (char **)calloc(i + 1, sizeof(char *));
+	
+	for (i = 0; roots[i]; i++) {
+		if (!realpath(roots[i], resolved)) {
+			perror(roots[i]);
+			failed++;
+			continue;
+		}
+		resolved_roots[root_count++] = strdup(resolved);
+	}
+	
+	char **paths = collectFilePaths(resolved_roots, ROM_FILE_EXT, &count);
+	
+	//anything unchanged comes straight out of the old catalog; the rest gets queued up to be read
+	//(the scanned files come first in scan.entries, and the old entries we keep go after them)
+	u64 old_count = catalog ? catalog->count : 0;
+	bool *scanned = (bool *)calloc(old_count ? old_count : 1, sizeof(bool));
+	CatalogScan scan;
+	char **read_paths = (char **)calloc(count + 1, sizeof(char *));
+	
+	scan.entries = (NESCatalogEntry *)calloc((count + old_count) ? (count + old_count) : 1, sizeof(NESCatalogEntry));
+	scan.slots = (int *)calloc(count ? count : 1, sizeof(int));
+	
+	for (i = 0; i < count; i++) {
+		struct stat st;
+		long long index = catalog ? NESCatalogFind(catalog, paths[i]) : -1;
+		
+		if (index >= 0) scanned[index] = true;
+		
+		if (index >= 0 && stat(paths[i], &st) == 0 && NESCatalogIsCurrent(catalog, index, &st)) {
+			NESCatalogEntryFromCatalog(&(scan.entries[i]), catalog, index);
+			reused++;
+			continue;
+		}
+		
+		scan.slots[read_count] = i;
+		read_paths[read_count++] = paths[i];
+	}
+	
+	v_printf(VERBOSE_NOTICE, "%d files, %d unchanged, %d to read", count, reused, read_count);
+	
+	failed += run_jobs(read_paths, catalog_read_job, &scan, 0);
+	
+	//drop the files we couldn't read
+	int entry_count = 0;
+	for (i = 0; i < count; i++) {
+		if (scan.entries[i].path) scan.entries[entry_count++] = scan.entries[i];
+	}
+	int scanned_count = entry_count;
+	
+	//keep what's outside the roots; what's under them and wasn't found again is gone
+	int kept = 0;
+	int removed = 0;
+	u64 index = 0;
+	for (index = 0; index < old_count; index++) {
+		if (scanned[index]) continue;
+		
+		if (catalog_path_in_roots(NESCatalogPath(catalog, index), resolved_roots)) {
+			removed++;
+			continue;
+		}
+		
+		NESCatalogEntryFromCatalog(&(scan.entries[entry_count++]), catalog, index);
+		kept++;
+	}
+	
+	NESCatalogClose(catalog);
+	freePathList(resolved_roots);
+	free(scanned);
+	
+	if (!NESCatalogWrite(catalog_path, scan.entries, entry_count)) {
+		perror(catalog_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	printf("%s: %d entries (%d unchanged, %d read, %d failed, %d kept from outside the scanned paths, %d removed)\n", catalog_path, entry_count, reused, read_count - (count - scanned_count), failed, kept, removed);
+	
+	for (i = 0; i < entry_count; i++) {
+		NESCatalogEntryFree(&(scan.entries[i]));
+	}
+	free(scan.entries);
+	free(scan.slots);
+	free(read_paths);
+	freePathList(paths);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void catalog_print_entry(StrBuf *sb, RecordFormat format, NESCatalog *catalog, u64 index) {
+	/*
+	**	appends one entry: a short line for text, otherwise the same record info writes
+	*/
+	
+	if (format == record_format_text) {
+		char line[64];
+		
+		sprintf(line, "%08X %4u %4u %4u  ",
+			NESCatalogGet32(catalog, catalog_crc32, index),
+			NESCatalogGet32(catalog, catalog_prg_count, index),
+			NESCatalogGet32(catalog, catalog_chr_count, index),
+			NESCatalogGet32(catalog, catalog_mapper, index));
+		
+		strbuf_append_str(sb, line);
+		strbuf_append_str(sb, NESCatalogPath(catalog, index));
+		strbuf_append_char(sb, '\n');
+		return;
+	}
+	
+	NESRom rom;
+	NESRomHashes hashes;
+	
+	NESCatalogGetRom(catalog, index, &rom);
+	NESCatalogGetHashes(catalog, index, &hashes);
+	
+	NESRecordAppendInfo(sb, format, NESCatalogPath(catalog, index), &rom, NESCatalogTitle(catalog, index), &hashes);
+}
+
+void parse_cli_catalog(char **argv) {
+	/*
+	**	usage:
+	**	catalog update <catalog_file> <file_or_directory> [ ... ]
+	**	catalog list [ --format=<text|ndjson|csv> ] <catalog_file>
+	**	catalog lookup [ --format=<text|ndjson|csv> ] <catalog_file> <file> [ ... ]
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a catalog command (update, list or lookup)!");
+	
+	char *command = current_arg;
+	RecordFormat format = record_format_text;
+	
+	if (strcmp(command, ACTION_CATALOG_UPDATE) == 0) {
+		current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected a catalog file!");
+		
+		if (PEEK_ARG == NULL) {
+			printf("no files or directories specified!\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		catalog_update(current_arg, argv);
+		return;
+	}
+	
+	if (strcmp(command, ACTION_CATALOG_LIST) != 0 && strcmp(command, ACTION_CATALOG_LOOKUP) != 0) {
+		fprintf(stderr, "Unknown catalog command '%s'! Please use '%s', '%s' or '%s'\n\n", command, ACTION_CATALOG_UPDATE, ACTION_CATALOG_LIST, ACTION_CATALOG_LOOKUP);
+		exit(EXIT_FAILURE);
+	}
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (parse_format_option(&argv, current_arg, &format)) {
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s %s: %s\n\n", ACTION_CATALOG, command, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a catalog file!");
+	
+	NESCatalog *catalog = catalog_open(current_arg);
+	
+	StrBuf sb;
+	char resolved[PATH_MAX];
+	int failed = 0;
+	u64 i = 0;
+	
+	setvbuf(stdout, NULL, _IOFBF, RECORD_OUTPUT_BUFFER_SIZE);
+	strbuf_init(&sb);
+	
+	if (format != record_format_text) {
+		NESRecordHeader(&sb, format);
+		strbuf_write(&sb, stdout);
+	}
+	
+	if (strcmp(command, ACTION_CATALOG_LIST) == 0) {
+		for (i = 0; i < catalog->count; i++) {
+			strbuf_reset(&sb);
+			catalog_print_entry(&sb, format, catalog, i);
+			strbuf_write(&sb, stdout);
+		}
+	} else {
+		if (PEEK_ARG == NULL) {
+			printf("no filenames specified!\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		for (current_arg = GET_NEXT_ARG; current_arg; current_arg = GET_NEXT_ARG) {
+			long long index = -1;
+			
+			if (!realpath(current_arg, resolved) || (index = NESCatalogFind(catalog, resolved)) < 0) {
+				fflush(stdout);
+				fprintf(stderr, "%s: not in catalog\n", current_arg);
+				failed++;
+				continue;
+			}
+			
+			strbuf_reset(&sb);
+			catalog_print_entry(&sb, format, catalog, index);
+			strbuf_write(&sb, stdout);
+		}
+	}
+	
+	fflush(stdout);
+	strbuf_free(&sb);
+	NESCatalogClose(catalog);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Query ***
+
+void parse_cli_query(char **argv) {
+	/*
+	**	usage:
+	**	query [ --format=<text|ndjson|csv> ] [ --count ] <catalog_file> <predicate> [ ... ]
+	**	prints the path of every entry that matches all of the predicates (see query.h),
+	**	or their records if a --format is given
+	*/
+	
+	char *current_arg = NULL;
+	RecordFormat format = record_format_text;
+	bool print_records = false;
+	bool count_only = false;
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (parse_format_option(&argv, current_arg, &format)) {
+			print_records = true;
+			continue;
+		}
+		
+		if (strcmp(current_arg, ACTION_QUERY_COUNT) == 0) {
+			count_only = true;
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_QUERY, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a catalog file!");
+	
+	char *catalog_path = current_arg;
+	
+	//parse everything before touching the catalog
+	int predicate_count = 0;
+	for (; argv[predicate_count]; predicate_count++);
+	
+	NESQueryPredicate *predicates = (NESQueryPredicate *)calloc(predicate_count ? predicate_count : 1, sizeof(NESQueryPredicate));
+	int i = 0;
+	
+	for (i = 0; i < predicate_count; i++) {
+		char *error = NULL;
+		
+		if (!NESQueryParsePredicate(&predicates[i], argv[i], &error)) {
+			char **names = NESQueryFieldNames();
+			
+			fprintf(stderr, "Bad predicate '%s': %s\n", argv[i], error);
+			fprintf(stderr, "Fields:");
+			for (; *names; names++) fprintf(stderr, " %s", *names);
+			fprintf(stderr, "\n\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	NESCatalog *catalog = catalog_open(catalog_path);
+	
+	u64 match_count = 0;
+	uint64_t *matches = NESQueryRun(catalog, predicates, predicate_count, &match_count);
+	
+	v_printf(VERBOSE_NOTICE, "%llu of %llu entries matched (%s scan)", match_count, catalog->count, NESQueryKernelName());
+	
+	if (count_only) {
+		printf("%llu\n", match_count);
+	} else {
+		StrBuf sb;
+		long long index = -1;
+		
+		setvbuf(stdout, NULL, _IOFBF, RECORD_OUTPUT_BUFFER_SIZE);
+		strbuf_init(&sb);
+		
+		if (print_records) NESRecordHeader(&sb, format);
+		
+		for (index = NESQueryNextMatch(matches, catalog->count, 0); index >= 0; index = NESQueryNextMatch(matches, catalog->count, index + 1)) {
+			if (print_records) {
+				catalog_print_entry(&sb, format, catalog, index);
+			} else {
+				strbuf_append_str(&sb, NESCatalogPath(catalog, index));
+				strbuf_append_char(&sb, '\n');
+			}
+			
+			//flush in big chunks rather than per line
+			if (sb.length >= RECORD_OUTPUT_BUFFER_SIZE) {
+				strbuf_write(&sb, stdout);
+				strbuf_reset(&sb);
+			}
+		}
+		
+		strbuf_write(&sb, stdout);
+		strbuf_free(&sb);
+		fflush(stdout);
+	}
+	
+	free(matches);
+	free(predicates);
+	NESCatalogClose(catalog);
+}
+
+#pragma mark -
+#pragma mark *** Hash ***
+
+static bool hash_job(Job *job) {
+	/*
+	**	prints "crc32  md5  sha1  path" for one file
+	*/
+	
+	bool payload = *(bool *)job->context;
+	NESRom *rom = NULL;
+	NESRomHashes hashes;
+	char md5[(MD5_DIGEST_LENGTH * 2) + 1];
+	char sha1[(SHA1_DIGEST_LENGTH * 2) + 1];
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	NESRomComputeHashes(rom, &hashes);
+	NESRomClose(rom);
+	
+	NESDigest *digest = payload ? &(hashes.payload) : &(hashes.file);
+	
+	fprintf(job->out, "%08x  %s  %s  %s\n", digest->crc32, hex_digest(md5, digest->md5, MD5_DIGEST_LENGTH), hex_digest(sha1, digest->sha1, SHA1_DIGEST_LENGTH), job->path);
+	
+	return true;
+}
+
+void parse_cli_hash(char **argv) {
+	/*
+	**	usage:
+	**	hash [ -p ] <file> [ <file> ... ]
+	**	CRC32, MD5 and SHA-1 of each file (or, with -p, of its PRG and CHR data)
+	*/
+	
+	char *current_arg = NULL;
+	bool payload = false;
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_PAYLOAD)) {
+			payload = true;
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_HASH, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf("no filenames specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	v_printf(VERBOSE_DEBUG, "Hash kernels: %s", hash_kernel_name());
+	
+	if (run_jobs(argv, hash_job, &payload, 0)) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** DAT ***
+
+typedef struct datOptions {
+	NESDatIndex *index;
+	bool dry_run;
+} DatOptions;
+
+static NESDatIndex *dat_index_open(char *index_path) {
+	/*
+	**	opens a DAT index for reading, or exits saying why it couldn't
+	*/
+	
+	NESDatIndex *index = NULL;
+	
+	if (!(index = NESDatIndexOpen(index_path))) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s: not a DAT index (or one from another version; run '%s %s' again)\n", index_path, ACTION_DAT, ACTION_DAT_BUILD);
+			exit(EXIT_FAILURE);
+		}
+		perror(index_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	return index;
+}
+
+static NESDatEntry *dat_match(NESDatIndex *index, NESRom *rom, uchar *payload_sha1) {
+	/*
+	**	DATs key on the headerless ROM, but headered ones exist too; try the payload first, then the whole file
+	**	only SHA-1 is needed, so this skips the other digests NESRomComputeHashes() would do
+	*/
+	
+	NESDatEntry *entry = NULL;
+	SHA1Context context;
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	u64 offset = 0, length = 0;
+	
+	NESRomPayload(rom, &offset, &length);
+	
+	sha1_init(&context);
+	if (length) sha1_update(&context, rom->data + offset, length);
+	sha1_final(&context, payload_sha1);
+	
+	if ((entry = NESDatIndexFind(index, payload_sha1)) || !rom->size) return entry;
+	
+	sha1_init(&context);
+	sha1_update(&context, rom->data, rom->size);
+	sha1_final(&context, sha1);
+	
+	return NESDatIndexFind(index, sha1);
+}
+
+static bool dat_identify_job(Job *job) {
+	/*
+	**	prints the DAT's name for one file, and what it expects next to what the header says
+	*/
+	
+	DatOptions *options = (DatOptions *)job->context;
+	NESRom *rom = NULL;
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	char hex[(SHA1_DIGEST_LENGTH * 2) + 1];
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	NESDatEntry *entry = dat_match(options->index, rom, sha1);
+	NESHeader *header = &(rom->info);
+	
+	fprintf(job->out, "Filename:           %s\n", job->path);
+	
+	if (!entry) {
+		fprintf(job->out, "Match:              [none] (payload SHA-1 %s)\n\n", hex_digest(hex, sha1, SHA1_DIGEST_LENGTH));
+		NESRomClose(rom);
+		return true;
+	}
+	
+	fprintf(job->out, "Match:              %s\n", NESDatIndexName(options->index, entry));
+	
+	if (entry->mapper != NES_DAT_UNKNOWN) {
+		fprintf(job->out, "Mapper:             %d (header: %d)%s\n", entry->mapper, header->mapper, entry->mapper != header->mapper ? "  [mismatch]" : "");
+	}
+	
+	if (entry->submapper != NES_DAT_UNKNOWN && header->format == nes_format_nes2) {
+		fprintf(job->out, "Submapper:          %d (header: %d)%s\n", entry->submapper, header->submapper, entry->submapper != header->submapper ? "  [mismatch]" : "");
+	}
+	
+	if (entry->mirroring != NES_DAT_UNKNOWN) {
+		int mirroring = NESDatHeaderMirroring(header);
+		fprintf(job->out, "Mirror Mode:        %s (header: %s)%s\n", NESDatMirroringName(entry->mirroring), NESDatMirroringName(mirroring), entry->mirroring != mirroring ? "  [mismatch]" : "");
+	}
+	
+	if (entry->battery != NES_DAT_UNKNOWN) {
+		fprintf(job->out, "Battery-backed RAM: %s (header: %s)%s\n", entry->battery ? "YES" : "NO", header->battery ? "YES" : "NO", (entry->battery != 0) != (header->battery != 0) ? "  [mismatch]" : "");
+	}
+	
+	fprintf(job->out, "\n");
+	
+	NESRomClose(rom);
+	
+	return true;
+}
+
+static bool dat_fix_job(Job *job) {
+	/*
+	**	rewrites the header bytes of one file that don't match the DAT
+	*/
+	
+	DatOptions *options = (DatOptions *)job->context;
+	NESRom *rom = NULL;
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	NESHeader before, after;
+	uchar original[NES_HEADER_SIZE];
+	uchar header[NES_HEADER_SIZE];
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	NESDatEntry *entry = dat_match(options->index, rom, sha1);
+	u64 filesize = rom->size;
+	
+	memcpy(original, rom->header, NES_HEADER_SIZE);
+	memcpy(header, rom->header, NES_HEADER_SIZE);
+	NESRomClose(rom);
+	
+	if (!entry) {
+		fprintf(job->err, "%s: not in the DAT\n", job->path);
+		return false;
+	}
+	
+	if (!NESDatFixHeader(entry, header, filesize)) {
+		fprintf(job->out, "%s: header OK\n", job->path);
+		return true;
+	}
+	
+	NESDecodeHeader(&before, original, filesize);
+	NESDecodeHeader(&after, header, filesize);
+	
+	fprintf(job->out, "%s: %s", job->path, options->dry_run ? "would fix" : "fixed");
+	
+	if (before.mapper != after.mapper) fprintf(job->out, " mapper %d -> %d", before.mapper, after.mapper);
+	if (before.submapper != after.submapper) fprintf(job->out, " submapper %d -> %d", before.submapper, after.submapper);
+	if (NESDatHeaderMirroring(&before) != NESDatHeaderMirroring(&after)) {
+		fprintf(job->out, " mirroring %s -> %s", NESDatMirroringName(NESDatHeaderMirroring(&before)), NESDatMirroringName(NESDatHeaderMirroring(&after)));
+	}
+	if (before.battery != after.battery) fprintf(job->out, " battery %s -> %s", before.battery ? "yes" : "no", after.battery ? "yes" : "no");
+	if (before.format != after.format) fprintf(job->out, " (header cleaned: %s -> %s)", NESHeaderFormatName(before.format), NESHeaderFormatName(after.format));
+	
+	fprintf(job->out, "\n");
+	
+	if (options->dry_run) return true;
+	
+	FILE *ofile = NULL;
+	
+	if (!(ofile = fopen(job->path, "r+"))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (fwrite(header, 1, NES_HEADER_SIZE, ofile) != NES_HEADER_SIZE) {
+		job_perror(job, job->path);
+		fclose(ofile);
+		return false;
+	}
+	
+	if (fclose(ofile) != 0) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	return true;
+}
+
+static void dat_build(char *dat_path, char *index_path) {
+	/*
+	**	reads a DAT and writes its index
+	*/
+	
+	NESDat dat;
+	
+	if (!NESDatRead(&dat, dat_path)) {
+		perror(dat_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (!dat.count) {
+		fprintf(stderr, "%s: no ROMs with SHA-1 hashes found\n", dat_path);
+		NESDatFree(&dat);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (!NESDatIndexWrite(index_path, &dat)) {
+		perror(index_path);
+		NESDatFree(&dat);
+		exit(EXIT_FAILURE);
+	}
+	
+	v_printf(VERBOSE_NOTICE, "%s: indexed %llu ROMs", index_path, dat.count);
+	
+	NESDatFree(&dat);
+}
+
+void parse_cli_dat(char **argv) {
+	/*
+	**	usage:
+	**	dat build <index_file> <dat_file>
+	**	dat identify <index_file> <file> [ ... ]
+	**	dat fix [ -n | --dry-run ] <index_file> <file> [ ... ]
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a dat command (build, identify or fix)!");
+	
+	char *command = current_arg;
+	DatOptions options;
+	
+	memset(&options, 0, sizeof(options));
+	
+	if (strcmp(command, ACTION_DAT_BUILD) == 0) {
+		//the output first, like catalog update and tiles build
+		char *index_path = current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected an index file!");
+		
+		current_arg = GET_NEXT_ARG;
+		CHECK_ARG_ERROR("Expected a DAT file!");
+		
+		dat_build(current_arg, index_path);
+		return;
+	}
+	
+	if (strcmp(command, ACTION_DAT_IDENTIFY) != 0 && strcmp(command, ACTION_DAT_FIX) != 0) {
+		fprintf(stderr, "Unknown dat command '%s'! Please use '%s', '%s' or '%s'\n\n", command, ACTION_DAT_BUILD, ACTION_DAT_IDENTIFY, ACTION_DAT_FIX);
+		exit(EXIT_FAILURE);
+	}
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (strcmp(command, ACTION_DAT_FIX) == 0 && MATCH_OPT(current_arg, OPT_DRY_RUN)) {
+			options.dry_run = true;
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s %s: %s\n\n", ACTION_DAT, command, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected an index file!");
+	
+	options.index = dat_index_open(current_arg);
+	
+	if (PEEK_ARG == NULL) {
+		printf("no filenames specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	int failed = run_jobs(argv, strcmp(command, ACTION_DAT_FIX) == 0 ? dat_fix_job : dat_identify_job, &options, 0);
+	
+	NESDatIndexClose(options.index);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Header ***
+
+static bool header_normalize_job(Job *job) {
+	/*
+	**	cleans one file's header in place; only the 16 header bytes are read or written
+	**	prints a line for each header that needs (or got) cleaning, and nothing for clean ones
+	*/
+	
+	bool dry_run = *(bool *)job->context;
+	uchar original[NES_HEADER_SIZE];
+	uchar header[NES_HEADER_SIZE];
+	struct stat st;
+	int fd = -1;
+	int i = 0;
+	
+	if ((fd = open(job->path, dry_run ? O_RDONLY : O_RDWR)) < 0 || fstat(fd, &st) != 0) {
+		job_perror(job, job->path);
+		if (fd >= 0) close(fd);
+		return false;
+	}
+	
+	if (pread(fd, header, NES_HEADER_SIZE, 0) != NES_HEADER_SIZE
+		|| memcmp(header + NES_HEADER_PREFIX_OFFSET, NES_HEADER_PREFIX, NES_HEADER_PREFIX_SIZE) != 0) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		close(fd);
+		return false;
+	}
+	
+	memcpy(original, header, NES_HEADER_SIZE);
+	
+	if (!NESHeaderNormalize(header, st.st_size)) {
+		close(fd);
+		return true;
+	}
+	
+	if (!dry_run && pwrite(fd, header, NES_HEADER_SIZE, 0) != NES_HEADER_SIZE) {
+		job_perror(job, job->path);
+		close(fd);
+		return false;
+	}
+	
+	if (close(fd) != 0) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	//the report: what was in there, and what an iNES 1.0 reader made of the mapper
+	char text[NES_HEADER_SIZE + 1];
+	int length = 0;
+	
+	fprintf(job->out, "%s: %s bytes %d-%d:", job->path, dry_run ? "would clear" : "cleared", NES_ROM_CONTROL_OFFSET + 1, NES_HEADER_SIZE - 1);
+	
+	for (i = NES_ROM_CONTROL_OFFSET + 1; i < NES_HEADER_SIZE; i++) {
+		fprintf(job->out, " %02x", original[i]);
+		text[length++] = (original[i] >= 0x20 && original[i] < 0x7F) ? original[i] : '.';
+	}
+	text[length] = '\0';
+	
+	fprintf(job->out, " \"%s\"", text);
+	
+	int old_mapper = (original[NES_ROM_CONTROL_OFFSET] >> 4) | (original[NES_ROM_CONTROL_OFFSET + 1] & NES_ROM_CONTROL_MAPPER_HIGH_MASK);
+	int new_mapper = header[NES_ROM_CONTROL_OFFSET] >> 4;
+	
+	if (old_mapper != new_mapper) {
+		fprintf(job->out, " (mapper %d -> %d)", old_mapper, new_mapper);
+	}
+	
+	fprintf(job->out, "\n");
+	
+	return true;
+}
+
+void parse_cli_header(char **argv) {
+	/*
+	**	usage:
+	**	header normalize [ -n | --dry-run ] <file_or_directory> [ ... ]
+	**	directories are walked for .nes files
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a header command (normalize)!");
+	
+	char *command = current_arg;
+	bool dry_run = false;
+	
+	if (strcmp(command, ACTION_HEADER_NORMALIZE) != 0) {
+		fprintf(stderr, "Unknown header command '%s'! Please use '%s'\n\n", command, ACTION_HEADER_NORMALIZE);
+		exit(EXIT_FAILURE);
+	}
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_DRY_RUN)) {
+			dry_run = true;
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s %s: %s\n\n", ACTION_HEADER, command, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf("no files or directories specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	int count = 0;
+	char **paths = collectFilePaths(argv, ROM_FILE_EXT, &count);
+	
+	v_printf(VERBOSE_NOTICE, "Checking %d files", count);
+	
+	int failed = run_jobs(paths, header_normalize_job, &dry_run, 0);
+	
+	freePathList(paths);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Verify ***
+
+static bool verify_job(Job *job) {
+	/*
+	**	checks one file and prints a line per problem (or "OK", with -v)
+	**	the result goes in this job's own slot of the results array, for the summary
+	*/
+	
+	NESVerifyResult *result = &((NESVerifyResult *)job->context)[job->index];
+	char description[256];
+	int problem = 0;
+	
+	if (!NESVerifyFile(result, job->path)) {
+		errno = result->error;
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!result->problems) {
+		if (get_verbosity() >= VERBOSE_NOTICE) fprintf(job->out, "%s: OK\n", job->path);
+		return true;
+	}
+	
+	for (problem = 1; problem < (1 << NES_VERIFY_PROBLEM_COUNT); problem <<= 1) {
+		if (!(result->problems & problem)) continue;
+		
+		NESVerifyDescribe(description, sizeof(description), result, problem);
+		fprintf(job->out, "%s: %s: %s\n", job->path, (problem & NES_VERIFY_ERRORS) ? "error" : "warning", description);
+	}
+	
+	return !(result->problems & NES_VERIFY_ERRORS);
+}
+
+void parse_cli_verify(char **argv) {
+	/*
+	**	usage:
+	**	verify <file_or_directory> [ ... ]
+	**	checks that each file holds exactly what its header says it does, then prints a summary
+	**	exits with NES_VERIFY_EXIT_OK, NES_VERIFY_EXIT_INVALID or NES_VERIFY_EXIT_WARNINGS (see verify.h)
+	*/
+	
+	int count = 0;
+	int i = 0;
+	int problem = 0;
+	
+	if (PEEK_ARG == NULL) {
+		printf("no files or directories specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	char **paths = collectFilePaths(argv, ROM_FILE_EXT, &count);
+	NESVerifyResult *results = (NESVerifyResult *)calloc(count ? count : 1, sizeof(NESVerifyResult));
+	
+	int failed = run_jobs(paths, verify_job, results, 0);
+	
+	//the summary
+	int unreadable = 0, invalid = 0, warned = 0;
+	int problem_counts[NES_VERIFY_PROBLEM_COUNT];
+	
+	memset(problem_counts, 0, sizeof(problem_counts));
+	
+	for (i = 0; i < count; i++) {
+		int bit = 0;
+		
+		if (results[i].error) {
+			unreadable++;
+		} else if (results[i].problems & NES_VERIFY_ERRORS) {
+			invalid++;
+		} else if (results[i].problems) {
+			warned++;
+		}
+		
+		for (bit = 0; bit < NES_VERIFY_PROBLEM_COUNT; bit++) {
+			if (results[i].problems & (1 << bit)) problem_counts[bit]++;
+		}
+	}
+	
+	fflush(stdout);
+	printf("Verified %d files: %d OK, %d with warnings, %d invalid, %d unreadable\n", count, count - unreadable - invalid - warned, warned, invalid, unreadable);
+	
+	for (problem = 0; problem < NES_VERIFY_PROBLEM_COUNT; problem++) {
+		if (problem_counts[problem]) printf("  %-16s %d\n", NESVerifyProblemName(1 << problem), problem_counts[problem]);
+	}
+	
+	free(results);
+	freePathList(paths);
+	
+	if (failed) {
+		exit(NES_VERIFY_EXIT_INVALID);
+	}
+	
+	if (warned) {
+		exit(NES_VERIFY_EXIT_WARNINGS);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Trim ***
+
+typedef struct trimOptions {
+	bool write;
+	NESTrimInfo *results;					/* one per file; each job only touches its own */
+} TrimOptions;
+
+static void trim_print_region(FILE *ofile, char *name, int count, int keep, int duplicates) {
+	if (keep != count) {
+		fprintf(ofile, "; %s %d -> %d banks", name, count, keep);
+	} else if (duplicates) {
+		fprintf(ofile, "; %d duplicate %s banks (not a repeat, so kept)", duplicates, name);
+	}
+}
+
+static bool trim_job(Job *job) {
+	/*
+	**	analyzes one file and, with --write, trims it in place
+	*/
+	
+	TrimOptions *options = (TrimOptions *)job->context;
+	NESTrimInfo *info = &(options->results[job->index]);
+	NESRom *rom = NULL;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESRomAnalyzeTrim(rom, info)) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	if (info->truncated) {
+		fprintf(job->err, "%s: truncated; not trimming\n", job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	if (info->trimmed_size == info->size && !info->prg_duplicates && !info->chr_duplicates) {
+		if (get_verbosity() >= VERBOSE_NOTICE) fprintf(job->out, "%s: nothing to trim\n", job->path);
+		NESRomClose(rom);
+		return true;
+	}
+	
+	bool ok = true;
+	
+	if (options->write && info->trimmed_size != info->size) {
+		int fd = open(job->path, O_WRONLY);
+		
+		ok = (fd >= 0) && NESRomTrim(rom, info, fd);
+		if (!ok) job_perror(job, job->path);
+		if (fd >= 0 && close(fd) != 0 && ok) {
+			job_perror(job, job->path);
+			ok = false;
+		}
+	}
+	
+	NESRomClose(rom);
+	
+	if (!ok) return false;
+	
+	fprintf(job->out, "%s: %llu -> %llu bytes", job->path, info->size, info->trimmed_size);
+	trim_print_region(job->out, "PRG", info->prg_count, info->prg_keep, info->prg_duplicates);
+	trim_print_region(job->out, "CHR", info->chr_count, info->chr_keep, info->chr_duplicates);
+	if (info->overdump) fprintf(job->out, "; %llu bytes of overdump", info->overdump);
+	fprintf(job->out, "%s\n", (options->write && info->trimmed_size != info->size) ? " (trimmed)" : "");
+	
+	return true;
+}
+
+void parse_cli_trim(char **argv) {
+	/*
+	**	usage:
+	**	trim [ -w | --write ] <file_or_directory> [ ... ]
+	**	reports mirrored banks and overdump, and what each file would shrink to
+	**	with --write, trims them in place
+	*/
+	
+	char *current_arg = NULL;
+	TrimOptions options;
+	int count = 0;
+	int i = 0;
+	
+	memset(&options, 0, sizeof(options));
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_WRITE)) {
+			options.write = true;
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_TRIM, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf("no files or directories specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	char **paths = collectFilePaths(argv, ROM_FILE_EXT, &count);
+	options.results = (NESTrimInfo *)calloc(count ? count : 1, sizeof(NESTrimInfo));
+	
+	int failed = run_jobs(paths, trim_job, &options, 0);
+	
+	//the summary
+	int trimmable = 0;
+	u64 saved = 0;
+	
+	for (i = 0; i < count; i++) {
+		if (options.results[i].trimmed_size < options.results[i].size) {
+			trimmable++;
+			saved += options.results[i].size - options.results[i].trimmed_size;
+		}
+	}
+	
+	fflush(stdout);
+	printf("%d of %d files %s, %s %llu bytes\n", trimmable, count, options.write ? "trimmed" : "can be trimmed", options.write ? "saving" : "which would save", saved);
+	
+	free(options.results);
+	freePathList(paths);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Store ***
+
+static bool store_split_job(Job *job) {
+	/*
+	**	hashes one ROM's chunks into its own slot of the manifests array
+	**	appending to the pack happens afterwards, one file at a time, so it stays in a stable order
+	*/
+	
+	NESStoreManifest *manifest = &((NESStoreManifest *)job->context)[job->index];
+	NESRom *rom = NULL;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESRomVerify(rom) || !rom->data) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	NESStoreSplit(rom, lastPathComponent(job->path), manifest);
+	NESRomClose(rom);
+	
+	return true;
+}
+
+static bool store_add_file(NESStore *store, char *path, NESStoreManifest *manifest) {
+	/*
+	**	appends whichever of a split ROM's chunks the store doesn't have yet, then writes its manifest
+	*/
+	
+	NESRom *rom = NULL;
+	uint32_t i = 0;
+	
+	if (!(rom = NESRomOpen(path))) {
+		perror(path);
+		return false;
+	}
+	
+	//make sure it's the file that was hashed
+	bool ok = (rom->size == manifest->size);
+	
+	for (i = 0; ok && i < manifest->count; i++) {
+		NESStoreChunk *chunk = &(manifest->chunks[i]);
+		
+		if (!NESStoreAdd(store, chunk->sha1, rom->data + chunk->offset, chunk->length)) {
+			perror(store->path);
+			NESRomClose(rom);
+			return false;
+		}
+	}
+	
+	NESRomClose(rom);
+	
+	if (!ok) {
+		fprintf(stderr, "%s: changed while it was being added\n", path);
+		return false;
+	}
+	
+	if (!NESStoreWriteManifest(store, manifest)) {
+		perror(store->path);
+		return false;
+	}
+	
+	return true;
+}
+
+static void store_add(NESStore *store, char **argv) {
+	int count = 0;
+	int i = 0;
+	int added = 0;
+	u64 chunks = 0;
+	char id[NES_STORE_ID_LENGTH];
+	
+	char **paths = collectFilePaths(argv, ROM_FILE_EXT, &count);
+	NESStoreManifest *manifests = (NESStoreManifest *)calloc(count ? count : 1, sizeof(NESStoreManifest));
+	
+	int failed = run_jobs(paths, store_split_job, manifests, 0);
+	
+	for (i = 0; i < count; i++) {
+		if (!manifests[i].name) continue;
+		
+		if (!store_add_file(store, paths[i], &manifests[i])) {
+			failed++;
+		} else {
+			added++;
+			chunks += manifests[i].count;
+			printf("%s  %s\n", hex_digest(id, manifests[i].sha1, SHA1_DIGEST_LENGTH), paths[i]);
+		}
+		
+		NESStoreManifestFree(&manifests[i]);
+	}
+	
+	//NESStoreSave() starts the count of added chunks over
+	u64 new_chunks = store->added;
+	
+	if (!NESStoreSave(store)) {
+		perror(store->path);
+		failed++;
+	}
+	
+	fflush(stdout);
+	printf("Added %d of %d files: %llu chunks, %llu new (%llu bytes); the store holds %llu chunks (%llu bytes)\n", added, count, chunks, new_chunks, store->added_bytes, store->count, store->pack_size);
+	
+	free(manifests);
+	freePathList(paths);
+	NESStoreClose(store);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void store_get(NESStore *store, char **argv, char *output_path) {
+	/*
+	**	restores each id to its original name (or output_path, if there's only one), in the current directory
+	**	a file that's already there under the original name is left alone and counts as a failure;
+	**	-o names the file outright, so that one is overwritten
+	*/
+	
+	NESStoreManifest manifest;
+	char *current_arg = NULL;
+	int failed = 0;
+	
+	if (output_path && argv[1] != NULL) {
+		fprintf(stderr, "%s can only be used with one id\n", OPT_OUTPUT_FILE);
+		exit(EXIT_FAILURE);
+	}
+	
+	while ((current_arg = GET_NEXT_ARG)) {
+		if (!NESStoreReadManifest(store, current_arg, &manifest)) {
+			if (errno == ENOENT) {
+				fprintf(stderr, "%s: not in the store\n", current_arg);
+			} else {
+				perror(current_arg);
+			}
+			failed++;
+			continue;
+		}
+		
+		char *path = output_path ? output_path : manifest.name;
+		int fd = open(path, O_WRONLY | O_CREAT | (output_path ? O_TRUNC : O_EXCL), 0666);
+		
+		bool ok = (fd >= 0) && NESStoreRestore(store, &manifest, fd);
+		
+		if (!ok) {
+			if (fd < 0 && errno == EEXIST) {
+				fprintf(stderr, "%s: already exists; not overwriting it (use %s to restore %s somewhere else)\n", path, OPT_OUTPUT_FILE, current_arg);
+			} else if (errno == EILSEQ) {
+				fprintf(stderr, "%s: the restored file doesn't match its SHA-1; the store is damaged\n", path);
+			} else if (errno == ENOENT && fd >= 0) {
+				fprintf(stderr, "%s: the store is missing some of its chunks\n", path);
+			} else {
+				perror(path);
+			}
+		}
+		
+		if (fd >= 0 && close(fd) != 0 && ok) {
+			perror(path);
+			ok = false;
+		}
+		
+		if (ok) {
+			v_printf(VERBOSE_NOTICE, "%s -> %s", current_arg, path);
+		} else {
+			if (fd >= 0) unlink(path);
+			failed++;
+		}
+		
+		NESStoreManifestFree(&manifest);
+	}
+	
+	NESStoreClose(store);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void store_list(NESStore *store) {
+	NESStoreManifest manifest;
+	char *roots[2];
+	int count = 0;
+	int i = 0;
+	
+	roots[0] = (char*)malloc(strlen(store->path) + strlen(NES_STORE_MANIFEST_DIR) + 2);
+	sprintf(roots[0], "%s/%s", store->path, NES_STORE_MANIFEST_DIR);
+	roots[1] = NULL;
+	
+	char **paths = collectFilePaths(roots, NULL, &count);
+	
+	for (i = 0; i < count; i++) {
+		char *id = lastPathComponent(paths[i]);
+		
+		//leftover temporary files don't have ids for names, so they're skipped here
+		if (!NESStoreReadManifest(store, id, &manifest)) continue;
+		
+		printf("%s  %8llu  %s\n", id, manifest.size, manifest.name);
+		NESStoreManifestFree(&manifest);
+	}
+	
+	free(roots[0]);
+	freePathList(paths);
+	NESStoreClose(store);
+}
+
+void parse_cli_store(char **argv) {
+	/*
+	**	usage:
+	**	store add <store> <file_or_directory> [ ... ]
+	**	store get [ -o <output_file> ] <store> <id> [ ... ]
+	**	store list <store>
+	**	a store is a directory holding each unique bank once, plus a manifest per ROM (see store.h)
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a store command (add, get or list)!");
+	
+	char *command = current_arg;
+	char *output_path = NULL;
+	
+	if (strcmp(command, ACTION_STORE_ADD) != 0 && strcmp(command, ACTION_STORE_GET) != 0 && strcmp(command, ACTION_STORE_LIST) != 0) {
+		fprintf(stderr, "Unknown store command '%s'! Please use '%s', '%s' or '%s'\n\n", command, ACTION_STORE_ADD, ACTION_STORE_GET, ACTION_STORE_LIST);
+		exit(EXIT_FAILURE);
+	}
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (strcmp(command, ACTION_STORE_GET) == 0 && MATCH_OPT(current_arg, OPT_OUTPUT_FILE)) {
+			output_path = current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected an output file!");
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s %s: %s\n\n", ACTION_STORE, command, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a store directory!");
+	
+	bool create = (strcmp(command, ACTION_STORE_ADD) == 0);
+	NESStore *store = NESStoreOpen(current_arg, create);
+	
+	if (!store) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s: not a ROM store (or a damaged one)\n", current_arg);
+			exit(EXIT_FAILURE);
+		}
+		perror(current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (strcmp(command, ACTION_STORE_LIST) == 0) {
+		store_list(store);
+		return;
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf(create ? "no files or directories specified!\n" : "no ids specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if (create) {
+		store_add(store, argv);
+	} else {
+		store_get(store, argv, output_path);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Similar ***
+
+#define SIMILAR_DEFAULT_LIMIT		10
+#define SIMILAR_MIN_SIMILARITY		0.25		/* below this, sharing a band was most likely luck */
+
+typedef struct similarOptions {
+	NESCatalog *catalog;
+	int limit;
+} SimilarOptions;
+
+static bool similar_job(Job *job) {
+	/*
+	**	prints the catalog entries most like one file
+	**	files the catalog is current for use their stored signature; anything else is read
+	*/
+	
+	SimilarOptions *options = (SimilarOptions *)job->context;
+	NESCatalog *catalog = options->catalog;
+	NESMinHash signature;
+	char resolved[PATH_MAX];
+	long long index = -1;
+	struct stat st;
+	
+	if (realpath(job->path, resolved) && stat(resolved, &st) == 0) {
+		index = NESCatalogFind(catalog, resolved);
+	}
+	
+	if (index >= 0 && NESCatalogIsCurrent(catalog, index, &st)) {
+		memcpy(&signature, NESCatalogBytes(catalog, catalog_minhash, index), sizeof(NESMinHash));
+	} else {
+		NESRom *rom = NULL;
+		
+		if (!(rom = NESRomOpen(job->path))) {
+			job_perror(job, job->path);
+			return false;
+		}
+		
+		NESRomMinHash(rom, &signature);
+		NESRomClose(rom);
+	}
+	
+	if (NESMinHashIsEmpty(&signature)) {
+		fprintf(job->err, "%s: no PRG or CHR data to compare\n", job->path);
+		return false;
+	}
+	
+	u64 match_count = 0;
+	u64 i = 0;
+	NESSimilarMatch *matches = NESSimilarFind(catalog->bands, NESCatalogMinHashes(catalog), catalog->count, &signature, SIMILAR_MIN_SIMILARITY, index, &match_count);
+	
+	if (match_count == 0) {
+		fprintf(job->out, "%s: no similar ROMs\n", job->path);
+	} else {
+		fprintf(job->out, "%s:\n", job->path);
+	}
+	
+	for (i = 0; i < match_count && (options->limit <= 0 || i < (u64)options->limit); i++) {
+		fprintf(job->out, "  %5.1f%%  %s\n", matches[i].similarity * 100.0, NESCatalogPath(catalog, matches[i].index));
+	}
+	
+	free(matches);
+	
+	return true;
+}
+
+void parse_cli_similar(char **argv) {
+	/*
+	**	usage:
+	**	similar [ -l <count> ] <catalog_file> <file> [ ... ]
+	**	lists the catalog entries whose banks and tiles overlap each file's the most (see similar.h)
+	**	-l 0 prints every match
+	*/
+	
+	char *current_arg = NULL;
+	SimilarOptions options;
+	
+	options.catalog = NULL;
+	options.limit = SIMILAR_DEFAULT_LIMIT;
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_LIMIT)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a number of matches!");
+			options.limit = atoi(current_arg);
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_SIMILAR, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a catalog file!");
+	
+	options.catalog = catalog_open(current_arg);
+	
+	if (PEEK_ARG == NULL) {
+		printf("no filenames specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	int failed = run_jobs(argv, similar_job, &options, 0);
+	
+	NESCatalogClose(options.catalog);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Derive ***
+
+typedef struct deriveOptions {
+	NESCatalog *catalog;
+	NESDatIndex *dat;						/* NULL if no --dat */
+	char *output_dir;						/* NULL to write patches next to the hacks */
+} DeriveOptions;
+
+static char *output_path_for(char *path, char *output_dir, char *extension) {
+	/*
+	**	returns a malloc()ed path for a file made from path: its name with the extension swapped for
+	**	extension, in output_dir if there is one
+	*/
+	
+	char *name = lastPathComponent(path);
+	char *output_path = (char *)malloc(strlen(path) + (output_dir ? strlen(output_dir) : 0) + strlen(extension) + 2);
+	
+	if (output_dir) {
+		sprintf(output_path, "%s/%s", output_dir, name);
+	} else {
+		strcpy(output_path, path);
+	}
+	
+	char *dot = strrchr(lastPathComponent(output_path), '.');
+	if (dot && dot != lastPathComponent(output_path)) *dot = '\0';
+	
+	strcat(output_path, extension);
+	
+	return output_path;
+}
+
+static bool derive_check_patch(NESRom *base, NESRom *hack, FILE *patch) {
+	/*
+	**	applies the patch to a scratch copy of base and makes sure it comes out as hack
+	*/
+	
+	FILE *scratch = tmpfile();
+	bool ok = (scratch != NULL);
+	
+	if (ok) ok = (fwrite(base->data, 1, base->size, scratch) == base->size);
+	if (ok) ok = (IPS_apply(scratch, patch) > 0);
+	if (ok) ok = (fflush(scratch) == 0 && NESGetFilesize(scratch) == hack->size);
+	
+	if (ok) {
+		uchar buffer[NES_PRG_BANK_LENGTH];
+		u64 done = 0;
+		
+		rewind(scratch);
+		
+		while (ok && done < hack->size) {
+			u64 length = hack->size - done;
+			if (length > sizeof(buffer)) length = sizeof(buffer);
+			
+			ok = (fread(buffer, 1, length, scratch) == length) && memcmp(buffer, hack->data + done, length) == 0;
+			done += length;
+		}
+	}
+	
+	if (scratch) fclose(scratch);
+	
+	return ok;
+}
+
+static bool derive_job(Job *job) {
+	/*
+	**	finds one hack's base in the catalog and writes a patch against it
+	*/
+	
+	DeriveOptions *options = (DeriveOptions *)job->context;
+	NESCatalog *catalog = options->catalog;
+	NESDeriveBase found;
+	NESMinHash signature;
+	NESRom *hack = NULL;
+	NESRom *base = NULL;
+	char resolved[PATH_MAX];
+	long long index = -1;
+	
+	if (!(hack = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESRomVerify(hack) || !hack->data) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		NESRomClose(hack);
+		return false;
+	}
+	
+	if (realpath(job->path, resolved)) index = NESCatalogFind(catalog, resolved);
+	
+	NESRomMinHash(hack, &signature);
+	
+	if (!NESDeriveFindBase(catalog, options->dat, hack, &signature, index, &found)) {
+		fprintf(job->err, "%s: no base ROM found\n", job->path);
+		NESRomClose(hack);
+		return false;
+	}
+	
+	char *base_path = NESCatalogPath(catalog, found.index);
+	
+	if (!(base = NESRomOpen(base_path))) {
+		job_perror(job, base_path);
+		NESRomClose(hack);
+		return false;
+	}
+	
+	if (base->size > hack->size) {
+		fprintf(job->err, "%s: smaller than its base (%s); IPS patches can't shrink a file\n", job->path, base_path);
+		NESRomClose(base);
+		NESRomClose(hack);
+		return false;
+	}
+	
+	char *patch_path = output_path_for(job->path, options->output_dir, ACTION_DERIVE_EXT);
+	FILE *patch = fopen(patch_path, "w+");
+	int err = 0;
+	
+	if (!patch) {
+		job_perror(job, patch_path);
+	} else if ((err = IPS_create_data(base->data, base->size, hack->data, hack->size, patch, 1)) < 0 || fflush(patch) != 0) {
+		fprintf(job->err, "An error occurred while creating %s (%d)!\n", patch_path, err);
+		err = -1;
+	} else if (!derive_check_patch(base, hack, patch)) {
+		fprintf(job->err, "%s: the patch doesn't reproduce %s; not keeping it\n", patch_path, job->path);
+		err = -1;
+	}
+	
+	bool ok = (patch != NULL && err >= 0);
+	
+	if (ok) {
+		fprintf(job->out, "%s: %s (%d of %d banks, %.1f%% similar%s) -> %s (%llu bytes)\n", job->path, base_path, found.matching_banks, found.banks, found.similarity * 100.0, found.in_dat ? ", in DAT" : "", patch_path, NESGetFilesize(patch));
+	}
+	
+	if (patch && fclose(patch) != 0 && ok) {
+		job_perror(job, patch_path);
+		ok = false;
+	}
+	
+	if (patch && !ok) unlink(patch_path);
+	
+	free(patch_path);
+	NESRomClose(base);
+	NESRomClose(hack);
+	
+	return ok;
+}
+
+void parse_cli_derive(char **argv) {
+	/*
+	**	usage:
+	**	derive [ -d <dat_index> ] [ -o <directory> ] <catalog_file> <file> [ ... ]
+	**	finds the catalog ROM each hack was most likely made from (see derive.h) and writes an
+	**	IPS patch against it, named after the hack. every patch is checked against its hack before it's kept
+	*/
+	
+	char *current_arg = NULL;
+	DeriveOptions options;
+	
+	memset(&options, 0, sizeof(options));
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_DAT)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a DAT index file!");
+			
+			options.dat = dat_index_open(current_arg);
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_OUTPUT_FILE)) {
+			options.output_dir = current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected an output directory!");
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_DERIVE, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a catalog file!");
+	
+	options.catalog = catalog_open(current_arg);
+	
+	if (PEEK_ARG == NULL) {
+		printf("no filenames specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	int failed = run_jobs(argv, derive_job, &options, 0);
+	
+	NESCatalogClose(options.catalog);
+	NESDatIndexClose(options.dat);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** Tiles ***
+
+#define TILES_DEFAULT_TOP			20
+
+typedef struct tilesBuildOptions {
+	NESTileIndexWriter *writer;
+	bool include_prg;
+} TilesBuildOptions;
+
+static bool tiles_build_job(Job *job) {
+	TilesBuildOptions *options = (TilesBuildOptions *)job->context;
+	NESRom *rom = NULL;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESRomVerify(rom) || !rom->data) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	bool ok = NESTileIndexWriterAdd(options->writer, rom, job->index, options->include_prg);
+	NESRomClose(rom);
+	
+	if (!ok) {
+		errno = options->writer->error;
+		job_perror(job, options->writer->path);
+	}
+	
+	return ok;
+}
+
+static void tiles_build(char *index_path, char **roots, bool include_prg, u64 memory) {
+	/*
+	**	indexes everything under roots from scratch; files that fail stay in the ROM table, with no postings
+	*/
+	
+	TilesBuildOptions options;
+	char resolved[PATH_MAX];
+	int count = 0;
+	int root_count = 0;
+	int failed = 0;
+	int i = 0;
+	
+	if (access(index_path, F_OK) == 0 && !NESTileIndexHasMagic(index_path)) {
+		fprintf(stderr, "%s: not a tile index; refusing to overwrite it\n", index_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	//the index stores absolute paths, like the catalog
+	for (i = 0; roots[i]; i++);
+	char **resolved_roots = (char **)calloc(i + 1, sizeof(char *));
+	
+	for (i = 0; roots[i]; i++) {
+		if (!realpath(roots[i], resolved)) {
+			perror(roots[i]);
+			failed++;
+			continue;
+		}
+		resolved_roots[root_count++] = strdup(resolved);
+	}
+	
+	char **paths = collectFilePaths(resolved_roots, ROM_FILE_EXT, &count);
+	freePathList(resolved_roots);
+	
+	options.writer = NESTileIndexWriterOpen(index_path, memory);
+	options.include_prg = include_prg;
+	
+	failed += run_jobs(paths, tiles_build_job, &options, 0);
+	
+	if (!NESTileIndexWriterFinish(options.writer, paths, count)) {
+		perror(index_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	NESTileIndex *index = NESTileIndexOpen(index_path);
+	
+	if (index) {
+		printf("%s: %d files, %llu tiles (%llu distinct), %d failed\n", index_path, count, (u64)index->header->posting_count, (u64)index->header->tile_count, failed);
+		NESTileIndexClose(index);
+	}
+	
+	freePathList(paths);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static bool tiles_parse_tile(char *arg, uchar *tile) {
+	/*
+	**	a tile is either 32 hex digits or a file holding one tile in ROM format (extract -t native)
+	*/
+	
+	int i = 0;
+	
+	if (strlen(arg) == NES_ROM_TILE_LENGTH * 2 && strspn(arg, "0123456789abcdefABCDEF") == NES_ROM_TILE_LENGTH * 2) {
+		for (i = 0; i < NES_ROM_TILE_LENGTH; i++) {
+			unsigned int byte = 0;
+			sscanf(arg + (i * 2), "%2x", &byte);
+			tile[i] = byte;
+		}
+		return true;
+	}
+	
+	FILE *ifile = fopen(arg, "r");
+	
+	if (!ifile) {
+		perror(arg);
+		return false;
+	}
+	
+	bool ok = (fread(tile, 1, NES_ROM_TILE_LENGTH, ifile) == NES_ROM_TILE_LENGTH);
+	fclose(ifile);
+	
+	if (!ok) fprintf(stderr, "%s: not a tile (expected %d hex digits or a %d-byte file)\n", arg, NES_ROM_TILE_LENGTH * 2, NES_ROM_TILE_LENGTH);
+	
+	return ok;
+}
+
+static char *tiles_flip_name(int flip) {
+	switch (flip & (NES_TILE_FLIP_HORIZONTAL | NES_TILE_FLIP_VERTICAL)) {
+		case NES_TILE_FLIP_HORIZONTAL: return "h";
+		case NES_TILE_FLIP_VERTICAL: return "v";
+		case NES_TILE_FLIP_HORIZONTAL | NES_TILE_FLIP_VERTICAL: return "hv";
+		default: return "-";
+	}
+}
+
+static void tiles_find(NESTileIndex *index, char **argv, int limit) {
+	/*
+	**	the flip printed for each occurrence is relative to the tile that was asked for
+	*/
+	
+	char *current_arg = NULL;
+	char hex[(NES_ROM_TILE_LENGTH * 2) + 1];
+	uchar tile[NES_ROM_TILE_LENGTH];
+	uchar canonical[NES_ROM_TILE_LENGTH];
+	int failed = 0;
+	
+	while ((current_arg = GET_NEXT_ARG)) {
+		u64 count = 0;
+		u64 i = 0;
+		u64 roms = 0;
+		
+		if (!tiles_parse_tile(current_arg, tile)) {
+			failed++;
+			continue;
+		}
+		
+		int query_flip = NESTileCanonicalize(tile, canonical);
+		NESTilePosting *postings = NESTileIndexFind(index, canonical, &count);
+		
+		for (i = 0; i < count; i++) {
+			if (i == 0 || postings[i].rom != postings[i - 1].rom) roms++;
+		}
+		
+		printf("%s: %llu occurrences in %llu ROMs\n", hex_digest(hex, tile, NES_ROM_TILE_LENGTH), count, roms);
+		
+		for (i = 0; i < count && (limit <= 0 || i < (u64)limit); i++) {
+			NESTilePosting *posting = &postings[i];
+			
+			printf("  %s  %s %d:%d  %s\n",
+				NESTileIndexRomPath(index, posting->rom),
+				(posting->bank_type == nes_prg_bank) ? ARG_PRG_BANK : ARG_CHR_BANK,
+				posting->bank, posting->index,
+				tiles_flip_name(posting->flip ^ query_flip));
+		}
+	}
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void tiles_top(NESTileIndex *index, int limit) {
+	char hex[(NES_ROM_TILE_LENGTH * 2) + 1];
+	u64 i = 0;
+	
+	printf("%s  %s  %s\n", "    ROMs", "occurrences", "tile");
+	
+	for (i = 0; i < index->header->top_count && (limit <= 0 || i < (u64)limit); i++) {
+		NESTileIndexTopEntry *entry = &(index->top[i]);
+		printf("%8u  %11u  %s\n", entry->roms, entry->postings, hex_digest(hex, entry->tile, NES_ROM_TILE_LENGTH));
+	}
+}
+
+void parse_cli_tiles(char **argv) {
+	/*
+	**	usage:
+	**	tiles build [ -p ] [ -m <megabytes> ] <index_file> <file_or_directory> [ ... ]
+	**	tiles find [ -l <count> ] <index_file> <tile> [ ... ]
+	**	tiles top [ -l <count> ] <index_file>
+	**	an index of every tile in a library, ignoring flips (see tileindex.h). only CHR banks are
+	**	indexed unless -p is given. a tile is 32 hex digits or a file holding one tile
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a tiles command (build, find or top)!");
+	
+	char *command = current_arg;
+	bool include_prg = false;
+	u64 memory = NES_TILE_INDEX_MEMORY;
+	int limit = (strcmp(command, ACTION_TILES_TOP) == 0) ? TILES_DEFAULT_TOP : 0;
+	
+	if (strcmp(command, ACTION_TILES_BUILD) != 0 && strcmp(command, ACTION_TILES_FIND) != 0 && strcmp(command, ACTION_TILES_TOP) != 0) {
+		fprintf(stderr, "Unknown tiles command '%s'! Please use '%s', '%s' or '%s'\n\n", command, ACTION_TILES_BUILD, ACTION_TILES_FIND, ACTION_TILES_TOP);
+		exit(EXIT_FAILURE);
+	}
+	
+	bool build = (strcmp(command, ACTION_TILES_BUILD) == 0);
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (build && MATCH_OPT(current_arg, OPT_PRG_TILES)) {
+			include_prg = true;
+			continue;
+		}
+		
+		if (build && MATCH_OPT(current_arg, OPT_MEMORY)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a number of megabytes!");
+			
+			if (atoi(current_arg) <= 0) {
+				fprintf(stderr, "%s: expected a number of megabytes\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			memory = (u64)atoi(current_arg) * 1024 * 1024;
+			continue;
+		}
+		
+		if (!build && MATCH_OPT(current_arg, OPT_LIMIT)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a number of tiles!");
+			limit = atoi(current_arg);
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s %s: %s\n\n", ACTION_TILES, command, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	char *index_path = current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected a tile index file!");
+	
+	if (build) {
+		if (PEEK_ARG == NULL) {
+			printf("no files or directories specified!\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		tiles_build(index_path, argv, include_prg, memory);
+		return;
+	}
+	
+	NESTileIndex *index = NESTileIndexOpen(index_path);
+	
+	if (!index) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s: not a tile index (or one from another version; run '%s %s' again)\n", index_path, ACTION_TILES, ACTION_TILES_BUILD);
+			exit(EXIT_FAILURE);
+		}
+		perror(index_path);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (strcmp(command, ACTION_TILES_TOP) == 0) {
+		tiles_top(index, limit);
+	} else if (PEEK_ARG == NULL) {
+		printf("no tiles specified!\n");
+		NESTileIndexClose(index);
+		exit(EXIT_FAILURE);
+	} else {
+		tiles_find(index, argv, limit);
+	}
+	
+	NESTileIndexClose(index);
+}
+
+#pragma mark -
+#pragma mark *** Thumbnails ***
+
+typedef struct thumbnailsOptions {
+	int grid;								/* banks across */
+	int zoom;
+	char *type;								/* PNG_TYPE, PGM_TYPE or GIF_TYPE (animated, a bank per frame) */
+	int delay;								/* GIF frames, in hundredths of a second (0 for the default) */
+	char *output_dir;						/* NULL to write thumbnails next to the ROMs */
+} ThumbnailsOptions;
+
+static bool thumbnails_animation(Job *job, ThumbnailsOptions *options, NESRom *rom) {
+	/*
+	**	cycles through the CHR banks, the way a mapper switching banks would
+	*/
+	
+	int *banks = (int*)malloc(sizeof(int) * rom->chr_count);
+	int i = 0;
+	
+	for (i = 0; i < rom->chr_count; i++) {
+		banks[i] = i;
+	}
+	
+	char *output_path = output_path_for(job->path, options->output_dir, "." GIF_TYPE_EXT);
+	FILE *ofile = fopen(output_path, "w");
+	bool ok = (ofile != NULL) && NESSheetWriteBankAnimation(rom, nes_chr_bank, banks, rom->chr_count, options->zoom, options->delay, ofile);
+	
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	if (ok) {
+		v_printf(VERBOSE_NOTICE, "%s -> %s (%d frames)", job->path, output_path, rom->chr_count);
+	} else {
+		job_perror(job, output_path);
+		if (ofile) unlink(output_path);
+	}
+	
+	free(banks);
+	free(output_path);
+	
+	return ok;
+}
+
+static bool thumbnails_job(Job *job) {
+	/*
+	**	renders one ROM's CHR banks into a single image
+	*/
+	
+	ThumbnailsOptions *options = (ThumbnailsOptions *)job->context;
+	NESRom *rom = NULL;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (!NESRomVerify(rom) || !rom->data) {
+		fprintf(job->err, "%s: not an NES ROM\n", job->path);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	//CHR-RAM games draw their tiles from PRG at runtime; there's nothing to lay out
+	if (rom->chr_count == 0) {
+		fprintf(job->out, "%s: no CHR banks; skipping it\n", job->path);
+		NESRomClose(rom);
+		return true;
+	}
+	
+	if (strcmp(options->type, GIF_TYPE) == 0) {
+		bool ok = thumbnails_animation(job, options, rom);
+		
+		NESRomClose(rom);
+		
+		return ok;
+	}
+	
+	NESSheet *sheet = NESSheetFromChr(rom, options->grid, options->zoom);
+	NESRomClose(rom);
+	
+	if (!sheet) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	bool png = (strcmp(options->type, PNG_TYPE) == 0);
+	char *output_path = output_path_for(job->path, options->output_dir, png ? "." PNG_TYPE_EXT : "." PGM_TYPE_EXT);
+	FILE *ofile = fopen(output_path, "w");
+	
+	//the files are already spread over the threads, so each image is compressed on its own one
+	bool ok = (ofile != NULL) && (png ? NESSheetWritePng(sheet, ofile) : NESSheetWritePGM(sheet, ofile));
+	
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	if (ok) {
+		v_printf(VERBOSE_NOTICE, "%s -> %s (%dx%d)", job->path, output_path, sheet->width, sheet->height);
+	} else {
+		job_perror(job, output_path);
+		if (ofile) unlink(output_path);
+	}
+	
+	NESSheetFree(sheet);
+	free(output_path);
+	
+	return ok;
+}
+
+void parse_cli_thumbnails(char **argv) {
+	/*
+	**	usage:
+	**	thumbnails [ -g <columns> ] [ -z <zoom> ] [ -t <png | pgm | gif> ] [ -d <delay> ] [ -o <directory> ] <file_or_directory> [ ... ]
+	**	renders every CHR bank of each ROM into one image, named after the ROM: banks are laid out
+	**	<columns> to a row, each one 16 tiles wide, and every pixel is drawn <zoom> pixels square
+	**	a gif is animated instead, one bank per frame, <delay> hundredths of a second apart
+	*/
+	
+	char *current_arg = NULL;
+	ThumbnailsOptions options;
+	int count = 0;
+	
+	options.grid = NES_SHEET_THUMBNAIL_COLUMNS;
+	options.zoom = 1;
+	options.type = PNG_TYPE;
+	options.delay = 0;
+	options.output_dir = NULL;
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_GRID)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a number of columns!");
+			
+			if ((options.grid = atoi(current_arg)) <= 0) {
+				fprintf(stderr, "%s: expected a number of columns\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_ZOOM)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a zoom factor!");
+			
+			if ((options.zoom = atoi(current_arg)) <= 0) {
+				fprintf(stderr, "%s: expected a zoom factor\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_FILETYPE)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected filetype!");
+			
+			if (strcmp(current_arg, PNG_TYPE) == 0) {
+				options.type = PNG_TYPE;
+			} else if (strcmp(current_arg, PGM_TYPE) == 0) {
+				options.type = PGM_TYPE;
+			} else if (strcmp(current_arg, GIF_TYPE) == 0) {
+				options.type = GIF_TYPE;
+			} else {
+				fprintf(stderr, "%s is an invalid filetype for thumbnails. Please use '%s', '%s' or '%s'\n\n", current_arg, PNG_TYPE, PGM_TYPE, GIF_TYPE);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_DELAY)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a delay!");
+			
+			if ((options.delay = atoi(current_arg)) <= 0 || options.delay > 0xFFFF) {
+				fprintf(stderr, "%s: expected a delay in hundredths of a second\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_OUTPUT_FILE)) {
+			options.output_dir = current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected an output directory!");
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_THUMBNAILS, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	if (PEEK_ARG == NULL) {
+		printf("no files or directories specified!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	char **paths = collectFilePaths(argv, ROM_FILE_EXT, &count);
+	int failed = run_jobs(paths, thumbnails_job, &options, 0);
+	
+	freePathList(paths);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+#pragma mark -
+#pragma mark *** View ***
+
+typedef struct viewOptions {
+	NESBankType bank_type;
+	int bank_index;
+	Range tile_range;						/* end is -1 for "the whole bank" */
+	int columns;
+	int zoom;
+	bool show_path;							/* more than one file: say which one each drawing is */
+} ViewOptions;
+
+static bool view_job(Job *job) {
+	/*
+	**	draws the tiles of one file to the terminal
+	*/
+	
+	ViewOptions *options = (ViewOptions *)job->context;
+	NESRom *rom = NULL;
+	
+	if (!(rom = NESRomOpen(job->path))) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	uchar *bank = NESRomGetBank(rom, options->bank_type, options->bank_index);
+	int bank_tiles = NESRomBankLength(options->bank_type) / NES_ROM_TILE_LENGTH;
+	Range tiles = options->tile_range;
+	
+	if (!bank) {
+		fprintf(job->err, "%s: Error reading %s bank %d. Either it does not exist or something went terribly wrong.\n",
+			job->path, (options->bank_type == nes_prg_bank) ? "PRG" : "CHR", options->bank_index);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	if (tiles.end == -1) tiles.end = bank_tiles - 1;
+	
+	if (tiles.start < 0 || tiles.start > tiles.end || tiles.end >= bank_tiles) {
+		fprintf(job->err, "%s: tiles %d-%d aren't all in a bank (0-%d)\n", job->path, tiles.start, tiles.end, bank_tiles - 1);
+		NESRomClose(rom);
+		return false;
+	}
+	
+	NESSheet *sheet = NESSheetFromTiles(bank + (tiles.start * NES_ROM_TILE_LENGTH), range_count(&tiles), options->columns, options->zoom);
+	NESRomClose(rom);
+	
+	if (!sheet) {
+		job_perror(job, job->path);
+		return false;
+	}
+	
+	if (options->show_path) fprintf(job->out, "%s:\n", job->path);
+	
+	bool ok = NESSheetWriteANSI(sheet, job->out);
+	
+	NESSheetFree(sheet);
+	
+	return ok;
+}
+
+void parse_cli_view(char **argv) {
+	/*
+	**	usage:
+	**	view <bank index> <tile | tile range | -a> [ -b <prg | chr> ] [ -g <columns> ] [ -z <zoom> ] <file> [ ... ]
+	**	draws the tiles in the terminal in 24-bit color, with the -c palette, <columns> tiles
+	**	to a row (16 by default) and every pixel <zoom> pixels square
+	*/
+	
+	char *current_arg = GET_NEXT_ARG;
+	ViewOptions options;
+	
+	options.bank_type = nes_chr_bank;
+	options.columns = NES_SHEET_BANK_COLUMNS;
+	options.zoom = 1;
+	
+	CHECK_ARG_ERROR("Expected bank index!");
+	options.bank_index = atoi(current_arg);
+	
+	current_arg = GET_NEXT_ARG;
+	CHECK_ARG_ERROR("Expected tile range!");
+	
+	if (MATCH_OPT(current_arg, OPT_ALL)) {
+		options.tile_range.start = 0;
+		options.tile_range.end = -1;
+	} else if (check_is_range(current_arg)) {
+		str_to_range(&options.tile_range, current_arg);
+	} else {
+		options.tile_range.start = options.tile_range.end = atoi(current_arg);
+	}
+	
+	for (current_arg = PEEK_ARG; current_arg && IS_OPT(current_arg); current_arg = PEEK_ARG) {
+		current_arg = GET_NEXT_ARG;
+		
+		if (MATCH_OPT(current_arg, OPT_BANK)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected bank type!");
+			
+			if (strcmp(current_arg, ARG_PRG_BANK) == 0) {
+				options.bank_type = nes_prg_bank;
+			} else if (strcmp(current_arg, ARG_CHR_BANK) == 0) {
+				options.bank_type = nes_chr_bank;
+			} else {
+				fprintf(stderr, "%s is an invalid bank-type. Please use '%s' or '%s'\n\n", current_arg, ARG_PRG_BANK, ARG_CHR_BANK);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_GRID)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a number of columns!");
+			
+			if ((options.columns = atoi(current_arg)) <= 0) {
+				fprintf(stderr, "%s: expected a number of columns\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		if (MATCH_OPT(current_arg, OPT_ZOOM)) {
+			current_arg = GET_NEXT_ARG;
+			CHECK_ARG_ERROR("Expected a zoom factor!");
+			
+			if ((options.zoom = atoi(current_arg)) <= 0) {
+				fprintf(stderr, "%s: expected a zoom factor\n", current_arg);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		
+		fprintf(stderr, "Unknown option for %s: %s\n\n", ACTION_VIEW, current_arg);
+		exit(EXIT_FAILURE);
+	}
+	
+	current_arg = PEEK_ARG;
+	CHECK_ARG_ERROR("No filenames specified.");
+	
+	options.show_path = (argv[1] != NULL);
+	
+	int failed = run_jobs(argv, view_job, &options, 0);
+	
+	if (failed) {
+		exit(EXIT_FAILURE);
+	}
+}
@@ -22,6 +22,19 @@ void parse_cli_title(char **argv);
 void parse_cli_extract(char **argv);
 void parse_cli_inject(char **argv);
 void parse_cli_patch(char **argv);
+void parse_cli_catalog(char **argv);
+void parse_cli_query(char **argv);
+void parse_cli_hash(char **argv);
+void parse_cli_dat(char **argv);
+void parse_cli_header(char **argv);
+void parse_cli_verify(char **argv);
+void parse_cli_trim(char **argv);
+void parse_cli_store(char **argv);
+void parse_cli_similar(char **argv);
+void parse_cli_derive(char **argv);
+void parse_cli_tiles(char **argv);
+void parse_cli_thumbnails(char **argv);
+void parse_cli_view(char **argv);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,518 @@
+/*
+**	catalog.c
+**	nesromtool
+**
+**	the on-disk ROM index (see catalog.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "catalog.h"
+#include "trim.h"
+#include "verbosity.h"
+
+#define NES_CATALOG_ALIGN_UP(n)		(((n) + NES_CATALOG_ALIGN - 1) & ~((u64)NES_CATALOG_ALIGN - 1))
+#define NES_CATALOG_BAND_LENGTH(n)	NES_CATALOG_ALIGN_UP((n) * sizeof(NESLshEntry))
+
+int NESCatalogColumnWidth(NESCatalogColumn column) {
+	/*
+	**	bytes per entry in column
+	*/
+	
+	if (column < catalog_path) return sizeof(uint64_t);
+	if (column < catalog_header) return sizeof(uint32_t);
+	
+	switch (column) {
+		case catalog_header:			return NES_HEADER_SIZE;
+		case catalog_md5:				return MD5_DIGEST_LENGTH;
+		case catalog_payload_md5:		return MD5_DIGEST_LENGTH;
+		case catalog_sha1:				return SHA1_DIGEST_LENGTH;
+		case catalog_payload_sha1:		return SHA1_DIGEST_LENGTH;
+		case catalog_minhash:			return sizeof(NESMinHash);
+		default:						return 0;
+	}
+}
+
+u64 NESStatMtime(struct stat *st) {
+	return ((u64)st->st_mtim.tv_sec * 1000000000ULL) + (u64)st->st_mtim.tv_nsec;
+}
+
+#pragma mark *** Reading ***
+
+NESCatalog *NESCatalogOpen(char *path) {
+	/*
+	**	maps the catalog at path and checks that it's one we can read
+	**	returns NULL if it can't be opened (errno is set; EINVAL for a bad or old catalog)
+	*/
+	
+	struct stat st;
+	int i = 0;
+	
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	
+	if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(NESCatalogHeader)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	uchar *data = (uchar*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	
+	NESCatalogHeader *header = (NESCatalogHeader*)data;
+	bool ok = (memcmp(header->magic, NES_CATALOG_MAGIC, NES_CATALOG_MAGIC_LENGTH) == 0)
+		&& header->version == NES_CATALOG_VERSION
+		&& header->column_count == catalog_column_count
+		&& header->strings_offset + header->strings_length <= (u64)st.st_size
+		&& header->entry_count < (u64)st.st_size;
+	
+	//every column has to fit in the file
+	for (i = 0; ok && i < catalog_column_count; i++) {
+		u64 end = header->column_offsets[i] + (header->entry_count * NESCatalogColumnWidth(i));
+		if (header->column_offsets[i] % NES_CATALOG_ALIGN || end > (u64)st.st_size) ok = false;
+	}
+	
+	if (ok && (header->lsh_offset % NES_CATALOG_ALIGN || header->lsh_offset + (NES_LSH_BANDS * NES_CATALOG_BAND_LENGTH(header->entry_count)) > (u64)st.st_size)) {
+		ok = false;
+	}
+	
+	if (!ok) {
+		v_printf(VERBOSE_DEBUG, "%s: not a version %d catalog", path, NES_CATALOG_VERSION);
+		munmap(data, st.st_size);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	NESCatalog *catalog = (NESCatalog*)calloc(1, sizeof(NESCatalog));
+	
+	catalog->fd = fd;
+	catalog->data = data;
+	catalog->size = st.st_size;
+	catalog->header = header;
+	catalog->count = header->entry_count;
+	catalog->strings = (char*)(data + header->strings_offset);
+	
+	for (i = 0; i < NES_LSH_BANDS; i++) {
+		catalog->bands[i] = (NESLshEntry*)(data + header->lsh_offset + (i * NES_CATALOG_BAND_LENGTH(header->entry_count)));
+	}
+	
+	return catalog;
+}
+
+bool NESCatalogHasMagic(char *path) {
+	/*
+	**	true if the file at path starts like a catalog (of any version)
+	*/
+	
+	char magic[NES_CATALOG_MAGIC_LENGTH];
+	FILE *ifile = fopen(path, "r");
+	
+	if (!ifile) return false;
+	
+	bool ok = (fread(magic, 1, NES_CATALOG_MAGIC_LENGTH, ifile) == NES_CATALOG_MAGIC_LENGTH)
+		&& memcmp(magic, NES_CATALOG_MAGIC, NES_CATALOG_MAGIC_LENGTH) == 0;
+	
+	fclose(ifile);
+	
+	return ok;
+}
+
+void NESCatalogClose(NESCatalog *catalog) {
+	if (!catalog) return;
+	
+	munmap(catalog->data, catalog->size);
+	close(catalog->fd);
+	free(catalog);
+}
+
+void *NESCatalogColumnData(NESCatalog *catalog, NESCatalogColumn column) {
+	return catalog->data + catalog->header->column_offsets[column];
+}
+
+uint64_t NESCatalogGet64(NESCatalog *catalog, NESCatalogColumn column, u64 index) {
+	return ((uint64_t*)NESCatalogColumnData(catalog, column))[index];
+}
+
+uint32_t NESCatalogGet32(NESCatalog *catalog, NESCatalogColumn column, u64 index) {
+	return ((uint32_t*)NESCatalogColumnData(catalog, column))[index];
+}
+
+uchar *NESCatalogBytes(NESCatalog *catalog, NESCatalogColumn column, u64 index) {
+	return (uchar*)NESCatalogColumnData(catalog, column) + (index * NESCatalogColumnWidth(column));
+}
+
+uchar *NESCatalogHeaderBytes(NESCatalog *catalog, u64 index) {
+	return NESCatalogBytes(catalog, catalog_header, index);
+}
+
+void NESCatalogGetHashes(NESCatalog *catalog, u64 index, NESRomHashes *hashes) {
+	hashes->file.crc32 = NESCatalogGet32(catalog, catalog_crc32, index);
+	memcpy(hashes->file.md5, NESCatalogBytes(catalog, catalog_md5, index), MD5_DIGEST_LENGTH);
+	memcpy(hashes->file.sha1, NESCatalogBytes(catalog, catalog_sha1, index), SHA1_DIGEST_LENGTH);
+	
+	hashes->payload.crc32 = NESCatalogGet32(catalog, catalog_payload_crc32, index);
+	memcpy(hashes->payload.md5, NESCatalogBytes(catalog, catalog_payload_md5, index), MD5_DIGEST_LENGTH);
+	memcpy(hashes->payload.sha1, NESCatalogBytes(catalog, catalog_payload_sha1, index), SHA1_DIGEST_LENGTH);
+}
+
+static char *NESCatalogString(NESCatalog *catalog, uint32_t offset) {
+	if (offset >= catalog->header->strings_length) return "";
+	
+	return catalog->strings + offset;
+}
+
+char *NESCatalogPath(NESCatalog *catalog, u64 index) {
+	return NESCatalogString(catalog, NESCatalogGet32(catalog, catalog_path, index));
+}
+
+char *NESCatalogTitle(NESCatalog *catalog, u64 index) {
+	/*
+	**	returns NULL if the entry has no title
+	*/
+	
+	uint32_t offset = NESCatalogGet32(catalog, catalog_title, index);
+	
+	return offset ? NESCatalogString(catalog, offset) : NULL;
+}
+
+NESMinHash *NESCatalogMinHashes(NESCatalog *catalog) {
+	/*
+	**	the similarity signature of every entry, in entry order
+	*/
+	
+	return (NESMinHash*)NESCatalogColumnData(catalog, catalog_minhash);
+}
+
+long long NESCatalogFind(NESCatalog *catalog, char *path) {
+	long long low = 0;
+	long long high = (long long)catalog->count - 1;
+	
+	if (!catalog || !path) return -1;
+	
+	while (low <= high) {
+		long long middle = low + ((high - low) / 2);
+		int cmp = strcmp(NESCatalogPath(catalog, middle), path);
+		
+		if (cmp == 0) return middle;
+		if (cmp < 0) {
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	
+	return -1;
+}
+
+bool NESCatalogIsCurrent(NESCatalog *catalog, u64 index, struct stat *st) {
+	return NESCatalogGet64(catalog, catalog_size, index) == (u64)st->st_size
+		&& NESCatalogGet64(catalog, catalog_mtime, index) == NESStatMtime(st)
+		&& NESCatalogGet64(catalog, catalog_inode, index) == (u64)st->st_ino
+		&& NESCatalogGet64(catalog, catalog_device, index) == (u64)st->st_dev;
+}
+
+void NESCatalogGetRom(NESCatalog *catalog, u64 index, NESRom *rom) {
+	memset(rom, 0, sizeof(NESRom));
+	rom->fd = -1;
+	
+	NESRomParseHeader(rom, NESCatalogHeaderBytes(catalog, index), NESCatalogGet64(catalog, catalog_size, index));
+}
+
+#pragma mark -
+#pragma mark *** Entries ***
+
+bool NESCatalogEntryFromRom(NESCatalogEntry *entry, char *path, NESRom *rom, struct stat *st) {
+	/*
+	**	fills in entry from a mapped ROM; hashes the whole file
+	*/
+	
+	char title[NES_TITLE_BLOCK_LENGTH];
+	
+	memset(entry, 0, sizeof(NESCatalogEntry));
+	
+	if (!rom || !path || !st) return false;
+	
+	entry->path = strdup(path);
+	entry->size = rom->size;
+	entry->mtime = NESStatMtime(st);
+	entry->inode = st->st_ino;
+	entry->device = st->st_dev;
+	memcpy(entry->header, rom->header, NES_HEADER_SIZE);
+	
+	NESRomGetTitle(rom, title, false);
+	if (title[0]) entry->title = strdup(title);
+	
+	NESRomComputeHashes(rom, &(entry->hashes));
+	
+	NESTrimInfo trim;
+	if (NESRomAnalyzeTrim(rom, &trim)) entry->trimmable = trim.size - trim.trimmed_size;
+	
+	NESRomMinHash(rom, &(entry->minhash));
+	
+	return true;
+}
+
+void NESCatalogEntryFromCatalog(NESCatalogEntry *entry, NESCatalog *catalog, u64 index) {
+	/*
+	**	copies an existing row (for files that haven't changed since the last scan)
+	*/
+	
+	char *title = NESCatalogTitle(catalog, index);
+	
+	memset(entry, 0, sizeof(NESCatalogEntry));
+	
+	entry->path = strdup(NESCatalogPath(catalog, index));
+	entry->title = title ? strdup(title) : NULL;
+	entry->size = NESCatalogGet64(catalog, catalog_size, index);
+	entry->mtime = NESCatalogGet64(catalog, catalog_mtime, index);
+	entry->inode = NESCatalogGet64(catalog, catalog_inode, index);
+	entry->device = NESCatalogGet64(catalog, catalog_device, index);
+	memcpy(entry->header, NESCatalogHeaderBytes(catalog, index), NES_HEADER_SIZE);
+	NESCatalogGetHashes(catalog, index, &(entry->hashes));
+	entry->trimmable = NESCatalogGet64(catalog, catalog_trimmable, index);
+	memcpy(&(entry->minhash), NESCatalogBytes(catalog, catalog_minhash, index), sizeof(NESMinHash));
+}
+
+void NESCatalogEntryFree(NESCatalogEntry *entry) {
+	free(entry->path);
+	free(entry->title);
+	entry->path = NULL;
+	entry->title = NULL;
+}
+
+#pragma mark -
+#pragma mark *** Writing ***
+
+static int NESCatalogEntryCompare(const void *a, const void *b) {
+	return strcmp(((NESCatalogEntry*)a)->path, ((NESCatalogEntry*)b)->path);
+}
+
+static uint32_t NESCatalogFlags(NESCatalogEntry *entry, NESHeader *info) {
+	uint32_t flags = 0;
+	
+	if (entry->size < NES_HEADER_SIZE || memcmp(entry->header, NES_HEADER_PREFIX, NES_HEADER_PREFIX_SIZE) != 0) {
+		return 0;
+	}
+	
+	flags |= NES_CATALOG_FLAG_VALID;
+	if (info->battery) flags |= NES_CATALOG_FLAG_BATTERY;
+	if (info->trainer) flags |= NES_CATALOG_FLAG_TRAINER;
+	if (info->mirroring == NES_VERTICAL_MIRROR_MODE) flags |= NES_CATALOG_FLAG_VERTICAL;
+	if (info->four_screen) flags |= NES_CATALOG_FLAG_FOUR_SCREEN;
+	if (entry->title) flags |= NES_CATALOG_FLAG_TITLE;
+	
+	return flags;
+}
+
+static uint64_t NESCatalogValue(NESCatalogColumn column, NESCatalogEntry *entry, NESHeader *info, uint32_t *string_offsets) {
+	/*
+	**	the value of a numeric column for entry
+	**	string_offsets holds the entry's path and title offsets
+	*/
+	
+	switch (column) {
+		case catalog_size:				return entry->size;
+		case catalog_mtime:				return entry->mtime;
+		case catalog_inode:				return entry->inode;
+		case catalog_device:			return entry->device;
+		case catalog_prg_size:			return info->prg_size;
+		case catalog_chr_size:			return info->chr_size;
+		case catalog_trimmable:			return entry->trimmable;
+		case catalog_path:				return string_offsets[0];
+		case catalog_title:				return string_offsets[1];
+		case catalog_crc32:				return entry->hashes.file.crc32;
+		case catalog_payload_crc32:		return entry->hashes.payload.crc32;
+		case catalog_flags:				return NESCatalogFlags(entry, info);
+		case catalog_format:			return info->format;
+		case catalog_prg_count:			return info->prg_count;
+		case catalog_chr_count:			return info->chr_count;
+		case catalog_mapper:			return info->mapper;
+		case catalog_submapper:			return info->submapper;
+		case catalog_prg_ram:			return info->prg_ram_size;
+		case catalog_prg_nvram:			return info->prg_nvram_size;
+		case catalog_chr_ram:			return info->chr_ram_size;
+		case catalog_chr_nvram:			return info->chr_nvram_size;
+		case catalog_console_type:		return info->console_type;
+		case catalog_timing:			return info->timing;
+		default:						return 0;
+	}
+}
+
+static uchar *NESCatalogEntryBytes(NESCatalogColumn column, NESCatalogEntry *entry) {
+	switch (column) {
+		case catalog_header:			return entry->header;
+		case catalog_md5:				return entry->hashes.file.md5;
+		case catalog_sha1:				return entry->hashes.file.sha1;
+		case catalog_payload_md5:		return entry->hashes.payload.md5;
+		case catalog_payload_sha1:		return entry->hashes.payload.sha1;
+		case catalog_minhash:			return (uchar*)entry->minhash.values;
+		default:						return NULL;
+	}
+}
+
+static bool NESCatalogPad(FILE *ofile, u64 *position, u64 target) {
+	static const uchar zeros[NES_CATALOG_ALIGN] = { 0 };
+	
+	while (*position < target) {
+		u64 length = target - *position;
+		if (length > NES_CATALOG_ALIGN) length = NES_CATALOG_ALIGN;
+		
+		if (fwrite(zeros, 1, length, ofile) != length) return false;
+		*position += length;
+	}
+	
+	return true;
+}
+
+bool NESCatalogWrite(char *path, NESCatalogEntry *entries, u64 count) {
+	/*
+	**	writes a catalog of entries (sorting them in place) to a temporary file next to path,
+	**	then renames it over path so readers never see a half-written catalog
+	**	returns false on error (errno is set)
+	*/
+	
+	NESCatalogHeader header;
+	u64 i = 0;
+	int column = 0;
+	
+	qsort(entries, count, sizeof(NESCatalogEntry), NESCatalogEntryCompare);
+	
+	//decode every header once, and lay out the string table (offset 0 is an empty string, meaning "none")
+	NESHeader *infos = (NESHeader*)malloc(sizeof(NESHeader) * (count ? count : 1));
+	uint32_t *string_offsets = (uint32_t*)malloc(sizeof(uint32_t) * 2 * (count ? count : 1));
+	u64 strings_length = 1;
+	
+	for (i = 0; i < count; i++) {
+		NESDecodeHeader(&infos[i], entries[i].header, entries[i].size);
+		
+		string_offsets[i * 2] = strings_length;
+		strings_length += strlen(entries[i].path) + 1;
+		
+		string_offsets[(i * 2) + 1] = entries[i].title ? strings_length : 0;
+		if (entries[i].title) strings_length += strlen(entries[i].title) + 1;
+	}
+	
+	if (strings_length > UINT32_MAX) {
+		free(infos);
+		free(string_offsets);
+		errno = EFBIG;
+		return false;
+	}
+	
+	//lay out the columns
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NES_CATALOG_MAGIC, NES_CATALOG_MAGIC_LENGTH);
+	header.version = NES_CATALOG_VERSION;
+	header.column_count = catalog_column_count;
+	header.entry_count = count;
+	
+	u64 position = NES_CATALOG_ALIGN_UP(sizeof(header));
+	
+	for (column = 0; column < catalog_column_count; column++) {
+		header.column_offsets[column] = position;
+		position = NES_CATALOG_ALIGN_UP(position + (count * NESCatalogColumnWidth(column)));
+	}
+	
+	header.lsh_offset = position;
+	position += NES_LSH_BANDS * NES_CATALOG_BAND_LENGTH(count);
+	
+	header.strings_offset = position;
+	header.strings_length = strings_length;
+	
+	//now write it all out
+	char *temp_path = (char*)malloc(strlen(path) + 32);
+	sprintf(temp_path, "%s.tmp.%d", path, (int)getpid());
+	
+	FILE *ofile = fopen(temp_path, "w");
+	bool ok = (ofile != NULL);
+	uchar *column_data = (uchar*)malloc(sizeof(NESMinHash) * (count ? count : 1));	/* big enough for the widest column */
+	
+	position = 0;
+	
+	if (ok) {
+		ok = (fwrite(&header, sizeof(header), 1, ofile) == 1);
+		position = sizeof(header);
+	}
+	
+	for (column = 0; ok && column < catalog_column_count; column++) {
+		int width = NESCatalogColumnWidth(column);
+		
+		ok = NESCatalogPad(ofile, &position, header.column_offsets[column]);
+		
+		for (i = 0; ok && i < count; i++) {
+			if (column >= catalog_header) {
+				memcpy(column_data + (i * width), NESCatalogEntryBytes(column, &entries[i]), width);
+			} else if (width == sizeof(uint64_t)) {
+				((uint64_t*)column_data)[i] = NESCatalogValue(column, &entries[i], &infos[i], &string_offsets[i * 2]);
+			} else {
+				((uint32_t*)column_data)[i] = (uint32_t)NESCatalogValue(column, &entries[i], &infos[i], &string_offsets[i * 2]);
+			}
+		}
+		
+		if (ok && count) ok = (fwrite(column_data, width, count, ofile) == count);
+		position += count * width;
+	}
+	
+	//the similarity tables are built from the signatures in their sorted order
+	if (ok) {
+		NESMinHash *signatures = (NESMinHash*)malloc(sizeof(NESMinHash) * (count ? count : 1));
+		NESLshEntry *table = (NESLshEntry*)column_data;
+		int band = 0;
+		
+		for (i = 0; i < count; i++) signatures[i] = entries[i].minhash;
+		
+		for (band = 0; ok && band < NES_LSH_BANDS; band++) {
+			ok = NESCatalogPad(ofile, &position, header.lsh_offset + (band * NES_CATALOG_BAND_LENGTH(count)));
+			
+			NESLshBuildBand(table, signatures, count, band);
+			
+			if (ok && count) ok = (fwrite(table, sizeof(NESLshEntry), count, ofile) == count);
+			position += count * sizeof(NESLshEntry);
+		}
+		
+		free(signatures);
+	}
+	
+	if (ok) ok = NESCatalogPad(ofile, &position, header.strings_offset);
+	if (ok) ok = (fputc(0, ofile) != EOF);
+	
+	for (i = 0; ok && i < count; i++) {
+		ok = (fwrite(entries[i].path, 1, strlen(entries[i].path) + 1, ofile) == strlen(entries[i].path) + 1);
+		if (ok && entries[i].title) {
+			ok = (fwrite(entries[i].title, 1, strlen(entries[i].title) + 1, ofile) == strlen(entries[i].title) + 1);
+		}
+	}
+	
+	if (ok) ok = (fflush(ofile) == 0 && fsync(fileno(ofile)) == 0);
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	if (ok) {
+		ok = (rename(temp_path, path) == 0);
+	}
+	
+	if (!ok) {
+		int saved = errno;
+		unlink(temp_path);
+		errno = saved;
+	}
+	
+	free(column_data);
+	free(temp_path);
+	free(infos);
+	free(string_offsets);
+	
+	return ok;
+}
@@ -0,0 +1,156 @@
+/*
+**	catalog.h
+**	nesromtool
+**
+**	an on-disk index of ROM info, meant to be mmap()ed and used in place
+**
+**	file layout (native byte order):
+**		NESCatalogHeader
+**		one array per column, entry_count long, each starting on an NES_CATALOG_ALIGN boundary
+**		NES_LSH_BANDS similarity tables of entry_count NESLshEntry each (see similar.h)
+**		string table (NUL-terminated paths and titles)
+**	entries are sorted by path (byte order), so a lookup is a binary search
+*/
+
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "nesrom.h"
+#include "hash.h"
+#include "similar.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_CATALOG_MAGIC				"NESCATLG"
+#define NES_CATALOG_MAGIC_LENGTH		8
+#define NES_CATALOG_VERSION				4			/* bump whenever the columns change */
+#define NES_CATALOG_ALIGN				64			/* column arrays start on cache-line boundaries */
+
+// bits in the catalog_flags column
+#define NES_CATALOG_FLAG_VALID			0x01		/* has the NES magic number */
+#define NES_CATALOG_FLAG_BATTERY		0x02
+#define NES_CATALOG_FLAG_TRAINER		0x04
+#define NES_CATALOG_FLAG_VERTICAL		0x08		/* vertical mirroring */
+#define NES_CATALOG_FLAG_FOUR_SCREEN	0x10
+#define NES_CATALOG_FLAG_TITLE			0x20		/* has a title block */
+
+typedef enum {
+	// 64-bit columns
+	catalog_size = 0,						/* filesize */
+	catalog_mtime,							/* modification time, in nanoseconds */
+	catalog_inode,
+	catalog_device,
+	catalog_prg_size,						/* PRG-ROM bytes */
+	catalog_chr_size,						/* CHR-ROM bytes */
+	catalog_trimmable,						/* bytes trimming mirrored banks and overdump would save */
+
+	// 32-bit columns
+	catalog_path,							/* string table offset */
+	catalog_title,							/* string table offset (0 if there's no title) */
+	catalog_crc32,
+	catalog_payload_crc32,
+	catalog_flags,							/* NES_CATALOG_FLAG_* */
+	catalog_format,							/* NESHeaderFormat */
+	catalog_prg_count,
+	catalog_chr_count,
+	catalog_mapper,
+	catalog_submapper,
+	catalog_prg_ram,
+	catalog_prg_nvram,
+	catalog_chr_ram,
+	catalog_chr_nvram,
+	catalog_console_type,
+	catalog_timing,
+
+	// byte-string columns (see NESCatalogColumnWidth())
+	catalog_header,							/* the raw header, so everything else can be re-derived */
+	catalog_md5,
+	catalog_sha1,
+	catalog_payload_md5,
+	catalog_payload_sha1,
+	catalog_minhash,						/* NESMinHash */
+
+	catalog_column_count
+} NESCatalogColumn;
+
+typedef struct nesCatalogHeader {
+	char magic[NES_CATALOG_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t column_count;
+	uint64_t entry_count;
+	uint64_t strings_offset;
+	uint64_t strings_length;
+	uint64_t lsh_offset;					/* the first band table; the rest follow, each aligned */
+	uint64_t column_offsets[catalog_column_count];
+} NESCatalogHeader;
+
+//an opened (mapped) catalog
+typedef struct nesCatalog {
+	int fd;
+	uchar *data;
+	u64 size;
+	NESCatalogHeader *header;
+	u64 count;								/* number of entries */
+	char *strings;
+	NESLshEntry *bands[NES_LSH_BANDS];		/* the similarity tables */
+} NESCatalog;
+
+//one entry, unpacked (used while building a catalog)
+typedef struct nesCatalogEntry {
+	char *path;								/* malloc()ed */
+	char *title;							/* malloc()ed, NULL if none */
+	u64 size;
+	u64 mtime;
+	u64 inode;
+	u64 device;
+	uchar header[NES_HEADER_SIZE];
+	NESRomHashes hashes;
+	u64 trimmable;
+	NESMinHash minhash;
+} NESCatalogEntry;
+
+//reading
+NESCatalog *NESCatalogOpen(char *path);
+void NESCatalogClose(NESCatalog *catalog);
+bool NESCatalogHasMagic(char *path);
+
+int NESCatalogColumnWidth(NESCatalogColumn column);
+void *NESCatalogColumnData(NESCatalog *catalog, NESCatalogColumn column);
+uint64_t NESCatalogGet64(NESCatalog *catalog, NESCatalogColumn column, u64 index);
+uint32_t NESCatalogGet32(NESCatalog *catalog, NESCatalogColumn column, u64 index);
+uchar *NESCatalogBytes(NESCatalog *catalog, NESCatalogColumn column, u64 index);
+uchar *NESCatalogHeaderBytes(NESCatalog *catalog, u64 index);
+void NESCatalogGetHashes(NESCatalog *catalog, u64 index, NESRomHashes *hashes);
+char *NESCatalogPath(NESCatalog *catalog, u64 index);
+char *NESCatalogTitle(NESCatalog *catalog, u64 index);
+NESMinHash *NESCatalogMinHashes(NESCatalog *catalog);
+
+//returns the index of path, or -1
+long long NESCatalogFind(NESCatalog *catalog, char *path);
+
+//true if st describes the same file contents the entry was built from
+bool NESCatalogIsCurrent(NESCatalog *catalog, u64 index, struct stat *st);
+
+//entries
+bool NESCatalogEntryFromRom(NESCatalogEntry *entry, char *path, NESRom *rom, struct stat *st);
+void NESCatalogEntryFromCatalog(NESCatalogEntry *entry, NESCatalog *catalog, u64 index);
+void NESCatalogEntryFree(NESCatalogEntry *entry);
+
+//parses a catalog row's header into rom (no file access; rom->data stays NULL)
+void NESCatalogGetRom(NESCatalog *catalog, u64 index, NESRom *rom);
+
+//writing: sorts entries by path and replaces the file at path atomically
+bool NESCatalogWrite(char *path, NESCatalogEntry *entries, u64 count);
+
+u64 NESStatMtime(struct stat *st);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _CATALOG_H_ */
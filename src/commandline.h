@@ -83,6 +83,14 @@
 #define OPT_COLOR			"-c"
 #define OPT_COLOR_LONG		"--color"
 
+// draw PNGs through the NTSC filter
+#define OPT_NTSC			"-N"
+#define OPT_NTSC_LONG		"--ntsc"
+
+// number of files to work on at once (0 for one per CPU)
+#define OPT_JOBS			"-j"
+#define OPT_JOBS_LONG		"--jobs"
+
 //program options (global ones)
 //*******************
 
@@ -132,12 +140,22 @@
 #define HTML_TYPE				"html"		/* create html output */
 #define HTML_TYPE_EXT			"html"
 
+#define PGM_TYPE				"pgm"		/* binary netpbm graymap, the 4 colors as shades of gray */
+#define PGM_TYPE_EXT			"pgm"
+
+#define SVG_TYPE				"svg"		/* vector sheet, same-colored pixels merged into rectangles */
+#define SVG_TYPE_EXT			"svg"
+
+/* ROM files, for the actions that walk directories */
+#define ROM_FILE_EXT			".nes"
+
 // program actions
 //*******************
 
 //info
 #define ACTION_INFO			"info"
 #define ACTION_INFO_ALL		"-a"
+#define ACTION_INFO_FORMAT	"--format"	/* --format=<text|ndjson|csv> */
 
 //title
 #define ACTION_TITLE			"title"
@@ -158,6 +176,13 @@
 #define OPT_OUTPUT_FILE			"-o"
 #define OPT_OUTPUT_FILE_LONG	"--output"
 
+#define OPT_ANIMATE				"-A"
+#define OPT_ANIMATE_LONG		"--animate"		/* banks as the frames of an animated GIF */
+#define OPT_SEQUENCE			"-q"
+#define OPT_SEQUENCE_LONG		"--sequence"	/* the banks to animate, in order (ie: 0-3,2,1) */
+#define OPT_DELAY				"-d"
+#define OPT_DELAY_LONG			"--delay"		/* hundredths of a second between frames */
+
 // inject
 #define ACTION_INJECT			"inject"
 #define ACTION_INJECT_TILE		"tile"
@@ -171,4 +196,76 @@
 #define ACTION_PATCH_CREATE		"create"
 #define ACTION_PATCH_APPLY		"apply"
 
+//catalog
+#define ACTION_CATALOG			"catalog"
+#define ACTION_CATALOG_UPDATE	"update"	/* scan files/directories into the catalog */
+#define ACTION_CATALOG_LIST		"list"		/* print every entry */
+#define ACTION_CATALOG_LOOKUP	"lookup"	/* print the entries for the given files */
+
+//query
+#define ACTION_QUERY			"query"
+#define ACTION_QUERY_COUNT		"--count"	/* just print how many entries matched */
+
+//hash
+#define ACTION_HASH				"hash"
+#define OPT_PAYLOAD				"-p"
+#define OPT_PAYLOAD_LONG		"--payload"	/* hash just the PRG and CHR data (no header, trainer or title) */
+
+//dat
+#define ACTION_DAT				"dat"
+#define ACTION_DAT_BUILD		"build"		/* read a DAT into an index */
+#define ACTION_DAT_IDENTIFY		"identify"	/* name files and compare their headers to the DAT */
+#define ACTION_DAT_FIX			"fix"		/* rewrite header bytes that don't match the DAT */
+#define OPT_DRY_RUN				"-n"
+#define OPT_DRY_RUN_LONG		"--dry-run"	/* say what would change without writing anything */
+
+//header
+#define ACTION_HEADER			"header"
+#define ACTION_HEADER_NORMALIZE	"normalize"	/* clear garbage out of bytes 7-15 */
+
+//verify
+#define ACTION_VERIFY			"verify"
+
+//trim
+#define ACTION_TRIM				"trim"
+#define OPT_WRITE				"-w"
+#define OPT_WRITE_LONG			"--write"	/* trim the files in place (otherwise just report) */
+
+//store
+#define ACTION_STORE			"store"
+#define ACTION_STORE_ADD		"add"		/* split ROMs into the store */
+#define ACTION_STORE_GET		"get"		/* rebuild ROMs from their manifests */
+#define ACTION_STORE_LIST		"list"		/* list the ROMs in the store */
+
+//similar
+#define ACTION_SIMILAR			"similar"
+#define OPT_LIMIT				"-l"
+#define OPT_LIMIT_LONG			"--limit"	/* most matches to print per file */
+
+//derive
+#define ACTION_DERIVE			"derive"
+#define ACTION_DERIVE_EXT		".ips"		/* what patches are named */
+#define OPT_DAT					"-d"
+#define OPT_DAT_LONG			"--dat"		/* prefer bases this DAT index knows */
+
+//tiles
+#define ACTION_TILES			"tiles"
+#define ACTION_TILES_BUILD		"build"		/* index every tile of files/directories */
+#define ACTION_TILES_FIND		"find"		/* list everywhere a tile occurs */
+#define ACTION_TILES_TOP		"top"		/* the tiles found in the most ROMs */
+#define OPT_PRG_TILES			"-p"
+#define OPT_PRG_TILES_LONG		"--prg"		/* index PRG banks too */
+#define OPT_MEMORY				"-m"
+#define OPT_MEMORY_LONG			"--memory"	/* megabytes of postings to sort at a time */
+
+//thumbnails
+#define ACTION_THUMBNAILS		"thumbnails"
+#define OPT_GRID				"-g"
+#define OPT_GRID_LONG			"--grid"	/* CHR banks across a thumbnail */
+#define OPT_ZOOM				"-z"
+#define OPT_ZOOM_LONG			"--zoom"	/* screen pixels per tile pixel */
+
+//view
+#define ACTION_VIEW				"view"
+
 #endif /* _COMMANDLINE_H_ */
@@ -0,0 +1,876 @@
+/*
+**	dat.c
+**	nesromtool
+**
+**	DAT parsing and the perfect-hash index (see dat.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "dat.h"
+#include "verbosity.h"
+
+#define NES_DAT_ALIGN_UP(n)			(((n) + NES_DAT_ALIGN - 1) & ~((u64)NES_DAT_ALIGN - 1))
+#define NES_DAT_MAX_ATTRIBUTES		16
+#define NES_DAT_MAX_BUCKET			256			/* bigger buckets than this mean the keys aren't SHA-1s */
+
+#pragma mark *** Hashing ***
+
+static uint64_t NESDatMix(uint64_t x) {
+	/*
+	**	splitmix64's finalizer
+	*/
+	
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	
+	return x;
+}
+
+static void NESDatKeyHashes(uchar *sha1, uint64_t *bucket_hash, uint64_t *slot_hash) {
+	/*
+	**	a SHA-1 is already as random as it gets, so the two hashes are just its first 16 bytes
+	*/
+	
+	memcpy(bucket_hash, sha1, sizeof(uint64_t));
+	memcpy(slot_hash, sha1 + sizeof(uint64_t), sizeof(uint64_t));
+}
+
+static u64 NESDatSlot(uint64_t slot_hash, uint32_t displacement, u64 slot_count) {
+	return NESDatMix(slot_hash + ((uint64_t)displacement * 0x9e3779b97f4a7c15ULL)) % slot_count;
+}
+
+#pragma mark -
+#pragma mark *** Parsing ***
+
+typedef struct nesDatAttribute {
+	char *name;
+	int name_length;
+	char *value;
+	int value_length;
+} NESDatAttribute;
+
+static void NESDatAppendString(NESDat *dat, char *s, int length) {
+	/*
+	**	appends length bytes of s (plus a NUL) to the string table, decoding XML entities as it goes
+	*/
+	
+	int i = 0;
+	
+	if (dat->strings_length + length + 1 > dat->strings_capacity) {
+		dat->strings_capacity = (dat->strings_length + length + 1) * 2;
+		dat->strings = (char*)realloc(dat->strings, dat->strings_capacity);
+	}
+	
+	char *out = dat->strings + dat->strings_length;
+	
+	for (i = 0; i < length; i++) {
+		if (s[i] != '&') {
+			*out++ = s[i];
+			continue;
+		}
+		
+		char *end = memchr(s + i, ';', length - i);
+		int entity_length = end ? (int)(end - (s + i)) + 1 : 0;
+		
+		if (entity_length == 5 && strncmp(s + i, "&amp;", 5) == 0) {
+			*out++ = '&';
+		} else if (entity_length == 4 && strncmp(s + i, "&lt;", 4) == 0) {
+			*out++ = '<';
+		} else if (entity_length == 4 && strncmp(s + i, "&gt;", 4) == 0) {
+			*out++ = '>';
+		} else if (entity_length == 6 && strncmp(s + i, "&quot;", 6) == 0) {
+			*out++ = '"';
+		} else if (entity_length == 6 && strncmp(s + i, "&apos;", 6) == 0) {
+			*out++ = '\'';
+		} else if (entity_length > 3 && s[i + 1] == '#') {
+			//numeric reference; anything past ASCII comes out as '?' (names are for people to read)
+			long c = (s[i + 2] == 'x') ? strtol(s + i + 3, NULL, 16) : strtol(s + i + 2, NULL, 10);
+			*out++ = (c > 0 && c < 128) ? (char)c : '?';
+		} else {
+			*out++ = '&';
+			continue;
+		}
+		
+		i += entity_length - 1;
+	}
+	
+	*out++ = '\0';
+	dat->strings_length = out - dat->strings;
+}
+
+static bool NESDatParseHex(uchar *out, int out_length, char *s, int length) {
+	/*
+	**	parses exactly out_length bytes of hex; false if s is anything else
+	*/
+	
+	int i = 0;
+	
+	if (length != out_length * 2) return false;
+	
+	for (i = 0; i < length; i++) {
+		char c = s[i];
+		int nibble = 0;
+		
+		if (c >= '0' && c <= '9') {
+			nibble = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			nibble = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			nibble = c - 'A' + 10;
+		} else {
+			return false;
+		}
+		
+		if (i % 2) {
+			out[i / 2] |= nibble;
+		} else {
+			out[i / 2] = nibble << 4;
+		}
+	}
+	
+	return true;
+}
+
+static NESDatAttribute *NESDatFindAttribute(NESDatAttribute *attributes, int count, char *name) {
+	int i = 0;
+	int length = strlen(name);
+	
+	for (i = 0; i < count; i++) {
+		if (attributes[i].name_length == length && strncmp(attributes[i].name, name, length) == 0) return &attributes[i];
+	}
+	
+	return NULL;
+}
+
+static long NESDatAttributeInt(NESDatAttribute *attributes, int count, char *name, long fallback) {
+	NESDatAttribute *attribute = NESDatFindAttribute(attributes, count, name);
+	char *end = NULL;
+	
+	if (!attribute || !attribute->value_length) return fallback;
+	
+	long value = strtol(attribute->value, &end, 10);
+	
+	return (end == attribute->value) ? fallback : value;
+}
+
+static int NESDatParseMirroring(NESDatAttribute *attribute) {
+	/*
+	**	the NES 2.0 database uses H, V and 4; be lenient about spelled-out names too
+	*/
+	
+	if (!attribute || !attribute->value_length) return NES_DAT_UNKNOWN;
+	
+	switch (attribute->value[0]) {
+		case 'H': case 'h':		return NES_DAT_MIRROR_HORIZONTAL;
+		case 'V': case 'v':		return NES_DAT_MIRROR_VERTICAL;
+		case '4': case 'F': case 'f':	return NES_DAT_MIRROR_FOUR_SCREEN;
+		default:				return NES_DAT_UNKNOWN;
+	}
+}
+
+static char *NESDatParseTag(char *p, char *end, char **tag_name, int *tag_length, NESDatAttribute *attributes, int *attribute_count, bool *self_closing) {
+	/*
+	**	p points just past a '<'. reads the tag name and its attributes
+	**	returns a pointer just past the closing '>' (or end)
+	*/
+	
+	*attribute_count = 0;
+	*self_closing = false;
+	
+	*tag_name = p;
+	while (p < end && *p != '>' && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+	*tag_length = p - *tag_name;
+	
+	while (p < end && *p != '>') {
+		if (*p == '/') {
+			*self_closing = true;
+			p++;
+			continue;
+		}
+		
+		if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+			continue;
+		}
+		
+		//name="value" (or name='value')
+		char *name = p;
+		while (p < end && *p != '=' && *p != '>' && *p != ' ' && *p != '/') p++;
+		int name_length = p - name;
+		
+		if (p >= end || *p != '=') continue;
+		p++;
+		
+		if (p >= end || (*p != '"' && *p != '\'')) continue;
+		char quote = *p++;
+		char *value = p;
+		while (p < end && *p != quote) p++;
+		int value_length = p - value;
+		if (p < end) p++;
+		
+		if (*attribute_count < NES_DAT_MAX_ATTRIBUTES) {
+			NESDatAttribute *attribute = &attributes[(*attribute_count)++];
+			attribute->name = name;
+			attribute->name_length = name_length;
+			attribute->value = value;
+			attribute->value_length = value_length;
+		}
+		
+		*self_closing = false;
+	}
+	
+	return (p < end) ? p + 1 : end;
+}
+
+static bool NESDatTagIs(char *tag_name, int tag_length, char *name) {
+	return tag_length == (int)strlen(name) && strncmp(tag_name, name, tag_length) == 0;
+}
+
+static void NESDatAddRom(NESDat *dat, NESDatAttribute *attributes, int count, uint32_t name) {
+	/*
+	**	adds one <rom> element; ones without a SHA-1 can't go in the index
+	*/
+	
+	NESDatEntry entry;
+	NESDatAttribute *attribute = NULL;
+	
+	memset(&entry, 0, sizeof(entry));
+	
+	attribute = NESDatFindAttribute(attributes, count, "sha1");
+	if (!attribute || !NESDatParseHex(entry.sha1, SHA1_DIGEST_LENGTH, attribute->value, attribute->value_length)) {
+		dat->skipped++;
+		return;
+	}
+	
+	uchar crc[4];
+	attribute = NESDatFindAttribute(attributes, count, "crc");
+	if (!attribute) attribute = NESDatFindAttribute(attributes, count, "crc32");
+	if (attribute && NESDatParseHex(crc, sizeof(crc), attribute->value, attribute->value_length)) {
+		entry.crc32 = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) | ((uint32_t)crc[2] << 8) | crc[3];
+		entry.flags |= NES_DAT_FLAG_CRC32;
+	}
+	
+	attribute = NESDatFindAttribute(attributes, count, "md5");
+	if (attribute && NESDatParseHex(entry.md5, MD5_DIGEST_LENGTH, attribute->value, attribute->value_length)) {
+		entry.flags |= NES_DAT_FLAG_MD5;
+	}
+	
+	long size = NESDatAttributeInt(attributes, count, "size", 0);
+	entry.size = (size > 0) ? (uint64_t)size : 0;
+	
+	entry.name = name;
+	entry.mapper = NES_DAT_UNKNOWN;
+	entry.submapper = NES_DAT_UNKNOWN;
+	entry.mirroring = NES_DAT_UNKNOWN;
+	entry.battery = NES_DAT_UNKNOWN;
+	
+	if (dat->count == dat->capacity) {
+		dat->capacity = dat->capacity ? dat->capacity * 2 : 1024;
+		dat->entries = (NESDatEntry*)realloc(dat->entries, sizeof(NESDatEntry) * dat->capacity);
+	}
+	
+	dat->entries[dat->count++] = entry;
+}
+
+static uint32_t NESDatAddName(NESDat *dat, char *s, int length) {
+	/*
+	**	adds a name to the string table, dropping a trailing ".nes"
+	**	names are never empty, since offset 0 marks an empty slot in the index
+	*/
+	
+	while (length && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+		s++;
+		length--;
+	}
+	
+	while (length && (s[length - 1] == ' ' || s[length - 1] == '\t' || s[length - 1] == '\r' || s[length - 1] == '\n')) length--;
+	
+	if (length > 4 && strncasecmp(s + length - 4, ".nes", 4) == 0) length -= 4;
+	
+	if (!length) {
+		s = "[unnamed]";
+		length = strlen(s);
+	}
+	
+	uint32_t offset = dat->strings_length;
+	NESDatAppendString(dat, s, length);
+	
+	return offset;
+}
+
+bool NESDatRead(NESDat *dat, char *path) {
+	/*
+	**	reads the <game>/<machine> elements of a DAT:
+	**		Logiqx/No-Intro:	<game name="..."><rom name="..." size="..." crc="..." md5="..." sha1="..."/></game>
+	**		NES 2.0 database:	<game><!-- name.nes --><rom size="..." crc32="..." sha1="..."/><pcb mapper="..." submapper="..." mirroring="H" battery="0"/></game>
+	**	a game without a name attribute is named by the comment inside it, which can come before or after
+	**	its <rom>s, so the name is settled when the game closes. everything else is skipped. this isn't a general XML parser; it only has to cope with DATs
+	**	returns false if the file can't be read (errno is set)
+	*/
+	
+	struct stat st;
+	NESDatAttribute attributes[NES_DAT_MAX_ATTRIBUTES];
+	int attribute_count = 0;
+	
+	memset(dat, 0, sizeof(NESDat));
+	
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	
+	char *data = NULL;
+	if (st.st_size > 0) {
+		data = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+	}
+	
+	char *p = data;
+	char *end = data + st.st_size;
+	
+	//offset 0 is the empty string
+	NESDatAppendString(dat, "", 0);
+	
+	char *comment = NULL;					/* the last comment inside the open game (the NES 2.0 database names games this way) */
+	int comment_length = 0;
+	bool in_game = false;
+	bool game_named = false;				/* the game has a name attribute, which beats any comment */
+	uint32_t game_name = 0;
+	u64 game_start = 0;
+	int mapper = NES_DAT_UNKNOWN, submapper = NES_DAT_UNKNOWN, mirroring = NES_DAT_UNKNOWN, battery = NES_DAT_UNKNOWN;
+	
+	while (p && p < end) {
+		p = memchr(p, '<', end - p);
+		if (!p) break;
+		p++;
+		
+		//comments, declarations and processing instructions
+		if (end - p >= 3 && strncmp(p, "!--", 3) == 0) {
+			char *close = p + 3;
+			
+			while (close + 3 <= end && strncmp(close, "-->", 3) != 0) close++;
+			
+			if (in_game) {
+				comment = p + 3;
+				comment_length = close - comment;
+			}
+			p = close + 3;
+			continue;
+		}
+		
+		if (p < end && (*p == '!' || *p == '?')) {
+			p = memchr(p, '>', end - p);
+			continue;
+		}
+		
+		bool closing = (p < end && *p == '/');
+		if (closing) p++;
+		
+		char *tag_name = NULL;
+		int tag_length = 0;
+		bool self_closing = false;
+		
+		p = NESDatParseTag(p, end, &tag_name, &tag_length, attributes, &attribute_count, &self_closing);
+		
+		bool is_game = NESDatTagIs(tag_name, tag_length, "game") || NESDatTagIs(tag_name, tag_length, "machine");
+		
+		if (is_game && !closing) {
+			NESDatAttribute *name = NESDatFindAttribute(attributes, attribute_count, "name");
+			
+			in_game = true;
+			game_start = dat->count;
+			mapper = submapper = mirroring = battery = NES_DAT_UNKNOWN;
+			game_named = (name != NULL);
+			game_name = name ? NESDatAddName(dat, name->value, name->value_length) : 0;
+			comment = NULL;
+			
+			if (!self_closing) continue;
+		}
+		
+		if (is_game) {
+			//closing tag: now that the <pcb> and the name comment have been seen, hand them to the game's ROMs
+			u64 i = 0;
+			
+			if (in_game && !game_named && comment) {
+				game_name = NESDatAddName(dat, comment, comment_length);
+			} else if (in_game && !game_name) {
+				game_name = NESDatAddName(dat, "", 0);
+			}
+			
+			for (i = game_start; in_game && i < dat->count; i++) {
+				if (!game_named && (comment || !dat->entries[i].name)) dat->entries[i].name = game_name;
+				dat->entries[i].mapper = mapper;
+				dat->entries[i].submapper = submapper;
+				dat->entries[i].mirroring = mirroring;
+				dat->entries[i].battery = battery;
+			}
+			
+			in_game = false;
+			comment = NULL;
+		} else if (closing) {
+			continue;
+		} else if (NESDatTagIs(tag_name, tag_length, "rom")) {
+			uint32_t name = in_game ? game_name : 0;
+			
+			if (!name) {
+				//inside a game an unnamed ROM waits for </game>, in case a comment names it
+				NESDatAttribute *rom_name = NESDatFindAttribute(attributes, attribute_count, "name");
+				
+				if (rom_name) {
+					name = NESDatAddName(dat, rom_name->value, rom_name->value_length);
+				} else if (!in_game) {
+					name = NESDatAddName(dat, "", 0);
+				}
+				
+				if (in_game) game_name = name;
+			}
+			
+			NESDatAddRom(dat, attributes, attribute_count, name);
+		} else if (NESDatTagIs(tag_name, tag_length, "pcb")) {
+			mapper = NESDatAttributeInt(attributes, attribute_count, "mapper", NES_DAT_UNKNOWN);
+			submapper = NESDatAttributeInt(attributes, attribute_count, "submapper", NES_DAT_UNKNOWN);
+			mirroring = NESDatParseMirroring(NESDatFindAttribute(attributes, attribute_count, "mirroring"));
+			battery = NESDatAttributeInt(attributes, attribute_count, "battery", NES_DAT_UNKNOWN);
+		}
+	}
+	
+	if (data) munmap(data, st.st_size);
+	close(fd);
+	
+	v_printf(VERBOSE_DEBUG, "%s: %llu ROMs (%llu skipped without a SHA-1)", path, dat->count, dat->skipped);
+	
+	return true;
+}
+
+void NESDatFree(NESDat *dat) {
+	if (!dat) return;
+	
+	free(dat->entries);
+	free(dat->strings);
+	memset(dat, 0, sizeof(NESDat));
+}
+
+#pragma mark -
+#pragma mark *** Building ***
+
+static int NESDatEntryCompare(const void *a, const void *b) {
+	return memcmp(((NESDatEntry*)a)->sha1, ((NESDatEntry*)b)->sha1, SHA1_DIGEST_LENGTH);
+}
+
+typedef struct nesDatBucket {
+	uint32_t bucket;
+	uint32_t size;
+} NESDatBucket;
+
+static int NESDatBucketCompare(const void *a, const void *b) {
+	//biggest first; ties in bucket order so the output doesn't depend on qsort()
+	const NESDatBucket *x = (const NESDatBucket*)a;
+	const NESDatBucket *y = (const NESDatBucket*)b;
+	
+	if (x->size != y->size) return (x->size > y->size) ? -1 : 1;
+	return (x->bucket < y->bucket) ? -1 : (x->bucket > y->bucket);
+}
+
+static u64 NESDatUnique(NESDatEntry *entries, u64 count) {
+	/*
+	**	sorts entries by SHA-1 and drops duplicates (the same ROM listed under several games)
+	**	when there's a choice, the entry that knows its mapper wins
+	**	returns the new count
+	*/
+	
+	u64 i = 0;
+	u64 unique = 0;
+	
+	qsort(entries, count, sizeof(NESDatEntry), NESDatEntryCompare);
+	
+	for (i = 0; i < count; i++) {
+		if (unique && memcmp(entries[unique - 1].sha1, entries[i].sha1, SHA1_DIGEST_LENGTH) == 0) {
+			if (entries[unique - 1].mapper == NES_DAT_UNKNOWN && entries[i].mapper != NES_DAT_UNKNOWN) entries[unique - 1] = entries[i];
+			continue;
+		}
+		
+		entries[unique++] = entries[i];
+	}
+	
+	return unique;
+}
+
+static bool NESDatPlace(NESDatEntry *entries, u64 count, u64 bucket_count, u64 slot_count, uint32_t *displacements, uint32_t *slot_entries) {
+	/*
+	**	the CHD construction: hash every key into a bucket, then, biggest bucket first, find a
+	**	displacement that drops all of the bucket's keys into free slots
+	**	fills displacements and slot_entries (entry index + 1 per slot; 0 is empty)
+	**	returns false if some bucket couldn't be placed
+	*/
+	
+	u64 i = 0, b = 0;
+	uint32_t *bucket_start = (uint32_t*)calloc(bucket_count + 1, sizeof(uint32_t));
+	uint32_t *bucket_keys = (uint32_t*)malloc(sizeof(uint32_t) * (count ? count : 1));
+	uint32_t *fill = (uint32_t*)calloc(bucket_count, sizeof(uint32_t));
+	NESDatBucket *order = (NESDatBucket*)malloc(sizeof(NESDatBucket) * bucket_count);
+	u64 slots[NES_DAT_MAX_BUCKET];
+	bool ok = true;
+	
+	memset(displacements, 0, sizeof(uint32_t) * bucket_count);
+	memset(slot_entries, 0, sizeof(uint32_t) * slot_count);
+	
+	//group the keys by bucket
+	for (i = 0; i < count; i++) {
+		uint64_t bucket_hash, slot_hash;
+		NESDatKeyHashes(entries[i].sha1, &bucket_hash, &slot_hash);
+		bucket_start[(bucket_hash % bucket_count) + 1]++;
+	}
+	
+	for (b = 0; b < bucket_count; b++) bucket_start[b + 1] += bucket_start[b];
+	
+	for (i = 0; i < count; i++) {
+		uint64_t bucket_hash, slot_hash;
+		NESDatKeyHashes(entries[i].sha1, &bucket_hash, &slot_hash);
+		b = bucket_hash % bucket_count;
+		bucket_keys[bucket_start[b] + fill[b]++] = i;
+	}
+	
+	for (b = 0; b < bucket_count; b++) {
+		order[b].bucket = b;
+		order[b].size = bucket_start[b + 1] - bucket_start[b];
+		if (order[b].size > NES_DAT_MAX_BUCKET) ok = false;
+	}
+	
+	qsort(order, bucket_count, sizeof(NESDatBucket), NESDatBucketCompare);
+	
+	for (b = 0; ok && b < bucket_count && order[b].size; b++) {
+		uint32_t *keys = bucket_keys + bucket_start[order[b].bucket];
+		uint32_t size = order[b].size;
+		uint32_t displacement = 0;
+		bool placed = false;
+		
+		for (displacement = 0; !placed && displacement < NES_DAT_MAX_DISPLACEMENT; displacement++) {
+			uint32_t k = 0, j = 0;
+			
+			placed = true;
+			
+			for (k = 0; placed && k < size; k++) {
+				uint64_t bucket_hash, slot_hash;
+				NESDatKeyHashes(entries[keys[k]].sha1, &bucket_hash, &slot_hash);
+				slots[k] = NESDatSlot(slot_hash, displacement, slot_count);
+				
+				if (slot_entries[slots[k]]) placed = false;
+				for (j = 0; placed && j < k; j++) {
+					if (slots[j] == slots[k]) placed = false;
+				}
+			}
+			
+			if (placed) {
+				displacements[order[b].bucket] = displacement;
+				for (k = 0; k < size; k++) slot_entries[slots[k]] = keys[k] + 1;
+			}
+		}
+		
+		if (!placed) ok = false;
+	}
+	
+	free(bucket_start);
+	free(bucket_keys);
+	free(fill);
+	free(order);
+	
+	return ok;
+}
+
+static bool NESDatPad(FILE *ofile, u64 *position, u64 target) {
+	static const uchar zeros[NES_DAT_ALIGN] = { 0 };
+	
+	while (*position < target) {
+		u64 length = target - *position;
+		if (length > NES_DAT_ALIGN) length = NES_DAT_ALIGN;
+		
+		if (fwrite(zeros, 1, length, ofile) != length) return false;
+		*position += length;
+	}
+	
+	return true;
+}
+
+bool NESDatIndexWrite(char *path, NESDat *dat) {
+	/*
+	**	builds the index for dat (dropping duplicate ROMs from it) and writes it to a temporary
+	**	file next to path, then renames it over path
+	**	returns false on error (errno is set)
+	*/
+	
+	NESDatIndexHeader header;
+	u64 i = 0;
+	
+	if (dat->strings_length > UINT32_MAX || dat->count > UINT32_MAX - 1) {
+		errno = EFBIG;
+		return false;
+	}
+	
+	dat->count = NESDatUnique(dat->entries, dat->count);
+	
+	u64 bucket_count = (dat->count / NES_DAT_BUCKET_SIZE) + 1;
+	u64 slot_count = ((dat->count * 100) / NES_DAT_LOAD_PERCENT) + 1;
+	uint32_t *displacements = (uint32_t*)malloc(sizeof(uint32_t) * bucket_count);
+	uint32_t *slot_entries = NULL;
+	bool ok = false;
+	
+	//practically never takes more than one go, but a table that's a bit roomier always works out eventually
+	while (!ok) {
+		slot_entries = (uint32_t*)realloc(slot_entries, sizeof(uint32_t) * slot_count);
+		ok = NESDatPlace(dat->entries, dat->count, bucket_count, slot_count, displacements, slot_entries);
+		
+		if (!ok) {
+			v_printf(VERBOSE_DEBUG, "couldn't place %llu keys in %llu slots; growing", dat->count, slot_count);
+			slot_count += (slot_count / 10) + 1;
+		}
+	}
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NES_DAT_MAGIC, NES_DAT_MAGIC_LENGTH);
+	header.version = NES_DAT_VERSION;
+	header.entry_size = sizeof(NESDatEntry);
+	header.entry_count = dat->count;
+	header.bucket_count = bucket_count;
+	header.slot_count = slot_count;
+	header.displacements_offset = NES_DAT_ALIGN_UP(sizeof(header));
+	header.slots_offset = NES_DAT_ALIGN_UP(header.displacements_offset + (sizeof(uint32_t) * bucket_count));
+	header.strings_offset = NES_DAT_ALIGN_UP(header.slots_offset + (sizeof(NESDatEntry) * slot_count));
+	header.strings_length = dat->strings_length;
+	
+	char *temp_path = (char*)malloc(strlen(path) + 32);
+	sprintf(temp_path, "%s.tmp.%d", path, (int)getpid());
+	
+	FILE *ofile = fopen(temp_path, "w");
+	u64 position = 0;
+	NESDatEntry empty;
+	
+	memset(&empty, 0, sizeof(empty));
+	ok = (ofile != NULL);
+	
+	if (ok) {
+		ok = (fwrite(&header, sizeof(header), 1, ofile) == 1);
+		position = sizeof(header);
+	}
+	
+	if (ok) ok = NESDatPad(ofile, &position, header.displacements_offset);
+	if (ok) ok = (fwrite(displacements, sizeof(uint32_t), bucket_count, ofile) == bucket_count);
+	position += sizeof(uint32_t) * bucket_count;
+	
+	if (ok) ok = NESDatPad(ofile, &position, header.slots_offset);
+	
+	for (i = 0; ok && i < slot_count; i++) {
+		NESDatEntry *entry = slot_entries[i] ? &(dat->entries[slot_entries[i] - 1]) : &empty;
+		ok = (fwrite(entry, sizeof(NESDatEntry), 1, ofile) == 1);
+	}
+	position += sizeof(NESDatEntry) * slot_count;
+	
+	if (ok) ok = NESDatPad(ofile, &position, header.strings_offset);
+	if (ok) ok = (fwrite(dat->strings, 1, dat->strings_length, ofile) == dat->strings_length);
+	
+	if (ok) ok = (fflush(ofile) == 0 && fsync(fileno(ofile)) == 0);
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	if (ok) ok = (rename(temp_path, path) == 0);
+	
+	if (!ok) {
+		int saved = errno;
+		unlink(temp_path);
+		errno = saved;
+	}
+	
+	v_printf(VERBOSE_DEBUG, "%s: %llu ROMs, %llu buckets, %llu slots", path, dat->count, bucket_count, slot_count);
+	
+	free(temp_path);
+	free(displacements);
+	free(slot_entries);
+	
+	return ok;
+}
+
+#pragma mark -
+#pragma mark *** Reading ***
+
+NESDatIndex *NESDatIndexOpen(char *path) {
+	/*
+	**	maps the index at path and checks that it's one we can read
+	**	returns NULL if it can't be opened (errno is set; EINVAL for a bad or old index)
+	*/
+	
+	struct stat st;
+	
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	
+	if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(NESDatIndexHeader)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	uchar *data = (uchar*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	
+	NESDatIndexHeader *header = (NESDatIndexHeader*)data;
+	u64 size = st.st_size;
+	bool ok = (memcmp(header->magic, NES_DAT_MAGIC, NES_DAT_MAGIC_LENGTH) == 0)
+		&& header->version == NES_DAT_VERSION
+		&& header->entry_size == sizeof(NESDatEntry)
+		&& header->bucket_count > 0 && header->bucket_count < size
+		&& header->slot_count > 0 && header->slot_count < size
+		&& header->displacements_offset % NES_DAT_ALIGN == 0
+		&& header->slots_offset % NES_DAT_ALIGN == 0
+		&& header->displacements_offset + (header->bucket_count * sizeof(uint32_t)) <= size
+		&& header->slots_offset + (header->slot_count * sizeof(NESDatEntry)) <= size
+		&& header->strings_length > 0
+		&& header->strings_offset + header->strings_length <= size
+		&& data[header->strings_offset + header->strings_length - 1] == '\0';
+	
+	if (!ok) {
+		v_printf(VERBOSE_DEBUG, "%s: not a version %d DAT index", path, NES_DAT_VERSION);
+		munmap(data, st.st_size);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	NESDatIndex *index = (NESDatIndex*)calloc(1, sizeof(NESDatIndex));
+	
+	index->fd = fd;
+	index->data = data;
+	index->size = size;
+	index->header = header;
+	index->displacements = (uint32_t*)(data + header->displacements_offset);
+	index->slots = (NESDatEntry*)(data + header->slots_offset);
+	index->strings = (char*)(data + header->strings_offset);
+	
+	return index;
+}
+
+void NESDatIndexClose(NESDatIndex *index) {
+	if (!index) return;
+	
+	munmap(index->data, index->size);
+	close(index->fd);
+	free(index);
+}
+
+NESDatEntry *NESDatIndexFind(NESDatIndex *index, uchar *sha1) {
+	/*
+	**	one displacement read, one slot read, one compare
+	*/
+	
+	uint64_t bucket_hash, slot_hash;
+	
+	NESDatKeyHashes(sha1, &bucket_hash, &slot_hash);
+	
+	uint32_t displacement = index->displacements[bucket_hash % index->header->bucket_count];
+	NESDatEntry *entry = &(index->slots[NESDatSlot(slot_hash, displacement, index->header->slot_count)]);
+	
+	if (!entry->name || memcmp(entry->sha1, sha1, SHA1_DIGEST_LENGTH) != 0) return NULL;
+	
+	return entry;
+}
+
+char *NESDatIndexName(NESDatIndex *index, NESDatEntry *entry) {
+	if (entry->name >= index->header->strings_length) return "";
+	
+	return index->strings + entry->name;
+}
+
+#pragma mark -
+#pragma mark *** Headers ***
+
+char *NESDatMirroringName(int mirroring) {
+	switch (mirroring) {
+		case NES_DAT_MIRROR_HORIZONTAL:		return "horizontal";
+		case NES_DAT_MIRROR_VERTICAL:		return "vertical";
+		case NES_DAT_MIRROR_FOUR_SCREEN:	return "four-screen";
+		default:							return "unknown";
+	}
+}
+
+int NESDatHeaderMirroring(NESHeader *info) {
+	if (info->four_screen) return NES_DAT_MIRROR_FOUR_SCREEN;
+	
+	return (info->mirroring == NES_VERTICAL_MIRROR_MODE) ? NES_DAT_MIRROR_VERTICAL : NES_DAT_MIRROR_HORIZONTAL;
+}
+
+bool NESDatFixHeader(NESDatEntry *entry, uchar *header, u64 filesize) {
+	/*
+	**	rewrites the mapper, submapper (NES 2.0 only), mirroring and battery bits in header to
+	**	what the DAT says, leaving everything it doesn't know alone
+	**	an archaic header that needs its mapper's high nibble gets bytes 7-15 cleared first,
+	**	since whatever is in there isn't header data. a mapper above 255 needs NES 2.0 and
+	**	is left alone in older headers
+	**	returns true if header changed
+	*/
+	
+	NESHeader info;
+	uchar original[NES_HEADER_SIZE];
+	uchar *control = header + NES_ROM_CONTROL_OFFSET;
+	
+	memcpy(original, header, NES_HEADER_SIZE);
+	NESDecodeHeader(&info, header, filesize);
+	
+	if (entry->mapper != NES_DAT_UNKNOWN && entry->mapper != info.mapper) {
+		if (info.format == nes_format_nes2 || entry->mapper <= 0xFF) {
+			if (info.format == nes_format_archaic && (entry->mapper & 0xF0)) {
+				NESHeaderNormalize(header, filesize);
+			}
+			
+			control[0] = (control[0] & ~NES_ROM_CONTROL_MAPPER_LOW_MASK) | ((entry->mapper & 0x0F) << 4);
+			
+			if (info.format != nes_format_archaic || (entry->mapper & 0xF0)) {
+				control[1] = (control[1] & ~NES_ROM_CONTROL_MAPPER_HIGH_MASK) | (entry->mapper & 0xF0);
+			}
+			
+			if (info.format == nes_format_nes2) {
+				header[NES2_MAPPER_OFFSET] = (header[NES2_MAPPER_OFFSET] & 0xF0) | ((entry->mapper >> 8) & 0x0F);
+			}
+		}
+	}
+	
+	if (info.format == nes_format_nes2 && entry->submapper != NES_DAT_UNKNOWN && entry->submapper != info.submapper) {
+		header[NES2_MAPPER_OFFSET] = (header[NES2_MAPPER_OFFSET] & 0x0F) | ((entry->submapper & 0x0F) << 4);
+	}
+	
+	if (entry->mirroring != NES_DAT_UNKNOWN && entry->mirroring != NESDatHeaderMirroring(&info)) {
+		if (entry->mirroring == NES_DAT_MIRROR_FOUR_SCREEN) {
+			control[0] |= NES_ROM_CONTROL_4_SCREEN_MASK;
+		} else {
+			control[0] &= ~NES_ROM_CONTROL_4_SCREEN_MASK;
+			control[0] = (control[0] & ~NES_ROM_CONTROL_MIRROR_TYPE_MASK) | (entry->mirroring == NES_DAT_MIRROR_VERTICAL ? NES_ROM_CONTROL_MIRROR_TYPE_MASK : 0);
+		}
+	}
+	
+	if (entry->battery != NES_DAT_UNKNOWN && (entry->battery != 0) != (info.battery != 0)) {
+		if (entry->battery) {
+			control[0] |= NES_ROM_CONTROL_BATT_RAM_MASK;
+		} else {
+			control[0] &= ~NES_ROM_CONTROL_BATT_RAM_MASK;
+		}
+	}
+	
+	return memcmp(original, header, NES_HEADER_SIZE) != 0;
+}
@@ -0,0 +1,128 @@
+/*
+**	dat.h
+**	nesromtool
+**
+**	ROM identification against a local DAT file
+**
+**	a DAT (Logiqx/No-Intro XML, or the NES 2.0 header database) is read once and built into
+**	an index file that gets mmap()ed and used in place. lookups are by SHA-1 through a
+**	CHD-style perfect hash (one displacement per bucket), so each one touches two cache lines
+**
+**	file layout (native byte order):
+**		NESDatIndexHeader
+**		displacements: one uint32_t per bucket
+**		slots: one NESDatEntry per slot (empty slots have name == 0)
+**		string table (NUL-terminated names)
+**	each section starts on an NES_DAT_ALIGN boundary
+*/
+
+#ifndef _DAT_H_
+#define _DAT_H_
+
+#include <stdint.h>
+#include "types.h"
+#include "nesrom.h"
+#include "hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_DAT_MAGIC					"NESDATIX"
+#define NES_DAT_MAGIC_LENGTH			8
+#define NES_DAT_VERSION					1
+#define NES_DAT_ALIGN					64
+
+#define NES_DAT_BUCKET_SIZE				4			/* average keys per bucket */
+#define NES_DAT_LOAD_PERCENT			95			/* filled slots, as a percentage of all slots */
+#define NES_DAT_MAX_DISPLACEMENT		(1 << 24)	/* give up on a bucket (and grow the table) after this many tries */
+
+#define NES_DAT_UNKNOWN					-1			/* the DAT doesn't say */
+#define NES_DAT_MIRROR_HORIZONTAL		NES_HORIZONTAL_MIRROR_MODE
+#define NES_DAT_MIRROR_VERTICAL			NES_VERTICAL_MIRROR_MODE
+#define NES_DAT_MIRROR_FOUR_SCREEN		2
+
+// bits in NESDatEntry.flags
+#define NES_DAT_FLAG_MD5				0x01		/* md5 is filled in */
+#define NES_DAT_FLAG_CRC32				0x02		/* crc32 is filled in */
+
+//one ROM from the DAT (64 bytes, so a slot is exactly one cache line)
+typedef struct nesDatEntry {
+	uchar sha1[SHA1_DIGEST_LENGTH];			/* the key */
+	uint32_t crc32;
+	uchar md5[MD5_DIGEST_LENGTH];
+	uint64_t size;
+	uint32_t name;							/* string table offset */
+	int32_t mapper;							/* NES_DAT_UNKNOWN if the DAT doesn't have it */
+	int32_t submapper;
+	int8_t mirroring;						/* NES_DAT_MIRROR_* or NES_DAT_UNKNOWN */
+	int8_t battery;							/* 0, 1 or NES_DAT_UNKNOWN */
+	uint8_t flags;							/* NES_DAT_FLAG_* */
+	uint8_t reserved;
+} NESDatEntry;
+
+typedef struct nesDatIndexHeader {
+	char magic[NES_DAT_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t entry_size;					/* sizeof(NESDatEntry) */
+	uint64_t entry_count;
+	uint64_t bucket_count;
+	uint64_t slot_count;
+	uint64_t displacements_offset;
+	uint64_t slots_offset;
+	uint64_t strings_offset;
+	uint64_t strings_length;
+} NESDatIndexHeader;
+
+//an opened (mapped) index
+typedef struct nesDatIndex {
+	int fd;
+	uchar *data;
+	u64 size;
+	NESDatIndexHeader *header;
+	uint32_t *displacements;
+	NESDatEntry *slots;
+	char *strings;
+} NESDatIndex;
+
+//a DAT that's been read into memory (used while building an index)
+typedef struct nesDat {
+	NESDatEntry *entries;
+	u64 count;
+	u64 capacity;
+	char *strings;							/* names; offset 0 is an empty string */
+	u64 strings_length;
+	u64 strings_capacity;
+	u64 skipped;							/* <rom>s without a usable SHA-1 */
+} NESDat;
+
+//reads a DAT file; returns false on error (errno is set)
+bool NESDatRead(NESDat *dat, char *path);
+void NESDatFree(NESDat *dat);
+
+//builds the perfect hash over dat's entries and replaces the file at path atomically
+bool NESDatIndexWrite(char *path, NESDat *dat);
+
+//reading
+NESDatIndex *NESDatIndexOpen(char *path);
+void NESDatIndexClose(NESDatIndex *index);
+
+//returns the entry with this SHA-1, or NULL
+NESDatEntry *NESDatIndexFind(NESDatIndex *index, uchar *sha1);
+char *NESDatIndexName(NESDatIndex *index, NESDatEntry *entry);
+
+//"horizontal", "vertical", "four-screen" or "unknown"
+char *NESDatMirroringName(int mirroring);
+
+//the mirroring a decoded header describes, as an NES_DAT_MIRROR_* value
+int NESDatHeaderMirroring(NESHeader *info);
+
+//rewrites header's mapper, mirroring and battery bits to match entry (where the DAT knows them)
+//returns true if anything changed
+bool NESDatFixHeader(NESDatEntry *entry, uchar *header, u64 filesize);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _DAT_H_ */
@@ -0,0 +1,828 @@
+/*
+**	deflate.c
+**	nesromtool
+**
+**	LZ77 + Huffman compression in the deflate format (see deflate.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "deflate.h"
+#include "verbosity.h"
+
+#define NES_DEFLATE_WINDOW				32768
+#define NES_DEFLATE_MIN_MATCH			3
+#define NES_DEFLATE_MAX_MATCH			258
+#define NES_DEFLATE_HASH_BITS			15
+#define NES_DEFLATE_MAX_CHAIN			128			/* candidates tried per position */
+#define NES_DEFLATE_LAZY_LENGTH			32			/* matches shorter than this get checked against the next position's */
+#define NES_DEFLATE_BLOCK_TOKENS		16384		/* literals and matches per block */
+
+#define NES_DEFLATE_LITLEN_CODES		286
+#define NES_DEFLATE_DIST_CODES			30
+#define NES_DEFLATE_CODELEN_CODES		19
+#define NES_DEFLATE_MAX_BITS			15
+#define NES_DEFLATE_MAX_CODELEN_BITS	7
+#define NES_DEFLATE_END_OF_BLOCK		256
+#define NES_DEFLATE_STORED_MAX			65535
+
+static const int NESDeflateLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int NESDeflateLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int NESDeflateDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int NESDeflateDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const int NESDeflateCodelenOrder[NES_DEFLATE_CODELEN_CODES] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+//code for each match length, and for each distance (distance - 1 below 256, else 256 + ((distance - 1) >> 7))
+static uchar NESDeflateLengthCode[NES_DEFLATE_MAX_MATCH + 1];
+static uchar NESDeflateDistCode[512];
+static uchar NESDeflateFixedLitlen[288];
+static uchar NESDeflateFixedDist[NES_DEFLATE_DIST_CODES];
+static uint16_t NESDeflateFixedLitlenCodes[288];		/* all 288, or the 9-bit codes come out wrong */
+static uint16_t NESDeflateFixedDistCodes[NES_DEFLATE_DIST_CODES];
+static pthread_once_t NESDeflateTablesOnce = PTHREAD_ONCE_INIT;
+
+static void NESHuffmanCodes(const uchar *lengths, int count, uint16_t *codes);
+
+static void NESDeflateBuildTables() {
+	int code = 0, i = 0;
+	
+	for (code = 0; code < 29; code++) {
+		int count = 1 << NESDeflateLengthExtra[code];
+		for (i = 0; i < count && NESDeflateLengthBase[code] + i <= NES_DEFLATE_MAX_MATCH; i++) {
+			NESDeflateLengthCode[NESDeflateLengthBase[code] + i] = code;
+		}
+	}
+	//258 has a code of its own, rather than being the top of 227's range
+	NESDeflateLengthCode[NES_DEFLATE_MAX_MATCH] = 28;
+	
+	for (code = 0; code < NES_DEFLATE_DIST_CODES; code++) {
+		int count = 1 << NESDeflateDistExtra[code];
+		for (i = 0; i < count; i++) {
+			int distance = NESDeflateDistBase[code] + i - 1;
+			if (distance < 256) {
+				NESDeflateDistCode[distance] = code;
+			} else {
+				NESDeflateDistCode[256 + (distance >> 7)] = code;
+			}
+		}
+	}
+	
+	for (i = 0; i < 288; i++) {
+		NESDeflateFixedLitlen[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+	}
+	for (i = 0; i < NES_DEFLATE_DIST_CODES; i++) {
+		NESDeflateFixedDist[i] = 5;
+	}
+	
+	NESHuffmanCodes(NESDeflateFixedLitlen, 288, NESDeflateFixedLitlenCodes);
+	NESHuffmanCodes(NESDeflateFixedDist, NES_DEFLATE_DIST_CODES, NESDeflateFixedDistCodes);
+}
+
+static inline int NESDeflateDistanceCode(int distance) {
+	distance--;
+	return (distance < 256) ? NESDeflateDistCode[distance] : NESDeflateDistCode[256 + (distance >> 7)];
+}
+
+uint32_t NESAdler32(uint32_t adler, const uchar *data, u64 length) {
+	/*
+	**	5552 bytes is the most that can be summed before the modulo without overflowing 32 bits
+	*/
+	
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	
+	while (length) {
+		u64 count = (length < 5552) ? length : 5552;
+		length -= count;
+		
+		while (count--) {
+			a += *(data++);
+			b += a;
+		}
+		
+		a %= 65521;
+		b %= 65521;
+	}
+	
+	return (b << 16) | a;
+}
+
+#pragma mark *** Bits ***
+
+typedef struct nesBitWriter {
+	uchar *data;
+	u64 length;
+	u64 capacity;
+	uint64_t bits;							/* pending bits, first one in bit 0 */
+	int count;
+} NESBitWriter;
+
+static void NESBitsReserve(NESBitWriter *writer, u64 length) {
+	if (writer->length + length <= writer->capacity) return;
+	
+	while (writer->length + length > writer->capacity) {
+		writer->capacity = writer->capacity ? writer->capacity * 2 : 4096;
+	}
+	writer->data = (uchar*)realloc(writer->data, writer->capacity);
+}
+
+static inline void NESBitsPut(NESBitWriter *writer, uint32_t value, int count) {
+	writer->bits |= (uint64_t)value << writer->count;
+	writer->count += count;
+	
+	if (writer->count >= 32) {
+		NESBitsReserve(writer, 4);
+		writer->data[writer->length++] = writer->bits;
+		writer->data[writer->length++] = writer->bits >> 8;
+		writer->data[writer->length++] = writer->bits >> 16;
+		writer->data[writer->length++] = writer->bits >> 24;
+		writer->bits >>= 32;
+		writer->count -= 32;
+	}
+}
+
+static void NESBitsAlign(NESBitWriter *writer) {
+	NESBitsReserve(writer, 8);
+	
+	while (writer->count > 0) {
+		writer->data[writer->length++] = writer->bits;
+		writer->bits >>= 8;
+		writer->count -= 8;
+	}
+	
+	writer->bits = 0;
+	writer->count = 0;
+}
+
+#pragma mark -
+#pragma mark *** Huffman ***
+
+typedef struct nesHuffmanNode {
+	uint32_t freq;
+	int parent;
+} NESHuffmanNode;
+
+static int NESHuffmanFreqCompare(const void *a, const void *b) {
+	const uint32_t *x = (const uint32_t*)a;
+	const uint32_t *y = (const uint32_t*)b;
+	
+	if (x[0] != y[0]) return (x[0] < y[0]) ? -1 : 1;
+	return (x[1] < y[1]) ? -1 : (x[1] > y[1]);
+}
+
+static void NESHuffmanLengths(const uint32_t *freqs, int count, int limit, uchar *lengths) {
+	/*
+	**	Huffman code lengths for count symbols, none longer than limit
+	**	a plain Huffman tree is built from the two-queue merge; if it comes out too deep, the
+	**	frequencies are halved (keeping every used symbol at 1 or more) and it's built again
+	*/
+	
+	uint32_t scaled[NES_DEFLATE_LITLEN_CODES];
+	uint32_t leaves[NES_DEFLATE_LITLEN_CODES][2];	/* frequency, symbol */
+	NESHuffmanNode nodes[NES_DEFLATE_LITLEN_CODES * 2];
+	int used = 0;
+	int i = 0;
+	
+	memset(lengths, 0, count);
+	
+	for (i = 0; i < count; i++) {
+		scaled[i] = freqs[i];
+		if (freqs[i]) used++;
+	}
+	
+	if (used == 0) return;
+	
+	if (used == 1) {
+		for (i = 0; i < count; i++) {
+			if (freqs[i]) lengths[i] = 1;
+		}
+		return;
+	}
+	
+	while (true) {
+		int leaf_count = 0;
+		int max_length = 0;
+		
+		for (i = 0; i < count; i++) {
+			if (!scaled[i]) continue;
+			leaves[leaf_count][0] = scaled[i];
+			leaves[leaf_count][1] = i;
+			leaf_count++;
+		}
+		
+		qsort(leaves, leaf_count, sizeof(leaves[0]), NESHuffmanFreqCompare);
+		
+		//nodes 0 .. leaf_count - 1 are the leaves in order; internal nodes are appended, already in order
+		for (i = 0; i < leaf_count; i++) {
+			nodes[i].freq = leaves[i][0];
+			nodes[i].parent = -1;
+		}
+		
+		int next_leaf = 0;
+		int next_internal = leaf_count;
+		int node_count = leaf_count;
+		
+		while (node_count < (leaf_count * 2) - 1) {
+			int pick[2];
+			int k = 0;
+			
+			for (k = 0; k < 2; k++) {
+				if (next_leaf < leaf_count && (next_internal >= node_count || nodes[next_leaf].freq <= nodes[next_internal].freq)) {
+					pick[k] = next_leaf++;
+				} else {
+					pick[k] = next_internal++;
+				}
+			}
+			
+			nodes[node_count].freq = nodes[pick[0]].freq + nodes[pick[1]].freq;
+			nodes[node_count].parent = -1;
+			nodes[pick[0]].parent = node_count;
+			nodes[pick[1]].parent = node_count;
+			node_count++;
+		}
+		
+		//depths, from the root down (parents always come after their children)
+		int depths[NES_DEFLATE_LITLEN_CODES * 2];
+		depths[node_count - 1] = 0;
+		
+		for (i = node_count - 2; i >= 0; i--) {
+			depths[i] = depths[nodes[i].parent] + 1;
+		}
+		
+		for (i = 0; i < leaf_count; i++) {
+			lengths[leaves[i][1]] = depths[i];
+			if (depths[i] > max_length) max_length = depths[i];
+		}
+		
+		if (max_length <= limit) return;
+		
+		for (i = 0; i < count; i++) {
+			if (scaled[i]) scaled[i] = (scaled[i] + 1) / 2;
+		}
+	}
+}
+
+static void NESHuffmanCodes(const uchar *lengths, int count, uint16_t *codes) {
+	/*
+	**	canonical codes for lengths, bit-reversed since deflate sends codes starting from the top bit
+	*/
+	
+	int bl_count[NES_DEFLATE_MAX_BITS + 1];
+	int next_code[NES_DEFLATE_MAX_BITS + 1];
+	int code = 0;
+	int i = 0, bits = 0;
+	
+	memset(bl_count, 0, sizeof(bl_count));
+	
+	for (i = 0; i < count; i++) {
+		bl_count[lengths[i]]++;
+	}
+	bl_count[0] = 0;
+	
+	for (bits = 1; bits <= NES_DEFLATE_MAX_BITS; bits++) {
+		code = (code + bl_count[bits - 1]) << 1;
+		next_code[bits] = code;
+	}
+	
+	for (i = 0; i < count; i++) {
+		int length = lengths[i];
+		uint16_t reversed = 0;
+		
+		if (!length) {
+			codes[i] = 0;
+			continue;
+		}
+		
+		code = next_code[length]++;
+		
+		for (bits = 0; bits < length; bits++) {
+			reversed = (reversed << 1) | ((code >> bits) & 1);
+		}
+		
+		codes[i] = reversed;
+	}
+}
+
+#pragma mark -
+#pragma mark *** Blocks ***
+
+typedef struct nesDeflateToken {
+	uint16_t value;							/* a literal byte, or a match length */
+	uint16_t distance;						/* 0 for a literal */
+} NESDeflateToken;
+
+typedef struct nesDeflateBlock {
+	NESDeflateToken *tokens;
+	int count;
+	const uchar *start;						/* the input the tokens cover */
+	u64 length;
+} NESDeflateBlock;
+
+typedef struct nesDeflateCodes {
+	uchar litlen_lengths[NES_DEFLATE_LITLEN_CODES];
+	uchar dist_lengths[NES_DEFLATE_DIST_CODES];
+	uint16_t litlen_codes[NES_DEFLATE_LITLEN_CODES];
+	uint16_t dist_codes[NES_DEFLATE_DIST_CODES];
+} NESDeflateCodes;
+
+static void NESDeflateCountTokens(NESDeflateBlock *block, uint32_t *litlen_freqs, uint32_t *dist_freqs) {
+	int i = 0;
+	
+	memset(litlen_freqs, 0, sizeof(uint32_t) * NES_DEFLATE_LITLEN_CODES);
+	memset(dist_freqs, 0, sizeof(uint32_t) * NES_DEFLATE_DIST_CODES);
+	
+	for (i = 0; i < block->count; i++) {
+		NESDeflateToken *token = &(block->tokens[i]);
+		
+		if (token->distance == 0) {
+			litlen_freqs[token->value]++;
+		} else {
+			litlen_freqs[257 + NESDeflateLengthCode[token->value]]++;
+			dist_freqs[NESDeflateDistanceCode(token->distance)]++;
+		}
+	}
+	
+	litlen_freqs[NES_DEFLATE_END_OF_BLOCK]++;
+}
+
+static u64 NESDeflateDataCost(const uint32_t *litlen_freqs, const uint32_t *dist_freqs, const uchar *litlen_lengths, const uchar *dist_lengths) {
+	u64 cost = 0;
+	int i = 0;
+	
+	for (i = 0; i < NES_DEFLATE_LITLEN_CODES; i++) {
+		cost += (u64)litlen_freqs[i] * (litlen_lengths[i] + ((i > 256) ? NESDeflateLengthExtra[i - 257] : 0));
+	}
+	for (i = 0; i < NES_DEFLATE_DIST_CODES; i++) {
+		cost += (u64)dist_freqs[i] * (dist_lengths[i] + NESDeflateDistExtra[i]);
+	}
+	
+	return cost;
+}
+
+typedef struct nesDeflateHeader {
+	int hlit;
+	int hdist;
+	int hclen;
+	uchar symbols[NES_DEFLATE_LITLEN_CODES + NES_DEFLATE_DIST_CODES];	/* run-length coded code lengths */
+	uchar extras[NES_DEFLATE_LITLEN_CODES + NES_DEFLATE_DIST_CODES];
+	int symbol_count;
+	uchar codelen_lengths[NES_DEFLATE_CODELEN_CODES];
+	uint16_t codelen_codes[NES_DEFLATE_CODELEN_CODES];
+	u64 cost;								/* in bits */
+} NESDeflateHeader;
+
+static void NESDeflateBuildHeader(NESDeflateCodes *codes, NESDeflateHeader *header) {
+	/*
+	**	the code lengths of a dynamic block, run-length coded with symbols 16-18
+	*/
+	
+	uchar lengths[NES_DEFLATE_LITLEN_CODES + NES_DEFLATE_DIST_CODES];
+	uint32_t freqs[NES_DEFLATE_CODELEN_CODES];
+	int total = 0;
+	int i = 0;
+	
+	for (header->hlit = NES_DEFLATE_LITLEN_CODES; header->hlit > 257 && !codes->litlen_lengths[header->hlit - 1]; header->hlit--);
+	for (header->hdist = NES_DEFLATE_DIST_CODES; header->hdist > 1 && !codes->dist_lengths[header->hdist - 1]; header->hdist--);
+	
+	memcpy(lengths, codes->litlen_lengths, header->hlit);
+	memcpy(lengths + header->hlit, codes->dist_lengths, header->hdist);
+	total = header->hlit + header->hdist;
+	
+	memset(freqs, 0, sizeof(freqs));
+	header->symbol_count = 0;
+	
+	for (i = 0; i < total; ) {
+		int length = lengths[i];
+		int run = 1;
+		
+		while (i + run < total && lengths[i + run] == length) run++;
+		
+		if (length == 0 && run >= 11) {
+			if (run > 138) run = 138;
+			header->symbols[header->symbol_count] = 18;
+			header->extras[header->symbol_count++] = run - 11;
+		} else if (length == 0 && run >= 3) {
+			header->symbols[header->symbol_count] = 17;
+			header->extras[header->symbol_count++] = run - 3;
+		} else if (length != 0 && run >= 4) {
+			//the length itself, then repeats of it
+			if (run > 7) run = 7;
+			header->symbols[header->symbol_count] = length;
+			header->extras[header->symbol_count++] = 0;
+			header->symbols[header->symbol_count] = 16;
+			header->extras[header->symbol_count++] = run - 4;
+		} else {
+			run = 1;
+			header->symbols[header->symbol_count] = length;
+			header->extras[header->symbol_count++] = 0;
+		}
+		
+		i += run;
+	}
+	
+	for (i = 0; i < header->symbol_count; i++) {
+		freqs[header->symbols[i]]++;
+	}
+	
+	NESHuffmanLengths(freqs, NES_DEFLATE_CODELEN_CODES, NES_DEFLATE_MAX_CODELEN_BITS, header->codelen_lengths);
+	NESHuffmanCodes(header->codelen_lengths, NES_DEFLATE_CODELEN_CODES, header->codelen_codes);
+	
+	for (header->hclen = NES_DEFLATE_CODELEN_CODES; header->hclen > 4 && !header->codelen_lengths[NESDeflateCodelenOrder[header->hclen - 1]]; header->hclen--);
+	
+	header->cost = 5 + 5 + 4 + (3 * header->hclen);
+	
+	for (i = 0; i < header->symbol_count; i++) {
+		int symbol = header->symbols[i];
+		header->cost += header->codelen_lengths[symbol] + ((symbol == 16) ? 2 : (symbol == 17) ? 3 : (symbol == 18) ? 7 : 0);
+	}
+}
+
+static void NESDeflateWriteTokens(NESBitWriter *writer, NESDeflateBlock *block, NESDeflateCodes *codes) {
+	int i = 0;
+	
+	for (i = 0; i < block->count; i++) {
+		NESDeflateToken *token = &(block->tokens[i]);
+		
+		if (token->distance == 0) {
+			NESBitsPut(writer, codes->litlen_codes[token->value], codes->litlen_lengths[token->value]);
+			continue;
+		}
+		
+		int length_code = NESDeflateLengthCode[token->value];
+		int dist_code = NESDeflateDistanceCode(token->distance);
+		
+		NESBitsPut(writer, codes->litlen_codes[257 + length_code], codes->litlen_lengths[257 + length_code]);
+		NESBitsPut(writer, token->value - NESDeflateLengthBase[length_code], NESDeflateLengthExtra[length_code]);
+		NESBitsPut(writer, codes->dist_codes[dist_code], codes->dist_lengths[dist_code]);
+		NESBitsPut(writer, token->distance - NESDeflateDistBase[dist_code], NESDeflateDistExtra[dist_code]);
+	}
+	
+	NESBitsPut(writer, codes->litlen_codes[NES_DEFLATE_END_OF_BLOCK], codes->litlen_lengths[NES_DEFLATE_END_OF_BLOCK]);
+}
+
+static void NESDeflateWriteStored(NESBitWriter *writer, const uchar *data, u64 length, bool final) {
+	/*
+	**	one stored block per 64KB (an empty one if there's no data)
+	*/
+	
+	do {
+		u64 count = (length > NES_DEFLATE_STORED_MAX) ? NES_DEFLATE_STORED_MAX : length;
+		bool last = final && count == length;
+		
+		NESBitsPut(writer, last ? 1 : 0, 1);
+		NESBitsPut(writer, 0, 2);
+		NESBitsAlign(writer);
+		
+		NESBitsReserve(writer, 4 + count);
+		writer->data[writer->length++] = count & 0xFF;
+		writer->data[writer->length++] = count >> 8;
+		writer->data[writer->length++] = ~count & 0xFF;
+		writer->data[writer->length++] = (~count >> 8) & 0xFF;
+		if (count) memcpy(writer->data + writer->length, data, count);
+		writer->length += count;
+		
+		data += count;
+		length -= count;
+	} while (length);
+}
+
+static void NESDeflateWriteBlock(NESBitWriter *writer, NESDeflateBlock *block, bool final) {
+	/*
+	**	writes the block as whichever of dynamic, fixed or stored is smallest
+	*/
+	
+	uint32_t litlen_freqs[NES_DEFLATE_LITLEN_CODES];
+	uint32_t dist_freqs[NES_DEFLATE_DIST_CODES];
+	NESDeflateCodes dynamic;
+	NESDeflateHeader header;
+	int i = 0;
+	
+	NESDeflateCountTokens(block, litlen_freqs, dist_freqs);
+	
+	u64 fixed_cost = 3 + NESDeflateDataCost(litlen_freqs, dist_freqs, NESDeflateFixedLitlen, NESDeflateFixedDist);
+	
+	//every code needs a partner: a tree with one leaf isn't complete, and some decoders choke on it
+	uint32_t tree_freqs[NES_DEFLATE_DIST_CODES];
+	int dist_used = 0;
+	
+	memcpy(tree_freqs, dist_freqs, sizeof(tree_freqs));
+	for (i = 0; i < NES_DEFLATE_DIST_CODES; i++) dist_used += (tree_freqs[i] != 0);
+	for (i = 0; dist_used < 2; i++) {
+		if (!tree_freqs[i]) {
+			tree_freqs[i] = 1;
+			dist_used++;
+		}
+	}
+	
+	NESHuffmanLengths(litlen_freqs, NES_DEFLATE_LITLEN_CODES, NES_DEFLATE_MAX_BITS, dynamic.litlen_lengths);
+	NESHuffmanLengths(tree_freqs, NES_DEFLATE_DIST_CODES, NES_DEFLATE_MAX_BITS, dynamic.dist_lengths);
+	NESHuffmanCodes(dynamic.litlen_lengths, NES_DEFLATE_LITLEN_CODES, dynamic.litlen_codes);
+	NESHuffmanCodes(dynamic.dist_lengths, NES_DEFLATE_DIST_CODES, dynamic.dist_codes);
+	NESDeflateBuildHeader(&dynamic, &header);
+	
+	u64 dynamic_cost = 3 + header.cost + NESDeflateDataCost(litlen_freqs, dist_freqs, dynamic.litlen_lengths, dynamic.dist_lengths);
+	u64 stored_cost = 3 + 7 + (32 * ((block->length / NES_DEFLATE_STORED_MAX) + 1)) + (block->length * 8);
+	
+	if (stored_cost < dynamic_cost && stored_cost < fixed_cost) {
+		NESDeflateWriteStored(writer, block->start, block->length, final);
+		return;
+	}
+	
+	if (fixed_cost <= dynamic_cost) {
+		NESDeflateCodes fixed;
+		
+		memcpy(fixed.litlen_lengths, NESDeflateFixedLitlen, NES_DEFLATE_LITLEN_CODES);
+		memcpy(fixed.dist_lengths, NESDeflateFixedDist, NES_DEFLATE_DIST_CODES);
+		memcpy(fixed.litlen_codes, NESDeflateFixedLitlenCodes, sizeof(fixed.litlen_codes));
+		memcpy(fixed.dist_codes, NESDeflateFixedDistCodes, sizeof(fixed.dist_codes));
+		
+		NESBitsPut(writer, final ? 1 : 0, 1);
+		NESBitsPut(writer, 1, 2);
+		NESDeflateWriteTokens(writer, block, &fixed);
+		return;
+	}
+	
+	NESBitsPut(writer, final ? 1 : 0, 1);
+	NESBitsPut(writer, 2, 2);
+	NESBitsPut(writer, header.hlit - 257, 5);
+	NESBitsPut(writer, header.hdist - 1, 5);
+	NESBitsPut(writer, header.hclen - 4, 4);
+	
+	for (i = 0; i < header.hclen; i++) {
+		NESBitsPut(writer, header.codelen_lengths[NESDeflateCodelenOrder[i]], 3);
+	}
+	
+	for (i = 0; i < header.symbol_count; i++) {
+		int symbol = header.symbols[i];
+		
+		NESBitsPut(writer, header.codelen_codes[symbol], header.codelen_lengths[symbol]);
+		if (symbol == 16) NESBitsPut(writer, header.extras[i], 2);
+		if (symbol == 17) NESBitsPut(writer, header.extras[i], 3);
+		if (symbol == 18) NESBitsPut(writer, header.extras[i], 7);
+	}
+	
+	NESDeflateWriteTokens(writer, block, &dynamic);
+}
+
+#pragma mark -
+#pragma mark *** Matching ***
+
+typedef struct nesDeflateChunk {
+	const uchar *data;						/* all of the input */
+	u64 length;
+	u64 start;								/* this chunk's part of it */
+	u64 end;
+	bool last;
+	NESBitWriter output;
+} NESDeflateChunk;
+
+static inline uint32_t NESDeflateHash(const uchar *p) {
+	uint32_t value = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+	return (value * 2654435761U) >> (32 - NES_DEFLATE_HASH_BITS);
+}
+
+typedef struct nesDeflateMatcher {
+	const uchar *data;
+	u64 length;
+	u64 base;								/* positions in head and prev are relative to this */
+	int32_t head[1 << NES_DEFLATE_HASH_BITS];
+	int32_t prev[NES_DEFLATE_WINDOW];
+} NESDeflateMatcher;
+
+static inline void NESDeflateInsert(NESDeflateMatcher *matcher, u64 position) {
+	if (position + NES_DEFLATE_MIN_MATCH > matcher->length) return;
+	
+	uint32_t hash = NESDeflateHash(matcher->data + position);
+	int32_t relative = (int32_t)(position - matcher->base);
+	
+	matcher->prev[relative & (NES_DEFLATE_WINDOW - 1)] = matcher->head[hash];
+	matcher->head[hash] = relative;
+}
+
+static int NESDeflateLongestMatch(NESDeflateMatcher *matcher, u64 position, u64 end, int *distance) {
+	/*
+	**	the longest earlier copy of the bytes at position (within the window), not running past end
+	*/
+	
+	if (position + NES_DEFLATE_MIN_MATCH > end) return 0;
+	
+	int max_length = (end - position > NES_DEFLATE_MAX_MATCH) ? NES_DEFLATE_MAX_MATCH : (int)(end - position);
+	const uchar *current = matcher->data + position;
+	int32_t relative = (int32_t)(position - matcher->base);
+	int32_t candidate = matcher->head[NESDeflateHash(current)];
+	int best = 0;
+	int chain = NES_DEFLATE_MAX_CHAIN;
+	
+	while (candidate >= 0 && chain-- > 0) {
+		int gap = relative - candidate;
+		if (gap <= 0 || gap > NES_DEFLATE_WINDOW) break;
+		
+		const uchar *previous = matcher->data + matcher->base + candidate;
+		
+		if (previous[best] == current[best] && previous[0] == current[0]) {
+			int length = 0;
+			while (length < max_length && previous[length] == current[length]) length++;
+			
+			if (length > best) {
+				best = length;
+				*distance = gap;
+				if (best == max_length) break;
+			}
+		}
+		
+		int32_t next = matcher->prev[candidate & (NES_DEFLATE_WINDOW - 1)];
+		if (next >= candidate) break;
+		candidate = next;
+	}
+	
+	return (best >= NES_DEFLATE_MIN_MATCH) ? best : 0;
+}
+
+static void NESDeflateCompressChunk(NESDeflateChunk *chunk) {
+	/*
+	**	greedy matching with one step of lazy evaluation; the window is primed with the 32KB
+	**	before the chunk so matches can reach back across the split
+	*/
+	
+	NESDeflateMatcher *matcher = (NESDeflateMatcher*)malloc(sizeof(NESDeflateMatcher));
+	NESDeflateBlock block;
+	u64 position = 0;
+	u64 i = 0;
+	
+	matcher->data = chunk->data;
+	matcher->length = chunk->length;
+	matcher->base = (chunk->start > NES_DEFLATE_WINDOW) ? chunk->start - NES_DEFLATE_WINDOW : 0;
+	memset(matcher->head, 0xFF, sizeof(matcher->head));
+	
+	for (position = matcher->base; position < chunk->start; position++) {
+		NESDeflateInsert(matcher, position);
+	}
+	
+	block.tokens = (NESDeflateToken*)malloc(sizeof(NESDeflateToken) * NES_DEFLATE_BLOCK_TOKENS);
+	block.count = 0;
+	block.start = chunk->data + chunk->start;
+	
+	position = chunk->start;
+	
+	while (position < chunk->end) {
+		int distance = 0;
+		int length = NESDeflateLongestMatch(matcher, position, chunk->end, &distance);
+		
+		if (length && length < NES_DEFLATE_LAZY_LENGTH) {
+			int next_distance = 0;
+			
+			NESDeflateInsert(matcher, position);
+			
+			if (NESDeflateLongestMatch(matcher, position + 1, chunk->end, &next_distance) > length) {
+				//a better match starts at the next byte, so this one goes out as a literal
+				length = 0;
+			}
+		} else {
+			NESDeflateInsert(matcher, position);
+		}
+		
+		NESDeflateToken *token = &(block.tokens[block.count++]);
+		u64 skip = 1;
+		
+		if (length) {
+			token->value = length;
+			token->distance = distance;
+			skip = length;
+		} else {
+			token->value = chunk->data[position];
+			token->distance = 0;
+		}
+		
+		for (i = 1; i < skip; i++) {
+			NESDeflateInsert(matcher, position + i);
+		}
+		
+		position += skip;
+		
+		if (block.count == NES_DEFLATE_BLOCK_TOKENS || position == chunk->end) {
+			block.length = (chunk->data + position) - block.start;
+			NESDeflateWriteBlock(&(chunk->output), &block, chunk->last && position == chunk->end);
+			
+			block.count = 0;
+			block.start = chunk->data + position;
+		}
+	}
+	
+	if (chunk->start == chunk->end) {
+		//nothing to compress, but the stream still needs a block
+		block.length = 0;
+		NESDeflateWriteBlock(&(chunk->output), &block, chunk->last);
+	}
+	
+	//an empty stored block brings the chunk out to a byte boundary, so the next one can follow it directly
+	if (!chunk->last) NESDeflateWriteStored(&(chunk->output), NULL, 0, false);
+	NESBitsAlign(&(chunk->output));
+	
+	free(block.tokens);
+	free(matcher);
+}
+
+#pragma mark -
+#pragma mark *** Streams ***
+
+typedef struct nesDeflateQueue {
+	NESDeflateChunk *chunks;
+	int count;
+	int next;
+	pthread_mutex_t lock;
+} NESDeflateQueue;
+
+static void *NESDeflateWorker(void *arg) {
+	NESDeflateQueue *queue = (NESDeflateQueue*)arg;
+	
+	while (true) {
+		pthread_mutex_lock(&(queue->lock));
+		int index = queue->next++;
+		pthread_mutex_unlock(&(queue->lock));
+		
+		if (index >= queue->count) return NULL;
+		
+		NESDeflateCompressChunk(&(queue->chunks[index]));
+	}
+}
+
+uchar *NESDeflate(const uchar *data, u64 length, int threads, u64 *out_length) {
+	NESDeflateQueue queue;
+	int i = 0;
+	
+	pthread_once(&NESDeflateTablesOnce, NESDeflateBuildTables);
+	
+	queue.count = (length + NES_DEFLATE_CHUNK - 1) / NES_DEFLATE_CHUNK;
+	if (queue.count == 0) queue.count = 1;
+	queue.chunks = (NESDeflateChunk*)calloc(queue.count, sizeof(NESDeflateChunk));
+	queue.next = 0;
+	pthread_mutex_init(&(queue.lock), NULL);
+	
+	for (i = 0; i < queue.count; i++) {
+		queue.chunks[i].data = data;
+		queue.chunks[i].length = length;
+		queue.chunks[i].start = (u64)i * NES_DEFLATE_CHUNK;
+		queue.chunks[i].end = (i == queue.count - 1) ? length : (u64)(i + 1) * NES_DEFLATE_CHUNK;
+		queue.chunks[i].last = (i == queue.count - 1);
+	}
+	
+	if (threads > queue.count) threads = queue.count;
+	
+	pthread_t *workers = (pthread_t*)malloc(sizeof(pthread_t) * (threads > 1 ? threads : 1));
+	int started = 0;
+	
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&workers[started], NULL, NESDeflateWorker, &queue) == 0) started++;
+	}
+	
+	//this thread works too, and does everything if no threads could be started
+	NESDeflateWorker(&queue);
+	
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	
+	v_printf(VERBOSE_DEBUG, "deflate: %llu bytes in %d chunks on %d threads", length, queue.count, started + 1);
+	
+	//zlib header (deflate, 32KB window, default level), the chunks, then the Adler-32 of the input
+	u64 total = 2 + 4;
+	for (i = 0; i < queue.count; i++) total += queue.chunks[i].output.length;
+	
+	uchar *stream = (uchar*)malloc(total);
+	u64 offset = 0;
+	
+	stream[offset++] = 0x78;
+	stream[offset++] = 0x9C;
+	
+	for (i = 0; i < queue.count; i++) {
+		memcpy(stream + offset, queue.chunks[i].output.data, queue.chunks[i].output.length);
+		offset += queue.chunks[i].output.length;
+		free(queue.chunks[i].output.data);
+	}
+	
+	uint32_t adler = NESAdler32(1, data, length);
+	
+	stream[offset++] = adler >> 24;
+	stream[offset++] = adler >> 16;
+	stream[offset++] = adler >> 8;
+	stream[offset++] = adler;
+	
+	*out_length = offset;
+	
+	pthread_mutex_destroy(&(queue.lock));
+	free(queue.chunks);
+	free(workers);
+	
+	return stream;
+}
@@ -0,0 +1,37 @@
+/*
+**	deflate.h
+**	nesromtool
+**
+**	a self-contained zlib (RFC 1950/1951) compressor, for the image writers
+**
+**	the input is cut into chunks that are compressed independently, on several threads if asked.
+**	a chunk can still refer back into the chunk before it (all of the input is in memory), so
+**	splitting costs almost nothing in size. each chunk but the last ends on a byte boundary with an
+**	empty stored block, the way parallel gzip does it, so the pieces just get strung together.
+**	blocks are written with dynamic, fixed or no Huffman codes, whichever comes out smallest.
+*/
+
+#ifndef _DEFLATE_H_
+#define _DEFLATE_H_
+
+#include <stdint.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_DEFLATE_CHUNK				(256 * 1024)	/* input bytes per independently compressed chunk */
+
+//zlib-wrapped deflate of data, using up to threads threads
+//returns a malloc()ed stream and sets *out_length
+uchar *NESDeflate(const uchar *data, u64 length, int threads, u64 *out_length);
+
+//Adler-32 (the zlib checksum); start with adler = 1
+uint32_t NESAdler32(uint32_t adler, const uchar *data, u64 length);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _DEFLATE_H_ */
@@ -0,0 +1,146 @@
+/*
+**	derive.c
+**	nesromtool
+**
+**	base-ROM detection (see derive.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "derive.h"
+#include "hash.h"
+#include "verbosity.h"
+
+typedef struct nesDeriveBank {
+	uint32_t crc32;
+	int index;
+} NESDeriveBank;
+
+static int NESDeriveBankCompare(const void *a, const void *b) {
+	const NESDeriveBank *x = (const NESDeriveBank*)a;
+	const NESDeriveBank *y = (const NESDeriveBank*)b;
+	
+	if (x->crc32 != y->crc32) return (x->crc32 < y->crc32) ? -1 : 1;
+	return x->index - y->index;
+}
+
+static int NESDeriveMatchingRegion(NESRom *hack, NESRom *base, NESBankType bank_type) {
+	/*
+	**	sorts the base's bank CRCs, then looks each hack bank up in them
+	**	the memcmp() makes a match exact
+	*/
+	
+	int hack_count = (bank_type == nes_prg_bank) ? hack->prg_count : hack->chr_count;
+	int base_count = (bank_type == nes_prg_bank) ? base->prg_count : base->chr_count;
+	u64 length = NESRomBankLength(bank_type);
+	int matching = 0;
+	int i = 0, j = 0;
+	
+	if (!hack_count || !base_count) return 0;
+	
+	NESDeriveBank *banks = (NESDeriveBank*)malloc(sizeof(NESDeriveBank) * base_count);
+	int count = 0;
+	
+	for (i = 0; i < base_count; i++) {
+		uchar *bank = NESRomGetBank(base, bank_type, i);
+		if (!bank) continue;
+		
+		banks[count].crc32 = crc32_update(0, bank, length);
+		banks[count].index = i;
+		count++;
+	}
+	
+	qsort(banks, count, sizeof(NESDeriveBank), NESDeriveBankCompare);
+	
+	for (i = 0; i < hack_count; i++) {
+		uchar *bank = NESRomGetBank(hack, bank_type, i);
+		if (!bank) continue;
+		
+		uint32_t crc = crc32_update(0, bank, length);
+		
+		//first bank with this CRC
+		int low = 0, high = count;
+		while (low < high) {
+			int middle = low + ((high - low) / 2);
+			if (banks[middle].crc32 < crc) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		
+		for (j = low; j < count && banks[j].crc32 == crc; j++) {
+			if (memcmp(bank, NESRomGetBank(base, bank_type, banks[j].index), length) == 0) {
+				matching++;
+				break;
+			}
+		}
+	}
+	
+	free(banks);
+	
+	return matching;
+}
+
+int NESDeriveMatchingBanks(NESRom *hack, NESRom *base) {
+	return NESDeriveMatchingRegion(hack, base, nes_prg_bank) + NESDeriveMatchingRegion(hack, base, nes_chr_bank);
+}
+
+static bool NESDeriveBetter(NESDeriveBase *a, NESDeriveBase *b) {
+	/*
+	**	true if a is a better base than b
+	*/
+	
+	if (b->index < 0) return true;
+	if (a->matching_banks != b->matching_banks) return a->matching_banks > b->matching_banks;
+	if (a->in_dat != b->in_dat) return a->in_dat;
+	
+	return a->similarity > b->similarity;
+}
+
+bool NESDeriveFindBase(NESCatalog *catalog, NESDatIndex *dat, NESRom *hack, NESMinHash *signature, long long skip, NESDeriveBase *base) {
+	/*
+	**	returns false if there were no candidates
+	*/
+	
+	u64 match_count = 0;
+	u64 i = 0;
+	uint32_t crc = hack->data ? crc32_update(0, hack->data, hack->size) : 0;
+	
+	memset(base, 0, sizeof(NESDeriveBase));
+	base->index = -1;
+	base->banks = hack->prg_count + hack->chr_count;
+	
+	NESSimilarMatch *matches = NESSimilarFind(catalog->bands, NESCatalogMinHashes(catalog), catalog->count, signature, NES_DERIVE_MIN_SIMILARITY, skip, &match_count);
+	
+	for (i = 0; i < match_count && i < NES_DERIVE_CANDIDATES; i++) {
+		u64 index = matches[i].index;
+		NESDeriveBase candidate;
+		NESRom *rom = NULL;
+		
+		//a copy of the hack isn't its base
+		if (NESCatalogGet64(catalog, catalog_size, index) == hack->size && NESCatalogGet32(catalog, catalog_crc32, index) == crc) continue;
+		
+		if (!(rom = NESRomOpen(NESCatalogPath(catalog, index)))) {
+			v_printf(VERBOSE_NOTICE, "%s: can't open; skipping it", NESCatalogPath(catalog, index));
+			continue;
+		}
+		
+		candidate.index = index;
+		candidate.banks = base->banks;
+		candidate.matching_banks = NESDeriveMatchingBanks(hack, rom);
+		candidate.similarity = matches[i].similarity;
+		candidate.in_dat = dat && NESDatIndexFind(dat, NESCatalogBytes(catalog, catalog_payload_sha1, index)) != NULL;
+		
+		NESRomClose(rom);
+		
+		v_printf(VERBOSE_DEBUG, "candidate %s: %d of %d banks%s", NESCatalogPath(catalog, index), candidate.matching_banks, candidate.banks, candidate.in_dat ? " (in DAT)" : "");
+		
+		if (NESDeriveBetter(&candidate, base)) *base = candidate;
+	}
+	
+	free(matches);
+	
+	return base->index >= 0;
+}
@@ -0,0 +1,48 @@
+/*
+**	derive.h
+**	nesromtool
+**
+**	finding the clean ROM a hack was made from, so the hack can be kept as a patch against it
+**
+**	the catalog's similarity index (see similar.h) narrows the library down to a few candidates;
+**	each one is then opened and scored by how many of the hack's PRG and CHR banks it holds
+**	byte for byte (anywhere in the same region, since expanded hacks move banks around).
+**	hacks that touch every bank still get the most similar candidate
+*/
+
+#ifndef _DERIVE_H_
+#define _DERIVE_H_
+
+#include "types.h"
+#include "nesrom.h"
+#include "catalog.h"
+#include "dat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_DERIVE_CANDIDATES			16			/* most similar entries whose banks get compared */
+#define NES_DERIVE_MIN_SIMILARITY		0.1
+
+typedef struct nesDeriveBase {
+	long long index;						/* the catalog entry, or -1 if there were no candidates */
+	int banks;								/* PRG + CHR banks in the hack */
+	int matching_banks;						/* hack banks that are also in the base */
+	double similarity;						/* from the signatures */
+	bool in_dat;							/* the base's payload is a known dump */
+} NESDeriveBase;
+
+//counts the banks of hack that also appear, byte for byte, in the same region of base
+int NESDeriveMatchingBanks(NESRom *hack, NESRom *base);
+
+//picks the best base for a mapped ROM from catalog: the most matching banks wins,
+//then one the DAT knows (if one is given), then the most similar
+//skip is the hack's own entry (-1 if it isn't in the catalog); entries with the same contents are skipped too
+bool NESDeriveFindBase(NESCatalog *catalog, NESDatIndex *dat, NESRom *hack, NESMinHash *signature, long long skip, NESDeriveBase *base);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _DERIVE_H_ */
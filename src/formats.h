@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include "nesutils.h"
+#include "sheet.h"
 #include <stdio.h>
 
 #ifdef __cplusplus
@@ -11,7 +12,10 @@ extern "C" {
 
 int NESWriteTileAsNative(FILE *ofile, char *data, int data_size);
 int NESWriteTileAsRaw(FILE *ofile, char *data, int data_size, NESSpriteOrder order);
-int NESWriteTileAsHTML(FILE *ofile, char *data, int data_size, NESSpriteOrder order);
+
+//tiles as an image sheet, columns tiles wide, written by one of the sheet writers (NESSheetWritePng(), ...)
+//threads is how many threads the writer may use; returns 1 on success, 0 on error
+int NESWriteTileAsImage(FILE *ofile, char *data, int data_size, int columns, NESSheetWriter writer, int threads);
 
 #ifdef __cplusplus
 };
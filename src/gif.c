@@ -0,0 +1,315 @@
+/*
+**	gif.c
+**	nesromtool
+**
+**	GIF encoding (see gif.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "gif.h"
+#include "verbosity.h"
+
+#define NES_GIF_MAX_CODES				4096		/* 12-bit codes */
+#define NES_GIF_HASH_SIZE				8191		/* prime, about twice NES_GIF_MAX_CODES */
+#define NES_GIF_BLOCK_LENGTH			255			/* most bytes in a data sub-block */
+
+#define NES_GIF_DISPOSE_NONE			(1 << 2)	/* leave each frame in place for the next to draw over */
+
+//the state of one frame's LZW stream
+typedef struct nesGifEncoder {
+	FILE *ofile;
+	int32_t keys[NES_GIF_HASH_SIZE];		/* (prefix code << 8 | pixel) + 1, 0 for an empty slot */
+	uint16_t codes[NES_GIF_HASH_SIZE];
+	int next_code;
+	int code_size;
+	uint32_t bits;							/* pending output, least significant bit first */
+	int bit_count;
+	uchar block[NES_GIF_BLOCK_LENGTH + 1];	/* length byte, then the data */
+	bool failed;
+} NESGifEncoder;
+
+#pragma mark *** Encoding ***
+
+static void NESGifFlushBlock(NESGifEncoder *encoder) {
+	if (encoder->block[0] == 0) return;
+	
+	if (fwrite(encoder->block, 1, encoder->block[0] + 1, encoder->ofile) != (size_t)encoder->block[0] + 1) {
+		encoder->failed = true;
+	}
+	
+	encoder->block[0] = 0;
+}
+
+static void NESGifPutCode(NESGifEncoder *encoder, int code) {
+	encoder->bits |= (uint32_t)code << encoder->bit_count;
+	encoder->bit_count += encoder->code_size;
+	
+	while (encoder->bit_count >= 8) {
+		encoder->block[++encoder->block[0]] = encoder->bits & 0xFF;
+		encoder->bits >>= 8;
+		encoder->bit_count -= 8;
+		
+		if (encoder->block[0] == NES_GIF_BLOCK_LENGTH) NESGifFlushBlock(encoder);
+	}
+}
+
+static void NESGifResetTable(NESGifEncoder *encoder, int depth) {
+	memset(encoder->keys, 0, sizeof(encoder->keys));
+	encoder->next_code = (1 << depth) + 2;
+	encoder->code_size = depth + 1;
+}
+
+static bool NESGifCompress(NESGifEncoder *encoder, const uchar *pixels, int stride, int width, int height, int depth) {
+	/*
+	**	LZW over the width x height rectangle at pixels (rows stride bytes apart)
+	**	the string table is a hash of (prefix, pixel) pairs. when it fills up a clear code starts it over,
+	**	which costs a little on big noisy images but keeps the encoder simple and its memory fixed
+	*/
+	
+	int clear_code = 1 << depth;
+	int x = 0, y = 0;
+	int prefix = -1;
+	int mask = (1 << depth) - 1;
+	
+	encoder->bits = 0;
+	encoder->bit_count = 0;
+	encoder->block[0] = 0;
+	encoder->failed = false;
+	
+	//the minimum code size, then the codes in sub-blocks
+	if (fputc(depth, encoder->ofile) == EOF) return false;
+	
+	NESGifResetTable(encoder, depth);
+	NESGifPutCode(encoder, clear_code);
+	
+	for (y = 0; y < height; y++) {
+		const uchar *row = pixels + ((u64)y * stride);
+		
+		for (x = 0; x < width; x++) {
+			int pixel = row[x] & mask;
+			
+			if (prefix < 0) {
+				prefix = pixel;
+				continue;
+			}
+			
+			int32_t key = ((prefix << 8) | pixel) + 1;
+			int slot = ((pixel << 12) ^ prefix) % NES_GIF_HASH_SIZE;
+			
+			while (encoder->keys[slot] != 0 && encoder->keys[slot] != key) {
+				if (++slot == NES_GIF_HASH_SIZE) slot = 0;
+			}
+			
+			if (encoder->keys[slot] == key) {
+				prefix = encoder->codes[slot];
+				continue;
+			}
+			
+			NESGifPutCode(encoder, prefix);
+			
+			if (encoder->next_code < NES_GIF_MAX_CODES) {
+				//the decoder widens its codes as soon as the next one it will make no longer fits
+				if (encoder->next_code == (1 << encoder->code_size)) encoder->code_size++;
+				
+				encoder->keys[slot] = key;
+				encoder->codes[slot] = encoder->next_code++;
+			} else {
+				NESGifPutCode(encoder, clear_code);
+				NESGifResetTable(encoder, depth);
+			}
+			
+			prefix = pixel;
+		}
+	}
+	
+	if (prefix >= 0) NESGifPutCode(encoder, prefix);
+	NESGifPutCode(encoder, clear_code + 1);
+	
+	//the last partial byte, the last block and the (empty) block that ends the data
+	if (encoder->bit_count > 0) {
+		encoder->block[++encoder->block[0]] = encoder->bits & 0xFF;
+		if (encoder->block[0] == NES_GIF_BLOCK_LENGTH) NESGifFlushBlock(encoder);
+	}
+	
+	NESGifFlushBlock(encoder);
+	
+	return !encoder->failed && fputc(0, encoder->ofile) != EOF;
+}
+
+#pragma mark -
+#pragma mark *** Writing ***
+
+static void NESGifPutShort(uchar *p, int value) {
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+}
+
+static bool NESGifWriterFail(NESGifWriter *writer) {
+	if (!writer->failed) {
+		writer->failed = true;
+		writer->error = errno ? errno : EIO;
+	}
+	
+	return false;
+}
+
+NESGifWriter *NESGifWriterOpen(FILE *ofile, int width, int height, const uchar *palette, int palette_count, int delay) {
+	if (!ofile || width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF
+		|| !palette || palette_count <= 0 || palette_count > NES_GIF_MAX_PALETTE) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	NESGifWriter *writer = (NESGifWriter*)calloc(1, sizeof(NESGifWriter));
+	
+	writer->ofile = ofile;
+	writer->width = width;
+	writer->height = height;
+	writer->delay = (delay > 0) ? delay : 0;
+	
+	//the color table is a power of two entries, and LZW codes can't start below 2 bits
+	writer->depth = 2;
+	while ((1 << writer->depth) < palette_count) writer->depth++;
+	
+	int table_size = 1 << writer->depth;
+	uchar header[13 + (NES_GIF_MAX_PALETTE * 3)];
+	
+	memcpy(header, "GIF89a", 6);
+	NESGifPutShort(header + 6, width);
+	NESGifPutShort(header + 8, height);
+	header[10] = 0x80 | ((writer->depth - 1) << 4) | (writer->depth - 1);		//global color table, its size
+	header[11] = 0;																//background color
+	header[12] = 0;																//square pixels
+	
+	//unused entries are black
+	memset(header + 13, 0, table_size * 3);
+	memcpy(header + 13, palette, palette_count * 3);
+	
+	if (fwrite(header, 1, 13 + (table_size * 3), ofile) != (size_t)(13 + (table_size * 3))) {
+		NESGifWriterFail(writer);
+	}
+	
+	if (writer->delay) {
+		//the NETSCAPE2.0 extension: loop forever
+		static const uchar loop[19] = { 0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0 };
+		
+		if (fwrite(loop, 1, sizeof(loop), ofile) != sizeof(loop)) NESGifWriterFail(writer);
+		
+		writer->previous = (uchar*)malloc((u64)width * height);
+	}
+	
+	return writer;
+}
+
+static void NESGifChangedRect(NESGifWriter *writer, const uchar *pixels, int *left, int *top, int *width, int *height) {
+	/*
+	**	the smallest rectangle holding every pixel that differs from the previous frame
+	**	an unchanged frame still needs a pixel to carry its delay
+	*/
+	
+	int x = 0, y = 0;
+	int min_x = writer->width, max_x = -1;
+	int min_y = writer->height, max_y = -1;
+	
+	for (y = 0; y < writer->height; y++) {
+		const uchar *row = pixels + ((u64)y * writer->width);
+		const uchar *old = writer->previous + ((u64)y * writer->width);
+		
+		if (memcmp(row, old, writer->width) == 0) continue;
+		
+		if (y < min_y) min_y = y;
+		max_y = y;
+		
+		for (x = 0; x < min_x && row[x] == old[x]; x++);
+		if (x < min_x) min_x = x;
+		
+		for (x = writer->width - 1; x > max_x && row[x] == old[x]; x--);
+		if (x > max_x) max_x = x;
+	}
+	
+	if (max_y < 0) {
+		min_x = max_x = 0;
+		min_y = max_y = 0;
+	}
+	
+	*left = min_x;
+	*top = min_y;
+	*width = max_x - min_x + 1;
+	*height = max_y - min_y + 1;
+}
+
+bool NESGifWriterAddFrame(NESGifWriter *writer, const uchar *pixels) {
+	int left = 0, top = 0;
+	int width = writer->width, height = writer->height;
+	
+	if (writer->failed) return false;
+	
+	if (!writer->delay && writer->frame_count > 0) {
+		//a still image only gets the one
+		errno = EINVAL;
+		return NESGifWriterFail(writer);
+	}
+	
+	if (writer->delay) {
+		uchar control[8] = { 0x21, 0xF9, 4, NES_GIF_DISPOSE_NONE, 0, 0, 0, 0 };
+		
+		NESGifPutShort(control + 4, writer->delay);
+		
+		if (fwrite(control, 1, sizeof(control), writer->ofile) != sizeof(control)) return NESGifWriterFail(writer);
+		
+		if (writer->frame_count > 0) NESGifChangedRect(writer, pixels, &left, &top, &width, &height);
+	}
+	
+	uchar descriptor[10];
+	
+	descriptor[0] = 0x2C;
+	NESGifPutShort(descriptor + 1, left);
+	NESGifPutShort(descriptor + 3, top);
+	NESGifPutShort(descriptor + 5, width);
+	NESGifPutShort(descriptor + 7, height);
+	descriptor[9] = 0;						//no local color table, not interlaced
+	
+	if (fwrite(descriptor, 1, sizeof(descriptor), writer->ofile) != sizeof(descriptor)) return NESGifWriterFail(writer);
+	
+	NESGifEncoder *encoder = (NESGifEncoder*)malloc(sizeof(NESGifEncoder));
+	encoder->ofile = writer->ofile;
+	
+	bool ok = NESGifCompress(encoder, pixels + ((u64)top * writer->width) + left, writer->width, width, height, writer->depth);
+	
+	free(encoder);
+	
+	if (!ok) return NESGifWriterFail(writer);
+	
+	v_printf(VERBOSE_DEBUG, "gif: frame %d, %dx%d at %d,%d", writer->frame_count, width, height, left, top);
+	
+	if (writer->previous) memcpy(writer->previous, pixels, (u64)writer->width * writer->height);
+	writer->frame_count++;
+	
+	return true;
+}
+
+bool NESGifWriterFinish(NESGifWriter *writer) {
+	if (!writer->failed && fputc(0x3B, writer->ofile) == EOF) NESGifWriterFail(writer);
+	
+	bool ok = !writer->failed;
+	int error = writer->error;
+	
+	free(writer->previous);
+	free(writer);
+	
+	if (!ok) errno = error;
+	
+	return ok;
+}
+
+bool NESWriteGif(FILE *ofile, const uchar *pixels, int width, int height, const uchar *palette, int palette_count) {
+	NESGifWriter *writer = NESGifWriterOpen(ofile, width, height, palette, palette_count, 0);
+	if (!writer) return false;
+	
+	NESGifWriterAddFrame(writer, pixels);
+	
+	return NESGifWriterFinish(writer);
+}
@@ -0,0 +1,56 @@
+/*
+**	gif.h
+**	nesromtool
+**
+**	a self-contained GIF89a writer: LZW-compressed palette images, still or animated
+**
+**	frames are written as they are added, so an animation never has more than the frame being
+**	added and the one before it in memory. a frame only carries the rectangle that changed since
+**	the one before it, which is usually a small part of a bank sheet when a mapper swaps banks
+*/
+
+#ifndef _GIF_H_
+#define _GIF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_GIF_MAX_PALETTE				256
+#define NES_GIF_DEFAULT_DELAY			20			/* hundredths of a second between frames */
+
+//an image being written
+typedef struct nesGifWriter {
+	FILE *ofile;
+	int width;
+	int height;
+	int depth;								/* bits per pixel, 2-8 (LZW codes start at depth + 1 bits) */
+	int delay;								/* 0 for a still image */
+	int frame_count;
+	uchar *previous;						/* the last frame added, for working out what changed */
+	bool failed;
+	int error;								/* errno of the first failure */
+} NESGifWriter;
+
+//writes the header and palette_count RGB triples from palette as the global color table
+//delay is hundredths of a second between frames (looping forever), or 0 for a single still image
+NESGifWriter *NESGifWriterOpen(FILE *ofile, int width, int height, const uchar *palette, int palette_count, int delay);
+
+//adds a frame of width * height palette indices
+bool NESGifWriterAddFrame(NESGifWriter *writer, const uchar *pixels);
+
+//writes the trailer; always frees writer; returns false on error (errno is set)
+bool NESGifWriterFinish(NESGifWriter *writer);
+
+//a still image in one call
+bool NESWriteGif(FILE *ofile, const uchar *pixels, int width, int height, const uchar *palette, int palette_count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _GIF_H_ */
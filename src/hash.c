@@ -0,0 +1,737 @@
+/*
+**	hash.c
+**	nesromtool
+**
+**	content hashes for ROM files (see hash.h)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "verbosity.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NES_HASH_X86 1
+#include <immintrin.h>
+#endif
+
+#define CRC32_POLYNOMIAL		0xEDB88320	/* reflected 0x04C11DB7 */
+#define CRC32_FOLD_MIN			64			/* the folding kernel needs at least one 64-byte block */
+
+#define ROL32(x, n)				(((x) << (n)) | ((x) >> (32 - (n))))
+
+//kernels work on the raw (not inverted) CRC register
+typedef uint32_t (*CRC32Kernel)(uint32_t crc, const uchar *data, size_t length);
+typedef void (*HashBlockKernel)(uint32_t *state, const uchar *data, size_t blocks);
+
+static CRC32Kernel crc32_fold_kernel = NULL;
+static HashBlockKernel sha1_block_kernel = NULL;
+static char hash_kernels[64] = "";
+static pthread_once_t hash_kernels_once = PTHREAD_ONCE_INIT;
+
+static void hash_pick_kernels();
+
+#pragma mark *** CRC-32 ***
+
+//slicing-by-8 tables: crc32_table[k][n] is the CRC of byte n followed by k zero bytes
+static uint32_t crc32_table[8][256];
+
+static void crc32_build_table() {
+	uint32_t i = 0;
+	int j = 0;
+	
+	for (i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0);
+		}
+		crc32_table[0][i] = crc;
+	}
+	
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^ crc32_table[0][crc32_table[j - 1][i] & 0xFF];
+		}
+	}
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const uchar *data, size_t length) {
+	/*
+	**	8 bytes per step, then a byte at a time for the tail
+	*/
+	
+	while (length >= 8) {
+		uint32_t lo = (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+		uint32_t hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+		
+		lo ^= crc;
+		crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF]
+			^ crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24]
+			^ crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF]
+			^ crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+		
+		data += 8;
+		length -= 8;
+	}
+	
+	while (length--) {
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+	}
+	
+	return crc;
+}
+
+#ifdef NES_HASH_X86
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uchar *data, size_t length) {
+	/*
+	**	carry-less multiply folding ("Fast CRC Computation for Generic Polynomials Using PCLMULQDQ", Intel)
+	**	folds 4 x 128 bits at a time, then down to 128, then Barrett-reduces to 32
+	**	length has to be a multiple of 16, and at least 64
+	*/
+	
+	static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+	
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+	
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+	
+	data += 64;
+	length -= 64;
+	
+	//fold 64 bytes at a time
+	while (length >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		
+		y5 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+		
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+		
+		data += 64;
+		length -= 64;
+	}
+	
+	//fold the 4 lanes into one
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	
+	//then 16 bytes at a time for what's left
+	while (length >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)data);
+		
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		
+		data += 16;
+		length -= 16;
+	}
+	
+	//128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	
+	//Barrett reduction down to 32
+	x0 = _mm_load_si128((const __m128i *)poly);
+	
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif /* NES_HASH_X86 */
+
+uint32_t crc32_update(uint32_t crc, const uchar *data, size_t length) {
+	/*
+	**	the folding kernel takes the 16-byte-multiple front of anything big enough;
+	**	the table does the rest
+	*/
+	
+	pthread_once(&hash_kernels_once, hash_pick_kernels);
+	
+	crc = ~crc;
+	
+	if (crc32_fold_kernel && length >= CRC32_FOLD_MIN) {
+		size_t fold_length = length & ~(size_t)15;
+		
+		crc = crc32_fold_kernel(crc, data, fold_length);
+		data += fold_length;
+		length -= fold_length;
+	}
+	
+	return ~crc32_slice8(crc, data, length);
+}
+
+#pragma mark -
+#pragma mark *** MD5 / SHA-1 buffering ***
+
+static void hash_buffer_update(uint32_t *state, uint64_t *total, uchar *buffer, const uchar *data, size_t length, HashBlockKernel kernel) {
+	/*
+	**	feeds whole blocks straight from data, keeping partial ones in buffer
+	*/
+	
+	size_t used = *total % HASH_BLOCK_LENGTH;
+	
+	*total += length;
+	
+	if (used) {
+		size_t fill = HASH_BLOCK_LENGTH - used;
+		
+		if (length < fill) {
+			memcpy(buffer + used, data, length);
+			return;
+		}
+		
+		memcpy(buffer + used, data, fill);
+		kernel(state, buffer, 1);
+		data += fill;
+		length -= fill;
+	}
+	
+	if (length >= HASH_BLOCK_LENGTH) {
+		kernel(state, data, length / HASH_BLOCK_LENGTH);
+		data += length - (length % HASH_BLOCK_LENGTH);
+		length %= HASH_BLOCK_LENGTH;
+	}
+	
+	memcpy(buffer, data, length);
+}
+
+static void hash_buffer_final(uint32_t *state, uint64_t total, uchar *buffer, HashBlockKernel kernel, bool big_endian) {
+	/*
+	**	appends 0x80, zeros, and the bit count (little-endian for MD5, big-endian for SHA-1)
+	*/
+	
+	size_t used = total % HASH_BLOCK_LENGTH;
+	uint64_t bits = total * 8;
+	int i = 0;
+	
+	buffer[used++] = 0x80;
+	
+	if (used > HASH_BLOCK_LENGTH - 8) {
+		memset(buffer + used, 0, HASH_BLOCK_LENGTH - used);
+		kernel(state, buffer, 1);
+		used = 0;
+	}
+	
+	memset(buffer + used, 0, HASH_BLOCK_LENGTH - 8 - used);
+	
+	for (i = 0; i < 8; i++) {
+		buffer[big_endian ? (HASH_BLOCK_LENGTH - 1 - i) : (HASH_BLOCK_LENGTH - 8 + i)] = (uchar)(bits >> (i * 8));
+	}
+	
+	kernel(state, buffer, 1);
+}
+
+#pragma mark -
+#pragma mark *** MD5 ***
+
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uchar md5_shift[4][4] = {
+	{ 7, 12, 17, 22 },
+	{ 5, 9, 14, 20 },
+	{ 4, 11, 16, 23 },
+	{ 6, 10, 15, 21 }
+};
+
+static void md5_blocks(uint32_t *state, const uchar *data, size_t blocks) {
+	uint32_t w[16];
+	int i = 0;
+	
+	for (; blocks; blocks--, data += HASH_BLOCK_LENGTH) {
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		
+		for (i = 0; i < 16; i++) {
+			w[i] = (uint32_t)data[i * 4] | ((uint32_t)data[(i * 4) + 1] << 8) | ((uint32_t)data[(i * 4) + 2] << 16) | ((uint32_t)data[(i * 4) + 3] << 24);
+		}
+		
+		for (i = 0; i < 64; i++) {
+			uint32_t f = 0;
+			int g = 0;
+			
+			switch (i / 16) {
+				case 0:		f = (b & c) | (~b & d);		g = i;					break;
+				case 1:		f = (d & b) | (~d & c);		g = ((5 * i) + 1) % 16;	break;
+				case 2:		f = b ^ c ^ d;				g = ((3 * i) + 5) % 16;	break;
+				default:	f = c ^ (b | ~d);			g = (7 * i) % 16;		break;
+			}
+			
+			f += a + md5_k[i] + w[g];
+			a = d;
+			d = c;
+			c = b;
+			b += ROL32(f, md5_shift[i / 16][i % 4]);
+		}
+		
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+}
+
+void md5_init(MD5Context *context) {
+	context->state[0] = 0x67452301;
+	context->state[1] = 0xefcdab89;
+	context->state[2] = 0x98badcfe;
+	context->state[3] = 0x10325476;
+	context->length = 0;
+}
+
+void md5_update(MD5Context *context, const uchar *data, size_t length) {
+	hash_buffer_update(context->state, &(context->length), context->buffer, data, length, md5_blocks);
+}
+
+void md5_final(MD5Context *context, uchar *digest) {
+	int i = 0;
+	
+	hash_buffer_final(context->state, context->length, context->buffer, md5_blocks, false);
+	
+	for (i = 0; i < MD5_DIGEST_LENGTH; i++) {
+		digest[i] = (uchar)(context->state[i / 4] >> ((i % 4) * 8));
+	}
+}
+
+#pragma mark -
+#pragma mark *** SHA-1 ***
+
+static void sha1_blocks_scalar(uint32_t *state, const uchar *data, size_t blocks) {
+	uint32_t w[80];
+	int i = 0;
+	
+	for (; blocks; blocks--, data += HASH_BLOCK_LENGTH) {
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+		
+		for (i = 0; i < 16; i++) {
+			w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[(i * 4) + 1] << 16) | ((uint32_t)data[(i * 4) + 2] << 8) | (uint32_t)data[(i * 4) + 3];
+		}
+		for (; i < 80; i++) {
+			uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+			w[i] = ROL32(x, 1);
+		}
+		
+		for (i = 0; i < 80; i++) {
+			uint32_t f = 0;
+			
+			if (i < 20) {
+				f = ((b & c) | (~b & d)) + 0x5a827999;
+			} else if (i < 40) {
+				f = (b ^ c ^ d) + 0x6ed9eba1;
+			} else if (i < 60) {
+				f = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+			} else {
+				f = (b ^ c ^ d) + 0xca62c1d6;
+			}
+			
+			f += ROL32(a, 5) + e + w[i];
+			e = d;
+			d = c;
+			c = ROL32(b, 30);
+			b = a;
+			a = f;
+		}
+		
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+#ifdef NES_HASH_X86
+
+/*
+**	SHA-NI: 4 rounds per sha1rnds4; the message schedule for group g (g >= 4) is
+**	msg2(msg1(W[g-4], W[g-3]) ^ W[g-2], W[g-1]), kept in a ring of 4 registers
+*/
+#define SHA1NI_SCHEDULE(g)			W[(g) & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(W[(g) & 3], W[((g) + 1) & 3]), W[((g) + 2) & 3]), W[((g) + 3) & 3])
+#define SHA1NI_ROUNDS(g, EA, EB)	EA = _mm_sha1nexte_epu32(EA, W[(g) & 3]); EB = abcd; abcd = _mm_sha1rnds4_epu32(abcd, EA, (g) / 5)
+#define SHA1NI_GROUP(g, EA, EB)		SHA1NI_SCHEDULE(g); SHA1NI_ROUNDS(g, EA, EB)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha1_blocks_shani(uint32_t *state, const uchar *data, size_t blocks) {
+	const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+	__m128i e1;
+	__m128i W[4];
+	
+	for (; blocks; blocks--, data += HASH_BLOCK_LENGTH) {
+		__m128i abcd_save = abcd;
+		__m128i e0_save = e0;
+		
+		W[0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), byte_swap);
+		W[1] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), byte_swap);
+		W[2] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), byte_swap);
+		W[3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), byte_swap);
+		
+		//rounds 0-15 use the message as-is
+		e0 = _mm_add_epi32(e0, W[0]);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		SHA1NI_ROUNDS(1, e1, e0);
+		SHA1NI_ROUNDS(2, e0, e1);
+		SHA1NI_ROUNDS(3, e1, e0);
+		
+		//rounds 16-79
+		SHA1NI_GROUP(4, e0, e1);
+		SHA1NI_GROUP(5, e1, e0);
+		SHA1NI_GROUP(6, e0, e1);
+		SHA1NI_GROUP(7, e1, e0);
+		SHA1NI_GROUP(8, e0, e1);
+		SHA1NI_GROUP(9, e1, e0);
+		SHA1NI_GROUP(10, e0, e1);
+		SHA1NI_GROUP(11, e1, e0);
+		SHA1NI_GROUP(12, e0, e1);
+		SHA1NI_GROUP(13, e1, e0);
+		SHA1NI_GROUP(14, e0, e1);
+		SHA1NI_GROUP(15, e1, e0);
+		SHA1NI_GROUP(16, e0, e1);
+		SHA1NI_GROUP(17, e1, e0);
+		SHA1NI_GROUP(18, e0, e1);
+		SHA1NI_GROUP(19, e1, e0);
+		
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+	
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#endif /* NES_HASH_X86 */
+
+void sha1_init(SHA1Context *context) {
+	pthread_once(&hash_kernels_once, hash_pick_kernels);
+	
+	context->state[0] = 0x67452301;
+	context->state[1] = 0xefcdab89;
+	context->state[2] = 0x98badcfe;
+	context->state[3] = 0x10325476;
+	context->state[4] = 0xc3d2e1f0;
+	context->length = 0;
+}
+
+void sha1_update(SHA1Context *context, const uchar *data, size_t length) {
+	hash_buffer_update(context->state, &(context->length), context->buffer, data, length, sha1_block_kernel);
+}
+
+void sha1_final(SHA1Context *context, uchar *digest) {
+	int i = 0;
+	
+	hash_buffer_final(context->state, context->length, context->buffer, sha1_block_kernel, true);
+	
+	for (i = 0; i < SHA1_DIGEST_LENGTH; i++) {
+		digest[i] = (uchar)(context->state[i / 4] >> ((3 - (i % 4)) * 8));
+	}
+}
+
+#pragma mark -
+#pragma mark *** DISPATCH ***
+
+static void hash_pick_kernels() {
+	/*
+	**	runs once (through pthread_once), so the CRC table is built before any thread uses it
+	*/
+	
+	char *crc_name = "table";
+	char *sha1_name = "scalar";
+	
+	crc32_build_table();
+	crc32_fold_kernel = NULL;
+	sha1_block_kernel = sha1_blocks_scalar;
+
+#ifdef NES_HASH_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		crc32_fold_kernel = crc32_pclmul;
+		crc_name = "pclmul";
+	}
+	
+	//there's no __builtin_cpu_supports() for SHA-NI, so ask cpuid (leaf 7, EBX bit 29)
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+	__asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+	
+	if (eax >= 7) {
+		__asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+		
+		if ((ebx & (1 << 29)) && __builtin_cpu_supports("sse4.1")) {
+			sha1_block_kernel = sha1_blocks_shani;
+			sha1_name = "sha-ni";
+		}
+	}
+#endif
+
+	snprintf(hash_kernels, sizeof(hash_kernels), "crc32:%s sha1:%s", crc_name, sha1_name);
+	
+	v_printf(VERBOSE_TRACE, "Hash kernels: %s", hash_kernels);
+}
+
+char *hash_kernel_name() {
+	pthread_once(&hash_kernels_once, hash_pick_kernels);
+	
+	return hash_kernels;
+}
+
+char *hex_digest(char *buf, const uchar *digest, int length) {
+	static const char digits[] = "0123456789abcdef";
+	int i = 0;
+	
+	for (i = 0; i < length; i++) {
+		buf[i * 2] = digits[digest[i] >> 4];
+		buf[(i * 2) + 1] = digits[digest[i] & 0x0F];
+	}
+	buf[length * 2] = '\0';
+	
+	return buf;
+}
+
+#pragma mark -
+#pragma mark *** ROMs ***
+
+typedef enum {
+	hash_crc32 = 0,
+	hash_md5,
+	hash_sha1
+} HashAlgorithm;
+
+typedef union hashContext {
+	uint32_t crc32;
+	MD5Context md5;
+	SHA1Context sha1;
+} HashContext;
+
+//one digest over a mapped file: the whole thing into hashes->file, the payload into hashes->payload
+typedef struct hashTask {
+	HashAlgorithm algorithm;
+	const uchar *data;
+	u64 size;
+	u64 payload_offset;
+	u64 payload_length;
+	NESRomHashes *hashes;
+} HashTask;
+
+static void hash_context_init(HashAlgorithm algorithm, HashContext *context) {
+	switch (algorithm) {
+		case hash_crc32:	context->crc32 = 0;				break;
+		case hash_md5:		md5_init(&(context->md5));		break;
+		case hash_sha1:		sha1_init(&(context->sha1));	break;
+	}
+}
+
+static void hash_context_update(HashAlgorithm algorithm, HashContext *context, const uchar *data, u64 length) {
+	switch (algorithm) {
+		case hash_crc32:	context->crc32 = crc32_update(context->crc32, data, length);	break;
+		case hash_md5:		md5_update(&(context->md5), data, length);						break;
+		case hash_sha1:		sha1_update(&(context->sha1), data, length);					break;
+	}
+}
+
+static void hash_context_final(HashAlgorithm algorithm, HashContext *context, NESDigest *digest) {
+	switch (algorithm) {
+		case hash_crc32:	digest->crc32 = context->crc32;				break;
+		case hash_md5:		md5_final(&(context->md5), digest->md5);		break;
+		case hash_sha1:		sha1_final(&(context->sha1), digest->sha1);	break;
+	}
+}
+
+static void *hash_task_run(void *arg) {
+	/*
+	**	the payload goes to both contexts a chunk at a time, so it's only pulled in from the mapping once
+	*/
+	
+	HashTask *task = (HashTask *)arg;
+	HashContext file;
+	HashContext payload;
+	u64 position = task->payload_offset;
+	u64 payload_end = task->payload_offset + task->payload_length;
+	
+	hash_context_init(task->algorithm, &file);
+	hash_context_init(task->algorithm, &payload);
+	
+	hash_context_update(task->algorithm, &file, task->data, task->payload_offset);
+	
+	while (position < payload_end) {
+		u64 length = payload_end - position;
+		if (length > NES_HASH_CHUNK_LENGTH) length = NES_HASH_CHUNK_LENGTH;
+		
+		hash_context_update(task->algorithm, &file, task->data + position, length);
+		hash_context_update(task->algorithm, &payload, task->data + position, length);
+		position += length;
+	}
+	
+	hash_context_update(task->algorithm, &file, task->data + payload_end, task->size - payload_end);
+	
+	hash_context_final(task->algorithm, &file, &(task->hashes->file));
+	hash_context_final(task->algorithm, &payload, &(task->hashes->payload));
+	
+	return NULL;
+}
+
+void NESRomPayload(NESRom *rom, u64 *offset, u64 *length) {
+	/*
+	**	the payload runs from the first PRG bank to the end of the CHR data
+	**	(truncated files just hash what's there)
+	*/
+	
+	u64 start = rom->dir.trainer_offset + rom->dir.trainer_length;
+	u64 end = rom->dir.title_offset;
+	
+	if (end > rom->size) end = rom->size;
+	if (start > end) start = end;
+	
+	*offset = start;
+	*length = end - start;
+}
+
+void NESRomComputeHashes(NESRom *rom, NESRomHashes *hashes) {
+	/*
+	**	hashes a mapped ROM
+	**	for big files, MD5 and SHA-1 each get a thread while this one does the CRC
+	*/
+	
+	HashTask tasks[3];
+	pthread_t threads[3];
+	bool threaded[3] = { false, false, false };
+	u64 offset = 0;
+	u64 length = 0;
+	int i = 0;
+	
+	memset(hashes, 0, sizeof(NESRomHashes));
+	
+	if (!rom) return;
+	
+	NESRomPayload(rom, &offset, &length);
+	
+	for (i = hash_crc32; i <= hash_sha1; i++) {
+		tasks[i].algorithm = i;
+		tasks[i].data = rom->data;
+		tasks[i].size = rom->data ? rom->size : 0;
+		tasks[i].payload_offset = rom->data ? offset : 0;
+		tasks[i].payload_length = rom->data ? length : 0;
+		tasks[i].hashes = hashes;
+	}
+	
+	//each task writes different fields of hashes, so they can share it
+	if (rom->data && rom->size >= NES_HASH_THREAD_MIN) {
+		for (i = hash_md5; i <= hash_sha1; i++) {
+			threaded[i] = (pthread_create(&threads[i], NULL, hash_task_run, &tasks[i]) == 0);
+		}
+	}
+	
+	for (i = hash_crc32; i <= hash_sha1; i++) {
+		if (!threaded[i]) hash_task_run(&tasks[i]);
+	}
+	
+	for (i = hash_md5; i <= hash_sha1; i++) {
+		if (threaded[i]) pthread_join(threads[i], NULL);
+	}
+}
+
+void NESDigestBuffer(NESDigest *digest, const uchar *data, u64 length) {
+	MD5Context md5;
+	SHA1Context sha1;
+	
+	digest->crc32 = crc32_update(0, data, length);
+	
+	md5_init(&md5);
+	md5_update(&md5, data, length);
+	md5_final(&md5, digest->md5);
+	
+	sha1_init(&sha1);
+	sha1_update(&sha1, data, length);
+	sha1_final(&sha1, digest->sha1);
+}
+
+bool NESRomBankDigest(NESRom *rom, NESBankType bank_type, int bank_index, NESDigest *digest) {
+	int count = (bank_type == nes_prg_bank) ? rom->prg_count : rom->chr_count;
+	
+	if (!rom->data || bank_index < 0 || bank_index >= count) return false;
+	
+	u64 start = NESRomBankOffset(rom, bank_type, bank_index);
+	u64 end = NESRomBankOffset(rom, bank_type, bank_index + 1);
+	
+	if (end > rom->size) end = rom->size;
+	if (start >= end) return false;
+	
+	NESDigestBuffer(digest, rom->data + start, end - start);
+	
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+**	hash.h
+**	nesromtool
+**
+**	content hashes for ROM files
+**	CRC-32, MD5 and SHA-1, with PCLMULQDQ and SHA-NI kernels picked at runtime when the CPU has them
+*/
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+#include "nesrom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MD5_DIGEST_LENGTH		16
+#define SHA1_DIGEST_LENGTH		20
+#define HASH_BLOCK_LENGTH		64			/* MD5 and SHA-1 both work on 64-byte blocks */
+
+#define NES_HASH_CHUNK_LENGTH	65536		/* the payload is fed to both the file and payload hashes this much at a time */
+#define NES_HASH_THREAD_MIN		262144		/* files at least this big get MD5 and SHA-1 on their own threads */
+
+//all three digests of some data
+typedef struct nesDigest {
+	uint32_t crc32;
+	uchar md5[MD5_DIGEST_LENGTH];
+	uchar sha1[SHA1_DIGEST_LENGTH];
+} NESDigest;
+
+//the hashes we keep for a ROM
+typedef struct nesRomHashes {
+	NESDigest file;						/* the whole file */
+	NESDigest payload;					/* PRG + CHR data only (no header, trainer or title); what ROM databases key on */
+} NESRomHashes;
+
+typedef struct md5Context {
+	uint32_t state[4];
+	uint64_t length;					/* bytes hashed so far */
+	uchar buffer[HASH_BLOCK_LENGTH];
+} MD5Context;
+
+typedef struct sha1Context {
+	uint32_t state[5];
+	uint64_t length;
+	uchar buffer[HASH_BLOCK_LENGTH];
+} SHA1Context;
+
+//CRC-32 (the zlib/PNG one); start with crc = 0
+uint32_t crc32_update(uint32_t crc, const uchar *data, size_t length);
+
+void md5_init(MD5Context *context);
+void md5_update(MD5Context *context, const uchar *data, size_t length);
+void md5_final(MD5Context *context, uchar *digest);
+
+void sha1_init(SHA1Context *context);
+void sha1_update(SHA1Context *context, const uchar *data, size_t length);
+void sha1_final(SHA1Context *context, uchar *digest);
+
+//name of the kernels that were picked (ie: "crc32:pclmul sha1:sha-ni")
+char *hash_kernel_name();
+
+//lowercase hex; buf must hold (length * 2) + 1 bytes. returns buf
+char *hex_digest(char *buf, const uchar *digest, int length);
+
+//the PRG + CHR region of a mapped ROM (clipped to the file)
+void NESRomPayload(NESRom *rom, u64 *offset, u64 *length);
+
+//hashes the whole file and its payload, reading each byte once per digest
+void NESRomComputeHashes(NESRom *rom, NESRomHashes *hashes);
+
+//all three digests of a buffer
+void NESDigestBuffer(NESDigest *digest, const uchar *data, u64 length);
+
+//digests of one bank of a mapped ROM (whatever of it is in the file); false if the bank isn't there at all
+bool NESRomBankDigest(NESRom *rom, NESBankType bank_type, int bank_index, NESDigest *digest);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _HASH_H_ */
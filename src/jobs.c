@@ -0,0 +1,205 @@
+/*
+**	jobs.c
+**	nesromtool
+**
+**	worker pool for per-file actions (see jobs.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "jobs.h"
+#include "verbosity.h"
+
+static int job_count = 1;
+
+typedef struct jobPool {
+	Job *jobs;
+	int count;
+	JobFunc func;
+	
+	pthread_mutex_t lock;
+	pthread_cond_t changed;			/* signalled when a job finishes or one is printed */
+	int next;						/* next job to hand out */
+	int printed;					/* jobs [0, printed) have been written out */
+	int window;						/* how far next may run ahead of printed */
+} JobPool;
+
+int get_job_count() {
+	return job_count;
+}
+
+void set_job_count(int n) {
+	/*
+	**	sets the number of worker threads
+	**	0 (or less) means one per online CPU
+	*/
+	
+	if (n <= 0) {
+		n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	
+	job_count = (n > 0) ? n : 1;
+}
+
+void job_perror(Job *job, char *path) {
+	fprintf(job->err, "%s: %s\n", path, strerror(errno));
+}
+
+#pragma mark -
+
+static void *job_worker(void *arg) {
+	/*
+	**	takes jobs off the pool in order until there are none left
+	**	won't run more than pool->window jobs ahead of the printer so a single slow file
+	**	can't make us buffer the output of the whole list
+	*/
+	
+	JobPool *pool = (JobPool *)arg;
+	
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->next < pool->count && pool->next >= pool->printed + pool->window) {
+			pthread_cond_wait(&pool->changed, &pool->lock);
+		}
+		
+		if (pool->next >= pool->count) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		
+		Job *job = &(pool->jobs[pool->next++]);
+		pthread_mutex_unlock(&pool->lock);
+		
+		job->out = open_memstream(&(job->out_buf), &(job->out_length));
+		job->err = open_memstream(&(job->err_buf), &(job->err_length));
+		
+		if (!job->out || !job->err) {
+			//no buffers; print straight through rather than lose the file
+			if (job->out) fclose(job->out);
+			if (job->err) fclose(job->err);
+			job->out = stdout;
+			job->err = stderr;
+			job->failed = !pool->func(job);
+			job->out = job->err = NULL;
+		} else {
+			job->failed = !pool->func(job);
+			fclose(job->out);
+			fclose(job->err);
+		}
+		
+		pthread_mutex_lock(&pool->lock);
+		job->done = true;
+		pthread_cond_broadcast(&pool->changed);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	
+	return NULL;
+}
+
+int run_jobs(char **paths, JobFunc func, void *context, int max_jobs) {
+	/*
+	**	runs func over every path, on up to get_job_count() threads
+	**	the main thread does the printing: it waits for each job in turn and
+	**	writes its buffers out, so output is in the same order as paths
+	*/
+	
+	if (!paths || !func) return 0;
+	
+	int count = 0;
+	int failed = 0;
+	int i = 0;
+	
+	while (paths[count]) count++;
+	
+	int threads = job_count;
+	if (max_jobs > 0 && threads > max_jobs) threads = max_jobs;
+	if (threads > count) threads = count;
+	
+	Job *jobs = (Job *)calloc(count ? count : 1, sizeof(Job));
+	
+	for (i = 0; i < count; i++) {
+		jobs[i].index = i;
+		jobs[i].path = paths[i];
+		jobs[i].context = context;
+	}
+	
+	//serial: no buffering, just run them
+	if (threads <= 1) {
+		for (i = 0; i < count; i++) {
+			jobs[i].out = stdout;
+			jobs[i].err = stderr;
+			if (!func(&jobs[i])) failed++;
+		}
+		
+		free(jobs);
+		return failed;
+	}
+	
+	v_printf(VERBOSE_DEBUG, "Running %d jobs on %d threads", count, threads);
+	
+	JobPool pool;
+	pool.jobs = jobs;
+	pool.count = count;
+	pool.func = func;
+	pool.next = 0;
+	pool.printed = 0;
+	pool.window = threads * JOBS_WINDOW_PER_THREAD;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.changed, NULL);
+	
+	pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+	int started = 0;
+	
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&workers[started], NULL, job_worker, &pool) == 0) started++;
+	}
+	
+	if (started == 0) {
+		//couldn't start any threads, so the main thread does all the work before printing any of it
+		pool.window = count;
+		job_worker(&pool);
+	}
+	
+	//print each job as soon as it (and everything before it) is done
+	for (i = 0; i < count; i++) {
+		Job *job = &jobs[i];
+		
+		pthread_mutex_lock(&pool.lock);
+		while (!job->done) {
+			pthread_cond_wait(&pool.changed, &pool.lock);
+		}
+		pthread_mutex_unlock(&pool.lock);
+		
+		if (job->out_length) fwrite(job->out_buf, 1, job->out_length, stdout);
+		if (job->err_length) {
+			fflush(stdout);
+			fwrite(job->err_buf, 1, job->err_length, stderr);
+		}
+		
+		free(job->out_buf);
+		free(job->err_buf);
+		
+		if (job->failed) failed++;
+		
+		pthread_mutex_lock(&pool.lock);
+		pool.printed = i + 1;
+		pthread_cond_broadcast(&pool.changed);
+		pthread_mutex_unlock(&pool.lock);
+	}
+	
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	
+	pthread_cond_destroy(&pool.changed);
+	pthread_mutex_destroy(&pool.lock);
+	free(workers);
+	free(jobs);
+	
+	return failed;
+}
@@ -0,0 +1,58 @@
+/*
+**	jobs.h
+**	nesromtool
+**
+**	runs an action's per-file work on a pool of worker threads
+**	each job prints into its own buffers, which are written out in input order
+**	so the output looks exactly like a serial run
+*/
+
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <stdio.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOBS_WINDOW_PER_THREAD		16		/* finished-but-unprinted jobs allowed per thread before workers wait */
+
+typedef struct job {
+	int index;							/* position in the file list */
+	char *path;							/* the file this job works on */
+	void *context;						/* the action's parsed options (shared between jobs; read-only) */
+
+	FILE *out;							/* print here instead of stdout */
+	FILE *err;							/* print here instead of stderr */
+
+	char *out_buf;						/* what was printed to out/err (when running on the pool) */
+	size_t out_length;
+	char *err_buf;
+	size_t err_length;
+
+	bool done;
+	bool failed;
+} Job;
+
+//returns false if the file failed; jobs print their own error messages
+typedef bool (*JobFunc)(Job *job);
+
+//the -j setting (1 runs everything on the main thread)
+int get_job_count();
+void set_job_count(int n);
+
+//runs func once per path in the NULL-terminated paths list
+//max_jobs caps the thread count for actions whose files can't be processed out of order (0 for no cap)
+//returns the number of jobs that failed
+int run_jobs(char **paths, JobFunc func, void *context, int max_jobs);
+
+//prints "path: strerror(errno)" to the job's error stream
+void job_perror(Job *job, char *path);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _JOBS_H_ */
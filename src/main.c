@@ -17,8 +17,10 @@
 #include "help.h"
 
 #include "patching.h"
+#include "jobs.h"
+#include "palette.h"
+#include "ntsc.h"
 
-extern char color_palette[4];
 char *program_name;
 
 //prototypes
@@ -64,10 +66,41 @@ int main (int argc, char *argv[]) {
 		
 		//set the color palette
 		if ( CHECK_ARG( OPT_COLOR ) ) {
-			printf("COLOR PALETTE NOT YET IMPLEMENTED!!\n");
+			uchar palette[NES_PALETTE_LENGTH * 3];
+			uchar entries[NES_PALETTE_LENGTH];
+			
+			current_arg = GET_NEXT_ARG;
+			if (!current_arg || !NESPaletteParse(palette, entries, current_arg)) {
+				fprintf(stderr, "Argument error: %s expects a palette name or 4 NES palette entries in hex (ie: 0f162736)\n", OPT_COLOR);
+				fprintf(stderr, "Palettes:\n");
+				NESPalettePrintNames(stderr);
+				fprintf(stderr, "\n");
+				exit(EXIT_FAILURE);
+			}
+			set_color_palette(palette, entries);
+			v_printf(VERBOSE_NOTICE, "Palette: %s", current_arg);
 			continue; //go to next iteration of for() loop
 		}
 		
+		//render PNGs like a TV would
+		if ( CHECK_ARG( OPT_NTSC ) ) {
+			set_ntsc_filter(true);
+			v_printf(VERBOSE_NOTICE, "NTSC filter on");
+			continue;
+		}
+		
+		//set the number of worker threads
+		if ( CHECK_ARG( OPT_JOBS ) ) {
+			current_arg = GET_NEXT_ARG;
+			if (!current_arg || current_arg[0] < '0' || current_arg[0] > '9') {
+				fprintf(stderr, "Argument error: %s expects a number of jobs\n\n", OPT_JOBS);
+				exit(EXIT_FAILURE);
+			}
+			set_job_count(atoi(current_arg));
+			v_printf(VERBOSE_NOTICE, "Jobs: %d", get_job_count());
+			continue;
+		}
+		
 		//if we get here, we reached an unknown option
 		printf("UNKNOWN OPTION: %s\n", *argv);
 		exit(EXIT_FAILURE);
@@ -110,6 +143,45 @@ void parse_line(int argc, char **argv) {
 	} else if (strcmp(command, ACTION_PATCH) == 0) {
 		//patch action
 		parse_cli_patch(argv);
+	} else if (strcmp(command, ACTION_CATALOG) == 0) {
+		//catalog action
+		parse_cli_catalog(argv);
+	} else if (strcmp(command, ACTION_QUERY) == 0) {
+		//query action
+		parse_cli_query(argv);
+	} else if (strcmp(command, ACTION_HASH) == 0) {
+		//hash action
+		parse_cli_hash(argv);
+	} else if (strcmp(command, ACTION_DAT) == 0) {
+		//dat action
+		parse_cli_dat(argv);
+	} else if (strcmp(command, ACTION_HEADER) == 0) {
+		//header action
+		parse_cli_header(argv);
+	} else if (strcmp(command, ACTION_VERIFY) == 0) {
+		//verify action
+		parse_cli_verify(argv);
+	} else if (strcmp(command, ACTION_TRIM) == 0) {
+		//trim action
+		parse_cli_trim(argv);
+	} else if (strcmp(command, ACTION_STORE) == 0) {
+		//store action
+		parse_cli_store(argv);
+	} else if (strcmp(command, ACTION_SIMILAR) == 0) {
+		//similar action
+		parse_cli_similar(argv);
+	} else if (strcmp(command, ACTION_DERIVE) == 0) {
+		//derive action
+		parse_cli_derive(argv);
+	} else if (strcmp(command, ACTION_TILES) == 0) {
+		//tiles action
+		parse_cli_tiles(argv);
+	} else if (strcmp(command, ACTION_THUMBNAILS) == 0) {
+		//thumbnails action
+		parse_cli_thumbnails(argv);
+	} else if (strcmp(command, ACTION_VIEW) == 0) {
+		//view action
+		parse_cli_view(argv);
 	} else {
 		//error! unknown command!
 		printf("Unknown command: %s\n\n", command);
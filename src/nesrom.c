@@ -0,0 +1,468 @@
+/*
+**	nesrom.c
+**	nesromtool
+**
+**	memory-mapped ROM handle (see nesrom.h)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "nesrom.h"
+#include "verbosity.h"
+
+static void NESRomBuildDirectory(NESRom *rom);
+
+static NESRom *NESRomMap(int fd, bool owns_fd) {
+	/*
+	**	maps fd and parses the header
+	**	returns NULL if the file can't be stat()ed or mapped
+	*/
+	
+	struct stat st;
+	
+	if (fd < 0 || fstat(fd, &st) != 0) return NULL;
+	
+	NESRom *rom = (NESRom*)calloc(1, sizeof(NESRom));
+	if (!rom) return NULL;
+	
+	rom->fd = fd;
+	rom->owns_fd = owns_fd;
+	rom->size = st.st_size;
+	
+	//mmap() refuses zero-length mappings, so an empty file just has no data
+	if (rom->size > 0) {
+		rom->data = (uchar*)mmap(NULL, rom->size, PROT_READ, MAP_SHARED, fd, 0);
+	
+		if (rom->data == MAP_FAILED) {
+			free(rom);
+			return NULL;
+		}
+	}
+	
+	NESRomParseHeader(rom, rom->data, rom->size);
+	NESRomBuildDirectory(rom);
+	
+	v_printf(VERBOSE_TRACE, "NESRomMap(fd=%d) => %llu bytes, %d PRG, %d CHR", fd, rom->size, rom->prg_count, rom->chr_count);
+	
+	return rom;
+}
+
+NESRom *NESRomOpen(char *path) {
+	/*
+	**	opens and maps the ROM at path
+	**	returns NULL if the file can't be opened (errno is set)
+	*/
+	
+	if (!path) return NULL;
+	
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	
+	NESRom *rom = NESRomMap(fd, true);
+	if (!rom) close(fd);
+	
+	return rom;
+}
+
+NESRom *NESRomOpenFile(FILE *ifile) {
+	/*
+	**	maps an already-open file
+	**	pending writes on ifile are flushed first; ifile must stay open until NESRomClose()
+	*/
+	
+	if (!ifile) return NULL;
+	
+	fflush(ifile);
+	
+	return NESRomMap(fileno(ifile), false);
+}
+
+void NESRomClose(NESRom *rom) {
+	if (!rom) return;
+	
+	if (rom->data) munmap(rom->data, rom->size);
+	if (rom->owns_fd) close(rom->fd);
+	
+	free(rom->dir.prg_offsets);
+	free(rom->dir.chr_offsets);
+	free(rom);
+}
+
+#pragma mark -
+
+static u64 NES2RomSize(int lsb, int msb, u64 unit) {
+	/*
+	**	works out a NES 2.0 PRG/CHR size from its LSB byte and MSB nibble
+	**	either a 12-bit count of units, or (MSB == 0xF) 2^E * (MM * 2 + 1) from the LSB byte EEEEEEMM
+	*/
+	
+	if (msb == NES2_SIZE_EXPONENT_MSB) {
+		int exponent = lsb >> 2;
+		int multiplier = ((lsb & 3) * 2) + 1;
+		
+		//anything that big isn't going to fit in a file anyway
+		if (exponent > 56) return ~(u64)0;
+		
+		return ((u64)1 << exponent) * multiplier;
+	}
+	
+	return (((u64)msb << 8) | lsb) * unit;
+}
+
+static u64 NES2RamSize(int shift_count) {
+	/*
+	**	NES 2.0 RAM sizes are stored as shift counts: 64 << n, or nothing if n is 0
+	*/
+	
+	return shift_count ? ((u64)64 << shift_count) : 0;
+}
+
+bool NESDecodeHeader(NESHeader *info, uchar *header, u64 filesize) {
+	/*
+	**	decodes an iNES / NES 2.0 header into info
+	**	filesize is used to tell a real NES 2.0 header from garbage with the same identifier bits
+	**	(per http://wiki.nesdev.com/w/index.php/INES#Detecting_NES_2.0)
+	**	returns false if header is NULL
+	*/
+	
+	if (!info) return false;
+	memset(info, 0, sizeof(NESHeader));
+	
+	if (!header) return false;
+	
+	uchar control_1 = header[NES_ROM_CONTROL_OFFSET];
+	uchar control_2 = header[NES_ROM_CONTROL_OFFSET + 1];
+	
+	info->mirroring = (control_1 & NES_ROM_CONTROL_MIRROR_TYPE_MASK) ? NES_VERTICAL_MIRROR_MODE : NES_HORIZONTAL_MIRROR_MODE;
+	info->four_screen = (control_1 & NES_ROM_CONTROL_4_SCREEN_MASK) != 0;
+	info->battery = (control_1 & NES_ROM_CONTROL_BATT_RAM_MASK) != 0;
+	info->trainer = (control_1 & NES_ROM_CONTROL_TRAINER_MASK) != 0;
+	
+	u64 payload_start = NES_HEADER_SIZE + (info->trainer ? NES_TRAINER_LENGTH : 0);
+	
+	//figure out which flavour of header this is
+	info->format = nes_format_archaic;
+	
+	if ((control_2 & NES2_IDENTIFIER_MASK) == NES2_IDENTIFIER) {
+		u64 prg_size = NES2RomSize(header[NES_PRG_COUNT_OFFSET], header[NES2_ROM_SIZE_MSB_OFFSET] & 0x0F, NES_PRG_BANK_LENGTH);
+		u64 chr_size = NES2RomSize(header[NES_CHR_COUNT_OFFSET], header[NES2_ROM_SIZE_MSB_OFFSET] >> 4, NES_CHR_BANK_LENGTH);
+		
+		//only believe it if the sizes it claims actually fit in the file
+		if (prg_size <= filesize && chr_size <= filesize && payload_start + prg_size + chr_size <= filesize) {
+			info->format = nes_format_nes2;
+			info->prg_size = prg_size;
+			info->chr_size = chr_size;
+		}
+	} else if ((control_2 & NES2_IDENTIFIER_MASK) == 0) {
+		int i = 0;
+		bool clean = true;
+		
+		for (i = NES2_TIMING_OFFSET; i < NES_HEADER_SIZE; i++) {
+			if (header[i]) clean = false;
+		}
+		
+		if (clean) info->format = nes_format_ines;
+	}
+	
+	if (info->format == nes_format_nes2) {
+		info->mapper = ((control_1 & NES_ROM_CONTROL_MAPPER_LOW_MASK) >> 4)
+			| (control_2 & NES_ROM_CONTROL_MAPPER_HIGH_MASK)
+			| ((header[NES2_MAPPER_OFFSET] & 0x0F) << 8);
+		info->submapper = header[NES2_MAPPER_OFFSET] >> 4;
+		
+		info->prg_ram_size = NES2RamSize(header[NES2_PRG_RAM_OFFSET] & 0x0F);
+		info->prg_nvram_size = NES2RamSize(header[NES2_PRG_RAM_OFFSET] >> 4);
+		info->chr_ram_size = NES2RamSize(header[NES2_CHR_RAM_OFFSET] & 0x0F);
+		info->chr_nvram_size = NES2RamSize(header[NES2_CHR_RAM_OFFSET] >> 4);
+		
+		info->console_type = control_2 & NES2_CONSOLE_TYPE_MASK;
+		info->timing = header[NES2_TIMING_OFFSET] & 3;
+		info->misc_roms = header[NES2_MISC_ROMS_OFFSET] & 3;
+		info->expansion = header[NES2_EXPANSION_OFFSET] & 0x3F;
+	} else {
+		info->prg_size = (u64)header[NES_PRG_COUNT_OFFSET] * NES_PRG_BANK_LENGTH;
+		info->chr_size = (u64)header[NES_CHR_COUNT_OFFSET] * NES_CHR_BANK_LENGTH;
+		
+		//archaic headers only get the low nibble; the rest of byte 7 is probably someone's name
+		info->mapper = (control_1 & NES_ROM_CONTROL_MAPPER_LOW_MASK) >> 4;
+		
+		if (info->format == nes_format_ines) {
+			info->mapper |= (control_2 & NES_ROM_CONTROL_MAPPER_HIGH_MASK);
+			info->console_type = control_2 & NES2_CONSOLE_TYPE_MASK;
+			info->prg_ram_size = (u64)header[NES_8KB_RAM_BANK_COUNT_OFFSET] * 8192;
+			info->timing = header[NES_RESERVED_BYTES_OFFSET] & 1;
+		}
+	}
+	
+	info->prg_count = (int)((info->prg_size + NES_PRG_BANK_LENGTH - 1) / NES_PRG_BANK_LENGTH);
+	info->chr_count = (int)((info->chr_size + NES_CHR_BANK_LENGTH - 1) / NES_CHR_BANK_LENGTH);
+	
+	return true;
+}
+
+char *NESHeaderFormatName(NESHeaderFormat format) {
+	switch (format) {
+		case nes_format_nes2:
+			return "NES 2.0";
+		case nes_format_ines:
+			return "iNES";
+		default:
+			return "archaic iNES";
+	}
+}
+
+bool NESHeaderNormalize(uchar *header, u64 filesize) {
+	/*
+	**	clears bytes 7-15 of an archaic header, where old tools left their names ("DiskDude!" and friends)
+	**	NESDecodeHeader() already ignores those bytes, so the decoded header doesn't change,
+	**	except that iNES 1.0 readers stop picking up a bogus upper mapper nibble
+	**	NES 2.0 and clean iNES headers are left alone
+	**	returns true if header changed
+	*/
+	
+	NESHeader info;
+	int i = 0;
+	bool dirty = false;
+	
+	NESDecodeHeader(&info, header, filesize);
+	if (info.format != nes_format_archaic) return false;
+	
+	for (i = NES_ROM_CONTROL_OFFSET + 1; i < NES_HEADER_SIZE; i++) {
+		if (header[i]) dirty = true;
+		header[i] = 0;
+	}
+	
+	return dirty;
+}
+
+static u64 *NESRomBuildBankOffsets(u64 start, int count, u64 bank_length, u64 end) {
+	/*
+	**	returns a malloc()ed array of count + 1 bank start offsets
+	**	the last entry is end (banks sized by exponent don't always fill the last bank)
+	*/
+	
+	u64 *offsets = (u64*)malloc(sizeof(u64) * (count + 1));
+	if (!offsets) return NULL;
+	
+	int i = 0;
+	for (i = 0; i < count; i++) {
+		offsets[i] = start + (bank_length * i);
+	}
+	offsets[count] = end;
+	
+	return offsets;
+}
+
+static void NESRomBuildDirectory(NESRom *rom) {
+	/*
+	**	fills in the per-bank offset tables for a ROM that's going to stick around
+	**	if an allocation fails, NESRomBankOffset() just works the offsets out instead
+	*/
+	
+	NESRomDirectory *dir = &(rom->dir);
+	u64 prg_start = dir->trainer_offset + dir->trainer_length;
+	u64 chr_start = prg_start + rom->info.prg_size;
+	
+	dir->prg_offsets = NESRomBuildBankOffsets(prg_start, rom->prg_count, NES_PRG_BANK_LENGTH, chr_start);
+	dir->chr_offsets = NESRomBuildBankOffsets(chr_start, rom->chr_count, NES_CHR_BANK_LENGTH, dir->title_offset);
+}
+
+bool NESRomParseHeader(NESRom *rom, uchar *header, u64 filesize) {
+	/*
+	**	fills in rom's header fields and the fixed parts of its directory from the first bytes of the file
+	**	header may be NULL or shorter than NES_HEADER_SIZE; missing bytes read as zero
+	**	the per-bank offset arrays are only built for mapped ROMs (see NESRomBuildDirectory())
+	**	returns false if there wasn't a full header to parse
+	*/
+	
+	if (!rom) return false;
+	
+	memset(rom->header, 0, NES_HEADER_SIZE);
+	if (header) {
+		memcpy(rom->header, header, filesize < NES_HEADER_SIZE ? filesize : NES_HEADER_SIZE);
+	}
+	
+	rom->size = filesize;
+	
+	NESDecodeHeader(&(rom->info), rom->header, filesize);
+	rom->prg_count = rom->info.prg_count;
+	rom->chr_count = rom->info.chr_count;
+	
+	//now lay out the file: header, [trainer], PRG banks, CHR banks, [title | overdump]
+	NESRomDirectory *dir = &(rom->dir);
+	
+	dir->header_offset = NES_HEADER_PREFIX_OFFSET;
+	dir->trainer_offset = NES_TRAINER_OFFSET;
+	dir->trainer_length = rom->info.trainer ? NES_TRAINER_LENGTH : 0;
+	
+	dir->prg_offsets = NULL;
+	dir->chr_offsets = NULL;
+	
+	dir->title_offset = dir->trainer_offset + dir->trainer_length + rom->info.prg_size + rom->info.chr_size;
+	dir->title_length = 0;
+	dir->overdump_offset = dir->title_offset;
+	dir->overdump_length = 0;
+	
+	//anything up to a title block's worth of trailing data is the title;
+	// more than that isn't something we wrote, so call it overdump
+	if (filesize > dir->title_offset) {
+		u64 trailing = filesize - dir->title_offset;
+		
+		if (trailing <= NES_TITLE_BLOCK_LENGTH) {
+			dir->title_length = trailing;
+			dir->overdump_offset = filesize;
+		} else {
+			dir->overdump_length = trailing;
+		}
+	}
+	
+	return (header && filesize >= NES_HEADER_SIZE);
+}
+
+bool NESRomLoadHeader(NESRom *rom, FILE *ifile) {
+	/*
+	**	parses ifile's header into rom without mapping the file
+	**	one pread() for the header and one fstat() for the size; ifile's position is untouched
+	**	rom->data is left NULL
+	*/
+	
+	if (!rom || !ifile) return false;
+	
+	memset(rom, 0, sizeof(NESRom));
+	rom->fd = -1;
+	
+	//make sure anything written through ifile is visible to pread()
+	fflush(ifile);
+	
+	int fd = fileno(ifile);
+	struct stat st;
+	uchar header[NES_HEADER_SIZE];
+	
+	if (fstat(fd, &st) != 0) return false;
+	
+	ssize_t count = pread(fd, header, NES_HEADER_SIZE, NES_HEADER_PREFIX_OFFSET);
+	if (count < 0) return false;
+	
+	NESRomParseHeader(rom, header, st.st_size);
+	
+	return (count == NES_HEADER_SIZE);
+}
+
+bool NESRomVerify(NESRom *rom) {
+	/*
+	**	checks the magic number
+	*/
+	
+	if (!rom || rom->size < NES_HEADER_SIZE) return false;
+	
+	return (memcmp(rom->header + NES_HEADER_PREFIX_OFFSET, NES_HEADER_PREFIX, NES_HEADER_PREFIX_SIZE) == 0);
+}
+
+#pragma mark -
+
+u64 NESRomBankLength(NESBankType bank_type) {
+	return (bank_type == nes_prg_bank) ? NES_PRG_BANK_LENGTH : NES_CHR_BANK_LENGTH;
+}
+
+u64 NESRomBankOffset(NESRom *rom, NESBankType bank_type, int bank_index) {
+	/*
+	**	returns the file offset of the bank_index bank_type bank
+	**	bank_index is 0-based; bank_count returns the end of the last bank
+	*/
+	
+	u64 *offsets = (bank_type == nes_prg_bank) ? rom->dir.prg_offsets : rom->dir.chr_offsets;
+	int bank_count = (bank_type == nes_prg_bank) ? rom->prg_count : rom->chr_count;
+	
+	if (offsets && bank_index >= 0 && bank_index <= bank_count) {
+		return offsets[bank_index];
+	}
+	
+	//outside of the tables (or they weren't built for this ROM), so work it out
+	u64 start = rom->dir.trainer_offset + rom->dir.trainer_length;
+	if (bank_type == nes_chr_bank) {
+		start += rom->info.prg_size;
+	}
+	
+	return start + (NESRomBankLength(bank_type) * bank_index);
+}
+
+u64 NESRomTitleOffset(NESRom *rom) {
+	/*
+	**	returns the offset where the title block starts (the end of the CHR data)
+	*/
+	
+	return rom->dir.title_offset;
+}
+
+bool NESRomHasTrainer(NESRom *rom) {
+	return rom->info.trainer;
+}
+
+uchar *NESRomGetBank(NESRom *rom, NESBankType bank_type, int bank_index) {
+	/*
+	**	returns a pointer to the start of the bank inside the mapping
+	**	returns NULL if the bank doesn't exist or the file is too short to hold it
+	*/
+	
+	if (!rom || !rom->data) return NULL;
+	
+	int count = (bank_type == nes_prg_bank) ? rom->prg_count : rom->chr_count;
+	if (bank_index < 0 || bank_index >= count) return NULL;
+	
+	u64 offset = NESRomBankOffset(rom, bank_type, bank_index);
+	if (offset + NESRomBankLength(bank_type) > rom->size) return NULL;
+	
+	return rom->data + offset;
+}
+
+uchar *NESRomGetTile(NESRom *rom, NESBankType bank_type, int bank_index, int tile_index) {
+	/*
+	**	returns a pointer to a single tile inside the mapping
+	*/
+	
+	uchar *bank = NESRomGetBank(rom, bank_type, bank_index);
+	
+	if (!bank || tile_index < 0) return NULL;
+	if ((u64)(tile_index + 1) * NES_ROM_TILE_LENGTH > NESRomBankLength(bank_type)) return NULL;
+	
+	return bank + (tile_index * NES_ROM_TILE_LENGTH);
+}
+
+#pragma mark -
+
+int NESRomHasTitle(NESRom *rom) {
+	/*
+	**	returns the length of the title or 0 if there is none
+	*/
+	
+	if (!rom || rom->dir.title_length == 0) return 0;
+	
+	char title[NES_TITLE_BLOCK_LENGTH];
+	NESRomGetTitle(rom, title, false);
+	
+	return strlen(title);
+}
+
+void NESRomGetTitle(NESRom *rom, char *buf, bool strip) {
+	/*
+	**	sets the contents of buf to the title if it exists
+	**	buf must hold NES_TITLE_BLOCK_LENGTH bytes and is always NUL-terminated
+	**	if strip is set to true, cut the title at the first character outside of 32-126
+	*/
+	
+	if (!buf) return;
+	buf[0] = 0;
+	
+	if (!rom || !rom->data) return;
+	
+	if (rom->dir.title_length == 0) return;
+	
+	NESCopyTitle(buf, rom->data + rom->dir.title_offset, rom->dir.title_length, strip);
+}
@@ -0,0 +1,125 @@
+/*
+**	nesrom.h
+**	nesromtool
+**
+**	an opened-once, memory-mapped handle on an NES ROM file
+**	the header is parsed a single time when the ROM is opened and
+**	bank/tile accessors hand out pointers straight into the mapping
+*/
+
+#ifndef _NESROM_H_
+#define _NESROM_H_
+
+#include <stdio.h>
+#include "types.h"
+#include "nesutils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+**	the directory of where everything lives in the file
+**	built once when the ROM is opened; every bank/tile lookup is an index into it
+**	the offset arrays hold count + 1 entries: the last one is the end of the final bank
+**	(they're left NULL for NESRoms filled in by NESRomLoadHeader())
+*/
+typedef struct nesRomDirectory {
+	u64 header_offset;						/* always 0 */
+	u64 trainer_offset;						/* NES_TRAINER_OFFSET */
+	u64 trainer_length;						/* NES_TRAINER_LENGTH if the trainer bit is set, otherwise 0 */
+	u64 *prg_offsets;						/* start of each PRG bank */
+	u64 *chr_offsets;						/* start of each CHR bank */
+	u64 title_offset;						/* where a title block would start (the end of the CHR data) */
+	u64 title_length;						/* bytes of title block present (0 if none) */
+	u64 overdump_offset;					/* start of any data past the banks that isn't a title block */
+	u64 overdump_length;					/* bytes of overdump (0 if none) */
+} NESRomDirectory;
+
+typedef enum {
+	nes_format_archaic = 0,					/* old iNES (bytes 7-15 can't be trusted; DiskDude! and friends) */
+	nes_format_ines = 1,					/* iNES 1.0 */
+	nes_format_nes2 = 2						/* NES 2.0 */
+} NESHeaderFormat;
+
+/*
+**	everything the 16-byte header says, decoded once
+**	sizes are in bytes; RAM sizes are 0 if absent (or unknown, for iNES 1.0)
+*/
+typedef struct nesHeader {
+	NESHeaderFormat format;
+	
+	u64 prg_size;							/* PRG-ROM size */
+	u64 chr_size;							/* CHR-ROM size (0 means the cart uses CHR-RAM) */
+	int prg_count;							/* PRG-ROM size in NES_PRG_BANK_LENGTH banks, rounded up */
+	int chr_count;							/* CHR-ROM size in NES_CHR_BANK_LENGTH banks, rounded up */
+	
+	int mapper;								/* 8 bits for iNES, 12 bits for NES 2.0 */
+	int submapper;							/* NES 2.0 only */
+	
+	int mirroring;							/* NES_HORIZONTAL_MIRROR_MODE or NES_VERTICAL_MIRROR_MODE */
+	bool four_screen;						/* overrides mirroring */
+	bool battery;
+	bool trainer;
+	
+	u64 prg_ram_size;						/* volatile PRG-RAM */
+	u64 prg_nvram_size;						/* battery-backed PRG-RAM */
+	u64 chr_ram_size;						/* volatile CHR-RAM */
+	u64 chr_nvram_size;						/* battery-backed CHR-RAM */
+	
+	int console_type;						/* 0: NES/Famicom, 1: Vs. System, 2: PlayChoice-10, 3: extended */
+	int timing;								/* 0: NTSC, 1: PAL, 2: multi-region, 3: Dendy */
+	int misc_roms;							/* number of miscellaneous ROMs after the CHR data */
+	int expansion;							/* default expansion device */
+} NESHeader;
+
+typedef struct nesRom {
+	int fd;									/* descriptor the mapping was made from (-1 if none) */
+	bool owns_fd;							/* close fd in NESRomClose() */
+	uchar *data;							/* the whole file, mmap()ed read-only (NULL if the file is empty) */
+	u64 size;								/* filesize, in bytes */
+
+	uchar header[NES_HEADER_SIZE];			/* copy of the 16-byte header (zero-filled if the file is short) */
+	NESHeader info;							/* the decoded header */
+	int prg_count;							/* number of PRG banks (info.prg_count) */
+	int chr_count;							/* number of CHR banks (info.chr_count) */
+
+	NESRomDirectory dir;					/* offsets of the header, trainer, banks, title and overdump */
+} NESRom;
+
+//opening and closing
+NESRom *NESRomOpen(char *path);
+NESRom *NESRomOpenFile(FILE *ifile);
+void NESRomClose(NESRom *rom);
+
+//header decoding
+bool NESDecodeHeader(NESHeader *info, uchar *header, u64 filesize);
+char *NESHeaderFormatName(NESHeaderFormat format);
+
+//zeroes the garbage in an archaic header's bytes 7-15; returns true if anything changed
+bool NESHeaderNormalize(uchar *header, u64 filesize);
+
+//header parsing (used by the FILE* wrappers in nesutils.c, which don't map the file)
+bool NESRomParseHeader(NESRom *rom, uchar *header, u64 filesize);
+bool NESRomLoadHeader(NESRom *rom, FILE *ifile);
+
+bool NESRomVerify(NESRom *rom);
+
+//offsets and zero-copy access
+u64 NESRomBankOffset(NESRom *rom, NESBankType bank_type, int bank_index);
+u64 NESRomBankLength(NESBankType bank_type);
+u64 NESRomTitleOffset(NESRom *rom);
+bool NESRomHasTrainer(NESRom *rom);
+
+uchar *NESRomGetBank(NESRom *rom, NESBankType bank_type, int bank_index);
+uchar *NESRomGetTile(NESRom *rom, NESBankType bank_type, int bank_index, int tile_index);
+
+//titles
+int NESRomHasTitle(NESRom *rom);
+void NESRomGetTitle(NESRom *rom, char *buf, bool strip);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _NESROM_H_ */
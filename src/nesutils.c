@@ -13,37 +13,36 @@
 #include <unistd.h>
 
 #include "nesutils.h"
+#include "nesrom.h"
+#include "tilecodec.h"
+#include "verify.h"
 #include "verbosity.h"
 
 
-char NESGetPrgBankCount(FILE *ifile) {
+int NESGetPrgBankCount(FILE *ifile) {
 	/*
 	**	returns the number of PRG Banks in ifile
 	**	returns -1 if an error occurrs
 	*/
 	
-	if (!ifile) return -1;
+	NESRom rom;
 	
-	if (fseek(ifile, NES_PRG_COUNT_OFFSET, SEEK_SET) != 0) {
-		return -1;
-	}
+	if (!NESRomLoadHeader(&rom, ifile)) return -1;
 	
-	return (char)fgetc(ifile);
+	return rom.prg_count;
 }
 
-char NESGetChrBankCount(FILE* ifile) {
+int NESGetChrBankCount(FILE* ifile) {
 	/*
 	**	returns the number of CHR banks in ifile
 	**	returns -1 if an error occurrs
 	*/
 
-	if (!ifile) return -1;
+	NESRom rom;
 	
-	if (fseek(ifile, NES_CHR_COUNT_OFFSET, SEEK_SET) != 0) {
-		return -1;
-	}
+	if (!NESRomLoadHeader(&rom, ifile)) return -1;
 	
-	return (char)fgetc(ifile);
+	return rom.chr_count;
 }
 
 bool NESGetRomControlBytes(char *buf, FILE *ifile) {
@@ -55,15 +54,11 @@ bool NESGetRomControlBytes(char *buf, FILE *ifile) {
 	**	returns false if not
 	*/
 	
-	if (!buf || !ifile) return false;
+	NESRom rom;
 	
-	if (fseek(ifile, NES_ROM_CONTROL_OFFSET, SEEK_SET) != 0) {
-		return false;
-	}
+	if (!buf || !NESRomLoadHeader(&rom, ifile)) return false;
 	
-	if (fread(buf, NES_ROM_CONTROL_LENGTH, 1, ifile) != 1) {
-		return false;
-	}
+	memcpy(buf, rom.header + NES_ROM_CONTROL_OFFSET, NES_ROM_CONTROL_LENGTH);
 	
 	return true;
 }
@@ -72,95 +67,46 @@ bool NESGetBank(char *buf, FILE *ifile, int bank_index, NESBankType type) {
 	/*
 	**	get the bank of type 'type'
 	**	buf must be pre-allocated with enough space for the bank in question...
+	**	reads straight into buf with pread(); ifile's position is untouched
 	*/
 	
-	switch (type) {
-		case nes_chr_bank:
-			return NESGetChrBank(buf, ifile, bank_index);
-			break;
-		case nes_prg_bank:
-			return NESGetPrgBank(buf, ifile, bank_index);
-			break;
-		default:
-			return false;
-	}
+	v_printf(VERBOSE_TRACE, "NESGetBank => %0x, %0x, %d, %c", buf, ifile, bank_index, type);
 	
-}
-
-bool NESGetPrgBank(char *buf, FILE *ifile, int bank_index) {
-	/*
-	**	retreive the bank_index PRG bank and put the data into buf
-	**	buf needs to be allocated: malloc(NES_PRG_BANK_LENGTH)
-	*/
+	NESRom rom;
 	
 	//check to make sure that ifile and buf aren't NULL
-	if (!ifile || !buf) {
-		return false;
-	}
+	if (!buf || !NESRomLoadHeader(&rom, ifile)) return false;
 	
-	//bail if we try to get a nonexistent PRG bank
-	if (bank_index < 0 || bank_index >= NESGetPrgBankCount(ifile)) return false;
+	//bail if we try to get a nonexistent bank
+	int bank_count = (type == nes_prg_bank) ? rom.prg_count : rom.chr_count;
+	if (bank_index < 0 || bank_index >= bank_count) return false;
 	
-	char *PRG_data = (char *)malloc(NES_PRG_BANK_LENGTH + 1); //temporary placeholder for data
+	u64 bank_length = NESRomBankLength(type);
 	
-	//seek to proper offset
-	//fseek(ifile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * (n - 1)), SEEK_SET);
-	if (NESSeekToBank(ifile, nes_prg_bank, bank_index) != 0) {
+	if (pread(fileno(ifile), buf, bank_length, NESRomBankOffset(&rom, type, bank_index)) != (ssize_t)bank_length) {
+		v_printf(VERBOSE_TRACE_2, "Failed to read bank from file!");
 		return false;
 	}
 	
-	//read to placeholder
-	if (fread(PRG_data, 1, NES_PRG_BANK_LENGTH, ifile) != NES_PRG_BANK_LENGTH) {
-		free(PRG_data);
-		return false;
-	}
-	
-	//copy data into buf
-	memcpy(buf, PRG_data, NES_PRG_BANK_LENGTH);
-	free(PRG_data);
-	
 	return true;
 }
 
+bool NESGetPrgBank(char *buf, FILE *ifile, int bank_index) {
+	/*
+	**	retreive the bank_index PRG bank and put the data into buf
+	**	buf needs to be allocated: malloc(NES_PRG_BANK_LENGTH)
+	*/
+	
+	return NESGetBank(buf, ifile, bank_index, nes_prg_bank);
+}
+
 bool NESGetChrBank(char *buf, FILE *ifile, int bank_index) {
 	/*
 	**	retreive the bank_index CHR bank and put the data into buf
 	**	buf needs to be allocated: malloc(NES_CHR_BANK_LENGTH)
 	*/
 	
-	v_printf(VERBOSE_TRACE, "NESGetChrBank => %0x, %0x, %d", buf, ifile, bank_index);
-			
-	//check to make sure that ifile and buf aren't NULL
-	if (!ifile || !buf) return false;
-	v_printf(VERBOSE_TRACE_2, "No null values!");
-		
-	//bail if we try to get a nonexistent bank
-	if (bank_index < 0 || bank_index >= NESGetChrBankCount(ifile)) return false;
-	v_printf(VERBOSE_TRACE_2, "Passed error checking.");
-	
-	//temporary placeholder for data
-	char *chrData = (char *)malloc(NES_CHR_BANK_LENGTH);
-	
-	//move to necessary point in file
-	//fseek(ifile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * NESGetPrgBankCount(ifile)) + (NES_CHR_BANK_LENGTH * (n - 1)), SEEK_SET);
-	if (NESSeekToBank(ifile, nes_chr_bank, bank_index) != 0) {
-		return false;
-	}
-	
-	//read data into placeholder
-	if (fread(chrData, 1, NES_CHR_BANK_LENGTH, ifile) != NES_CHR_BANK_LENGTH) {
-		free(chrData);
-		v_printf(VERBOSE_TRACE_2, "Failed to read CHR bank from file!");
-		return false;
-	}
-	
-	//copy data into buf
-	memcpy(buf, chrData, NES_CHR_BANK_LENGTH);
-	free(chrData);
-	
-	v_printf(VERBOSE_TRACE_2, "Copied CHR bank into buffer -- NESGetChrBank Done.");
-	
-	return true;
+	return NESGetBank(buf, ifile, bank_index, nes_chr_bank);
 }
 
 #pragma mark -
@@ -203,13 +149,15 @@ bool NESInjectPrgBank(FILE *ofile, char *prg_data, int bank_index) {
 	**	replaces existing bank
 	*/
 	
+	NESRom rom;
+	
 	//error detection
-	if (!ofile || !prg_data) return false;
+	if (!prg_data || !NESRomLoadHeader(&rom, ofile)) return false;
 	
 	//don't bank index starts at 1... you can't inject a non-existent bank
-	if (bank_index < 0 || bank_index >= NESGetPrgBankCount(ofile)) return false;
+	if (bank_index < 0 || bank_index >= rom.prg_count) return false;
 	
-	if (NESSeekToBank(ofile, nes_prg_bank, bank_index) != 0) {
+	if (fseeko(ofile, NESRomBankOffset(&rom, nes_prg_bank, bank_index), SEEK_SET) != 0) {
 		return false;
 	}
 	
@@ -227,13 +175,15 @@ bool NESInjectChrBank(FILE *ofile, char *chr_data, int bank_index) {
 	**	replaces existing bank
 	*/
 	
+	NESRom rom;
+	
 	//error detection
-	if (!ofile || !chr_data) return false;
+	if (!chr_data || !NESRomLoadHeader(&rom, ofile)) return false;
 	
 	//don't bank index starts at 1... you can't inject a non-existent bank
-	if (bank_index < 0 || bank_index >= NESGetChrBankCount(ofile)) return false;
+	if (bank_index < 0 || bank_index >= rom.chr_count) return false;
 	
-	if (NESSeekToBank(ofile, nes_chr_bank, bank_index) != 0) {
+	if (fseeko(ofile, NESRomBankOffset(&rom, nes_chr_bank, bank_index), SEEK_SET) != 0) {
 		return false;
 	}
 	
@@ -331,11 +281,7 @@ bool NESInjectTileData(FILE *rom_file, char *tile_data, int tile_count, NESBankT
 	
 	int data_size = tile_count * NES_ROM_TILE_LENGTH;
 	
-	if (NESSeekToBank(rom_file, bank_type, bank_index) != 0) {
-		return false;
-	}
-	
-	if (NESSeekAheadNTiles(rom_file, tile_index) != 0) {
+	if (NESSeekToTile(rom_file, bank_type, bank_index, tile_index) != 0) {
 		return false;
 	}
 	
@@ -351,44 +297,19 @@ bool NESInjectRawTileData(FILE *ofile, char *tileData, int chrIndex, int tileInd
 	
 	//note that tileData is in the form of a .raw file, not .NES format...
 	
-	int prgCount = NESGetPrgBankCount(ofile);
+	NESRom rom;
 	
-	if (prgCount < 1 || chrIndex > NESGetChrBankCount(ofile)) return false; //error
+	if (!NESRomLoadHeader(&rom, ofile)) return false; //error
+	if (rom.prg_count < 1 || chrIndex > rom.chr_count) return false; //error
 	
-	NESSeekToTile(ofile, nes_chr_bank, chrIndex, tileIndex);
+	fseeko(ofile, NESRomBankOffset(&rom, nes_chr_bank, chrIndex) + (tileIndex * NES_ROM_TILE_LENGTH), SEEK_SET);
 	//fseek(ofile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * prgCount) + (NES_CHR_BANK_LENGTH * (chrIndex - 1)) + ((tileIndex - 1) * NES_ROM_TILE_LENGTH), SEEK_SET);
 	
-	int i = 0;
+	uchar tile[NES_ROM_TILE_LENGTH];
 	
-	char *composite = (char *)malloc(NES_ROM_TILE_LENGTH);
-	unsigned char chan_a = 0;
-	unsigned char chan_b = 0;
-	char channel_buffer[2];
+	NESEncodeTiles(tile, (uchar *)tileData, 1);
 	
-	for (i = 0; i < NES_COMPOSITE_TILE_LENGTH; i++) {
-		NESBreakBits(tileData[i], channel_buffer);
-		
-		chan_a += abs(channel_buffer[0] - '0');
-		chan_b += abs(channel_buffer[1] - '0');
-
-		if ((i + 1) % NES_ROM_TILE_CHANNEL_LENGTH == 0) {
-			composite[i / NES_ROM_TILE_CHANNEL_LENGTH] = chan_a;
-			composite[(i / NES_ROM_TILE_CHANNEL_LENGTH) + NES_ROM_TILE_CHANNEL_LENGTH] = chan_b;
-			
-			chan_a = 0;
-			chan_b = 0;
-		}
-		
-		chan_a = (chan_a << 1);
-		chan_b = (chan_b << 1);
-	}
-	
-	if (fwrite(composite, 1, NES_ROM_TILE_LENGTH, ofile) != NES_ROM_TILE_LENGTH) {
-		free(composite);
-		return false;
-	}
-	
-	free(composite);
+	if (fwrite(tile, 1, NES_ROM_TILE_LENGTH, ofile) != NES_ROM_TILE_LENGTH) return false;
 	
 	return true;
 }
@@ -555,74 +476,70 @@ int NESHasTitle(FILE *ifile) {
 	**	checks ifile (NES ROM) to see if it has title data
 	**	returns the length of the title or 0 if there is none
 	*/
-	if (!ifile) return false;
-	
-	//initialize some values
-	int PRG_count = NESGetPrgBankCount(ifile);
-	int CHR_count = NESGetChrBankCount(ifile);
-	long filesize = NESGetFilesize(ifile);
 	
 	//if the header_size + PRG_Banks + CHR_banks == filesize, then no titledata block...
 	// if there's additional data beyond that, it's safe to assume that titledata exists...
 	// but we're going to check the contents of the title anyway to make sure there really is a title.
-	if (filesize > (NES_HEADER_SIZE + PRG_count * NES_PRG_BANK_LENGTH + CHR_count * NES_CHR_BANK_LENGTH)) {
-		char *title = (char*)malloc(NES_TITLE_BLOCK_LENGTH);
-				
-		NESGetTitle(title, ifile, false);
-		
-		int title_length = strlen(title);
-		free(title);
-		
-		return title_length;
-	}
+	char title[NES_TITLE_BLOCK_LENGTH];
+	
+	NESGetTitle(title, ifile, false);
 	
-	return 0;
+	return strlen(title);
 }
 
 void NESGetTitle(char *buf, FILE *ifile, bool strip) {
 	/*
 	**	reads ifile's titledata
 	**	sets the contents of buf to the title if it exists
+	**	buf must hold NES_TITLE_BLOCK_LENGTH bytes and is always NUL-terminated
 	**	if strip is set to true, remove all characters outside of 32-126
 	*/
 	
+	NESRom rom;
+	
 	// check if ifile or buf are NULL, if so, bail
-	if (!ifile || !buf) return;
+	if (!buf) return;
+	buf[0] = 0;
 	
-	long rom_filesize = NESGetFilesize(ifile);
+	if (!NESRomLoadHeader(&rom, ifile)) return;
 	
-	//seek to the location of the title data
-	if (fseek(ifile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * NESGetPrgBankCount(ifile)) + (NES_CHR_BANK_LENGTH * NESGetChrBankCount(ifile)), SEEK_SET) != 0) {
-		return;
-	}
+	//no title block (either nothing after the banks or it's overdump data)
+	if (rom.dir.title_length == 0) return;
 	
-	//allocate the titleData
-	char *title_data = (char *)malloc(rom_filesize);
+	//read the title block (or whatever's left of the file, if it's shorter)
+	char title_data[NES_TITLE_BLOCK_LENGTH];
+	ssize_t count = pread(fileno(ifile), title_data, rom.dir.title_length, rom.dir.title_offset);
 	
-	//read the title_data... set count to the number of bytes read.
-	int count = fread(title_data, 1, rom_filesize, ifile);
+	if (count <= 0) return;
 	
-	//yeah, I'm a little strict... this should probably be fixed so we're not quite as strict...
-	if (count != rom_filesize) {
-		free(title_data);
-		return;
-	}
+	NESCopyTitle(buf, (uchar*)title_data, count, strip);
+}
+
+void NESCopyTitle(char *buf, uchar *title_data, u32 length, bool strip) {
+	/*
+	**	copies a title block out of title_data (length bytes are available) into buf
+	**	buf must hold NES_TITLE_BLOCK_LENGTH bytes and is always NUL-terminated
+	**	if strip is set to true, cut the title at the first character outside of 32-126
+	**	this is for display purposes only
+	*/
+	
+	if (!buf) return;
+	
+	if (length > NES_TITLE_BLOCK_LENGTH - 1) length = NES_TITLE_BLOCK_LENGTH - 1;
+	
+	memcpy(buf, title_data, length);
+	buf[length] = 0;
 	
 	//strip all non-normal characters (keep standard human-readable stuff)
-	//this is for display purposes only
 	if (strip) {
 		int i = 0;
-		for(i = 0; title_data[i]; i++) { //stop when we hit a \0
-			if (title_data[i] < 32 || title_data[i] > 126) {
-				title_data[i] = 0;
+		for(i = 0; buf[i]; i++) { //stop when we hit a \0
+			if ((uchar)buf[i] < 32 || (uchar)buf[i] > 126) {
+				buf[i] = 0;
 				break;
 			}
 		}
 	}
-	
-	//copy title_data into buf and free it
-	memcpy(buf, title_data, rom_filesize);
-	free(title_data);
 }
 
 bool NESSetTitle(FILE *ofile, char *title) {
@@ -632,11 +549,15 @@ bool NESSetTitle(FILE *ofile, char *title) {
 	**	returns false on failure
 	*/
 	
+	NESRom rom;
+	
 	//bail if anything is NULL
-	if(!ofile || !title) return false;
+	if(!title || !NESRomLoadHeader(&rom, ofile)) return false;
 	
 	//seek to the start of the title
-	fseek(ofile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * NESGetPrgBankCount(ofile)) + (NES_CHR_BANK_LENGTH * NESGetChrBankCount(ofile)), SEEK_SET);
+	if (fseeko(ofile, NESRomTitleOffset(&rom), SEEK_SET) != 0) {
+		return false;
+	}
 	
 	//create a new titleblock
 	char *newTitle = (char*)malloc(NES_TITLE_BLOCK_LENGTH);
@@ -647,7 +568,7 @@ bool NESSetTitle(FILE *ofile, char *title) {
 	for (i = 0; i < NES_TITLE_BLOCK_LENGTH; i++) {
 		newTitle[i] = 0;
 	}
-	strcpy(newTitle, title);
+	strncpy(newTitle, title, NES_TITLE_BLOCK_LENGTH - 1);
 	
 	//write the titledata... bail if an error occurs
 	if (fwrite(newTitle, 1, NES_TITLE_BLOCK_LENGTH, ofile) != NES_TITLE_BLOCK_LENGTH) {
@@ -655,6 +576,8 @@ bool NESSetTitle(FILE *ofile, char *title) {
 		return false;
 	}
 	
+	free(newTitle);
+	
 	//success!!!
 	return true;
 }
@@ -668,15 +591,17 @@ bool NESRemoveTitle(FILE *ofile) {
 	** 	returns false on failure
 	*/
 	
+	NESRom rom;
+	
 	// check if the file is NULL... if so, bail
-	if (!ofile) return false;
+	if (!NESRomLoadHeader(&rom, ofile)) return false;
 	
 	// if it doesn't have a title, bail... returns true because the title isn't there!
 	if (!NESHasTitle(ofile)) return true;
 	
 	// truncate the file to the proper size
 	// (header_size + prg_banks + chr_banks)
-	if (ftruncate(fileno(ofile), NES_HEADER_SIZE + (NESGetPrgBankCount(ofile) * NES_PRG_BANK_LENGTH) + (NESGetChrBankCount(ofile) * NES_CHR_BANK_LENGTH)) != 0) {
+	if (ftruncate(fileno(ofile), NESRomTitleOffset(&rom)) != 0) {
 		return false;
 	}
 	
@@ -689,37 +614,36 @@ bool NESRemoveTitle(FILE *ofile) {
 
 #pragma mark -
 
-u32 NESGetFilesize(FILE *ifile) {
+u64 NESGetFilesize(FILE *ifile) {
+	/*
+	**	returns the size of ifile, in bytes
+	**	doesn't move the file pointer
+	*/
+	
+	NESRom rom;
+	
 	if (!ifile) return 0;
-	fseek(ifile, 0, SEEK_END);
-	return ftell(ifile);
+	NESRomLoadHeader(&rom, ifile);
+	
+	return rom.size;
 }
 
 bool NESVerifyROM(FILE *ifile) {
-	//check the header
-	//should also make sure that the rom contains said amount of PRG and CHR banks
-	
-	if (!ifile) return false;
+	/*
+	**	checks the header, and that the file holds all of the PRG and CHR data it says it does
+	**	(header + [trainer] + PRG + CHR; see verify.h for the warnings this doesn't fail on)
+	*/
 	
-	fseek(ifile, NES_HEADER_PREFIX_OFFSET, SEEK_SET);
+	NESVerifyResult result;
 	
-	unsigned char *four_byte_header = (unsigned char*)malloc(NES_HEADER_PREFIX_SIZE);
+	if (!ifile) return false;
 	
-	if (fread(four_byte_header, 1, NES_HEADER_PREFIX_SIZE, ifile) != (NES_HEADER_PREFIX_SIZE)) {
-		printf("ERROR READING\n");
-		free(four_byte_header);
-		return false;
-	}
-	if (strncmp(NES_HEADER_PREFIX, (const char*)four_byte_header, NES_HEADER_PREFIX_SIZE) != 0) { //make sure the 
-		free(four_byte_header);
-		return false;
-	}
-	free(four_byte_header);
+	//make sure anything written through ifile is visible to pread()
+	fflush(ifile);
 	
-	//still need to verify the filesize and bank counts!
-	//(remember,  it's (PRGsize * PRGpagecount) + (CHRsize * CHRpagecount) + headersize + [titlesize])
+	if (!NESVerifyDescriptor(&result, fileno(ifile))) return false;
 	
-	return true;
+	return !(result.problems & NES_VERIFY_ERRORS);
 }
 
 //seeking around in file
@@ -730,28 +654,28 @@ int NESSeekToBank(FILE *ifile, NESBankType bank_type, int bank_index) {
 	**	returns the same value as fseek() (0 on success)
 	*/
 	
-	if (bank_type == nes_prg_bank) {
-		return fseek(ifile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * bank_index), SEEK_SET);
-	} else {
-		return fseek(ifile, NES_HEADER_SIZE + (NES_PRG_BANK_LENGTH * NESGetPrgBankCount(ifile)) + (NES_CHR_BANK_LENGTH * bank_index), SEEK_SET);
-	}
-
+	NESRom rom;
+	
+	if (!ifile) return -1;
+	NESRomLoadHeader(&rom, ifile);
+	
+	return fseeko(ifile, NESRomBankOffset(&rom, bank_type, bank_index), SEEK_SET);
 }
 
 int NESSeekToTile(FILE *ifile, NESBankType bank_type, int bank_index, int tile_index) {
 	/*
 	**	Seeks to the tile_index tile of the bank_index bank.
-	**	returns the current file offset pointer
+	**	returns the same value as fseek() (0 on success)
 	**	bank_index and tile_index are 0-based indexes (first tile/bank is 0)
 	*/
 	
-	//TODO: Add errorchecking
+	NESRom rom;
 	
-	//first seek to the bank
-	NESSeekToBank(ifile, bank_type, bank_index);
+	if (!ifile || !NESRomLoadHeader(&rom, ifile)) return -1;
+	if (tile_index < 0 || (u64)(tile_index + 1) * NES_ROM_TILE_LENGTH > NESRomBankLength(bank_type)) return -1;
 	
-	//then return the value of seeking ahead n tiles
-	return NESSeekAheadNTiles(ifile, tile_index);
+	//one seek, straight to the tile
+	return fseeko(ifile, NESRomBankOffset(&rom, bank_type, bank_index) + (NES_ROM_TILE_LENGTH * tile_index), SEEK_SET);
 }
 
 int NESSeekAheadNTiles(FILE *ifile, int n) {
@@ -820,31 +744,7 @@ int NESTileToComposite(char *tile_data, char *buf) {
 	
 	if (!tile_data || !buf) return 0;
 	
-	//temporary storage for converted data
-	char *new_composite = (char*)malloc(NES_TILE_WIDTH * NES_TILE_HEIGHT);
-	
-	//temporary storage for channels
-	unsigned char channel_a[NES_ROM_TILE_CHANNEL_LENGTH], channel_b[NES_ROM_TILE_CHANNEL_LENGTH];
-	
-	//initialize channel_a and channel_b
-	int i = 0; int j = 0;
-	for (i = 0; i < NES_ROM_TILE_CHANNEL_LENGTH; i++) {
-		channel_a[i] = tile_data[i];
-		channel_b[i] = tile_data[NES_ROM_TILE_CHANNEL_LENGTH + i];
-		v_printf(VERBOSE_TRACE_2, "Channels A/B: %d/%d", channel_a[i], channel_b[i]);
-	}
-	
-	//create composite data
-	for (i = 0; i < NES_ROM_TILE_CHANNEL_LENGTH; i++) {
-		for (j = 7; j >= 0; j--) {
-			int pixel_offset = (i * 8) + (8 - j); //where in the composite we are
-			new_composite[(pixel_offset) - 1] = NESCombineBits(channel_a[i], channel_b[i], j);
-			v_printf(VERBOSE_TRACE_2, "Composite (%d,%d:%d): %d", i, j, (pixel_offset), new_composite[pixel_offset - 1]);
-		}
-	}
-	
-	memcpy(buf, new_composite, NES_TILE_WIDTH * NES_TILE_HEIGHT);
-	free(new_composite);
+	NESDecodeTiles((uchar *)buf, (uchar *)tile_data, 1);
 	
 	return 1;
 }
@@ -856,12 +756,8 @@ void NESCompositeRowToChannels(char *tile_row, char *buf) {
 	**	buf[0] == channel_a, buf[1] == channel_b
 	*/
 	
-	v_printf(VERBOSE_TRACE, "NESCompositeRowToChannels()");
-	
 	if (!tile_row || !buf) return;
 	
-	v_printf(VERBOSE_TRACE_2, "Passed errorchecking.");
-	
 	//initialize
 	buf[0] = 0; //channel_a
 	buf[1] = 0; //channel_b
@@ -869,8 +765,6 @@ void NESCompositeRowToChannels(char *tile_row, char *buf) {
 	int i = 0;
 	for (i = 0; i < NES_TILE_WIDTH; i++) {
 		//shift the bits to the left
-		v_printf(VERBOSE_TRACE_2, "Checking %d", tile_row[i]);
-		
 		buf[0] <<= 1; 
 		buf[1] <<= 1;
 		
@@ -878,8 +772,6 @@ void NESCompositeRowToChannels(char *tile_row, char *buf) {
 		if (tile_row[i] & 1) buf[0]++;
 		if (tile_row[i] & 2) buf[1]++;
 	}
-	
-	v_printf(VERBOSE_TRACE_2, "Done.");
 }
 
 int NESCompositeToTile(char *composite_data, char *buf) {
@@ -891,28 +783,7 @@ int NESCompositeToTile(char *composite_data, char *buf) {
 	
 	if (!composite_data || !buf) return 0;
 	
-	char *new_tile = (char*)malloc(NES_ROM_TILE_LENGTH);
-	
-	char channel[2]; //temporary cache for splitting into channels
-	
-	int i = 0;
-	
-	//loop over the pixels in composite_data
-	//loop row by row, pixel by pixel
-	for (i = 0; i < NES_TILE_HEIGHT; i++) { //looping over pixels in rows
-		//NESBreakBits(composite_data[j * NES_TILE_WIDTH + i], pixel);
-		NESCompositeRowToChannels(composite_data, channel);
-		
-		//set the channels in the new tile
-		new_tile[i] = channel[0]; //channel A
-		new_tile[i + NES_ROM_TILE_CHANNEL_LENGTH] = channel[1]; //channel B
-		
-		composite_data += NES_TILE_WIDTH;
-	} //end of pixel loop
-	
-	//copy into buffer and free memory
-	memcpy(buf, new_tile, NES_ROM_TILE_LENGTH);
-	free(new_tile);
+	NESEncodeTiles((uchar *)buf, (uchar *)composite_data, 1);
 	
 	return 1;
 }
@@ -923,6 +794,7 @@ bool NESConvertTileDataToComposite(char *buf, char *tileData, int size) {
 	/*
 	**	convert native tile data (tileData) to composite data
 	**	composite == 0-3, 1 byte per pixel.
+	**	buf must hold NES_COMPOSITE_TILE_LENGTH bytes for every tile in tileData
 	*/
 	
 	v_printf(VERBOSE_TRACE, "Start NESConvertTileDataToComposite()");
@@ -930,45 +802,26 @@ bool NESConvertTileDataToComposite(char *buf, char *tileData, int size) {
 	if (!tileData || !size || !buf) return false;
 	if (size % NES_ROM_TILE_LENGTH) return false;
 	
-	int tileCount = size / NES_ROM_TILE_LENGTH;
+	NESDecodeTiles((uchar *)buf, (uchar *)tileData, size / NES_ROM_TILE_LENGTH);
 	
-	unsigned char channel_a[NES_ROM_TILE_CHANNEL_LENGTH], channel_b[NES_ROM_TILE_CHANNEL_LENGTH];
-	int i = 0;
-	int j = 0;
-	int curTile = 0;
-	
-	char *composite = (char *)malloc(NES_COMPOSITE_TILE_LENGTH * tileCount);
+	return true;
+}
+
+bool NESConvertCompositeToTileData(char *buf, char *compositeData, int size) {
+	/*
+	**	convert composite data (compositeData) back to native tile data
+	**	buf must hold NES_ROM_TILE_LENGTH bytes for every tile in compositeData
+	*/
 	
-	for (curTile = 0; curTile < tileCount; curTile++) {
-		v_printf(VERBOSE_TRACE_1, "curTile: %d/%d", curTile + 1, tileCount);
-		
-		//initialize channel_a and channel_b
-		for (i = 0; i < NES_ROM_TILE_CHANNEL_LENGTH; i++) {
-			channel_a[i] = tileData[NES_ROM_TILE_LENGTH * (curTile) + i];
-			channel_b[i] = tileData[NES_ROM_TILE_LENGTH * (curTile) + i + NES_ROM_TILE_CHANNEL_LENGTH];
-			v_printf(VERBOSE_TRACE_2, "Channels A/B: %d/%d", channel_a[i], channel_b[i]);
-		}
-		
-		//create composite data
-		for (i = 0; i < NES_ROM_TILE_CHANNEL_LENGTH; i++) {
-			for (j = 7; j >= 0; j--) {
-				int pixel_offset = (i * 8) + (8 - j); //where in the composite we are
-				composite[(pixel_offset + curTile * NES_COMPOSITE_TILE_LENGTH) - 1] = NESCombineBits(channel_a[i], channel_b[i], j);
-				v_printf(VERBOSE_TRACE_2, "Composite (%d,%d:%d): %d", i, j, (pixel_offset + curTile * NES_COMPOSITE_TILE_LENGTH),composite[pixel_offset + curTile * NES_COMPOSITE_TILE_LENGTH]);
-			}
-		}
-	}
+	if (!compositeData || !size || !buf) return false;
+	if (size % NES_COMPOSITE_TILE_LENGTH) return false;
 	
-	memcpy(buf, composite, NES_COMPOSITE_TILE_LENGTH * tileCount);
+	NESEncodeTiles((uchar *)buf, (uchar *)compositeData, size / NES_COMPOSITE_TILE_LENGTH);
 	
 	return true;
 }
 
-char *NESConvertTileDataToRom(char *compositeData, int size) {
-	return NULL;
-}
-
-int NESTileCountFromData(u16 size) {
+int NESTileCountFromData(int size) {
 	/*
 	**	returns the number of tiles in the data based on the size of the data
 	*/
@@ -62,6 +62,23 @@ extern "C" {
 #define NES_RESERVED_BYTES_OFFSET			9			/* reserved; should all be 0 */
 #define NES_RESERVED_BYTES_LENGTH			7			/* length of reserved bytes */
 
+// NES 2.0 headers reuse bytes 7-15 (see http://wiki.nesdev.com/w/index.php/NES_2.0)
+#define NES2_IDENTIFIER_MASK				12			/* 00001100 : in the second ROM control byte */
+#define NES2_IDENTIFIER						8			/* 00001000 : (byte 7 & NES2_IDENTIFIER_MASK) for NES 2.0 */
+#define NES_ARCHAIC_IDENTIFIER				4			/* 00000100 : (byte 7 & NES2_IDENTIFIER_MASK) for archaic iNES */
+#define NES2_CONSOLE_TYPE_MASK				3			/* 00000011 : in the second ROM control byte */
+
+#define NES2_MAPPER_OFFSET					8			/* bits 0-3: mapper bits 8-11, bits 4-7: submapper */
+#define NES2_ROM_SIZE_MSB_OFFSET			9			/* bits 0-3: PRG size MSB, bits 4-7: CHR size MSB */
+#define NES2_PRG_RAM_OFFSET					10			/* bits 0-3: PRG-RAM shift count, bits 4-7: PRG-NVRAM shift count */
+#define NES2_CHR_RAM_OFFSET					11			/* bits 0-3: CHR-RAM shift count, bits 4-7: CHR-NVRAM shift count */
+#define NES2_TIMING_OFFSET					12			/* bits 0-1: CPU/PPU timing */
+#define NES2_SYSTEM_TYPE_OFFSET				13			/* Vs. System PPU/hardware type or extended console type */
+#define NES2_MISC_ROMS_OFFSET				14			/* bits 0-1: number of miscellaneous ROMs */
+#define NES2_EXPANSION_OFFSET				15			/* bits 0-5: default expansion device */
+
+#define NES2_SIZE_EXPONENT_MSB				15			/* a size MSB nibble of 0xF means the LSB byte is EEEEEEMM: 2^E * (MM * 2 + 1) */
+
 // ROM
 #define NES_ROM_TILE_LENGTH 				16			/* datalength of a tile from ROM file (.nes) - 16 bytes */
 
@@ -80,6 +97,9 @@ extern "C" {
 
 #define NES_TITLE_BLOCK_LENGTH 				128			/* the block size (including padding) of the title data that gets appended to the end of the file */
 
+#define NES_TRAINER_OFFSET					16			/* the trainer (if NES_ROM_CONTROL_TRAINER_MASK is set) sits between the header and the first PRG bank */
+#define NES_TRAINER_LENGTH					512			/* length (in bytes) of the trainer */
+
 // tile assembly order
 // horiz =>  	1 2			vertical =>		1 3
 //				3 4							2 4
@@ -96,8 +116,8 @@ typedef enum {
 
 //header functions:
 //returns the number of PRG and CHR banks respectively
-char NESGetPrgBankCount(FILE *ifile);
-char NESGetChrBankCount(FILE *ifile);
+int NESGetPrgBankCount(FILE *ifile);
+int NESGetChrBankCount(FILE *ifile);
 
 //reads the ROM control bytes
 bool NESGetRomControlBytes(char *buf, FILE *ifile);
@@ -133,11 +153,12 @@ char *NESMakeCompoundTile(char *tileData, int size, int columns, NESSpriteOrder
 //title functions
 int NESHasTitle(FILE *ifile);
 void NESGetTitle(char *buf, FILE *ifile, int strip);
+void NESCopyTitle(char *buf, uchar *title_data, u32 length, bool strip);
 bool NESSetTitle(FILE *ofile, char *title);
 bool NESRemoveTitle(FILE *ofile);
 
 //some utility functions
-u32 NESGetFilesize(FILE *ifile);
+u64 NESGetFilesize(FILE *ifile);
 bool NESVerifyROM(FILE *ifile);
 
 //seeking around in file
@@ -154,8 +175,10 @@ int NESTileToComposite(char *tile_data, char *composite_data);
 void NESCompositeRowToChannels(char *tile_row, char *buf);
 int NESCompositeToTile(char *composite_data, char *tile_data);
 
+//batch conversion (see tilecodec.h for the kernels)
 bool NESConvertTileDataToComposite(char *buf, char *tileData, int size);
-int NESTileCountFromData(u16 size);
+bool NESConvertCompositeToTileData(char *buf, char *compositeData, int size);
+int NESTileCountFromData(int size);
 
 int NESGetOffset(int x, int y, int width);
 
@@ -0,0 +1,270 @@
+/*
+**	ntsc.c
+**	nesromtool
+**
+**	the NTSC filter (see ntsc.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "ntsc.h"
+#include "palette.h"
+#include "verbosity.h"
+
+#if defined(__SSE2__)
+#define NES_NTSC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define NES_NTSC_PHASES					12			/* signal samples per color carrier cycle */
+#define NES_NTSC_PIXEL_SAMPLES			8			/* signal samples per pixel */
+#define NES_NTSC_LINE_PHASE				4			/* how much later each scanline starts (341 pixels * 8 samples, mod 12) */
+#define NES_NTSC_STEP					(NES_NTSC_PIXEL_SAMPLES / NES_NTSC_SCALE)	/* samples per output pixel */
+
+#define NES_NTSC_HUE					120.0		/* degrees; lines the decoded hues up with NESMasterPalette */
+#define NES_NTSC_SATURATION				1.4
+#define NES_NTSC_GAMMA					(2.2 / 1.8)	/* the PPU's signal is made for a TV's gamma, not a monitor's */
+#define NES_NTSC_GAMMA_STEPS			1024
+
+//PPU output levels, in volts above sync: the low and high halves of the square wave for each luma level
+static const float NESNtscLevels[8] = { 0.350f, 0.518f, 0.962f, 1.550f, 1.094f, 1.506f, 1.962f, 1.962f };
+#define NES_NTSC_BLACK					0.518f
+#define NES_NTSC_WHITE					1.962f
+
+//a pixel's 8 samples for each color, starting at each phase of the carrier
+static float NESNtscSignal[NES_MASTER_PALETTE_LENGTH][NES_NTSC_PHASES][NES_NTSC_PIXEL_SAMPLES];
+
+//the decoder: what each of a window's 12 samples adds to R, G and B, for each phase the window can start at
+//(the 4th lane is unused; it lets a sample's three weights go in one vector)
+static float NESNtscWeights[NES_NTSC_PHASES][NES_NTSC_PHASES][4] __attribute__((aligned(16)));
+
+static uchar NESNtscGammaTable[NES_NTSC_GAMMA_STEPS + 1];
+
+static pthread_once_t NESNtscTablesOnce = PTHREAD_ONCE_INIT;
+
+static bool ntsc_filter = false;
+
+#pragma mark *** Tables ***
+
+static float NESNtscSample(int color, int phase) {
+	/*
+	**	the PPU's signal for a master palette entry at one phase of the carrier: the low 4 bits are a hue,
+	**	which is where in the cycle the wave is high, and the next 2 are a luma level. hue 0 is high all
+	**	the way through, 13-15 are low all the way through (14 and 15 are the blacks, at level 1)
+	*/
+	
+	int hue = color & 0x0F;
+	int level = (color >> 4) & 0x03;
+	
+	if (hue > 13) level = 1;
+	
+	float low = NESNtscLevels[level];
+	float high = NESNtscLevels[4 + level];
+	
+	if (hue == 0) low = high;
+	if (hue > 12) high = low;
+	
+	float signal = (((hue + phase) % NES_NTSC_PHASES) < NES_NTSC_PHASES / 2) ? high : low;
+	
+	//0 at black, 1 at white
+	return (signal - NES_NTSC_BLACK) / (NES_NTSC_WHITE - NES_NTSC_BLACK);
+}
+
+static void NESNtscBuildTables() {
+	int color = 0, phase = 0, sample = 0;
+	int step = 0;
+	
+	for (color = 0; color < NES_MASTER_PALETTE_LENGTH; color++) {
+		for (phase = 0; phase < NES_NTSC_PHASES; phase++) {
+			for (sample = 0; sample < NES_NTSC_PIXEL_SAMPLES; sample++) {
+				NESNtscSignal[color][phase][sample] = NESNtscSample(color, phase + sample);
+			}
+		}
+	}
+	
+	/*
+	**	a window's luma is the average of its samples, and its chroma (I and Q) the average of them
+	**	times the carrier and the carrier 90 degrees on. YIQ to RGB is linear too, so it's folded in
+	**	here and decoding a pixel is just 12 samples times 12 sets of RGB weights
+	*/
+	
+	for (phase = 0; phase < NES_NTSC_PHASES; phase++) {
+		for (sample = 0; sample < NES_NTSC_PHASES; sample++) {
+			double angle = (M_PI * (phase + sample) / 6.0) + (NES_NTSC_HUE * M_PI / 180.0);
+			double y = 1.0 / NES_NTSC_PHASES;
+			double i = NES_NTSC_SATURATION * cos(angle) / NES_NTSC_PHASES;
+			double q = NES_NTSC_SATURATION * sin(angle) / NES_NTSC_PHASES;
+			
+			NESNtscWeights[phase][sample][0] = (float)(y + (0.946882 * i) + (0.623557 * q));
+			NESNtscWeights[phase][sample][1] = (float)(y - (0.274788 * i) - (0.635691 * q));
+			NESNtscWeights[phase][sample][2] = (float)(y - (1.108545 * i) + (1.709007 * q));
+			NESNtscWeights[phase][sample][3] = 0.0f;
+		}
+	}
+	
+	for (step = 0; step <= NES_NTSC_GAMMA_STEPS; step++) {
+		double value = 255.95 * pow((double)step / NES_NTSC_GAMMA_STEPS, NES_NTSC_GAMMA);
+		
+		NESNtscGammaTable[step] = (value > 255.0) ? 255 : (uchar)value;
+	}
+}
+
+#pragma mark -
+#pragma mark *** Rendering ***
+
+static void NESNtscEncodeLine(float *signal, const uchar *pixels, int width, int line_phase, const uchar *colors, int color_count) {
+	/*
+	**	signal gets width pixels' samples with a pixel of the backdrop (color 0) either side of them,
+	**	so the decoder's window never runs off the end. sample n is at carrier phase line_phase + n
+	*/
+	
+	int x = 0;
+	
+	for (x = -1; x <= width; x++) {
+		int index = (x >= 0 && x < width) ? pixels[x] : 0;
+		int color = colors[(index < color_count) ? index : 0] & (NES_MASTER_PALETTE_LENGTH - 1);
+		int phase = (line_phase + ((x + 1) * NES_NTSC_PIXEL_SAMPLES)) % NES_NTSC_PHASES;
+		
+		memcpy(signal + ((x + 1) * NES_NTSC_PIXEL_SAMPLES), NESNtscSignal[color][phase], sizeof(NESNtscSignal[color][phase]));
+	}
+}
+
+static void NESNtscDecodeLine(uchar *rgb, const float *signal, int width, int line_phase) {
+	/*
+	**	each output pixel is decoded from the 12 samples (one carrier cycle) centered on it, which reach
+	**	into the pixels either side. with SSE2 a sample's R, G and B are worked out together
+	*/
+	
+	int out_width = width * NES_NTSC_SCALE;
+	int x = 0, i = 0;
+	
+	for (x = 0; x < out_width; x++, rgb += 3) {
+		int start = NES_NTSC_PIXEL_SAMPLES + (x * NES_NTSC_STEP) + (NES_NTSC_STEP / 2) - (NES_NTSC_PHASES / 2);
+		const float *window = signal + start;
+		const float *weights = NESNtscWeights[(line_phase + start) % NES_NTSC_PHASES][0];
+		int steps[4];
+		
+#ifdef NES_NTSC_SSE2
+		__m128 sum = _mm_setzero_ps();
+		
+		for (i = 0; i < NES_NTSC_PHASES; i++) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(window[i]), _mm_load_ps(weights + (i * 4))));
+		}
+		
+		sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		_mm_storeu_si128((__m128i*)steps, _mm_cvttps_epi32(_mm_mul_ps(sum, _mm_set1_ps((float)NES_NTSC_GAMMA_STEPS))));
+#else
+		float sum[3] = { 0.0f, 0.0f, 0.0f };
+		
+		for (i = 0; i < NES_NTSC_PHASES; i++) {
+			sum[0] += window[i] * weights[(i * 4) + 0];
+			sum[1] += window[i] * weights[(i * 4) + 1];
+			sum[2] += window[i] * weights[(i * 4) + 2];
+		}
+		
+		for (i = 0; i < 3; i++) {
+			float value = (sum[i] < 0.0f) ? 0.0f : (sum[i] > 1.0f) ? 1.0f : sum[i];
+			steps[i] = (int)(value * NES_NTSC_GAMMA_STEPS);
+		}
+#endif
+		
+		rgb[0] = NESNtscGammaTable[steps[0]];
+		rgb[1] = NESNtscGammaTable[steps[1]];
+		rgb[2] = NESNtscGammaTable[steps[2]];
+	}
+}
+
+//one thread's share of the scanlines
+typedef struct nesNtscTask {
+	const uchar *pixels;
+	int width;
+	const uchar *colors;
+	int color_count;
+	uchar *rgb;
+	int first_line;
+	int last_line;							/* one past the last */
+} NESNtscTask;
+
+static void *NESNtscRenderLines(void *arg) {
+	NESNtscTask *task = (NESNtscTask*)arg;
+	u64 out_stride = (u64)task->width * NES_NTSC_SCALE * 3;
+	float *signal = (float*)malloc(sizeof(float) * (task->width + 2) * NES_NTSC_PIXEL_SAMPLES);
+	int y = 0, i = 0;
+	
+	for (y = task->first_line; y < task->last_line; y++) {
+		int line_phase = (int)(((u64)y * NES_NTSC_LINE_PHASE) % NES_NTSC_PHASES);
+		uchar *line = task->rgb + ((u64)y * NES_NTSC_SCALE * out_stride);
+		
+		NESNtscEncodeLine(signal, task->pixels + ((u64)y * task->width), task->width, line_phase, task->colors, task->color_count);
+		NESNtscDecodeLine(line, signal, task->width, line_phase);
+		
+		//the rest of the output lines for this scanline are copies
+		for (i = 1; i < NES_NTSC_SCALE; i++) {
+			memcpy(line + (i * out_stride), line, out_stride);
+		}
+	}
+	
+	free(signal);
+	
+	return NULL;
+}
+
+uchar *NESNtscRender(const uchar *pixels, int width, int height, const uchar *colors, int color_count, int threads) {
+	int i = 0;
+	
+	pthread_once(&NESNtscTablesOnce, NESNtscBuildTables);
+	
+	uchar *rgb = (uchar*)malloc((u64)width * height * NES_NTSC_SCALE * NES_NTSC_SCALE * 3);
+	if (!rgb) return NULL;
+	
+	if (threads > height) threads = height;
+	if (threads < 1) threads = 1;
+	
+	NESNtscTask *tasks = (NESNtscTask*)malloc(sizeof(NESNtscTask) * threads);
+	pthread_t *workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	bool *started = (bool*)calloc(threads, sizeof(bool));
+	
+	for (i = 0; i < threads; i++) {
+		tasks[i].pixels = pixels;
+		tasks[i].width = width;
+		tasks[i].colors = colors;
+		tasks[i].color_count = color_count;
+		tasks[i].rgb = rgb;
+		tasks[i].first_line = (int)(((u64)height * i) / threads);
+		tasks[i].last_line = (int)(((u64)height * (i + 1)) / threads);
+	}
+	
+	//this thread does the first share, and any share a thread couldn't be started for
+	for (i = 1; i < threads; i++) {
+		started[i] = (pthread_create(&workers[i], NULL, NESNtscRenderLines, &tasks[i]) == 0);
+	}
+	
+	NESNtscRenderLines(&tasks[0]);
+	
+	for (i = 1; i < threads; i++) {
+		if (started[i]) {
+			pthread_join(workers[i], NULL);
+		} else {
+			NESNtscRenderLines(&tasks[i]);
+		}
+	}
+	
+	v_printf(VERBOSE_DEBUG, "ntsc: %dx%d on %d threads", width, height, threads);
+	
+	free(tasks);
+	free(workers);
+	free(started);
+	
+	return rgb;
+}
+
+bool get_ntsc_filter() {
+	return ntsc_filter;
+}
+
+void set_ntsc_filter(bool enabled) {
+	ntsc_filter = enabled;
+}
@@ -0,0 +1,39 @@
+/*
+**	ntsc.h
+**	nesromtool
+**
+**	an NTSC filter: renders palette entries the way a TV shows the NES's composite video
+**
+**	each scanline is turned into the signal the PPU would send (a square wave per pixel, 8 samples
+**	long, whose phase against the 12-sample color carrier picks the hue) and decoded back to RGB
+**	the way a TV does it, over a window a color cycle wide. neighboring pixels bleed into each
+**	other, so edges get the fringes and artifact colors that real hardware shows, and every
+**	scanline starts a third of a cycle later than the one before it, like the PPU's do
+*/
+
+#ifndef _NTSC_H_
+#define _NTSC_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_NTSC_SCALE					2			/* output pixels per input pixel, across and down */
+
+//renders a width x height image through the filter
+//pixels are indices into colors (master palette entries, 0-63); an index of color_count or more is drawn as colors[0]
+//returns (width * NES_NTSC_SCALE) x (height * NES_NTSC_SCALE) RGB pixels, 3 bytes each, that the caller frees
+//scanlines are split between threads threads; NULL if out of memory
+uchar *NESNtscRender(const uchar *pixels, int width, int height, const uchar *colors, int color_count, int threads);
+
+//the -N setting (off until set)
+bool get_ntsc_filter();
+void set_ntsc_filter(bool enabled);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _NTSC_H_ */
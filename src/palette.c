@@ -0,0 +1,137 @@
+/*
+**	palette.c
+**	nesromtool
+**
+**	tile colors (see palette.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <strings.h>
+
+#include "palette.h"
+
+const uchar NESMasterPalette[NES_MASTER_PALETTE_LENGTH * 3] = {
+	 84,  84,  84,    0,  30, 116,    8,  16, 144,   48,   0, 136,   68,   0, 100,   92,   0,  48,   84,   4,   0,   60,  24,   0,
+	 32,  42,   0,    8,  58,   0,    0,  64,   0,    0,  60,   0,    0,  50,  60,    0,   0,   0,    0,   0,   0,    0,   0,   0,
+	152, 150, 152,    8,  76, 196,   48,  50, 236,   92,  30, 228,  136,  20, 176,  160,  20, 100,  152,  34,  32,  120,  60,   0,
+	 84,  90,   0,   40, 114,   0,    8, 124,   0,    0, 118,  40,    0, 102, 120,    0,   0,   0,    0,   0,   0,    0,   0,   0,
+	236, 238, 236,   76, 154, 236,  120, 124, 236,  176,  98, 236,  228,  84, 236,  236,  88, 180,  236, 106, 100,  212, 136,  32,
+	160, 170,   0,  116, 196,   0,   76, 208,  32,   56, 204, 108,   56, 180, 204,   60,  60,  60,    0,   0,   0,    0,   0,   0,
+	236, 238, 236,  168, 204, 236,  188, 188, 236,  212, 178, 236,  236, 174, 236,  236, 174, 212,  236, 180, 176,  228, 196, 144,
+	204, 210, 120,  180, 222, 120,  168, 226, 144,  152, 226, 180,  160, 214, 228,  160, 162, 160,    0,   0,   0,    0,   0,   0
+};
+
+//evenly spaced grays, which no set of master palette entries quite gives
+static const uchar NESPaletteGrays[NES_PALETTE_LENGTH * 3] = {
+	0x00, 0x00, 0x00,
+	0x55, 0x55, 0x55,
+	0xAA, 0xAA, 0xAA,
+	0xFF, 0xFF, 0xFF
+};
+
+//the master palette entries closest to them
+#define NES_PALETTE_GRAY_ENTRIES		"0f001030"
+
+static const NESNamedPalette NESNamedPalettes[] = {
+	{ "gray",			NULL,			"4 even shades of gray (the default)" },
+	{ "nes-gray",		"0f001030",		"the NES's own grays" },
+	{ "mario",			"0f162718",		"red, orange and brown" },
+	{ "luigi",			"0f302719",		"white, orange and green" },
+	{ "fire",			"0f372716",		"cream, orange and red" },
+	{ "overworld",		"22291a0f",		"sky blue, greens and black" },
+	{ "link",			"0f292717",		"green, orange and brown" },
+	{ NULL,				NULL,			NULL }
+};
+
+static uchar color_palette_chosen[NES_PALETTE_LENGTH * 3];
+static const uchar *color_palette = NESPaletteGrays;
+static uchar color_palette_entries[NES_PALETTE_LENGTH] = { 0x0F, 0x00, 0x10, 0x30 };
+
+bool NESPaletteParse(uchar *palette, uchar *entries, const char *spec) {
+	int values[NES_PALETTE_LENGTH];
+	int count = 0;
+	const char *p = spec;
+	int i = 0;
+	
+	if (!spec) return false;
+	
+	for (i = 0; NESNamedPalettes[i].name; i++) {
+		if (strcasecmp(spec, NESNamedPalettes[i].name) != 0) continue;
+		
+		if (!NESNamedPalettes[i].entries) {
+			NESPaletteParse(palette, entries, NES_PALETTE_GRAY_ENTRIES);
+			memcpy(palette, NESPaletteGrays, sizeof(NESPaletteGrays));
+			return true;
+		}
+		
+		return NESPaletteParse(palette, entries, NESNamedPalettes[i].entries);
+	}
+	
+	if (strchr(spec, ',')) {
+		//comma-separated: each entry is one or two digits
+		while (count < NES_PALETTE_LENGTH) {
+			char *end = NULL;
+			
+			if (!isxdigit((unsigned char)*p)) return false;
+			
+			long entry = strtol(p, &end, 16);
+			
+			if (end - p > 2) return false;
+			values[count++] = (int)entry;
+			
+			p = end;
+			if (*p == ',' && count < NES_PALETTE_LENGTH) p++;
+		}
+	} else {
+		//run together: two digits each
+		char digits[3] = { 0, 0, 0 };
+		
+		if (strlen(spec) != NES_PALETTE_LENGTH * 2) return false;
+		
+		for (count = 0; count < NES_PALETTE_LENGTH; count++, p += 2) {
+			if (!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1])) return false;
+			
+			digits[0] = p[0];
+			digits[1] = p[1];
+			values[count] = (int)strtol(digits, NULL, 16);
+		}
+	}
+	
+	if (*p) return false;
+	
+	for (count = 0; count < NES_PALETTE_LENGTH; count++) {
+		if (values[count] >= NES_MASTER_PALETTE_LENGTH) return false;
+	}
+	
+	for (count = 0; count < NES_PALETTE_LENGTH; count++) {
+		memcpy(palette + (count * 3), NESMasterPalette + (values[count] * 3), 3);
+		if (entries) entries[count] = (uchar)values[count];
+	}
+	
+	return true;
+}
+
+void NESPalettePrintNames(FILE *ofile) {
+	int i = 0;
+	
+	for (i = 0; NESNamedPalettes[i].name; i++) {
+		fprintf(ofile, "\t%-12s%-12s%s\n", NESNamedPalettes[i].name,
+			NESNamedPalettes[i].entries ? NESNamedPalettes[i].entries : "", NESNamedPalettes[i].description);
+	}
+}
+
+const uchar *get_color_palette() {
+	return color_palette;
+}
+
+const uchar *get_color_palette_entries() {
+	return color_palette_entries;
+}
+
+void set_color_palette(const uchar *palette, const uchar *entries) {
+	memcpy(color_palette_chosen, palette, sizeof(color_palette_chosen));
+	memcpy(color_palette_entries, entries, sizeof(color_palette_entries));
+	color_palette = color_palette_chosen;
+}
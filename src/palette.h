@@ -0,0 +1,57 @@
+/*
+**	palette.h
+**	nesromtool
+**
+**	colors for drawing tiles: the NES master palette, and the 4 colors (as RGB) that a tile's
+**	pixel values 0-3 are drawn with, chosen with -c
+**
+**	every image writer colors its sheet with these. the formats here are all indexed (a PNG or
+**	GIF color table, CSS classes, SVG fills, terminal escapes), so the palette is applied once
+**	per color rather than once per pixel
+**
+**	the master palette entries a palette was made from are kept too, for the NTSC filter (ntsc.h),
+**	which works from the colors the PPU would have been asked for rather than from RGB
+*/
+
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+#include <stdio.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_MASTER_PALETTE_LENGTH		64			/* colors the PPU can make */
+#define NES_PALETTE_LENGTH				4			/* colors in a tile palette */
+
+//the master palette, as RGB triples (the usual 2C02 one)
+extern const uchar NESMasterPalette[NES_MASTER_PALETTE_LENGTH * 3];
+
+//a palette with a name, for -c
+typedef struct nesNamedPalette {
+	char *name;
+	char *entries;							/* as for NESPaletteParse(); NULL for the default grays */
+	char *description;
+} NESNamedPalette;
+
+//sets palette (NES_PALETTE_LENGTH RGB triples) from the name of a palette, or from four master
+//palette entries in hex, either run together ("0f162736") or separated by commas ("f,16,27,36")
+//entries (if not NULL) gets the NES_PALETTE_LENGTH master palette entries; the default grays use 0f001030
+//returns false if spec is neither
+bool NESPaletteParse(uchar *palette, uchar *entries, const char *spec);
+
+//lists the named palettes, one per line
+void NESPalettePrintNames(FILE *ofile);
+
+//the -c palette (4 shades of gray until one is set), and the master palette entries it was made from
+const uchar *get_color_palette();
+const uchar *get_color_palette_entries();
+void set_color_palette(const uchar *palette, const uchar *entries);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _PALETTE_H_ */
@@ -2,7 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 
 int IPS_apply(FILE *source, FILE *patch) {
 	/*
@@ -50,7 +50,7 @@ int IPS_apply(FILE *source, FILE *patch) {
 			int j = 0;
 			//if it's RLE encoded, we write the only byte in pr->data pr->size times
 			for (j = 0; j < pr->size; j++) {
-				if (fputc(pr->data[0], source) != pr->data[0]) {
+				if (fputc(pr->data[0], source) == EOF) {
 					return -20; //error writing patch data
 				}
 			}
@@ -59,6 +59,8 @@ int IPS_apply(FILE *source, FILE *patch) {
 				return -20; //error writing patch data
 			}	
 		}
+		
+		free(pr->data);
 	}
 		
 	if (err != -1) {
@@ -71,6 +73,29 @@ int IPS_apply(FILE *source, FILE *patch) {
 	return patch_count; //no error
 }
 
+static unsigned char *IPS_read_file(FILE *file, unsigned long *length) {
+	/*
+	**	reads all of file into a malloc()ed buffer
+	**	returns NULL on error
+	*/
+	
+	long size = 0;
+	
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0) return NULL;
+	rewind(file);
+	
+	unsigned char *data = (unsigned char*)malloc(size ? size : 1);
+	
+	if (size && fread(data, size, 1, file) != 1) {
+		free(data);
+		return NULL;
+	}
+	
+	*length = size;
+	
+	return data;
+}
+
 int IPS_create(FILE *original, FILE *modified, FILE *patch, int use_rle) {
 	/*
 	**	create a new patch_file by comparing source_file to modif_file
@@ -79,90 +104,182 @@ int IPS_create(FILE *original, FILE *modified, FILE *patch, int use_rle) {
 	**	set use_rle to 1 to enable rle
 	**
 	**	returns number of patches written
-	**	returns -10 if there was an error writing the patch header
-	**	returns -20 if there was an error writing the patch EOF
+	**	returns -5 if either file couldn't be read
+	**	(see IPS_create_data() for the rest)
 	*/
 	
+	unsigned long original_length = 0;
+	unsigned long modified_length = 0;
+	unsigned char *original_data = NULL;
+	unsigned char *modified_data = NULL;
+	
 	if (!original || !modified || !patch) return -1;
 	
-	//make sure we're at the beginning of each file...
-	rewind(original);
-	rewind(modified);
+	if (!(original_data = IPS_read_file(original, &original_length))) return -5;
+	
+	if (!(modified_data = IPS_read_file(modified, &modified_length))) {
+		free(original_data);
+		return -5;
+	}
+	
 	rewind(patch);
 	
-	//let's write the header of the patch
-	if (fwrite(IPS_HEADER_MAGIC_WORD, IPS_HEADER_LENGTH, 1, patch) != 1) {
-		return -10; //error
+	int patch_count = IPS_create_data(original_data, original_length, modified_data, modified_length, patch, use_rle);
+	
+	free(original_data);
+	free(modified_data);
+	
+	return patch_count;
+}
+
+static int IPS_write_record(FILE *patch, unsigned long offset, unsigned long size, const unsigned char *data, int is_rle) {
+	/*
+	**	writes one record: size bytes of data, or (for RLE) data[0] size times
+	**	returns 1 on success, 0 on a write error
+	*/
+	
+	unsigned char offset_value[IPS_OFFSET_LENGTH] = {
+		(offset >> 16) & 0xff,
+		(offset >> 8) & 0xff,
+		offset & 0xff
+	};
+	
+	unsigned char size_value[IPS_SIZE_LENGTH] = {
+		(size >> 8) & 0xff,
+		size & 0xff
+	};
+	
+	unsigned char rle_value[IPS_SIZE_LENGTH] = { 0, 0 };
+	
+	if (fwrite(offset_value, IPS_OFFSET_LENGTH, 1, patch) != 1) return 0;
+	
+	if (is_rle) {
+		//RLE records have a size of 0, then the real size and the byte to repeat
+		return fwrite(rle_value, IPS_SIZE_LENGTH, 1, patch) == 1
+			&& fwrite(size_value, IPS_RLE_SIZE_LENGTH, 1, patch) == 1
+			&& fwrite(data, IPS_RLE_DATA_LENGTH, 1, patch) == 1;
 	}
 	
-	//allocate the buffer; this is where we will store the different data
-	//need to allocate 2^16 bytes
-	char *buffer = (char*)malloc(pow(2,16));
-	long patch_offset = 0;
-	short buffer_size = 0;
-	int patch_count = 0;
+	return fwrite(size_value, IPS_SIZE_LENGTH, 1, patch) == 1
+		&& fwrite(data, size, 1, patch) == 1;
+}
+
+static int IPS_write_records(FILE *patch, const unsigned char *modified, unsigned long offset, unsigned long size, int use_rle) {
+	/*
+	**	writes modified[offset] through modified[offset + size - 1] (size <= IPS_SIZE_MAX)
+	**	with use_rle set, long runs of one byte get their own RLE records
+	**	returns the number of records written, or -1 on a write error
+	*/
 	
-	char c; //buffer for single character reads
+	int count = 0;
 	
-	//for now, we don't support RLE
+	//a record starting at "EOF" would end the patch; start one byte early instead
+	//(the byte before is written with the value it already has in modified)
+	if (offset == IPS_EOF_OFFSET) {
+		if (!IPS_write_record(patch, offset - 1, 2, modified + offset - 1, 0)) return -1;
+		count++;
+		offset++;
+		size--;
+	}
 	
-	//read a character from the original and the modified files and loop until
-	//we hit a character where they don't match 
-	while( !feof(modified) && !feof(original) ) {
-		while( (c = fgetc(modified)) == fgetc(original) && !feof(modified) && !feof(original));
+	while (size > 0) {
+		unsigned long literal = 0;
+		unsigned long run = 0;
 		
-		//if we're at the EOF, let's exit this iteration, which will exit the outer loop, too.
-		if (feof(modified) || feof(original)) {
-			continue;
+		//find the next run long enough to be worth an RLE record
+		while (literal < size) {
+			run = 1;
+			if (use_rle) {
+				while (literal + run < size && modified[offset + literal + run] == modified[offset + literal]) run++;
+				if (run >= IPS_RLE_MIN) break;
+			}
+			literal += run;
+			run = 0;
 		}
 		
-		//now we hit a character that doesn't match,
-		//so let's loop until we hit a character that does
+		if (literal) {
+			if (!IPS_write_record(patch, offset, literal, modified + offset, 0)) return -1;
+			count++;
+			offset += literal;
+			size -= literal;
+		}
 		
-		patch_offset = ftell(modified) - 1;		
+		if (run) {
+			//only a literal record can step around "EOF", so split the run there
+			if (offset == IPS_EOF_OFFSET) {
+				int more = IPS_write_records(patch, modified, offset, run, 0);
+				if (more < 0) return -1;
+				count += more;
+			} else {
+				if (!IPS_write_record(patch, offset, run, modified + offset, 1)) return -1;
+				count++;
+			}
+			offset += run;
+			size -= run;
+		}
+	}
+	
+	return count;
+}
 
-		buffer[buffer_size++] = c;
-		while ((c = fgetc(modified)) != fgetc(original)) {
-			buffer[buffer_size++] = c;
-			
-			//if we've maxed out our buffer, let's bail, write this one out and
-			//start the next one... this should almost never happen...
-			if (buffer_size > pow(2,16)) {
+int IPS_create_data(const unsigned char *original, unsigned long original_length, const unsigned char *modified, unsigned long modified_length, FILE *patch, int use_rle) {
+	/*
+	**	writes a patch that turns original into modified
+	**	changes closer together than a record's overhead share one record; anything past the
+	**	end of original is always written. IPS can't shrink a file, so if modified is shorter
+	**	than original the result is still original_length bytes long
+	**
+	**	returns number of patches written
+	**	returns -10 if there was an error writing the patch header
+	**	returns -20 if there was an error writing the patch EOF
+	**	returns -30 if modified has changes past IPS_OFFSET_MAX
+	**	returns -40 if there was an error writing a record
+	*/
+	
+	unsigned long position = 0;
+	int patch_count = 0;
+	
+	if (!original || !modified || !patch) return -1;
+	
+	//let's write the header of the patch
+	if (fwrite(IPS_HEADER_MAGIC_WORD, IPS_HEADER_LENGTH, 1, patch) != 1) {
+		return -10; //error
+	}
+	
+	while (position < modified_length) {
+		//skip everything that's the same
+		if (position < original_length && modified[position] == original[position]) {
+			position++;
+			continue;
+		}
+		
+		if (position > IPS_OFFSET_MAX) {
+			return -30;
+		}
+		
+		//grow the record until there's a stretch of matching bytes longer than starting a new one would cost
+		unsigned long start = position;
+		unsigned long last = position; //the last byte that differs
+		
+		for (position = start; position < modified_length && position - start < IPS_SIZE_MAX; position++) {
+			if (position >= original_length || modified[position] != original[position]) {
+				last = position;
+			} else if (position - last > IPS_RECORD_OVERHEAD) {
 				break;
 			}
 		}
-
-		//we hit 2 characters that match, so let's write out the patch information...
-
-		printf("Patch: Offset: %d (%08X), Length: %d(%04X)\n", patch_offset, patch_offset, buffer_size, buffer_size);
-
-		char offset_value[3] = { 
-			(patch_offset & 0x00ff0000) >> 16,
-			(patch_offset & 0x0000ff00) >> 8,
-			(patch_offset & 0x000000ff)
-		};
 		
-		char size_value[2] = {
-			(buffer_size & 0xff00) >> 8,
-			(buffer_size & 0x00ff)
-		};
-
-		//patch_offset = patch_offset << 8;
-		//long *offset_value = &(patch_offset);
-		//short *size_value = &(buffer_size);
+		position = last + 1;
 		
-		fwrite(offset_value, IPS_OFFSET_LENGTH, 1, patch);
-		fwrite(size_value, IPS_SIZE_LENGTH, 1, patch);
-		fwrite(buffer, buffer_size, 1, patch);
-
-		//reset the buffer and increment patch_count
-		buffer_size = 0;
-		patch_count++;
-
+		//every record has to start at or before IPS_OFFSET_MAX, so no splitting one that runs past it
+		int count = IPS_write_records(patch, modified, start, position - start, use_rle && position <= IPS_OFFSET_MAX);
+		if (count < 0) {
+			return -40;
+		}
+		
+		patch_count += count;
 	}
 	
-	free(buffer);
-	
 	//at the end of the file, so write out the EOF and we're done.
 	if (fwrite(IPS_EOF_MAGIC_WORD, IPS_EOF_LENGTH, 1, patch) != 1) {
 		//an error occurred while writing...
@@ -217,6 +334,9 @@ int IPS_read_record(FILE *pfile, IPS_Record *pr) {
 			return 0; //error
 		}
 		
+		//the real size is the number of times to repeat the one byte of data
+		pr->size = IPS_BYTE2_TO_UINT(patch_size);
+		
 		//allocate the RLE data length worth of 
 		pr->data = (char*)malloc(IPS_RLE_DATA_LENGTH);
 		pr->is_rle = 1; //this patch record IS RLE encoded
@@ -226,7 +346,8 @@ int IPS_read_record(FILE *pfile, IPS_Record *pr) {
 		pr->is_rle = 0; //this patch record is NOT RLE encoded
 	}
 	
-	if (fread(pr->data, pr->size, 1, pfile) != 1) {
+	if (fread(pr->data, pr->is_rle ? IPS_RLE_DATA_LENGTH : pr->size, 1, pfile) != 1) {
+		free(pr->data);
 		return 0;
 	}
 	
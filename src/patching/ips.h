@@ -20,9 +20,13 @@
 #define IPS_SIZE_LENGTH			2 		/* the data length of the Size segment */
 
 #define IPS_SIZE_MAX			65535	/* the maximum patch size */
+#define IPS_OFFSET_MAX			0xFFFFFF	/* the last offset a record can start at */
+#define IPS_EOF_OFFSET			0x454F46	/* "EOF"; a record can't start here or it reads as the end of the patch */
+#define IPS_RECORD_OVERHEAD		(IPS_OFFSET_LENGTH + IPS_SIZE_LENGTH)	/* bytes a record costs besides its data */
 
 #define IPS_RLE_SIZE_LENGTH		2 		/* the data length of an RLE size segment */
 #define IPS_RLE_DATA_LENGTH		1 		/* the data length of an RLE encoded data segment */
+#define IPS_RLE_MIN				16		/* shortest run of one byte worth its own RLE record */
 
 // the following 2 macros were copied from http://zerosoft.zophar.net/ips.htm :
 // values are stored in IPS patchfiles as big-endian
@@ -48,6 +52,9 @@ int IPS_apply(FILE *source, FILE *patch);
 // create a new patch file at patch_file that will make source_file like modif_file
 int IPS_create(FILE *original, FILE *modified, FILE *patch, int use_rle);
 
+// same as IPS_create(), but from data that's already in memory (ie: mapped ROMs)
+int IPS_create_data(const unsigned char *original, unsigned long original_length, const unsigned char *modified, unsigned long modified_length, FILE *patch, int use_rle);
+
 // reads an IPS_Record from the current location in pfile (pfile is a patchfile)
 int IPS_read_record(FILE *pfile, IPS_Record *pr);
 
@@ -7,11 +7,16 @@
  *
  */
 
+#define _XOPEN_SOURCE 500	/* for nftw() */
+
 #include "pathfunc.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <ftw.h>
+#include <sys/stat.h>
 
 #ifndef PATH_SEPARATOR
 #define PATH_SEPARATOR '/'
@@ -116,3 +121,136 @@ int pathComponentCount(char *source) {
 	
 	return count;
 }
+
+//state for collectFilePaths() (nftw() callbacks don't take a context pointer)
+static char **collected_paths = NULL;
+static int collected_count = 0;
+static int collected_capacity = 0;
+static char *collected_extension = NULL;
+
+static void collectPath(const char *path) {
+	if (collected_count + 1 >= collected_capacity) {
+		collected_capacity = collected_capacity ? collected_capacity * 2 : 256;
+		collected_paths = (char**)realloc(collected_paths, sizeof(char*) * collected_capacity);
+	}
+	
+	collected_paths[collected_count++] = strdup(path);
+	collected_paths[collected_count] = NULL;
+}
+
+static int collectWalkCallback(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+	(void)ftw;
+	
+	if (type != FTW_F || !S_ISREG(st->st_mode)) return 0;
+	
+	if (collected_extension) {
+		size_t length = strlen(path);
+		size_t ext_length = strlen(collected_extension);
+		
+		if (length <= ext_length || strcasecmp(path + length - ext_length, collected_extension) != 0) return 0;
+	}
+	
+	collectPath(path);
+	
+	return 0;
+}
+
+static int comparePaths(const void *a, const void *b) {
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+static unsigned int hashPath(const char *path) {
+	//FNV-1a
+	unsigned int hash = 2166136261u;
+	
+	for (; *path; path++) {
+		hash = (hash ^ (unsigned char)*path) * 16777619u;
+	}
+	
+	return hash;
+}
+
+static int dropDuplicatePaths(char **paths, int count) {
+	/*
+	**	removes every path that's already earlier in the list, keeping the order of the rest
+	**	returns the new count
+	*/
+	
+	int size = 16;
+	int i = 0;
+	int j = 0;
+	
+	while (size < count * 2) size *= 2;
+	
+	char **seen = (char**)calloc(size, sizeof(char*));
+	
+	for (i = 0, j = 0; i < count; i++) {
+		unsigned int slot = hashPath(paths[i]) & (size - 1);
+		
+		while (seen[slot] && strcmp(seen[slot], paths[i]) != 0) slot = (slot + 1) & (size - 1);
+		
+		if (seen[slot]) {
+			free(paths[i]);
+			continue;
+		}
+		
+		seen[slot] = paths[i];
+		paths[j++] = paths[i];
+	}
+	
+	free(seen);
+	
+	return j;
+}
+
+char **collectFilePaths(char **roots, char *extension, int *count) {
+	/*
+	**	builds a list of files from roots (a NULL-terminated list of paths)
+	**	files are taken as-is (even if they don't exist, so the caller reports the error)
+	**	directories are walked, without following symlinks, for regular files ending in extension
+	**	(case-insensitive; NULL for every file)
+	**	returns a NULL-terminated list in the order of roots, each directory's files sorted in its place,
+	**	with duplicates removed (the first one stays); free it with freePathList()
+	**	not thread-safe
+	*/
+	
+	struct stat st;
+	int count_out = 0;
+	
+	collected_capacity = 256;
+	collected_paths = (char**)malloc(sizeof(char*) * collected_capacity);
+	collected_paths[0] = NULL;
+	collected_count = 0;
+	collected_extension = extension;
+	
+	for (; *roots; roots++) {
+		if (stat(*roots, &st) == 0 && S_ISDIR(st.st_mode)) {
+			//nftw() order depends on the filesystem, so a walk's files are sorted
+			int first = collected_count;
+			
+			nftw(*roots, collectWalkCallback, 32, FTW_PHYS);
+			qsort(collected_paths + first, collected_count - first, sizeof(char*), comparePaths);
+		} else {
+			collectPath(*roots);
+		}
+	}
+	
+	count_out = dropDuplicatePaths(collected_paths, collected_count);
+	collected_paths[count_out] = NULL;
+	
+	if (count) *count = count_out;
+	
+	char **paths = collected_paths;
+	collected_paths = NULL;
+	
+	return paths;
+}
+
+void freePathList(char **paths) {
+	char **p = paths;
+	
+	if (!paths) return;
+	
+	for (; *p; p++) free(*p);
+	free(paths);
+}
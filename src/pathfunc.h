@@ -25,6 +25,9 @@ char *lastPathComponent(char *source);
 char *nthPathComponent(char *buf, char *source, int n);
 int pathComponentCount(char *source);
 
+char **collectFilePaths(char **roots, char *extension, int *count);
+void freePathList(char **paths);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,218 @@
+/*
+**	png.c
+**	nesromtool
+**
+**	PNG encoding (see png.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "png.h"
+#include "deflate.h"
+#include "hash.h"
+#include "verbosity.h"
+
+#define NES_PNG_SIGNATURE				"\x89PNG\r\n\x1a\n"
+#define NES_PNG_SIGNATURE_LENGTH		8
+
+enum {
+	nes_png_filter_none = 0,
+	nes_png_filter_sub,
+	nes_png_filter_up,
+	nes_png_filter_average,
+	nes_png_filter_paeth,
+	nes_png_filter_count
+};
+
+static bool NESPngWriteChunk(FILE *ofile, char *type, const uchar *data, u64 length) {
+	/*
+	**	length, type, data, then the CRC of the type and data
+	*/
+	
+	uchar header[8];
+	uchar trailer[4];
+	
+	header[0] = length >> 24;
+	header[1] = length >> 16;
+	header[2] = length >> 8;
+	header[3] = length;
+	memcpy(header + 4, type, 4);
+	
+	uint32_t crc = crc32_update(0, header + 4, 4);
+	if (length) crc = crc32_update(crc, data, length);
+	
+	trailer[0] = crc >> 24;
+	trailer[1] = crc >> 16;
+	trailer[2] = crc >> 8;
+	trailer[3] = crc;
+	
+	return fwrite(header, 1, sizeof(header), ofile) == sizeof(header)
+		&& (length == 0 || fwrite(data, 1, length, ofile) == length)
+		&& fwrite(trailer, 1, sizeof(trailer), ofile) == sizeof(trailer);
+}
+
+static inline uchar NESPngPaeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+static void NESPngFilterRow(uchar *out, const uchar *row, const uchar *previous, u64 length, int bpp, int filter) {
+	/*
+	**	previous is NULL for the first row (which counts as a row of zeros)
+	*/
+	
+	u64 i = 0;
+	
+	for (i = 0; i < length; i++) {
+		int left = (i >= (u64)bpp) ? row[i - bpp] : 0;
+		int up = previous ? previous[i] : 0;
+		int corner = (previous && i >= (u64)bpp) ? previous[i - bpp] : 0;
+		
+		switch (filter) {
+			case nes_png_filter_sub: out[i] = row[i] - left; break;
+			case nes_png_filter_up: out[i] = row[i] - up; break;
+			case nes_png_filter_average: out[i] = row[i] - ((left + up) >> 1); break;
+			case nes_png_filter_paeth: out[i] = row[i] - NESPngPaeth(left, up, corner); break;
+			default: out[i] = row[i]; break;
+		}
+	}
+}
+
+static u64 NESPngFilterCost(const uchar *filtered, u64 length) {
+	//the sum of the bytes taken as signed: the closer to zero, the better they tend to compress
+	u64 cost = 0;
+	u64 i = 0;
+	
+	for (i = 0; i < length; i++) {
+		cost += abs((signed char)filtered[i]);
+	}
+	
+	return cost;
+}
+
+static void NESPngFilter(uchar *out, const uchar *rows, int height, u64 row_length, int bpp, bool adaptive) {
+	/*
+	**	each output row is a filter type byte, then the filtered row
+	**	indexed images go unfiltered (the PNG spec's advice, and it holds up: neighbouring palette
+	**	indices aren't related the way neighbouring color samples are)
+	*/
+	
+	uchar *trial = (uchar*)malloc(row_length + 1);
+	int y = 0;
+	int filter = 0;
+	
+	for (y = 0; y < height; y++) {
+		const uchar *row = rows + (y * row_length);
+		const uchar *previous = y ? row - row_length : NULL;
+		uchar *target = out + (y * (row_length + 1));
+		u64 best_cost = 0;
+		
+		target[0] = nes_png_filter_none;
+		memcpy(target + 1, row, row_length);
+		
+		if (!adaptive) continue;
+		
+		best_cost = NESPngFilterCost(target + 1, row_length);
+		
+		for (filter = nes_png_filter_sub; filter < nes_png_filter_count; filter++) {
+			NESPngFilterRow(trial, row, previous, row_length, bpp, filter);
+			
+			u64 cost = NESPngFilterCost(trial, row_length);
+			
+			if (cost < best_cost) {
+				best_cost = cost;
+				target[0] = filter;
+				memcpy(target + 1, trial, row_length);
+			}
+		}
+	}
+	
+	free(trial);
+}
+
+bool NESWritePng(FILE *ofile, const uchar *pixels, int width, int height, NESPngColorType color_type, const uchar *palette, int palette_count, int threads) {
+	int depth = 8;
+	int channels = 1;
+	int x = 0, y = 0;
+	
+	if (width <= 0 || height <= 0 || (color_type == nes_png_indexed && (palette_count <= 0 || palette_count > NES_PNG_MAX_PALETTE))) {
+		errno = EINVAL;
+		return false;
+	}
+	
+	if (color_type == nes_png_indexed) {
+		depth = (palette_count <= 2) ? 1 : (palette_count <= 4) ? 2 : (palette_count <= 16) ? 4 : 8;
+	} else {
+		channels = (color_type == nes_png_rgba) ? 4 : 3;
+	}
+	
+	//pack the rows (several pixels to a byte below 8 bits, leftmost in the high bits)
+	u64 row_length = (((u64)width * channels * depth) + 7) / 8;
+	uchar *rows = NULL;
+	
+	if (depth == 8) {
+		rows = (uchar*)pixels;
+	} else {
+		int per_byte = 8 / depth;
+		
+		rows = (uchar*)calloc(row_length * height, 1);
+		
+		for (y = 0; y < height; y++) {
+			const uchar *source = pixels + ((u64)y * width);
+			uchar *target = rows + (y * row_length);
+			
+			for (x = 0; x < width; x++) {
+				int shift = 8 - (depth * ((x % per_byte) + 1));
+				target[x / per_byte] |= (source[x] & ((1 << depth) - 1)) << shift;
+			}
+		}
+	}
+	
+	u64 filtered_length = (row_length + 1) * height;
+	uchar *filtered = (uchar*)malloc(filtered_length);
+	
+	NESPngFilter(filtered, rows, height, row_length, (channels * depth + 7) / 8, color_type != nes_png_indexed);
+	
+	if (rows != pixels) free(rows);
+	
+	u64 compressed_length = 0;
+	uchar *compressed = NESDeflate(filtered, filtered_length, threads, &compressed_length);
+	
+	free(filtered);
+	
+	v_printf(VERBOSE_DEBUG, "png: %dx%d, %d-bit, %llu bytes of image data", width, height, depth, compressed_length);
+	
+	uchar ihdr[13];
+	
+	ihdr[0] = width >> 24;
+	ihdr[1] = width >> 16;
+	ihdr[2] = width >> 8;
+	ihdr[3] = width;
+	ihdr[4] = height >> 24;
+	ihdr[5] = height >> 16;
+	ihdr[6] = height >> 8;
+	ihdr[7] = height;
+	ihdr[8] = depth;
+	ihdr[9] = color_type;
+	ihdr[10] = 0;		//deflate
+	ihdr[11] = 0;		//adaptive filtering
+	ihdr[12] = 0;		//not interlaced
+	
+	bool ok = (fwrite(NES_PNG_SIGNATURE, 1, NES_PNG_SIGNATURE_LENGTH, ofile) == NES_PNG_SIGNATURE_LENGTH)
+		&& NESPngWriteChunk(ofile, "IHDR", ihdr, sizeof(ihdr))
+		&& (color_type != nes_png_indexed || NESPngWriteChunk(ofile, "PLTE", palette, palette_count * 3))
+		&& NESPngWriteChunk(ofile, "IDAT", compressed, compressed_length)
+		&& NESPngWriteChunk(ofile, "IEND", NULL, 0);
+	
+	free(compressed);
+	
+	return ok;
+}
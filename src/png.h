@@ -0,0 +1,40 @@
+/*
+**	png.h
+**	nesromtool
+**
+**	a self-contained PNG writer (compression is in deflate.h)
+**
+**	indexed images are packed to the smallest bit depth their palette fits in (2 bits for the
+**	usual 4 colors) and left unfiltered; RGB and RGBA rows each get the filter that leaves them
+**	closest to zero. the image is deflated in chunks, on several threads for big sheets
+*/
+
+#ifndef _PNG_H_
+#define _PNG_H_
+
+#include <stdio.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_PNG_MAX_PALETTE				256
+
+typedef enum {
+	nes_png_rgb = 2,
+	nes_png_indexed = 3,
+	nes_png_rgba = 6
+} NESPngColorType;
+
+//writes a width x height image to ofile
+//pixels are one palette index per byte (nes_png_indexed, with palette_count RGB triples in palette),
+//or 3 or 4 bytes per pixel (nes_png_rgb / nes_png_rgba, palette is ignored)
+//threads is how many threads the compression may use; returns false on error (errno is set)
+bool NESWritePng(FILE *ofile, const uchar *pixels, int width, int height, NESPngColorType color_type, const uchar *palette, int palette_count, int threads);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _PNG_H_ */
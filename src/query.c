@@ -0,0 +1,480 @@
+/*
+**	query.c
+**	nesromtool
+**
+**	filtered scans over a catalog's column arrays (see query.h)
+**
+**	each predicate is one pass down a single column, ANDing 64 results at a time into the
+**	result bitmap. 32-bit columns are compared 4 (SSE2) or 8 (AVX2) entries per instruction;
+**	64-bit columns 4 at a time with AVX2, otherwise one at a time.
+**	words of the bitmap that are already 0 are skipped, so later predicates get cheaper.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "query.h"
+#include "verbosity.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NES_QUERY_X86 1
+#include <immintrin.h>
+#endif
+
+#define NES_QUERY_WORD_BITS			64
+
+typedef void (*NESScan32Kernel)(uint64_t *bitmap, const uint32_t *column, u64 words, NESQueryOp op, uint32_t value, uint32_t mask);
+typedef void (*NESScan64Kernel)(uint64_t *bitmap, const uint64_t *column, u64 words, NESQueryOp op, uint64_t value, uint64_t mask);
+
+#pragma mark *** PARSING ***
+
+typedef enum {
+	query_field_number = 0,					/* plain integer (decimal, or 0x for hex) */
+	query_field_size,						/* integer with an optional k/m suffix */
+	query_field_hex,						/* a hash, always hex */
+	query_field_format,						/* archaic, ines or nes2 */
+	query_field_mirroring,					/* horizontal or vertical (one bit of the flags column) */
+	query_field_flag						/* one bit of the flags column */
+} NESQueryFieldType;
+
+typedef struct nesQueryField {
+	char *name;
+	NESCatalogColumn column;
+	NESQueryFieldType type;
+	uint32_t flag;							/* for flag and mirroring fields */
+} NESQueryField;
+
+//names line up with the info --format record columns
+static NESQueryField NESQueryFields[] = {
+	{ "filesize",		catalog_size,			query_field_size,		0 },
+	{ "prg_size",		catalog_prg_size,		query_field_size,		0 },
+	{ "chr_size",		catalog_chr_size,		query_field_size,		0 },
+	{ "trimmable",		catalog_trimmable,		query_field_size,		0 },
+	{ "prg_banks",		catalog_prg_count,		query_field_number,		0 },
+	{ "chr_banks",		catalog_chr_count,		query_field_number,		0 },
+	{ "mapper",			catalog_mapper,			query_field_number,		0 },
+	{ "submapper",		catalog_submapper,		query_field_number,		0 },
+	{ "format",			catalog_format,			query_field_format,		0 },
+	{ "mirroring",		catalog_flags,			query_field_mirroring,	NES_CATALOG_FLAG_VERTICAL },
+	{ "four_screen",	catalog_flags,			query_field_flag,		NES_CATALOG_FLAG_FOUR_SCREEN },
+	{ "battery",		catalog_flags,			query_field_flag,		NES_CATALOG_FLAG_BATTERY },
+	{ "trainer",		catalog_flags,			query_field_flag,		NES_CATALOG_FLAG_TRAINER },
+	{ "title",			catalog_flags,			query_field_flag,		NES_CATALOG_FLAG_TITLE },
+	{ "valid",			catalog_flags,			query_field_flag,		NES_CATALOG_FLAG_VALID },
+	{ "prg_ram",		catalog_prg_ram,		query_field_size,		0 },
+	{ "prg_nvram",		catalog_prg_nvram,		query_field_size,		0 },
+	{ "chr_ram",		catalog_chr_ram,		query_field_size,		0 },
+	{ "chr_nvram",		catalog_chr_nvram,		query_field_size,		0 },
+	{ "console_type",	catalog_console_type,	query_field_number,		0 },
+	{ "timing",			catalog_timing,			query_field_number,		0 },
+	{ "crc32",			catalog_crc32,			query_field_hex,		0 },
+	{ "payload_crc32",	catalog_payload_crc32,	query_field_hex,		0 },
+	{ "mtime",			catalog_mtime,			query_field_number,		0 },
+	{ "inode",			catalog_inode,			query_field_number,		0 },
+	{ NULL,				0,						0,						0 }
+};
+
+char **NESQueryFieldNames() {
+	static char *names[sizeof(NESQueryFields) / sizeof(NESQueryField)];
+	int i = 0;
+	
+	for (i = 0; NESQueryFields[i].name; i++) {
+		names[i] = NESQueryFields[i].name;
+	}
+	names[i] = NULL;
+	
+	return names;
+}
+
+static bool NESQueryParseValue(NESQueryField *field, char *text, uint64_t *value) {
+	/*
+	**	turns the right-hand side of a predicate into a column value
+	*/
+	
+	char *end = NULL;
+	
+	if (!text || !*text) return false;
+	
+	switch (field->type) {
+		case query_field_format:
+			if (strcmp(text, "archaic") == 0) { *value = nes_format_archaic; return true; }
+			if (strcmp(text, "ines") == 0) { *value = nes_format_ines; return true; }
+			if (strcmp(text, "nes2") == 0) { *value = nes_format_nes2; return true; }
+			break;
+		
+		case query_field_mirroring:
+			if (strcmp(text, "vertical") == 0) { *value = field->flag; return true; }
+			if (strcmp(text, "horizontal") == 0) { *value = 0; return true; }
+			return false;
+		
+		case query_field_flag:
+			if (strcmp(text, "1") == 0 || strcmp(text, "true") == 0 || strcmp(text, "yes") == 0) { *value = field->flag; return true; }
+			if (strcmp(text, "0") == 0 || strcmp(text, "false") == 0 || strcmp(text, "no") == 0) { *value = 0; return true; }
+			return false;
+		
+		case query_field_hex:
+			*value = strtoull(text, &end, 16);
+			return (*end == '\0' && strlen(text) <= 8);
+		
+		default:
+			break;
+	}
+	
+	*value = strtoull(text, &end, 0);
+	if (end == text) return false;
+	
+	if (field->type == query_field_size && (*end == 'k' || *end == 'K')) {
+		*value *= 1024;
+		end++;
+	} else if (field->type == query_field_size && (*end == 'm' || *end == 'M')) {
+		*value *= 1024 * 1024;
+		end++;
+	}
+	
+	return (*end == '\0');
+}
+
+bool NESQueryParsePredicate(NESQueryPredicate *predicate, char *text, char **error) {
+	bool negate = false;
+	size_t name_length = 0;
+	int i = 0;
+	
+	if (text[0] == '!') {
+		negate = true;
+		text++;
+	}
+	
+	while (isalnum((uchar)text[name_length]) || text[name_length] == '_') name_length++;
+	
+	NESQueryField *field = NULL;
+	for (i = 0; NESQueryFields[i].name; i++) {
+		if (strlen(NESQueryFields[i].name) == name_length && strncmp(NESQueryFields[i].name, text, name_length) == 0) {
+			field = &NESQueryFields[i];
+			break;
+		}
+	}
+	
+	if (!field) {
+		*error = "unknown field";
+		return false;
+	}
+	
+	predicate->column = field->column;
+	predicate->mask = field->flag ? field->flag : UINT64_MAX;
+	
+	char *op = text + name_length;
+	
+	//a bare field means "set" (or non-zero); with a ! in front, the opposite
+	if (*op == '\0') {
+		predicate->value = 0;
+		predicate->op = negate ? query_eq : query_ne;
+		return true;
+	}
+	
+	if (negate) {
+		*error = "'!' only goes in front of a bare field";
+		return false;
+	}
+	
+	if (strncmp(op, "==", 2) == 0) { predicate->op = query_eq; op += 2; }
+	else if (strncmp(op, "!=", 2) == 0) { predicate->op = query_ne; op += 2; }
+	else if (strncmp(op, "<=", 2) == 0) { predicate->op = query_le; op += 2; }
+	else if (strncmp(op, ">=", 2) == 0) { predicate->op = query_ge; op += 2; }
+	else if (*op == '=') { predicate->op = query_eq; op++; }
+	else if (*op == '<') { predicate->op = query_lt; op++; }
+	else if (*op == '>') { predicate->op = query_gt; op++; }
+	else {
+		*error = "expected =, !=, <, <=, > or >=";
+		return false;
+	}
+	
+	if (field->flag && predicate->op != query_eq && predicate->op != query_ne) {
+		*error = "only = and != work on this field";
+		return false;
+	}
+	
+	if (!NESQueryParseValue(field, op, &(predicate->value))) {
+		*error = "bad value";
+		return false;
+	}
+	
+	return true;
+}
+
+#pragma mark -
+#pragma mark *** SCALAR ***
+
+static inline bool NESQueryCompare(uint64_t x, NESQueryOp op, uint64_t value) {
+	switch (op) {
+		case query_eq:	return x == value;
+		case query_ne:	return x != value;
+		case query_lt:	return x < value;
+		case query_le:	return x <= value;
+		case query_gt:	return x > value;
+		default:		return x >= value;
+	}
+}
+
+static uint64_t NESScanWord32(const uint32_t *column, int n, NESQueryOp op, uint32_t value, uint32_t mask) {
+	uint64_t bits = 0;
+	int i = 0;
+	
+	for (i = 0; i < n; i++) {
+		if (NESQueryCompare(column[i] & mask, op, value)) bits |= (uint64_t)1 << i;
+	}
+	
+	return bits;
+}
+
+static uint64_t NESScanWord64(const uint64_t *column, int n, NESQueryOp op, uint64_t value, uint64_t mask) {
+	uint64_t bits = 0;
+	int i = 0;
+	
+	for (i = 0; i < n; i++) {
+		if (NESQueryCompare(column[i] & mask, op, value)) bits |= (uint64_t)1 << i;
+	}
+	
+	return bits;
+}
+
+static void NESScan32Scalar(uint64_t *bitmap, const uint32_t *column, u64 words, NESQueryOp op, uint32_t value, uint32_t mask) {
+	u64 w = 0;
+	
+	for (w = 0; w < words; w++, column += NES_QUERY_WORD_BITS) {
+		if (bitmap[w]) bitmap[w] &= NESScanWord32(column, NES_QUERY_WORD_BITS, op, value, mask);
+	}
+}
+
+static void NESScan64Scalar(uint64_t *bitmap, const uint64_t *column, u64 words, NESQueryOp op, uint64_t value, uint64_t mask) {
+	u64 w = 0;
+	
+	for (w = 0; w < words; w++, column += NES_QUERY_WORD_BITS) {
+		if (bitmap[w]) bitmap[w] &= NESScanWord64(column, NES_QUERY_WORD_BITS, op, value, mask);
+	}
+}
+
+#pragma mark -
+#pragma mark *** SIMD ***
+
+#ifdef NES_QUERY_X86
+
+/*
+**	the SIMD kernels only have (signed) ==, and >, so:
+**		x < v is v > x; x != v, x >= v and x <= v are the inverse of ==, < and >
+**	flipping the top bit of both sides turns the signed compare into an unsigned one
+*/
+static inline bool NESQueryOpIsInverted(NESQueryOp op) {
+	return (op == query_ne || op == query_ge || op == query_le);
+}
+
+__attribute__((target("sse2")))
+static void NESScan32SSE2(uint64_t *bitmap, const uint32_t *column, u64 words, NESQueryOp op, uint32_t value, uint32_t mask) {
+	const __m128i bias = _mm_set1_epi32((int)0x80000000);
+	const __m128i vmask = _mm_set1_epi32((int)mask);
+	const __m128i vvalue = _mm_xor_si128(_mm_set1_epi32((int)value), bias);
+	const uint64_t invert = NESQueryOpIsInverted(op) ? UINT64_MAX : 0;
+	u64 w = 0;
+	int i = 0;
+	
+	for (w = 0; w < words; w++, column += NES_QUERY_WORD_BITS) {
+		uint64_t bits = 0;
+		
+		if (!bitmap[w]) continue;
+		
+		for (i = 0; i < NES_QUERY_WORD_BITS; i += 4) {
+			__m128i x = _mm_xor_si128(_mm_and_si128(_mm_loadu_si128((const __m128i *)(column + i)), vmask), bias);
+			__m128i hit;
+			
+			if (op == query_eq || op == query_ne) {
+				hit = _mm_cmpeq_epi32(x, vvalue);
+			} else if (op == query_lt || op == query_ge) {
+				hit = _mm_cmpgt_epi32(vvalue, x);
+			} else {
+				hit = _mm_cmpgt_epi32(x, vvalue);
+			}
+			
+			bits |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(hit)) << i;
+		}
+		
+		bitmap[w] &= bits ^ invert;
+	}
+}
+
+__attribute__((target("avx2")))
+static void NESScan32AVX2(uint64_t *bitmap, const uint32_t *column, u64 words, NESQueryOp op, uint32_t value, uint32_t mask) {
+	const __m256i bias = _mm256_set1_epi32((int)0x80000000);
+	const __m256i vmask = _mm256_set1_epi32((int)mask);
+	const __m256i vvalue = _mm256_xor_si256(_mm256_set1_epi32((int)value), bias);
+	const uint64_t invert = NESQueryOpIsInverted(op) ? UINT64_MAX : 0;
+	u64 w = 0;
+	int i = 0;
+	
+	for (w = 0; w < words; w++, column += NES_QUERY_WORD_BITS) {
+		uint64_t bits = 0;
+		
+		if (!bitmap[w]) continue;
+		
+		for (i = 0; i < NES_QUERY_WORD_BITS; i += 8) {
+			__m256i x = _mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(column + i)), vmask), bias);
+			__m256i hit;
+			
+			if (op == query_eq || op == query_ne) {
+				hit = _mm256_cmpeq_epi32(x, vvalue);
+			} else if (op == query_lt || op == query_ge) {
+				hit = _mm256_cmpgt_epi32(vvalue, x);
+			} else {
+				hit = _mm256_cmpgt_epi32(x, vvalue);
+			}
+			
+			bits |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) << i;
+		}
+		
+		bitmap[w] &= bits ^ invert;
+	}
+}
+
+__attribute__((target("avx2")))
+static void NESScan64AVX2(uint64_t *bitmap, const uint64_t *column, u64 words, NESQueryOp op, uint64_t value, uint64_t mask) {
+	const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+	const __m256i vmask = _mm256_set1_epi64x((long long)mask);
+	const __m256i vvalue = _mm256_xor_si256(_mm256_set1_epi64x((long long)value), bias);
+	const uint64_t invert = NESQueryOpIsInverted(op) ? UINT64_MAX : 0;
+	u64 w = 0;
+	int i = 0;
+	
+	for (w = 0; w < words; w++, column += NES_QUERY_WORD_BITS) {
+		uint64_t bits = 0;
+		
+		if (!bitmap[w]) continue;
+		
+		for (i = 0; i < NES_QUERY_WORD_BITS; i += 4) {
+			__m256i x = _mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(column + i)), vmask), bias);
+			__m256i hit;
+			
+			if (op == query_eq || op == query_ne) {
+				hit = _mm256_cmpeq_epi64(x, vvalue);
+			} else if (op == query_lt || op == query_ge) {
+				hit = _mm256_cmpgt_epi64(vvalue, x);
+			} else {
+				hit = _mm256_cmpgt_epi64(x, vvalue);
+			}
+			
+			bits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(hit)) << i;
+		}
+		
+		bitmap[w] &= bits ^ invert;
+	}
+}
+
+#endif /* NES_QUERY_X86 */
+
+#pragma mark -
+#pragma mark *** DISPATCH ***
+
+static NESScan32Kernel NESScan32 = NULL;
+static NESScan64Kernel NESScan64 = NULL;
+static char *NESQueryKernel = "scalar";
+static pthread_once_t NESQueryKernelsOnce = PTHREAD_ONCE_INIT;
+
+static void NESPickQueryKernels() {
+	/*
+	**	picks the widest kernels the CPU supports: AVX2, then SSE2 (32-bit columns only), then scalar
+	*/
+	
+	NESScan32Kernel scan32 = NESScan32Scalar;
+	NESScan64Kernel scan64 = NESScan64Scalar;
+	char *name = "scalar";
+
+#ifdef NES_QUERY_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2")) {
+		scan32 = NESScan32AVX2;
+		scan64 = NESScan64AVX2;
+		name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		scan32 = NESScan32SSE2;
+		name = "sse2";
+	}
+#endif
+
+	NESQueryKernel = name;
+	NESScan32 = scan32;
+	NESScan64 = scan64;
+	
+	v_printf(VERBOSE_TRACE, "Query kernel: %s", name);
+}
+
+char *NESQueryKernelName() {
+	pthread_once(&NESQueryKernelsOnce, NESPickQueryKernels);
+	
+	return NESQueryKernel;
+}
+
+#pragma mark -
+#pragma mark *** QUERIES ***
+
+uint64_t *NESQueryRun(NESCatalog *catalog, NESQueryPredicate *predicates, int predicate_count, u64 *match_count) {
+	/*
+	**	full words go through the picked kernel; the last partial word is done by hand
+	*/
+	
+	u64 count = catalog->count;
+	u64 full_words = count / NES_QUERY_WORD_BITS;
+	int tail = count % NES_QUERY_WORD_BITS;
+	u64 words = full_words + (tail ? 1 : 0);
+	u64 w = 0;
+	int i = 0;
+	
+	pthread_once(&NESQueryKernelsOnce, NESPickQueryKernels);
+	
+	uint64_t *bitmap = (uint64_t *)malloc(sizeof(uint64_t) * (words ? words : 1));
+	
+	for (w = 0; w < full_words; w++) bitmap[w] = UINT64_MAX;
+	if (tail) bitmap[full_words] = ((uint64_t)1 << tail) - 1;
+	
+	for (i = 0; i < predicate_count; i++) {
+		NESQueryPredicate *p = &predicates[i];
+		
+		if (NESCatalogColumnWidth(p->column) == sizeof(uint64_t)) {
+			const uint64_t *column = (const uint64_t *)NESCatalogColumnData(catalog, p->column);
+			
+			NESScan64(bitmap, column, full_words, p->op, p->value, p->mask);
+			if (tail) bitmap[full_words] &= NESScanWord64(column + (full_words * NES_QUERY_WORD_BITS), tail, p->op, p->value, p->mask);
+		} else {
+			const uint32_t *column = (const uint32_t *)NESCatalogColumnData(catalog, p->column);
+			
+			//a 32-bit column can't hold anything past UINT32_MAX, so those compares are constant
+			if (p->value > UINT32_MAX) {
+				bool all = (p->op == query_ne || p->op == query_lt || p->op == query_le);
+				if (!all) memset(bitmap, 0, sizeof(uint64_t) * words);
+				continue;
+			}
+			
+			NESScan32(bitmap, column, full_words, p->op, (uint32_t)p->value, (uint32_t)p->mask);
+			if (tail) bitmap[full_words] &= NESScanWord32(column + (full_words * NES_QUERY_WORD_BITS), tail, p->op, (uint32_t)p->value, (uint32_t)p->mask);
+		}
+	}
+	
+	if (match_count) {
+		*match_count = 0;
+		for (w = 0; w < words; w++) *match_count += __builtin_popcountll(bitmap[w]);
+	}
+	
+	return bitmap;
+}
+
+long long NESQueryNextMatch(uint64_t *bitmap, u64 count, u64 index) {
+	while (index < count) {
+		u64 w = index / NES_QUERY_WORD_BITS;
+		uint64_t bits = bitmap[w] >> (index % NES_QUERY_WORD_BITS);
+		
+		if (bits) return index + __builtin_ctzll(bits);
+		
+		index = (w + 1) * NES_QUERY_WORD_BITS;
+	}
+	
+	return -1;
+}
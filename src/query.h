@@ -0,0 +1,61 @@
+/*
+**	query.h
+**	nesromtool
+**
+**	filtered scans over a catalog's column arrays
+**
+**	a query is a list of predicates that must all match. each one is a single word:
+**		<field><op><value>		mapper=4, chr_banks>16, prg_size>=256k, crc32=9a1fb071
+**		<field>					true/non-zero (battery, title, mapper)
+**		!<field>				false/zero (!title)
+**	ops are = (or ==), !=, <, <=, > and >=
+**	results come back as a bitmap with one bit per catalog entry (bit n of word n / 64)
+*/
+
+#ifndef _QUERY_H_
+#define _QUERY_H_
+
+#include <stdint.h>
+#include "types.h"
+#include "catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	query_eq = 0,
+	query_ne,
+	query_lt,
+	query_le,
+	query_gt,
+	query_ge
+} NESQueryOp;
+
+typedef struct nesQueryPredicate {
+	NESCatalogColumn column;
+	NESQueryOp op;
+	uint64_t value;
+	uint64_t mask;							/* the column value is ANDed with this before comparing */
+} NESQueryPredicate;
+
+//parses one predicate; on failure returns false and points *error at a message
+bool NESQueryParsePredicate(NESQueryPredicate *predicate, char *text, char **error);
+
+//the field names NESQueryParsePredicate() knows, as a NULL-terminated list
+char **NESQueryFieldNames();
+
+//runs every predicate over catalog; returns a malloc()ed bitmap and sets *match_count
+uint64_t *NESQueryRun(NESCatalog *catalog, NESQueryPredicate *predicates, int predicate_count, u64 *match_count);
+
+//walks a result bitmap: returns the first match at or after index, or -1
+long long NESQueryNextMatch(uint64_t *bitmap, u64 count, u64 index);
+
+//name of the scan kernel that was picked ("avx2", "sse2" or "scalar")
+char *NESQueryKernelName();
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _QUERY_H_ */
@@ -0,0 +1,473 @@
+/*
+**	records.c
+**	nesromtool
+**
+**	NDJSON and CSV records for ROMs (see records.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "records.h"
+#include "pathfunc.h"
+#include "hash.h"
+#include "verify.h"
+
+#define STRBUF_MIN_CAPACITY			1024
+
+//every record has these columns, in this order (it's the CSV header, too)
+static char *NESRecordColumns[] = {
+	"path", "filename", "filesize", "valid", "error",
+	"format", "prg_banks", "chr_banks", "prg_size", "chr_size",
+	"mapper", "submapper", "mirroring", "battery", "trainer",
+	"prg_ram", "prg_nvram", "chr_ram", "chr_nvram", "console_type", "timing",
+	"title", "crc32", "md5", "sha1", "payload_crc32", "payload_md5", "payload_sha1",
+	"trainer_offset", "prg_offsets", "chr_offsets", "title_offset", "overdump_offset", "overdump_length",
+	NULL
+};
+
+#pragma mark *** StrBuf ***
+
+void strbuf_init(StrBuf *sb) {
+	sb->data = NULL;
+	sb->length = 0;
+	sb->capacity = 0;
+}
+
+void strbuf_free(StrBuf *sb) {
+	free(sb->data);
+	strbuf_init(sb);
+}
+
+void strbuf_reset(StrBuf *sb) {
+	sb->length = 0;
+}
+
+static void strbuf_reserve(StrBuf *sb, size_t extra) {
+	if (sb->length + extra <= sb->capacity) return;
+	
+	size_t capacity = sb->capacity ? sb->capacity : STRBUF_MIN_CAPACITY;
+	while (capacity < sb->length + extra) capacity *= 2;
+	
+	char *data = (char *)realloc(sb->data, capacity);
+	if (!data) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	
+	sb->data = data;
+	sb->capacity = capacity;
+}
+
+void strbuf_append(StrBuf *sb, const char *s, size_t length) {
+	strbuf_reserve(sb, length);
+	memcpy(sb->data + sb->length, s, length);
+	sb->length += length;
+}
+
+void strbuf_append_str(StrBuf *sb, const char *s) {
+	strbuf_append(sb, s, strlen(s));
+}
+
+void strbuf_append_char(StrBuf *sb, char c) {
+	strbuf_reserve(sb, 1);
+	sb->data[sb->length++] = c;
+}
+
+void strbuf_append_u64(StrBuf *sb, u64 n) {
+	char digits[24];
+	int i = sizeof(digits);
+	
+	do {
+		digits[--i] = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+	
+	strbuf_append(sb, digits + i, sizeof(digits) - i);
+}
+
+void strbuf_append_int(StrBuf *sb, int n) {
+	if (n < 0) {
+		strbuf_append_char(sb, '-');
+		strbuf_append_u64(sb, (u64)(-(long long)n));
+	} else {
+		strbuf_append_u64(sb, (u64)n);
+	}
+}
+
+static int utf8_sequence_length(const uchar *s) {
+	/*
+	**	returns the length of the valid UTF-8 sequence at s, or 0 if it isn't one
+	*/
+	
+	int length = 0;
+	int i = 0;
+	
+	if (s[0] < 0x80) return 1;
+	else if ((s[0] & 0xE0) == 0xC0 && s[0] >= 0xC2) length = 2;
+	else if ((s[0] & 0xF0) == 0xE0) length = 3;
+	else if ((s[0] & 0xF8) == 0xF0 && s[0] <= 0xF4) length = 4;
+	else return 0;
+	
+	for (i = 1; i < length; i++) {
+		if ((s[i] & 0xC0) != 0x80) return 0;
+	}
+	
+	return length;
+}
+
+void strbuf_append_json_string(StrBuf *sb, const char *s) {
+	/*
+	**	appends s as a quoted JSON string
+	**	ROM titles aren't always UTF-8, so bytes that aren't part of a valid sequence
+	**	are written as \u00XX (ie: read as Latin-1) to keep the output valid JSON
+	*/
+	
+	static const char hex[] = "0123456789abcdef";
+	const uchar *p = (const uchar *)s;
+	
+	strbuf_append_char(sb, '"');
+	
+	while (*p) {
+		int length = 0;
+		
+		switch (*p) {
+			case '"':	strbuf_append(sb, "\\\"", 2); p++; continue;
+			case '\\':	strbuf_append(sb, "\\\\", 2); p++; continue;
+			case '\n':	strbuf_append(sb, "\\n", 2); p++; continue;
+			case '\r':	strbuf_append(sb, "\\r", 2); p++; continue;
+			case '\t':	strbuf_append(sb, "\\t", 2); p++; continue;
+		}
+		
+		if (*p >= 0x20 && (length = utf8_sequence_length(p)) > 0) {
+			strbuf_append(sb, (const char *)p, length);
+			p += length;
+			continue;
+		}
+		
+		char escape[6] = { '\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xF] };
+		strbuf_append(sb, escape, sizeof(escape));
+		p++;
+	}
+	
+	strbuf_append_char(sb, '"');
+}
+
+void strbuf_append_csv_field(StrBuf *sb, const char *s) {
+	/*
+	**	appends s as a CSV field (RFC 4180), quoting it only if it needs it
+	*/
+	
+	if (!strpbrk(s, ",\"\r\n")) {
+		strbuf_append_str(sb, s);
+		return;
+	}
+	
+	strbuf_append_char(sb, '"');
+	
+	for (; *s; s++) {
+		if (*s == '"') strbuf_append_char(sb, '"');
+		strbuf_append_char(sb, *s);
+	}
+	
+	strbuf_append_char(sb, '"');
+}
+
+bool strbuf_write(StrBuf *sb, FILE *ofile) {
+	if (sb->length == 0) return true;
+	
+	return (fwrite(sb->data, 1, sb->length, ofile) == sb->length);
+}
+
+#pragma mark -
+#pragma mark *** Records ***
+
+RecordFormat record_format_from_name(char *name, bool *ok) {
+	if (ok) *ok = true;
+	
+	if (strcmp(name, "text") == 0) return record_format_text;
+	if (strcmp(name, "ndjson") == 0 || strcmp(name, "json") == 0) return record_format_ndjson;
+	if (strcmp(name, "csv") == 0) return record_format_csv;
+	
+	if (ok) *ok = false;
+	return record_format_text;
+}
+
+void NESRecordHeader(StrBuf *sb, RecordFormat format) {
+	int i = 0;
+	
+	if (format != record_format_csv) return;
+	
+	for (i = 0; NESRecordColumns[i]; i++) {
+		if (i) strbuf_append_char(sb, ',');
+		strbuf_append_str(sb, NESRecordColumns[i]);
+	}
+	
+	strbuf_append_char(sb, '\n');
+}
+
+/*
+**	a record is written one field at a time, in NESRecordColumns order
+**	the field functions handle the differences between the formats
+*/
+typedef struct recordWriter {
+	StrBuf *sb;
+	RecordFormat format;
+	int field;							/* index into NESRecordColumns of the next field */
+} RecordWriter;
+
+static void record_key(RecordWriter *w) {
+	if (w->field) strbuf_append_char(w->sb, ',');
+	
+	if (w->format == record_format_ndjson) {
+		strbuf_append_char(w->sb, '"');
+		strbuf_append_str(w->sb, NESRecordColumns[w->field]);
+		strbuf_append(w->sb, "\":", 2);
+	}
+	
+	w->field++;
+}
+
+static void record_null(RecordWriter *w) {
+	record_key(w);
+	if (w->format == record_format_ndjson) strbuf_append(w->sb, "null", 4);
+}
+
+static void record_u64(RecordWriter *w, u64 n) {
+	record_key(w);
+	strbuf_append_u64(w->sb, n);
+}
+
+static void record_int(RecordWriter *w, int n) {
+	record_key(w);
+	strbuf_append_int(w->sb, n);
+}
+
+static void record_bool(RecordWriter *w, bool b) {
+	record_key(w);
+	strbuf_append_str(w->sb, b ? "true" : "false");
+}
+
+static void record_string(RecordWriter *w, const char *s) {
+	if (!s) {
+		record_null(w);
+		return;
+	}
+	
+	record_key(w);
+	
+	if (w->format == record_format_ndjson) {
+		strbuf_append_json_string(w->sb, s);
+	} else {
+		strbuf_append_csv_field(w->sb, s);
+	}
+}
+
+static void record_hex32(RecordWriter *w, uint32_t n) {
+	static const char hex[] = "0123456789abcdef";
+	char digits[8];
+	int i = 0;
+	
+	for (i = 7; i >= 0; i--, n >>= 4) digits[i] = hex[n & 0xF];
+	
+	record_key(w);
+	
+	if (w->format == record_format_ndjson) strbuf_append_char(w->sb, '"');
+	strbuf_append(w->sb, digits, sizeof(digits));
+	if (w->format == record_format_ndjson) strbuf_append_char(w->sb, '"');
+}
+
+static void record_digest(RecordWriter *w, NESDigest *digest) {
+	/*
+	**	the crc32, md5 and sha1 fields
+	*/
+	
+	char hex[(SHA1_DIGEST_LENGTH * 2) + 1];
+	
+	record_hex32(w, digest->crc32);
+	record_string(w, hex_digest(hex, digest->md5, MD5_DIGEST_LENGTH));
+	record_string(w, hex_digest(hex, digest->sha1, SHA1_DIGEST_LENGTH));
+}
+
+static void record_offsets(RecordWriter *w, NESRom *rom, NESBankType bank_type, int count) {
+	/*
+	**	a JSON array, or a ;-separated list in a single CSV field
+	*/
+	
+	int i = 0;
+	
+	record_key(w);
+	
+	if (w->format == record_format_ndjson) strbuf_append_char(w->sb, '[');
+	
+	for (i = 0; i < count; i++) {
+		u64 offset = NESRomBankOffset(rom, bank_type, i);
+		
+		//a truncated file only lists the banks it holds all of
+		if (offset + NESRomBankLength(bank_type) > rom->size) break;
+		
+		if (i) strbuf_append_char(w->sb, (w->format == record_format_ndjson) ? ',' : ';');
+		strbuf_append_u64(w->sb, offset);
+	}
+	
+	if (w->format == record_format_ndjson) strbuf_append_char(w->sb, ']');
+}
+
+static void record_begin(RecordWriter *w, StrBuf *sb, RecordFormat format) {
+	w->sb = sb;
+	w->format = format;
+	w->field = 0;
+	
+	if (format == record_format_ndjson) strbuf_append_char(sb, '{');
+}
+
+static void record_end(RecordWriter *w) {
+	//anything we didn't get to is null
+	while (NESRecordColumns[w->field]) record_null(w);
+	
+	if (w->format == record_format_ndjson) strbuf_append_char(w->sb, '}');
+	strbuf_append_char(w->sb, '\n');
+}
+
+static char *NESRecordFormatToken(NESHeaderFormat format) {
+	switch (format) {
+		case nes_format_nes2:
+			return "nes2";
+		case nes_format_ines:
+			return "ines";
+		default:
+			return "archaic";
+	}
+}
+
+void NESRecordAppend(StrBuf *sb, RecordFormat format, char *path, NESRom *rom) {
+	/*
+	**	appends the record for a mapped rom (which was opened from path)
+	**	the title and hashes come out of the file
+	*/
+	
+	char title[NES_TITLE_BLOCK_LENGTH];
+	NESRomHashes hashes;
+	
+	//unstripped: the escaping takes care of anything odd in there
+	NESRomGetTitle(rom, title, false);
+	NESRomComputeHashes(rom, &hashes);
+	
+	NESRecordAppendInfo(sb, format, path, rom, title[0] ? title : NULL, &hashes);
+}
+
+void NESRecordAppendInfo(StrBuf *sb, RecordFormat format, char *path, NESRom *rom, char *title, NESRomHashes *hashes) {
+	/*
+	**	appends the record for rom, which only needs its header and size filled in (rom->data isn't used)
+	**	title and hashes can be NULL
+	**	valid and error come from the verify action's check (NESVerifyOpenRom()), so the two agree
+	**	files that don't look like NES ROMs get valid=false and nulls for everything past the error;
+	**	other invalid ones (truncated, ...) still get their header fields, but no payload hashes and
+	**	no offsets for banks that aren't all there
+	*/
+	
+	RecordWriter w;
+	NESVerifyResult verify;
+	char error[256];
+	
+	record_begin(&w, sb, format);
+	
+	record_string(&w, path);
+	record_string(&w, lastPathComponent(path));
+	record_u64(&w, rom->size);
+	
+	bool readable = NESVerifyOpenRom(&verify, rom);
+	bool valid = readable && !(verify.problems & NES_VERIFY_ERRORS);
+	
+	if (!valid) NESVerifyDescribeError(error, sizeof(error), &verify);
+	
+	if (!readable || (verify.problems & NES_VERIFY_NOT_ROM)) {
+		record_bool(&w, false);
+		record_string(&w, error);
+		record_end(&w);
+		return;
+	}
+	
+	NESHeader *header = &(rom->info);
+	
+	record_bool(&w, valid);
+	
+	if (valid) {
+		record_null(&w);
+	} else {
+		record_string(&w, error);
+	}
+	
+	record_string(&w, NESRecordFormatToken(header->format));
+	record_int(&w, header->prg_count);
+	record_int(&w, header->chr_count);
+	record_u64(&w, header->prg_size);
+	record_u64(&w, header->chr_size);
+	
+	record_int(&w, header->mapper);
+	record_int(&w, header->submapper);
+	record_string(&w, header->four_screen ? "four-screen" : (header->mirroring == NES_VERTICAL_MIRROR_MODE ? "vertical" : "horizontal"));
+	record_bool(&w, header->battery);
+	record_bool(&w, header->trainer);
+	
+	record_u64(&w, header->prg_ram_size);
+	record_u64(&w, header->prg_nvram_size);
+	record_u64(&w, header->chr_ram_size);
+	record_u64(&w, header->chr_nvram_size);
+	record_int(&w, header->console_type);
+	record_int(&w, header->timing);
+	
+	record_string(&w, title);
+	
+	//crc32, md5 and sha1 of the file, then of the payload (which an invalid file doesn't have all of)
+	int i = 0;
+	
+	if (hashes) {
+		record_digest(&w, &(hashes->file));
+	} else {
+		for (i = 0; i < 3; i++) record_null(&w);
+	}
+	
+	if (hashes && valid) {
+		record_digest(&w, &(hashes->payload));
+	} else {
+		for (i = 0; i < 3; i++) record_null(&w);
+	}
+	
+	if (rom->dir.trainer_length && rom->dir.trainer_offset + rom->dir.trainer_length <= rom->size) {
+		record_u64(&w, rom->dir.trainer_offset);
+	} else {
+		record_null(&w);
+	}
+	
+	record_offsets(&w, rom, nes_prg_bank, rom->prg_count);
+	record_offsets(&w, rom, nes_chr_bank, rom->chr_count);
+	
+	if (rom->dir.title_length) {
+		record_u64(&w, rom->dir.title_offset);
+	} else {
+		record_null(&w);
+	}
+	
+	if (rom->dir.overdump_length) {
+		record_u64(&w, rom->dir.overdump_offset);
+		record_u64(&w, rom->dir.overdump_length);
+	}
+	
+	record_end(&w);
+}
+
+void NESRecordAppendError(StrBuf *sb, RecordFormat format, char *path, char *error) {
+	RecordWriter w;
+	
+	record_begin(&w, sb, format);
+	
+	record_string(&w, path);
+	record_string(&w, lastPathComponent(path));
+	record_null(&w);		//filesize
+	record_bool(&w, false);
+	record_string(&w, error);
+	
+	record_end(&w);
+}
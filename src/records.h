@@ -0,0 +1,65 @@
+/*
+**	records.h
+**	nesromtool
+**
+**	machine-readable output: one record per ROM as NDJSON or CSV
+**	records are built in a StrBuf and written with a single fwrite()
+*/
+
+#ifndef _RECORDS_H_
+#define _RECORDS_H_
+
+#include <stdio.h>
+#include "types.h"
+#include "nesrom.h"
+#include "hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORD_OUTPUT_BUFFER_SIZE		65536	/* stdout buffer size when writing records */
+
+typedef enum {
+	record_format_text = 0,				/* the aligned, human-readable output */
+	record_format_ndjson,				/* one JSON object per line */
+	record_format_csv					/* header line, then one row per ROM */
+} RecordFormat;
+
+//growable output buffer
+typedef struct strBuf {
+	char *data;
+	size_t length;
+	size_t capacity;
+} StrBuf;
+
+void strbuf_init(StrBuf *sb);
+void strbuf_free(StrBuf *sb);
+void strbuf_reset(StrBuf *sb);
+void strbuf_append(StrBuf *sb, const char *s, size_t length);
+void strbuf_append_str(StrBuf *sb, const char *s);
+void strbuf_append_char(StrBuf *sb, char c);
+void strbuf_append_u64(StrBuf *sb, u64 n);
+void strbuf_append_int(StrBuf *sb, int n);
+void strbuf_append_json_string(StrBuf *sb, const char *s);
+void strbuf_append_csv_field(StrBuf *sb, const char *s);
+bool strbuf_write(StrBuf *sb, FILE *ofile);
+
+//returns record_format_text if name isn't one we know (and sets *ok to false)
+RecordFormat record_format_from_name(char *name, bool *ok);
+
+//the CSV header line (nothing for the other formats)
+void NESRecordHeader(StrBuf *sb, RecordFormat format);
+
+//one record for an opened ROM
+void NESRecordAppend(StrBuf *sb, RecordFormat format, char *path, NESRom *rom);
+//same, for a ROM that only has its header parsed (the title and hashes come from elsewhere; either can be NULL)
+void NESRecordAppendInfo(StrBuf *sb, RecordFormat format, char *path, NESRom *rom, char *title, NESRomHashes *hashes);
+//a record for a file that couldn't be opened (error is the reason)
+void NESRecordAppendError(StrBuf *sb, RecordFormat format, char *path, char *error);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _RECORDS_H_ */
@@ -0,0 +1,525 @@
+/*
+**	sheet.c
+**	nesromtool
+**
+**	tile sheet layout and writers (see sheet.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sheet.h"
+#include "tilecodec.h"
+#include "png.h"
+#include "gif.h"
+#include "records.h"
+#include "palette.h"
+#include "ntsc.h"
+#include "verbosity.h"
+
+#define NES_SHEET_MAX_PIXELS			(1 << 30)	/* bigger than any whole ROM at a sensible scale */
+#define NES_SHEET_DECODE_BATCH			64			/* tiles decoded at a time */
+#define NES_SHEET_HTML_CELL_MAX			12			/* strlen("<td class=a>"), the most a pixel can take */
+#define NES_SHEET_HTML_PIXEL			4			/* screen pixels per tile pixel, square */
+#define NES_SHEET_UPPER_HALF_BLOCK		"\xE2\x96\x80"	/* U+2580 in UTF-8 */
+
+static const uchar NESSheetGrays[4] = { 0x00, 0x55, 0xAA, 0xFF };
+
+NESSheet *NESSheetNew(int width, int height) {
+	if (width <= 0 || height <= 0 || (u64)width * height > NES_SHEET_MAX_PIXELS) {
+		errno = EFBIG;
+		return NULL;
+	}
+	
+	NESSheet *sheet = (NESSheet*)malloc(sizeof(NESSheet));
+	
+	sheet->width = width;
+	sheet->height = height;
+	sheet->pixels = (uchar*)calloc((u64)width * height, 1);
+	memcpy(sheet->palette, get_color_palette(), sizeof(sheet->palette));
+	memcpy(sheet->entries, get_color_palette_entries(), sizeof(sheet->entries));
+	sheet->threads = 1;
+	
+	return sheet;
+}
+
+void NESSheetFree(NESSheet *sheet) {
+	if (!sheet) return;
+	
+	free(sheet->pixels);
+	free(sheet);
+}
+
+int NESSheetRows(int tile_count, int columns) {
+	return (tile_count + columns - 1) / columns;
+}
+
+static void NESSheetBlitTile(NESSheet *sheet, const uchar *composite, int x, int y, int scale) {
+	/*
+	**	copies one decoded tile to (x, y), scaled and clipped
+	*/
+	
+	int width = NES_TILE_WIDTH * scale;
+	int row = 0, i = 0, j = 0;
+	
+	if (x >= sheet->width || y >= sheet->height) return;
+	if (x + width > sheet->width) width = sheet->width - x;
+	
+	for (row = 0; row < NES_TILE_HEIGHT; row++) {
+		const uchar *source = composite + (row * NES_TILE_WIDTH);
+		int line = y + (row * scale);
+		
+		if (line >= sheet->height) return;
+		
+		uchar *target = sheet->pixels + ((u64)line * sheet->width) + x;
+		
+		if (scale == 1) {
+			memcpy(target, source, width);
+			continue;
+		}
+		
+		for (i = 0; i < width; i++) {
+			target[i] = source[i / scale];
+		}
+		
+		//the rest of the pixel's lines are copies of the first
+		for (j = 1; j < scale && line + j < sheet->height; j++) {
+			memcpy(target + ((u64)j * sheet->width), target, width);
+		}
+	}
+}
+
+void NESSheetDrawTiles(NESSheet *sheet, const uchar *tiles, int tile_count, int x, int y, int columns, int scale) {
+	/*
+	**	tiles are decoded in batches, so the codec's wide kernels get a run at them
+	*/
+	
+	uchar composite[NES_SHEET_DECODE_BATCH * NES_COMPOSITE_TILE_LENGTH];
+	int tile_size = NES_TILE_WIDTH * scale;
+	int done = 0;
+	int i = 0;
+	
+	if (columns <= 0 || scale <= 0) return;
+	
+	while (done < tile_count) {
+		int count = tile_count - done;
+		if (count > NES_SHEET_DECODE_BATCH) count = NES_SHEET_DECODE_BATCH;
+		
+		NESDecodeTiles(composite, tiles + ((u64)done * NES_ROM_TILE_LENGTH), count);
+		
+		for (i = 0; i < count; i++) {
+			int tile = done + i;
+			
+			NESSheetBlitTile(sheet, composite + (i * NES_COMPOSITE_TILE_LENGTH),
+				x + ((tile % columns) * tile_size), y + ((tile / columns) * tile_size), scale);
+		}
+		
+		done += count;
+	}
+}
+
+NESSheet *NESSheetFromTiles(const uchar *tiles, int tile_count, int columns, int scale) {
+	if (tile_count <= 0 || columns <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	if (columns > tile_count) columns = tile_count;
+	
+	NESSheet *sheet = NESSheetNew(columns * NES_TILE_WIDTH * scale, NESSheetRows(tile_count, columns) * NES_TILE_HEIGHT * scale);
+	if (!sheet) return NULL;
+	
+	NESSheetDrawTiles(sheet, tiles, tile_count, 0, 0, columns, scale);
+	
+	return sheet;
+}
+
+NESSheet *NESSheetFromChr(NESRom *rom, int columns, int scale) {
+	int tiles = NES_CHR_BANK_LENGTH / NES_ROM_TILE_LENGTH;
+	int bank_width = NES_SHEET_BANK_COLUMNS * NES_TILE_WIDTH * scale;
+	int bank_height = NESSheetRows(tiles, NES_SHEET_BANK_COLUMNS) * NES_TILE_HEIGHT * scale;
+	int i = 0;
+	
+	if (rom->chr_count <= 0) return NULL;
+	if (columns > rom->chr_count) columns = rom->chr_count;
+	
+	NESSheet *sheet = NESSheetNew(bank_width * columns, bank_height * NESSheetRows(rom->chr_count, columns));
+	if (!sheet) return NULL;
+	
+	for (i = 0; i < rom->chr_count; i++) {
+		uchar *bank = NESRomGetBank(rom, nes_chr_bank, i);
+		
+		//a short file just leaves the missing banks blank
+		if (!bank) continue;
+		
+		NESSheetDrawTiles(sheet, bank, tiles, (i % columns) * bank_width, (i / columns) * bank_height, NES_SHEET_BANK_COLUMNS, scale);
+	}
+	
+	return sheet;
+}
+
+#pragma mark -
+#pragma mark *** Writers ***
+
+bool NESSheetWritePGM(NESSheet *sheet, FILE *ofile) {
+	/*
+	**	binary PGM (netpbm P5), the palette indices as 4 shades of gray, in a single write
+	*/
+	
+	char header[64];
+	int header_length = snprintf(header, sizeof(header), "P5\n%d %d\n255\n", sheet->width, sheet->height);
+	u64 pixel_count = (u64)sheet->width * sheet->height;
+	u64 i = 0;
+	
+	uchar *buffer = (uchar*)malloc(header_length + pixel_count);
+	
+	memcpy(buffer, header, header_length);
+	
+	for (i = 0; i < pixel_count; i++) {
+		buffer[header_length + i] = NESSheetGrays[sheet->pixels[i] & 3];
+	}
+	
+	bool ok = (fwrite(buffer, 1, header_length + pixel_count, ofile) == header_length + pixel_count);
+	
+	free(buffer);
+	
+	return ok;
+}
+
+bool NESSheetWriteHTML(NESSheet *sheet, FILE *ofile) {
+	/*
+	**	a table with a cell per run of same-colored pixels in a row (colspan), colored by a
+	**	one-letter class. the columns are sized once with <col>, and the optional end tags are
+	**	left off, so a pixel costs at most a "<td class=a>"; the whole thing goes out in one write
+	*/
+	
+	u64 capacity = ((u64)sheet->width * sheet->height * NES_SHEET_HTML_CELL_MAX) + ((u64)sheet->height * 8) + 512;
+	char *buffer = (char*)malloc(capacity);
+	char *p = buffer;
+	int x = 0, y = 0;
+	int i = 0;
+	
+	if (!buffer) return false;
+	
+	p += sprintf(p, "<style>table.nes{border-collapse:collapse;table-layout:fixed;width:%dpx}"
+		".nes col{width:%dpx}.nes tr{height:%dpx}.nes td{padding:0}",
+		sheet->width * NES_SHEET_HTML_PIXEL, NES_SHEET_HTML_PIXEL, NES_SHEET_HTML_PIXEL);
+	
+	for (i = 0; i < NES_PALETTE_LENGTH; i++) {
+		const uchar *rgb = sheet->palette + (i * 3);
+		
+		p += sprintf(p, ".nes .%c{background:#%02x%02x%02x}", 'a' + i, rgb[0], rgb[1], rgb[2]);
+	}
+	
+	p += sprintf(p, "</style>\n<table class=nes><col span=%d>\n", sheet->width);
+	
+	for (y = 0; y < sheet->height; y++) {
+		const uchar *row = sheet->pixels + ((u64)y * sheet->width);
+		
+		memcpy(p, "<tr>", 4);
+		p += 4;
+		
+		for (x = 0; x < sheet->width; ) {
+			int color = row[x] & 3;
+			int run = 1;
+			
+			while (x + run < sheet->width && (row[x + run] & 3) == color) run++;
+			
+			if (run == 1) {
+				memcpy(p, "<td class=a>", 12);
+				p[10] = 'a' + color;
+				p += 12;
+			} else {
+				p += sprintf(p, "<td class=%c colspan=%d>", 'a' + color, run);
+			}
+			
+			x += run;
+		}
+		
+		*(p++) = '\n';
+	}
+	
+	p += sprintf(p, "</table>\n");
+	
+	u64 length = p - buffer;
+	bool ok = (fwrite(buffer, 1, length, ofile) == length);
+	
+	free(buffer);
+	
+	return ok;
+}
+
+typedef struct nesSheetSVGPath {
+	StrBuf d;
+	int x, y;								/* where the last rectangle started (a "z" goes back there) */
+} NESSheetSVGPath;
+
+static void NESSheetSVGRect(NESSheetSVGPath *path, int x, int y, int width, int height) {
+	//"m<dx> <dy>h<width>v<height>h-<width>z", moving from the last rectangle (a leading "m" is absolute)
+	int dy = y - path->y;
+	
+	strbuf_append_char(&path->d, 'm');
+	strbuf_append_int(&path->d, x - path->x);
+	if (dy >= 0) strbuf_append_char(&path->d, ' ');
+	strbuf_append_int(&path->d, dy);
+	strbuf_append_char(&path->d, 'h');
+	strbuf_append_int(&path->d, width);
+	strbuf_append_char(&path->d, 'v');
+	strbuf_append_int(&path->d, height);
+	strbuf_append_str(&path->d, "h-");
+	strbuf_append_int(&path->d, width);
+	strbuf_append_char(&path->d, 'z');
+	
+	path->x = x;
+	path->y = y;
+}
+
+bool NESSheetWriteSVG(NESSheet *sheet, FILE *ofile) {
+	/*
+	**	every row is cut into runs of one color, and a run that starts and ends where a run of
+	**	the same color did in the row above just makes that rectangle taller. so each pixel is
+	**	looked at once, and only the runs of the row above are kept to find the ones that ended
+	**	color 0 is the background, and every other color's rectangles are one <path>
+	*/
+	
+	int width = sheet->width;
+	int *open_width = (int*)calloc(width, sizeof(int));	/* the rectangle whose runs start at x (0 for none) */
+	int *open_top = (int*)malloc(sizeof(int) * width);
+	int *open_last = (int*)malloc(sizeof(int) * width);	/* the last row it covers */
+	uchar *open_color = (uchar*)malloc(width);
+	int *previous = (int*)malloc(sizeof(int) * width);		/* where the last row's runs started */
+	int *current = (int*)malloc(sizeof(int) * width);
+	int previous_count = 0;
+	NESSheetSVGPath paths[4];
+	StrBuf out;
+	int x = 0, y = 0;
+	int i = 0;
+	
+	for (i = 0; i < 4; i++) {
+		strbuf_init(&paths[i].d);
+		paths[i].x = paths[i].y = 0;
+	}
+	
+	for (y = 0; y < sheet->height; y++) {
+		const uchar *row = sheet->pixels + ((u64)y * width);
+		int current_count = 0;
+		
+		for (x = 0; x < width; ) {
+			uchar color = row[x] & 3;
+			int run = 1;
+			
+			while (x + run < width && (row[x + run] & 3) == color) run++;
+			
+			if (open_width[x] == run && open_color[x] == color) {
+				open_last[x] = y;
+			} else {
+				//anything open here ended on the row above
+				if (open_width[x] && open_color[x]) {
+					NESSheetSVGRect(&paths[open_color[x]], x, open_top[x], open_width[x], y - open_top[x]);
+				}
+				
+				open_width[x] = run;
+				open_color[x] = color;
+				open_top[x] = open_last[x] = y;
+			}
+			
+			current[current_count++] = x;
+			x += run;
+		}
+		
+		//the row above's runs that this row didn't carry on
+		for (i = 0; i < previous_count; i++) {
+			int start = previous[i];
+			
+			if (open_width[start] && open_last[start] != y) {
+				if (open_color[start]) {
+					NESSheetSVGRect(&paths[open_color[start]], start, open_top[start], open_width[start], y - open_top[start]);
+				}
+				
+				open_width[start] = 0;
+			}
+		}
+		
+		int *swap = previous;
+		previous = current;
+		current = swap;
+		previous_count = current_count;
+	}
+	
+	for (i = 0; i < previous_count; i++) {
+		int start = previous[i];
+		
+		if (open_width[start] && open_color[start]) {
+			NESSheetSVGRect(&paths[open_color[start]], start, open_top[start], open_width[start], sheet->height - open_top[start]);
+		}
+	}
+	
+	free(open_width);
+	free(open_top);
+	free(open_last);
+	free(open_color);
+	free(previous);
+	free(current);
+	
+	char header[256];
+	
+	snprintf(header, sizeof(header), "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" shape-rendering=\"crispEdges\">\n",
+		sheet->width, sheet->height, sheet->width, sheet->height);
+	
+	strbuf_init(&out);
+	strbuf_append_str(&out, header);
+	
+	snprintf(header, sizeof(header), "<rect width=\"%d\" height=\"%d\" fill=\"#%02x%02x%02x\"/>\n",
+		sheet->width, sheet->height, sheet->palette[0], sheet->palette[1], sheet->palette[2]);
+	strbuf_append_str(&out, header);
+	
+	for (i = 1; i < 4; i++) {
+		if (paths[i].d.length) {
+			const uchar *rgb = sheet->palette + (i * 3);
+			
+			snprintf(header, sizeof(header), "<path fill=\"#%02x%02x%02x\" d=\"", rgb[0], rgb[1], rgb[2]);
+			strbuf_append_str(&out, header);
+			strbuf_append(&out, paths[i].d.data, paths[i].d.length);
+			strbuf_append_str(&out, "\"/>\n");
+		}
+		
+		strbuf_free(&paths[i].d);
+	}
+	
+	strbuf_free(&paths[0].d);
+	strbuf_append_str(&out, "</svg>\n");
+	
+	bool ok = strbuf_write(&out, ofile);
+	
+	strbuf_free(&out);
+	
+	return ok;
+}
+
+bool NESSheetWriteANSI(NESSheet *sheet, FILE *ofile) {
+	/*
+	**	each character cell is two pixels, one above the other: an upper half block in the top
+	**	pixel's color over a background of the bottom one's. colors are only sent when they
+	**	change, a cell with both pixels the same is a space, and it all goes out in one write
+	*/
+	
+	char foreground[NES_PALETTE_LENGTH][24];
+	char background[NES_PALETTE_LENGTH + 1][24];		/* the extra one is the terminal's own, under an odd last row */
+	int fg_length[NES_PALETTE_LENGTH], bg_length[NES_PALETTE_LENGTH + 1];
+	int x = 0, y = 0;
+	int i = 0;
+	StrBuf out;
+	
+	for (i = 0; i < NES_PALETTE_LENGTH; i++) {
+		const uchar *rgb = sheet->palette + (i * 3);
+		
+		fg_length[i] = snprintf(foreground[i], sizeof(foreground[i]), "\033[38;2;%d;%d;%dm", rgb[0], rgb[1], rgb[2]);
+		bg_length[i] = snprintf(background[i], sizeof(background[i]), "\033[48;2;%d;%d;%dm", rgb[0], rgb[1], rgb[2]);
+	}
+	
+	bg_length[NES_PALETTE_LENGTH] = snprintf(background[NES_PALETTE_LENGTH], sizeof(background[NES_PALETTE_LENGTH]), "\033[49m");
+	
+	strbuf_init(&out);
+	
+	for (y = 0; y < sheet->height; y += 2) {
+		const uchar *top = sheet->pixels + ((u64)y * sheet->width);
+		const uchar *bottom = (y + 1 < sheet->height) ? top + sheet->width : NULL;
+		int current_fg = -1, current_bg = -1;
+		
+		for (x = 0; x < sheet->width; x++) {
+			int upper = top[x] & 3;
+			int lower = bottom ? (bottom[x] & 3) : NES_PALETTE_LENGTH;
+			
+			if (lower != current_bg) {
+				strbuf_append(&out, background[lower], bg_length[lower]);
+				current_bg = lower;
+			}
+			
+			if (upper == lower) {
+				strbuf_append_char(&out, ' ');
+				continue;
+			}
+			
+			if (upper != current_fg) {
+				strbuf_append(&out, foreground[upper], fg_length[upper]);
+				current_fg = upper;
+			}
+			
+			strbuf_append(&out, NES_SHEET_UPPER_HALF_BLOCK, sizeof(NES_SHEET_UPPER_HALF_BLOCK) - 1);
+		}
+		
+		strbuf_append_str(&out, "\033[0m\n");
+	}
+	
+	bool ok = strbuf_write(&out, ofile) && fflush(ofile) == 0;
+	
+	strbuf_free(&out);
+	
+	return ok;
+}
+
+bool NESSheetWritePng(NESSheet *sheet, FILE *ofile) {
+	int threads = sheet->threads;
+	
+	if (!get_ntsc_filter()) {
+		//a 2-bit indexed PNG: the palette is its PLTE
+		return NESWritePng(ofile, sheet->pixels, sheet->width, sheet->height, nes_png_indexed, sheet->palette, NES_PALETTE_LENGTH, threads);
+	}
+	
+	//the filter blends neighboring pixels into colors no 4-entry palette has, so this one is RGB
+	uchar *rgb = NESNtscRender(sheet->pixels, sheet->width, sheet->height, sheet->entries, NES_PALETTE_LENGTH, threads);
+	if (!rgb) return false;
+	
+	bool ok = NESWritePng(ofile, rgb, sheet->width * NES_NTSC_SCALE, sheet->height * NES_NTSC_SCALE, nes_png_rgb, NULL, 0, threads);
+	
+	free(rgb);
+	
+	return ok;
+}
+
+bool NESSheetWriteGif(NESSheet *sheet, FILE *ofile) {
+	return NESWriteGif(ofile, sheet->pixels, sheet->width, sheet->height, sheet->palette, NES_PALETTE_LENGTH);
+}
+
+bool NESSheetWriteBankAnimation(NESRom *rom, NESBankType bank_type, const int *banks, int bank_count, int scale, int delay, FILE *ofile) {
+	/*
+	**	every bank is drawn onto the same bank-sized sheet in turn and handed to the GIF writer
+	**	as a frame, so only one decoded bank (and the writer's copy of the one before) is ever held
+	*/
+	
+	int tiles = NESRomBankLength(bank_type) / NES_ROM_TILE_LENGTH;
+	int i = 0;
+	
+	if (bank_count <= 0 || scale <= 0) {
+		errno = EINVAL;
+		return false;
+	}
+	
+	NESSheet *sheet = NESSheetNew(NES_SHEET_BANK_COLUMNS * NES_TILE_WIDTH * scale, NESSheetRows(tiles, NES_SHEET_BANK_COLUMNS) * NES_TILE_HEIGHT * scale);
+	if (!sheet) return false;
+	
+	NESGifWriter *writer = NESGifWriterOpen(ofile, sheet->width, sheet->height, sheet->palette, NES_PALETTE_LENGTH, (delay > 0) ? delay : NES_GIF_DEFAULT_DELAY);
+	
+	if (!writer) {
+		NESSheetFree(sheet);
+		return false;
+	}
+	
+	for (i = 0; i < bank_count; i++) {
+		uchar *bank = NESRomGetBank(rom, bank_type, banks[i]);
+		
+		//a bank that isn't there is a blank frame
+		if (bank) {
+			NESSheetDrawTiles(sheet, bank, tiles, 0, 0, NES_SHEET_BANK_COLUMNS, scale);
+		} else {
+			memset(sheet->pixels, 0, (u64)sheet->width * sheet->height);
+		}
+		
+		if (!NESGifWriterAddFrame(writer, sheet->pixels)) break;
+	}
+	
+	NESSheetFree(sheet);
+	
+	return NESGifWriterFinish(writer);
+}
@@ -0,0 +1,75 @@
+/*
+**	sheet.h
+**	nesromtool
+**
+**	tile sheets: tiles decoded and laid out on a grid as one image, one byte (a palette index,
+**	0-3) per pixel. the image writers work from these, so a bank becomes an image in one pass
+**	instead of being converted and written a tile at a time
+*/
+
+#ifndef _SHEET_H_
+#define _SHEET_H_
+
+#include <stdio.h>
+#include "types.h"
+#include "nesutils.h"
+#include "nesrom.h"
+#include "palette.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_SHEET_BANK_COLUMNS			16			/* tiles across a bank sheet */
+
+#define NES_SHEET_THUMBNAIL_COLUMNS		8			/* banks across a thumbnail */
+
+typedef struct nesSheet {
+	int width;								/* in pixels */
+	int height;
+	uchar *pixels;							/* width * height palette indices, row by row */
+	uchar palette[NES_PALETTE_LENGTH * 3];	/* what the indices are drawn as, RGB */
+	uchar entries[NES_PALETTE_LENGTH];		/* the master palette entries those came from, for -N */
+	int threads;							/* how many threads a writer may use (1 unless set) */
+} NESSheet;
+
+//any of the writers below that take just the sheet and a file
+typedef bool (*NESSheetWriter)(NESSheet *sheet, FILE *ofile);
+
+//a blank (all index 0) sheet in the -c palette; NULL if it would be too big
+NESSheet *NESSheetNew(int width, int height);
+void NESSheetFree(NESSheet *sheet);
+
+//rows of tiles needed to lay out tile_count tiles columns wide
+int NESSheetRows(int tile_count, int columns);
+
+//decodes tile_count native tiles onto the sheet, columns to a row, starting at pixel (x, y), each pixel scale x scale
+//tiles that would fall off the sheet are clipped
+void NESSheetDrawTiles(NESSheet *sheet, const uchar *tiles, int tile_count, int x, int y, int columns, int scale);
+
+//tile_count native tiles on a sheet of their own, columns to a row (fewer if there aren't that many tiles)
+NESSheet *NESSheetFromTiles(const uchar *tiles, int tile_count, int columns, int scale);
+
+//every CHR bank of a ROM, each one NES_SHEET_BANK_COLUMNS tiles wide, banks laid out columns to a row
+//NULL if the ROM has no CHR banks
+NESSheet *NESSheetFromChr(NESRom *rom, int columns, int scale);
+
+//writers; return false on error (errno is set)
+bool NESSheetWritePGM(NESSheet *sheet, FILE *ofile);	/* always in 4 shades of gray */
+bool NESSheetWritePng(NESSheet *sheet, FILE *ofile);	/* compressed on sheet->threads threads; -N makes it truecolor */
+bool NESSheetWriteGif(NESSheet *sheet, FILE *ofile);
+bool NESSheetWriteHTML(NESSheet *sheet, FILE *ofile);	/* a <style> and a <table>, to go in a page */
+bool NESSheetWriteSVG(NESSheet *sheet, FILE *ofile);	/* same-colored pixels merged into rectangles */
+
+//24-bit color ANSI text, two pixel rows to a line
+bool NESSheetWriteANSI(NESSheet *sheet, FILE *ofile);
+
+//an animated GIF with banks[0..bank_count-1] of a ROM as its frames, one bank sheet each, delay hundredths
+//of a second apart (0 for the default); the banks are decoded one at a time as they are written
+bool NESSheetWriteBankAnimation(NESRom *rom, NESBankType bank_type, const int *banks, int bank_count, int scale, int delay, FILE *ofile);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _SHEET_H_ */
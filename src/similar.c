@@ -0,0 +1,254 @@
+/*
+**	similar.c
+**	nesromtool
+**
+**	MinHash signatures and the LSH band tables (see similar.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "similar.h"
+#include "nesutils.h"
+#include "verbosity.h"
+
+#define NES_MINHASH_SEED			0x6e6573726f6d746fULL	/* "nesromto"; changing it invalidates every stored signature */
+
+static inline uint64_t NESSimilarMix(uint64_t x) {
+	/*
+	**	the murmur3 finalizer: every input bit affects every output bit
+	*/
+	
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	
+	return x;
+}
+
+static uint64_t NESSimilarNext(uint64_t *state) {
+	/*
+	**	splitmix64, for the hash function parameters
+	*/
+	
+	*state += 0x9e3779b97f4a7c15ULL;
+	
+	return NESSimilarMix(*state);
+}
+
+#pragma mark *** Signatures ***
+
+typedef struct nesMinHashState {
+	uint64_t multipliers[NES_MINHASH_LENGTH];	/* odd, so each one permutes the 64-bit shingle hashes */
+	uint64_t addends[NES_MINHASH_LENGTH];
+	uint32_t values[NES_MINHASH_LENGTH];
+} NESMinHashState;
+
+static void NESMinHashStart(NESMinHashState *state) {
+	uint64_t seed = NES_MINHASH_SEED;
+	int i = 0;
+	
+	for (i = 0; i < NES_MINHASH_LENGTH; i++) {
+		state->multipliers[i] = NESSimilarNext(&seed) | 1;
+		state->addends[i] = NESSimilarNext(&seed);
+		state->values[i] = NES_MINHASH_EMPTY;
+	}
+}
+
+static inline void NESMinHashAdd(NESMinHashState *state, uint64_t shingle) {
+	/*
+	**	multiply-shift hashing: the top 32 bits of (a * x + b) for each function
+	**	(a fixed-length loop with no dependencies between lanes, so the compiler vectorizes it)
+	*/
+	
+	int i = 0;
+	
+	for (i = 0; i < NES_MINHASH_LENGTH; i++) {
+		uint32_t value = (uint32_t)(((shingle * state->multipliers[i]) + state->addends[i]) >> 32);
+		if (value < state->values[i]) state->values[i] = value;
+	}
+}
+
+static void NESMinHashAddBank(NESMinHashState *state, uchar *bank, u64 length, NESBankType bank_type) {
+	/*
+	**	a shingle per tile that isn't a single byte repeated, and one for the whole bank
+	*/
+	
+	uint64_t bank_hash = NESSimilarMix(NES_MINHASH_SEED ^ bank_type);
+	u64 offset = 0;
+	
+	for (offset = 0; offset + NES_ROM_TILE_LENGTH <= length; offset += NES_ROM_TILE_LENGTH) {
+		uint64_t low, high;
+		
+		memcpy(&low, bank + offset, sizeof(low));
+		memcpy(&high, bank + offset + sizeof(low), sizeof(high));
+		
+		uint64_t tile_hash = NESSimilarMix(low ^ NESSimilarMix(high ^ NES_MINHASH_SEED));
+		bank_hash = NESSimilarMix(bank_hash ^ tile_hash);
+		
+		//all 0x00, all 0xFF and the like show up in nearly every ROM
+		if (low == high && low == (0x0101010101010101ULL * (low & 0xFF))) continue;
+		
+		NESMinHashAdd(state, tile_hash);
+	}
+	
+	NESMinHashAdd(state, bank_hash);
+}
+
+void NESRomMinHash(NESRom *rom, NESMinHash *signature) {
+	NESMinHashState state;
+	int i = 0;
+	
+	NESMinHashStart(&state);
+	
+	for (i = 0; i < rom->prg_count; i++) {
+		uchar *bank = NESRomGetBank(rom, nes_prg_bank, i);
+		if (bank) NESMinHashAddBank(&state, bank, NES_PRG_BANK_LENGTH, nes_prg_bank);
+	}
+	
+	for (i = 0; i < rom->chr_count; i++) {
+		uchar *bank = NESRomGetBank(rom, nes_chr_bank, i);
+		if (bank) NESMinHashAddBank(&state, bank, NES_CHR_BANK_LENGTH, nes_chr_bank);
+	}
+	
+	memcpy(signature->values, state.values, sizeof(signature->values));
+}
+
+bool NESMinHashIsEmpty(const NESMinHash *signature) {
+	int i = 0;
+	
+	for (i = 0; i < NES_MINHASH_LENGTH; i++) {
+		if (signature->values[i] != NES_MINHASH_EMPTY) return false;
+	}
+	
+	return true;
+}
+
+double NESMinHashSimilarity(const NESMinHash *a, const NESMinHash *b) {
+	int i = 0;
+	int same = 0;
+	
+	for (i = 0; i < NES_MINHASH_LENGTH; i++) {
+		same += (a->values[i] == b->values[i]);
+	}
+	
+	return (double)same / NES_MINHASH_LENGTH;
+}
+
+uint32_t NESMinHashBandKey(const NESMinHash *signature, int band) {
+	uint64_t key = NES_MINHASH_SEED + band;
+	int i = 0;
+	
+	for (i = 0; i < NES_LSH_ROWS; i++) {
+		key = NESSimilarMix(key ^ signature->values[(band * NES_LSH_ROWS) + i]);
+	}
+	
+	return (uint32_t)(key >> 32);
+}
+
+#pragma mark -
+#pragma mark *** Index ***
+
+static int NESLshEntryCompare(const void *a, const void *b) {
+	const NESLshEntry *x = (const NESLshEntry*)a;
+	const NESLshEntry *y = (const NESLshEntry*)b;
+	
+	if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+	return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+void NESLshBuildBand(NESLshEntry *table, const NESMinHash *signatures, u64 count, int band) {
+	u64 i = 0;
+	
+	for (i = 0; i < count; i++) {
+		table[i].key = NESMinHashBandKey(&signatures[i], band);
+		table[i].index = i;
+	}
+	
+	qsort(table, count, sizeof(NESLshEntry), NESLshEntryCompare);
+}
+
+static u64 NESLshLowerBound(NESLshEntry *table, u64 count, uint32_t key) {
+	u64 low = 0;
+	u64 high = count;
+	
+	while (low < high) {
+		u64 middle = low + ((high - low) / 2);
+		
+		if (table[middle].key < key) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	
+	return low;
+}
+
+static int NESSimilarMatchCompare(const void *a, const void *b) {
+	//most similar first; ties in catalog order
+	const NESSimilarMatch *x = (const NESSimilarMatch*)a;
+	const NESSimilarMatch *y = (const NESSimilarMatch*)b;
+	
+	if (x->similarity != y->similarity) return (x->similarity > y->similarity) ? -1 : 1;
+	return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+NESSimilarMatch *NESSimilarFind(NESLshEntry **bands, const NESMinHash *signatures, u64 count, const NESMinHash *signature, double min_similarity, long long skip, u64 *match_count) {
+	/*
+	**	every entry that shares at least one band with signature is a candidate;
+	**	candidates are then scored on their whole signatures
+	*/
+	
+	uint64_t *seen = (uint64_t*)calloc((count / 64) + 1, sizeof(uint64_t));
+	NESSimilarMatch *matches = NULL;
+	u64 capacity = 0;
+	u64 candidates = 0;
+	int band = 0;
+	
+	*match_count = 0;
+	
+	if (NESMinHashIsEmpty(signature)) {
+		free(seen);
+		return (NESSimilarMatch*)malloc(sizeof(NESSimilarMatch));
+	}
+	
+	for (band = 0; band < NES_LSH_BANDS; band++) {
+		uint32_t key = NESMinHashBandKey(signature, band);
+		u64 i = 0;
+		
+		for (i = NESLshLowerBound(bands[band], count, key); i < count && bands[band][i].key == key; i++) {
+			u64 index = bands[band][i].index;
+			
+			if (index >= count || (seen[index / 64] & (1ULL << (index % 64)))) continue;
+			seen[index / 64] |= (1ULL << (index % 64));
+			candidates++;
+			
+			if ((long long)index == skip || NESMinHashIsEmpty(&signatures[index])) continue;
+			
+			double similarity = NESMinHashSimilarity(signature, &signatures[index]);
+			if (similarity < min_similarity) continue;
+			
+			if (*match_count == capacity) {
+				capacity = capacity ? capacity * 2 : 16;
+				matches = (NESSimilarMatch*)realloc(matches, sizeof(NESSimilarMatch) * capacity);
+			}
+			
+			matches[*match_count].index = index;
+			matches[*match_count].similarity = similarity;
+			(*match_count)++;
+		}
+	}
+	
+	v_printf(VERBOSE_DEBUG, "%llu candidates of %llu entries, %llu matches", candidates, count, *match_count);
+	
+	free(seen);
+	
+	if (!matches) return (NESSimilarMatch*)malloc(sizeof(NESSimilarMatch));
+	
+	qsort(matches, *match_count, sizeof(NESSimilarMatch), NESSimilarMatchCompare);
+	
+	return matches;
+}
@@ -0,0 +1,74 @@
+/*
+**	similar.h
+**	nesromtool
+**
+**	whole-ROM similarity: MinHash signatures over bank and tile shingles, with an LSH index
+**
+**	a ROM's shingles are every 16-byte tile of its PRG and CHR data (tiles that are one byte
+**	repeated carry no signal and are skipped) plus one per whole bank. the signature keeps, for
+**	each of NES_MINHASH_LENGTH hash functions, the smallest hash of any shingle; the fraction of
+**	positions two signatures agree on estimates the Jaccard similarity of their shingle sets.
+**
+**	the index splits each signature into NES_LSH_BANDS bands of NES_LSH_ROWS values and keeps one
+**	table per band of (band key, entry) pairs sorted by key. a lookup is one binary search per band,
+**	so ROMs sharing any whole band become candidates without scanning the library; with 16 bands of
+**	4 rows, pairs above ~0.6 similarity almost always collide and pairs below ~0.3 rarely do
+*/
+
+#ifndef _SIMILAR_H_
+#define _SIMILAR_H_
+
+#include <stdint.h>
+#include "types.h"
+#include "nesrom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_MINHASH_LENGTH				64			/* hash functions (uint32_t values) per signature */
+#define NES_LSH_BANDS					16
+#define NES_LSH_ROWS					(NES_MINHASH_LENGTH / NES_LSH_BANDS)
+#define NES_MINHASH_EMPTY				UINT32_MAX	/* every value of a ROM with no shingles */
+
+typedef struct nesMinHash {
+	uint32_t values[NES_MINHASH_LENGTH];
+} NESMinHash;
+
+//one row of a band table
+typedef struct nesLshEntry {
+	uint32_t key;							/* NESMinHashBandKey() */
+	uint32_t index;							/* the catalog entry */
+} NESLshEntry;
+
+//a match from NESSimilarFind()
+typedef struct nesSimilarMatch {
+	u64 index;								/* the catalog entry */
+	double similarity;						/* estimated Jaccard similarity, 0-1 */
+} NESSimilarMatch;
+
+//the signature of a mapped ROM (whatever of its banks is in the file)
+void NESRomMinHash(NESRom *rom, NESMinHash *signature);
+
+//true if the signature came from a ROM with no shingles at all
+bool NESMinHashIsEmpty(const NESMinHash *signature);
+
+//the fraction of values two signatures share
+double NESMinHashSimilarity(const NESMinHash *a, const NESMinHash *b);
+
+//hash of one band of a signature
+uint32_t NESMinHashBandKey(const NESMinHash *signature, int band);
+
+//fills table with count entries for band, sorted by key (then index)
+void NESLshBuildBand(NESLshEntry *table, const NESMinHash *signatures, u64 count, int band);
+
+//looks a signature up in the band tables (bands[b] holds count entries)
+//returns a malloc()ed list of matches, most similar first, and sets *match_count
+//entries whose similarity is below min_similarity are dropped, as is skip (pass -1 to keep everything)
+NESSimilarMatch *NESSimilarFind(NESLshEntry **bands, const NESMinHash *signatures, u64 count, const NESMinHash *signature, double min_similarity, long long skip, u64 *match_count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _SIMILAR_H_ */
@@ -0,0 +1,593 @@
+/*
+**	store.c
+**	nesromtool
+**
+**	the content-addressed bank store (see store.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "store.h"
+#include "verbosity.h"
+
+#define NES_STORE_TABLE_MIN			1024		/* smallest hash table, in slots */
+
+#ifndef IOV_MAX
+#define IOV_MAX						1024
+#endif
+
+static char *NESStorePath(NESStore *store, char *name) {
+	/*
+	**	returns a malloc()ed <store>/<name>
+	*/
+	
+	char *path = (char*)malloc(strlen(store->path) + strlen(name) + 2);
+	sprintf(path, "%s/%s", store->path, name);
+	
+	return path;
+}
+
+#pragma mark *** Index ***
+
+static u64 NESStoreSlot(NESStore *store, uchar *sha1) {
+	uint64_t hash;
+	
+	memcpy(&hash, sha1, sizeof(hash));
+	
+	return hash & (store->table_size - 1);
+}
+
+static void NESStoreRehash(NESStore *store, u64 table_size) {
+	u64 i = 0;
+	
+	free(store->table);
+	store->table_size = table_size;
+	store->table = (uint32_t*)calloc(table_size, sizeof(uint32_t));
+	
+	for (i = 0; i < store->count; i++) {
+		u64 slot = NESStoreSlot(store, store->chunks[i].sha1);
+		
+		while (store->table[slot]) slot = (slot + 1) & (table_size - 1);
+		store->table[slot] = i + 1;
+	}
+}
+
+NESStoreChunk *NESStoreFind(NESStore *store, uchar *sha1) {
+	u64 slot = NESStoreSlot(store, sha1);
+	
+	while (store->table[slot]) {
+		NESStoreChunk *chunk = &(store->chunks[store->table[slot] - 1]);
+		
+		if (memcmp(chunk->sha1, sha1, SHA1_DIGEST_LENGTH) == 0) return chunk;
+		slot = (slot + 1) & (store->table_size - 1);
+	}
+	
+	return NULL;
+}
+
+static bool NESStoreReadIndex(NESStore *store) {
+	/*
+	**	loads chunks.idx; a missing index is an empty store
+	*/
+	
+	NESStoreIndexHeader header;
+	char *path = NESStorePath(store, NES_STORE_INDEX_NAME);
+	FILE *ifile = fopen(path, "r");
+	
+	free(path);
+	
+	if (!ifile) return (errno == ENOENT);
+	
+	bool ok = (fread(&header, sizeof(header), 1, ifile) == 1)
+		&& memcmp(header.magic, NES_STORE_INDEX_MAGIC, NES_STORE_MAGIC_LENGTH) == 0
+		&& header.version == NES_STORE_VERSION
+		&& header.chunk_count < UINT32_MAX;
+	
+	if (ok) {
+		store->count = store->capacity = header.chunk_count;
+		store->pack_size = header.pack_size;
+		store->chunks = (NESStoreChunk*)malloc(sizeof(NESStoreChunk) * (store->capacity ? store->capacity : 1));
+		
+		ok = (fread(store->chunks, sizeof(NESStoreChunk), store->count, ifile) == store->count);
+	}
+	
+	fclose(ifile);
+	
+	if (!ok) errno = EINVAL;
+	
+	return ok;
+}
+
+static int NESStoreChunkCompare(const void *a, const void *b) {
+	return memcmp(((NESStoreChunk*)a)->sha1, ((NESStoreChunk*)b)->sha1, SHA1_DIGEST_LENGTH);
+}
+
+bool NESStoreSave(NESStore *store) {
+	/*
+	**	flushes the pack, then replaces the index (sorted by SHA-1) via a temporary file
+	**	returns false on error (errno is set)
+	*/
+	
+	NESStoreIndexHeader header;
+	
+	if (!store->added) return true;
+	
+	if (fsync(store->pack_fd) != 0) return false;
+	
+	qsort(store->chunks, store->count, sizeof(NESStoreChunk), NESStoreChunkCompare);
+	NESStoreRehash(store, store->table_size);
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NES_STORE_INDEX_MAGIC, NES_STORE_MAGIC_LENGTH);
+	header.version = NES_STORE_VERSION;
+	header.chunk_count = store->count;
+	header.pack_size = store->pack_size;
+	
+	char *path = NESStorePath(store, NES_STORE_INDEX_NAME);
+	char *temp_path = (char*)malloc(strlen(path) + 32);
+	sprintf(temp_path, "%s.tmp.%d", path, (int)getpid());
+	
+	FILE *ofile = fopen(temp_path, "w");
+	bool ok = (ofile != NULL)
+		&& fwrite(&header, sizeof(header), 1, ofile) == 1
+		&& fwrite(store->chunks, sizeof(NESStoreChunk), store->count, ofile) == store->count
+		&& fflush(ofile) == 0
+		&& fsync(fileno(ofile)) == 0;
+	
+	if (ofile && fclose(ofile) != 0) ok = false;
+	if (ok) ok = (rename(temp_path, path) == 0);
+	
+	if (!ok) {
+		int saved = errno;
+		unlink(temp_path);
+		errno = saved;
+	}
+	
+	free(temp_path);
+	free(path);
+	
+	if (ok) store->added = 0;
+	
+	return ok;
+}
+
+#pragma mark -
+#pragma mark *** Opening ***
+
+NESStore *NESStoreOpen(char *path, bool create) {
+	/*
+	**	opens the store at path; with create, makes the directories if they aren't there yet
+	**	and gets the pack ready for appending
+	*/
+	
+	struct stat st;
+	
+	if (create) {
+		if (mkdir(path, 0777) != 0 && errno != EEXIST) return NULL;
+	}
+	
+	if (stat(path, &st) != 0) return NULL;
+	if (!S_ISDIR(st.st_mode)) {
+		errno = ENOTDIR;
+		return NULL;
+	}
+	
+	NESStore *store = (NESStore*)calloc(1, sizeof(NESStore));
+	store->path = strdup(path);
+	store->pack_fd = -1;
+	
+	char *manifest_dir = NESStorePath(store, NES_STORE_MANIFEST_DIR);
+	bool ok = !create || mkdir(manifest_dir, 0777) == 0 || errno == EEXIST;
+	free(manifest_dir);
+	
+	if (ok) ok = NESStoreReadIndex(store);
+	
+	if (ok) {
+		char *pack_path = NESStorePath(store, NES_STORE_PACK_NAME);
+		
+		store->pack_fd = create ? open(pack_path, O_RDWR | O_CREAT, 0666) : open(pack_path, O_RDONLY);
+		free(pack_path);
+		
+		//an empty store doesn't need a pack yet
+		if (store->pack_fd < 0 && !create && errno == ENOENT && store->count == 0) errno = 0;
+		ok = (store->pack_fd >= 0 || errno == 0);
+	}
+	
+	if (ok && store->pack_fd >= 0) {
+		ok = (fstat(store->pack_fd, &st) == 0);
+		
+		if (ok && (u64)st.st_size < store->pack_size) {
+			v_printf(VERBOSE_DEBUG, "%s: pack is shorter than its index says", path);
+			errno = EINVAL;
+			ok = false;
+		}
+		
+		//drop anything a crashed add left past the end of the index
+		if (ok && create && (u64)st.st_size > store->pack_size) ok = (ftruncate(store->pack_fd, store->pack_size) == 0);
+	}
+	
+	if (!ok) {
+		int saved = errno;
+		NESStoreClose(store);
+		errno = saved;
+		return NULL;
+	}
+	
+	u64 table_size = NES_STORE_TABLE_MIN;
+	while (table_size < store->count * 2) table_size <<= 1;
+	NESStoreRehash(store, table_size);
+	
+	return store;
+}
+
+void NESStoreClose(NESStore *store) {
+	if (!store) return;
+	
+	if (store->pack) munmap(store->pack, store->pack_mapped);
+	if (store->pack_fd >= 0) close(store->pack_fd);
+	
+	free(store->path);
+	free(store->chunks);
+	free(store->table);
+	free(store);
+}
+
+bool NESStoreAdd(NESStore *store, uchar *sha1, uchar *data, uint32_t length) {
+	/*
+	**	appends a chunk to the pack (the index isn't written until NESStoreSave())
+	*/
+	
+	u64 done = 0;
+	
+	if (NESStoreFind(store, sha1)) return true;
+	
+	while (done < length) {
+		ssize_t count = pwrite(store->pack_fd, data + done, length - done, store->pack_size + done);
+		
+		if (count < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		
+		done += count;
+	}
+	
+	if (store->count == store->capacity) {
+		store->capacity = store->capacity ? store->capacity * 2 : 1024;
+		store->chunks = (NESStoreChunk*)realloc(store->chunks, sizeof(NESStoreChunk) * store->capacity);
+	}
+	
+	NESStoreChunk *chunk = &(store->chunks[store->count++]);
+	memcpy(chunk->sha1, sha1, SHA1_DIGEST_LENGTH);
+	chunk->length = length;
+	chunk->offset = store->pack_size;
+	
+	store->pack_size += length;
+	store->added++;
+	store->added_bytes += length;
+	
+	//keep the table at most half full
+	if (store->count * 2 > store->table_size) {
+		NESStoreRehash(store, store->table_size * 2);
+	} else {
+		u64 slot = NESStoreSlot(store, sha1);
+		
+		while (store->table[slot]) slot = (slot + 1) & (store->table_size - 1);
+		store->table[slot] = store->count;
+	}
+	
+	return true;
+}
+
+#pragma mark -
+#pragma mark *** Splitting ***
+
+int NESRomChunkCount(NESRom *rom) {
+	/*
+	**	the most chunks rom can split into
+	*/
+	
+	return 3 + rom->prg_count + rom->chr_count;
+}
+
+int NESRomChunkOffsets(NESRom *rom, u64 *offsets) {
+	/*
+	**	fills in the start of each chunk (and, at the end, the filesize)
+	**	every boundary is clipped to the file, so a truncated ROM just has fewer chunks
+	*/
+	
+	u64 *boundaries = (u64*)malloc(sizeof(u64) * (NESRomChunkCount(rom) + 1));
+	int count = 0;
+	int i = 0;
+	int chunks = 0;
+	
+	boundaries[count++] = NES_HEADER_SIZE;
+	if (rom->dir.trainer_length) boundaries[count++] = rom->dir.trainer_offset + rom->dir.trainer_length;
+	
+	for (i = 1; i <= rom->prg_count; i++) boundaries[count++] = NESRomBankOffset(rom, nes_prg_bank, i);
+	for (i = 1; i <= rom->chr_count; i++) boundaries[count++] = NESRomBankOffset(rom, nes_chr_bank, i);
+	
+	boundaries[count++] = rom->size;
+	
+	offsets[chunks] = 0;
+	
+	for (i = 0; i < count; i++) {
+		u64 boundary = (boundaries[i] < rom->size) ? boundaries[i] : rom->size;
+		
+		if (boundary > offsets[chunks]) offsets[++chunks] = boundary;
+	}
+	
+	free(boundaries);
+	
+	return chunks;
+}
+
+void NESStoreSplit(NESRom *rom, char *name, NESStoreManifest *manifest) {
+	/*
+	**	hashes each chunk, and the file as a whole
+	*/
+	
+	SHA1Context context;
+	int i = 0;
+	u64 *offsets = (u64*)malloc(sizeof(u64) * (NESRomChunkCount(rom) + 1));
+	
+	memset(manifest, 0, sizeof(NESStoreManifest));
+	
+	manifest->size = rom->size;
+	manifest->name = strdup(name);
+	manifest->count = NESRomChunkOffsets(rom, offsets);
+	manifest->chunks = (NESStoreChunk*)calloc(manifest->count ? manifest->count : 1, sizeof(NESStoreChunk));
+	
+	sha1_init(&context);
+	if (rom->size) sha1_update(&context, rom->data, rom->size);
+	sha1_final(&context, manifest->sha1);
+	
+	for (i = 0; i < (int)manifest->count; i++) {
+		NESStoreChunk *chunk = &(manifest->chunks[i]);
+		
+		chunk->offset = offsets[i];
+		chunk->length = offsets[i + 1] - offsets[i];
+		
+		sha1_init(&context);
+		sha1_update(&context, rom->data + offsets[i], chunk->length);
+		sha1_final(&context, chunk->sha1);
+	}
+	
+	free(offsets);
+}
+
+void NESStoreManifestFree(NESStoreManifest *manifest) {
+	free(manifest->name);
+	free(manifest->chunks);
+	memset(manifest, 0, sizeof(NESStoreManifest));
+}
+
+#pragma mark -
+#pragma mark *** Manifests ***
+
+static char *NESStoreManifestPath(NESStore *store, char *id) {
+	char *path = (char*)malloc(strlen(store->path) + strlen(NES_STORE_MANIFEST_DIR) + strlen(id) + 3);
+	sprintf(path, "%s/%s/%s", store->path, NES_STORE_MANIFEST_DIR, id);
+	
+	return path;
+}
+
+bool NESStoreWriteManifest(NESStore *store, NESStoreManifest *manifest) {
+	/*
+	**	writes <store>/manifests/<id> via a temporary file
+	**	chunk offsets aren't written; they're looked up in the index when restoring
+	*/
+	
+	NESStoreManifestHeader header;
+	char id[NES_STORE_ID_LENGTH];
+	uint32_t i = 0;
+	
+	hex_digest(id, manifest->sha1, SHA1_DIGEST_LENGTH);
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NES_STORE_MANIFEST_MAGIC, NES_STORE_MAGIC_LENGTH);
+	header.version = NES_STORE_VERSION;
+	header.chunk_count = manifest->count;
+	header.size = manifest->size;
+	memcpy(header.sha1, manifest->sha1, SHA1_DIGEST_LENGTH);
+	header.name_length = strlen(manifest->name);
+	
+	char *path = NESStoreManifestPath(store, id);
+	char *temp_path = (char*)malloc(strlen(path) + 32);
+	sprintf(temp_path, "%s.tmp.%d", path, (int)getpid());
+	
+	FILE *ofile = fopen(temp_path, "w");
+	bool ok = (ofile != NULL)
+		&& fwrite(&header, sizeof(header), 1, ofile) == 1
+		&& fwrite(manifest->name, 1, header.name_length, ofile) == header.name_length;
+	
+	for (i = 0; ok && i < manifest->count; i++) {
+		ok = fwrite(manifest->chunks[i].sha1, SHA1_DIGEST_LENGTH, 1, ofile) == 1
+			&& fwrite(&(manifest->chunks[i].length), sizeof(uint32_t), 1, ofile) == 1;
+	}
+	
+	if (ofile && fclose(ofile) != 0) ok = false;
+	if (ok) ok = (rename(temp_path, path) == 0);
+	
+	if (!ok) {
+		int saved = errno;
+		unlink(temp_path);
+		errno = saved;
+	}
+	
+	free(temp_path);
+	free(path);
+	
+	return ok;
+}
+
+bool NESStoreReadManifest(NESStore *store, char *id, NESStoreManifest *manifest) {
+	/*
+	**	reads the manifest called id
+	**	returns false if it isn't there (errno is set; EINVAL if it isn't a manifest)
+	*/
+	
+	NESStoreManifestHeader header;
+	uint32_t i = 0;
+	
+	memset(manifest, 0, sizeof(NESStoreManifest));
+	
+	//ids are hex; anything else could walk out of the manifest directory
+	if (strlen(id) != NES_STORE_ID_LENGTH - 1 || strspn(id, "0123456789abcdef") != NES_STORE_ID_LENGTH - 1) {
+		errno = ENOENT;
+		return false;
+	}
+	
+	char *path = NESStoreManifestPath(store, id);
+	FILE *ifile = fopen(path, "r");
+	
+	free(path);
+	
+	if (!ifile) return false;
+	
+	bool ok = (fread(&header, sizeof(header), 1, ifile) == 1)
+		&& memcmp(header.magic, NES_STORE_MANIFEST_MAGIC, NES_STORE_MAGIC_LENGTH) == 0
+		&& header.version == NES_STORE_VERSION
+		&& header.name_length < PATH_MAX;
+	
+	if (ok) {
+		manifest->size = header.size;
+		manifest->count = header.chunk_count;
+		memcpy(manifest->sha1, header.sha1, SHA1_DIGEST_LENGTH);
+		
+		manifest->name = (char*)calloc(header.name_length + 1, 1);
+		ok = (fread(manifest->name, 1, header.name_length, ifile) == header.name_length);
+	}
+	
+	if (ok) {
+		manifest->chunks = (NESStoreChunk*)calloc(manifest->count ? manifest->count : 1, sizeof(NESStoreChunk));
+		
+		for (i = 0; ok && i < manifest->count; i++) {
+			ok = fread(manifest->chunks[i].sha1, SHA1_DIGEST_LENGTH, 1, ifile) == 1
+				&& fread(&(manifest->chunks[i].length), sizeof(uint32_t), 1, ifile) == 1;
+		}
+	}
+	
+	fclose(ifile);
+	
+	if (!ok) {
+		NESStoreManifestFree(manifest);
+		errno = EINVAL;
+	}
+	
+	return ok;
+}
+
+#pragma mark -
+#pragma mark *** Restoring ***
+
+static bool NESStoreMapPack(NESStore *store) {
+	/*
+	**	(re)maps the pack if it has grown past what's mapped
+	*/
+	
+	if (store->pack && store->pack_mapped >= store->pack_size) return true;
+	if (store->pack_size == 0) return true;
+	
+	if (store->pack) munmap(store->pack, store->pack_mapped);
+	
+	store->pack = (uchar*)mmap(NULL, store->pack_size, PROT_READ, MAP_SHARED, store->pack_fd, 0);
+	
+	if (store->pack == MAP_FAILED) {
+		store->pack = NULL;
+		store->pack_mapped = 0;
+		return false;
+	}
+	
+	store->pack_mapped = store->pack_size;
+	
+	return true;
+}
+
+static bool NESStoreWritev(int fd, struct iovec *iov, int count) {
+	/*
+	**	writev() until everything is out, picking up after short writes
+	*/
+	
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	
+	return true;
+}
+
+bool NESStoreRestore(NESStore *store, NESStoreManifest *manifest, int fd) {
+	/*
+	**	gathers the chunks straight from the mapped pack and writes them with writev(), IOV_MAX at a time
+	**	the output is hashed on the way out and checked against the manifest
+	*/
+	
+	struct iovec iov[IOV_MAX];
+	SHA1Context context;
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	uint32_t i = 0;
+	int pending = 0;
+	bool ok = NESStoreMapPack(store);
+	
+	sha1_init(&context);
+	
+	for (i = 0; ok && i < manifest->count; i++) {
+		NESStoreChunk *chunk = NESStoreFind(store, manifest->chunks[i].sha1);
+		
+		if (!chunk || chunk->length != manifest->chunks[i].length || chunk->offset + chunk->length > store->pack_size) {
+			errno = ENOENT;
+			ok = false;
+			break;
+		}
+		
+		iov[pending].iov_base = store->pack + chunk->offset;
+		iov[pending].iov_len = chunk->length;
+		pending++;
+		
+		sha1_update(&context, store->pack + chunk->offset, chunk->length);
+		
+		if (pending == IOV_MAX) {
+			ok = NESStoreWritev(fd, iov, pending);
+			pending = 0;
+		}
+	}
+	
+	if (ok && pending) ok = NESStoreWritev(fd, iov, pending);
+	
+	if (ok) {
+		sha1_final(&context, sha1);
+		
+		if (memcmp(sha1, manifest->sha1, SHA1_DIGEST_LENGTH) != 0) {
+			errno = EILSEQ;
+			ok = false;
+		}
+	}
+	
+	return ok;
+}
@@ -0,0 +1,121 @@
+/*
+**	store.h
+**	nesromtool
+**
+**	a content-addressed bank store: ROMs are split at their bank boundaries and each unique
+**	chunk is kept once, keyed by its SHA-1. a ROM becomes a small manifest listing its chunks
+**
+**	a store is a directory:
+**		chunks.pack		every unique chunk, back to back (append-only)
+**		chunks.idx		NESStoreIndexHeader, then NESStoreChunk entries sorted by SHA-1
+**		manifests/		one file per ROM, named by the SHA-1 of the whole file
+**	the pack is only trusted up to the size the index records, so a crash while adding
+**	leaves at most some unreferenced bytes that the next add drops
+*/
+
+#ifndef _STORE_H_
+#define _STORE_H_
+
+#include <stdint.h>
+#include "types.h"
+#include "nesrom.h"
+#include "hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_STORE_PACK_NAME				"chunks.pack"
+#define NES_STORE_INDEX_NAME			"chunks.idx"
+#define NES_STORE_MANIFEST_DIR			"manifests"
+
+#define NES_STORE_INDEX_MAGIC			"NESCHIDX"
+#define NES_STORE_MANIFEST_MAGIC		"NESMANIF"
+#define NES_STORE_MAGIC_LENGTH			8
+#define NES_STORE_VERSION				1
+
+#define NES_STORE_ID_LENGTH				((SHA1_DIGEST_LENGTH * 2) + 1)	/* a manifest id: hex SHA-1 + NUL */
+
+//one chunk in the pack
+typedef struct nesStoreChunk {
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	uint32_t length;
+	uint64_t offset;						/* in the pack */
+} NESStoreChunk;
+
+typedef struct nesStoreIndexHeader {
+	char magic[NES_STORE_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t chunk_count;
+	uint64_t pack_size;						/* bytes of the pack the index covers */
+} NESStoreIndexHeader;
+
+//what a ROM is made of
+typedef struct nesStoreManifest {
+	u64 size;								/* of the whole file */
+	uchar sha1[SHA1_DIGEST_LENGTH];			/* of the whole file; also the manifest's name */
+	char *name;								/* the file's original name (malloc()ed) */
+	uint32_t count;
+	NESStoreChunk *chunks;					/* sha1 and length of each chunk, in file order (malloc()ed; offsets unused) */
+} NESStoreManifest;
+
+typedef struct nesStoreManifestHeader {
+	char magic[NES_STORE_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t chunk_count;
+	uint64_t size;
+	uchar sha1[SHA1_DIGEST_LENGTH];
+	uint32_t name_length;					/* the name follows the header, then the chunks */
+} NESStoreManifestHeader;
+
+//an opened store
+typedef struct nesStore {
+	char *path;
+	int pack_fd;
+	uchar *pack;							/* the pack, mapped read-only (NULL until needed) */
+	u64 pack_mapped;						/* bytes of it mapped */
+	u64 pack_size;							/* bytes of it in use */
+	NESStoreChunk *chunks;
+	u64 count;
+	u64 capacity;
+	uint32_t *table;						/* open-addressed hash table of chunk index + 1 */
+	u64 table_size;
+	u64 added;								/* chunks appended since the store was opened */
+	u64 added_bytes;
+} NESStore;
+
+//opens (creating it if asked to) the store at path; NULL on error (errno is set; EINVAL for a bad index)
+NESStore *NESStoreOpen(char *path, bool create);
+void NESStoreClose(NESStore *store);
+
+//writes the index out (atomically) after chunks have been added
+bool NESStoreSave(NESStore *store);
+
+NESStoreChunk *NESStoreFind(NESStore *store, uchar *sha1);
+
+//appends data to the pack unless a chunk with this SHA-1 is already there
+bool NESStoreAdd(NESStore *store, uchar *sha1, uchar *data, uint32_t length);
+
+//chunk boundaries of a mapped ROM: header, [trainer], each PRG bank, each CHR bank, [whatever follows]
+//offsets must hold NESRomChunkCount(rom) + 1 entries; returns the number of chunks
+int NESRomChunkCount(NESRom *rom);
+int NESRomChunkOffsets(NESRom *rom, u64 *offsets);
+
+//splits and hashes a mapped ROM into manifest (name is copied)
+void NESStoreSplit(NESRom *rom, char *name, NESStoreManifest *manifest);
+void NESStoreManifestFree(NESStoreManifest *manifest);
+
+//manifests are stored as <store>/manifests/<id>, where id is the file's SHA-1 in hex
+bool NESStoreWriteManifest(NESStore *store, NESStoreManifest *manifest);
+bool NESStoreReadManifest(NESStore *store, char *id, NESStoreManifest *manifest);
+
+//writes the ROM a manifest describes to fd, straight out of the mapped pack with writev()
+//returns false on a write error (errno is set), or with errno = EILSEQ if the result doesn't hash to the manifest's SHA-1
+bool NESStoreRestore(NESStore *store, NESStoreManifest *manifest, int fd);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _STORE_H_ */
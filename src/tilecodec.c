@@ -0,0 +1,354 @@
+/*
+**	tilecodec.c
+**	nesromtool
+**
+**	native <-> composite tile conversion kernels (see tilecodec.h)
+**
+**	a native tile is 2 channels of 8 bytes; byte n of each channel is row n, and bit 7 is the
+**	leftmost pixel. a composite pixel is (channel_a bit) | (channel_b bit << 1).
+*/
+
+#include <string.h>
+#include <pthread.h>
+
+#include "tilecodec.h"
+#include "nesutils.h"
+#include "verbosity.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NES_TILECODEC_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*NESTileKernel)(uchar *out, const uchar *in, int tile_count);
+
+#pragma mark *** SCALAR ***
+
+//NESSpreadBits[n] is the 8 pixels of channel byte n, as bytes of 0 or 1 (leftmost pixel first)
+static uchar NESSpreadBits[256][NES_TILE_WIDTH];
+
+static void NESBuildSpreadBits() {
+	int i = 0;
+	int j = 0;
+	
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < NES_TILE_WIDTH; j++) {
+			NESSpreadBits[i][j] = (i >> (7 - j)) & 1;
+		}
+	}
+}
+
+static void NESDecodeTilesScalar(uchar *composite, const uchar *tiles, int tile_count) {
+	int tile = 0;
+	int row = 0;
+	int i = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row++) {
+			const uchar *a = NESSpreadBits[tiles[row]];
+			const uchar *b = NESSpreadBits[tiles[row + NES_ROM_TILE_CHANNEL_LENGTH]];
+			
+			for (i = 0; i < NES_TILE_WIDTH; i++) {
+				composite[i] = a[i] | (b[i] << 1);
+			}
+			
+			composite += NES_TILE_WIDTH;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+static void NESEncodeTilesScalar(uchar *tiles, const uchar *composite, int tile_count) {
+	int tile = 0;
+	int row = 0;
+	int i = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row++) {
+			uchar a = 0;
+			uchar b = 0;
+			
+			for (i = 0; i < NES_TILE_WIDTH; i++) {
+				a = (a << 1) | (composite[i] & 1);
+				b = (b << 1) | ((composite[i] >> 1) & 1);
+			}
+			
+			tiles[row] = a;
+			tiles[row + NES_ROM_TILE_CHANNEL_LENGTH] = b;
+			
+			composite += NES_TILE_WIDTH;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+#ifdef NES_TILECODEC_X86
+
+#pragma mark *** SSE2 ***
+
+//NESReverseBits[n] is n with its bit order flipped (movemask gives us the leftmost pixel in bit 0)
+static uchar NESReverseBits[256];
+
+static void NESBuildReverseBits() {
+	int i = 0;
+	int j = 0;
+	
+	for (i = 0; i < 256; i++) {
+		uchar r = 0;
+		for (j = 0; j < 8; j++) {
+			if (i & (1 << j)) r |= 0x80 >> j;
+		}
+		NESReverseBits[i] = r;
+	}
+}
+
+__attribute__((target("sse2")))
+static void NESDecodeTilesSSE2(uchar *composite, const uchar *tiles, int tile_count) {
+	/*
+	**	2 rows (16 pixels) per register:
+	**	broadcast each channel byte across the 8 lanes of its row, then test one bit per lane
+	*/
+	
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+	int tile = 0;
+	int row = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		__m128i t = _mm_loadu_si128((const __m128i *)tiles);
+		__m128i a = _mm_unpacklo_epi8(t, t);				// a0 a0 a1 a1 ... a7 a7
+		__m128i b = _mm_unpackhi_epi8(t, t);				// b0 b0 b1 b1 ... b7 b7
+		
+		for (row = 0; row < NES_TILE_HEIGHT; row += 2) {
+			__m128i a2 = _mm_unpacklo_epi16(a, a);			// a(row) x4, a(row + 1) x4, ...
+			__m128i b2 = _mm_unpacklo_epi16(b, b);
+			__m128i a8 = _mm_unpacklo_epi32(a2, a2);		// a(row) x8, a(row + 1) x8
+			__m128i b8 = _mm_unpacklo_epi32(b2, b2);
+			
+			__m128i pa = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(a8, bits), bits), one);
+			__m128i pb = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(b8, bits), bits), two);
+			
+			_mm_storeu_si128((__m128i *)composite, _mm_or_si128(pa, pb));
+			composite += 16;
+			
+			//move the next 2 rows down
+			a = _mm_srli_si128(a, 4);
+			b = _mm_srli_si128(b, 4);
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+__attribute__((target("sse2")))
+static void NESEncodeTilesSSE2(uchar *tiles, const uchar *composite, int tile_count) {
+	/*
+	**	shift each channel bit up to bit 7 of its byte and let movemask collect 16 pixels at a time
+	*/
+	
+	int tile = 0;
+	int row = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row += 2) {
+			__m128i p = _mm_loadu_si128((const __m128i *)composite);
+			int a = _mm_movemask_epi8(_mm_slli_epi16(p, 7));
+			int b = _mm_movemask_epi8(_mm_slli_epi16(p, 6));
+			
+			tiles[row] = NESReverseBits[a & 0xFF];
+			tiles[row + 1] = NESReverseBits[a >> 8];
+			tiles[row + NES_ROM_TILE_CHANNEL_LENGTH] = NESReverseBits[b & 0xFF];
+			tiles[row + NES_ROM_TILE_CHANNEL_LENGTH + 1] = NESReverseBits[b >> 8];
+			
+			composite += 16;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+#pragma mark *** AVX2 ***
+
+__attribute__((target("avx2")))
+static void NESDecodeTilesAVX2(uchar *composite, const uchar *tiles, int tile_count) {
+	/*
+	**	4 rows (32 pixels) per register; a shuffle does the broadcasting in one step
+	*/
+	
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi8(2);
+	
+	// rows 0-3 and 4-7 of channel a; channel b is the same + 8
+	const __m256i rows_lo = _mm256_setr_epi8(0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1, 2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3);
+	const __m256i rows_hi = _mm256_setr_epi8(4,4,4,4,4,4,4,4, 5,5,5,5,5,5,5,5, 6,6,6,6,6,6,6,6, 7,7,7,7,7,7,7,7);
+	const __m256i channel_b = _mm256_set1_epi8(NES_ROM_TILE_CHANNEL_LENGTH);
+	
+	int tile = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		__m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tiles));
+		
+		__m256i a = _mm256_shuffle_epi8(t, rows_lo);
+		__m256i b = _mm256_shuffle_epi8(t, _mm256_add_epi8(rows_lo, channel_b));
+		__m256i pa = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(a, bits), bits), one);
+		__m256i pb = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(b, bits), bits), two);
+		_mm256_storeu_si256((__m256i *)composite, _mm256_or_si256(pa, pb));
+		
+		a = _mm256_shuffle_epi8(t, rows_hi);
+		b = _mm256_shuffle_epi8(t, _mm256_add_epi8(rows_hi, channel_b));
+		pa = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(a, bits), bits), one);
+		pb = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(b, bits), bits), two);
+		_mm256_storeu_si256((__m256i *)(composite + 32), _mm256_or_si256(pa, pb));
+		
+		composite += NES_COMPOSITE_TILE_LENGTH;
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+__attribute__((target("avx2")))
+static void NESEncodeTilesAVX2(uchar *tiles, const uchar *composite, int tile_count) {
+	/*
+	**	flip each row end for end so the leftmost pixel lands in bit 7 of the movemask byte,
+	**	then 2 movemasks give 4 rows of each channel
+	*/
+	
+	const __m256i flip = _mm256_setr_epi8(7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8, 7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8);
+	int tile = 0;
+	int half = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (half = 0; half < 2; half++) {
+			__m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)composite), flip);
+			unsigned int a = _mm256_movemask_epi8(_mm256_slli_epi16(p, 7));
+			unsigned int b = _mm256_movemask_epi8(_mm256_slli_epi16(p, 6));
+			
+			memcpy(tiles + (half * 4), &a, 4);
+			memcpy(tiles + NES_ROM_TILE_CHANNEL_LENGTH + (half * 4), &b, 4);
+			
+			composite += 32;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+#pragma mark *** BMI2 ***
+
+#define NES_PDEP_LANE_MASK		0x0101010101010101ULL	/* bit 0 of every byte */
+
+__attribute__((target("bmi2")))
+static void NESDecodeTilesBMI2(uchar *composite, const uchar *tiles, int tile_count) {
+	/*
+	**	pdep drops each channel bit into its own byte; a byte swap puts the leftmost pixel first
+	*/
+	
+	int tile = 0;
+	int row = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row++) {
+			unsigned long long pixels = _pdep_u64(tiles[row], NES_PDEP_LANE_MASK)
+				| _pdep_u64(tiles[row + NES_ROM_TILE_CHANNEL_LENGTH], NES_PDEP_LANE_MASK << 1);
+			
+			pixels = __builtin_bswap64(pixels);
+			memcpy(composite, &pixels, NES_TILE_WIDTH);
+			
+			composite += NES_TILE_WIDTH;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+__attribute__((target("bmi2")))
+static void NESEncodeTilesBMI2(uchar *tiles, const uchar *composite, int tile_count) {
+	int tile = 0;
+	int row = 0;
+	
+	for (tile = 0; tile < tile_count; tile++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row++) {
+			unsigned long long pixels;
+			
+			memcpy(&pixels, composite, NES_TILE_WIDTH);
+			pixels = __builtin_bswap64(pixels);
+			
+			tiles[row] = _pext_u64(pixels, NES_PDEP_LANE_MASK);
+			tiles[row + NES_ROM_TILE_CHANNEL_LENGTH] = _pext_u64(pixels, NES_PDEP_LANE_MASK << 1);
+			
+			composite += NES_TILE_WIDTH;
+		}
+		
+		tiles += NES_ROM_TILE_LENGTH;
+	}
+}
+
+#endif /* NES_TILECODEC_X86 */
+
+#pragma mark *** DISPATCH ***
+
+static NESTileKernel NESDecodeKernel = NULL;
+static NESTileKernel NESEncodeKernel = NULL;
+static char *NESKernelName = "scalar";
+static pthread_once_t NESTileKernelsOnce = PTHREAD_ONCE_INIT;
+
+static void NESPickTileKernels() {
+	/*
+	**	picks the widest kernel the CPU supports: AVX2, then BMI2, then SSE2, then scalar
+	**	runs once (through pthread_once), so the tables are built before any thread uses them
+	*/
+	
+	NESTileKernel decode = (NESTileKernel)NESDecodeTilesScalar;
+	NESTileKernel encode = (NESTileKernel)NESEncodeTilesScalar;
+	char *name = "scalar";
+	
+	NESBuildSpreadBits();
+	
+#ifdef NES_TILECODEC_X86
+	NESBuildReverseBits();
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2")) {
+		decode = (NESTileKernel)NESDecodeTilesAVX2;
+		encode = (NESTileKernel)NESEncodeTilesAVX2;
+		name = "avx2";
+	} else if (__builtin_cpu_supports("bmi2")) {
+		decode = (NESTileKernel)NESDecodeTilesBMI2;
+		encode = (NESTileKernel)NESEncodeTilesBMI2;
+		name = "bmi2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		decode = (NESTileKernel)NESDecodeTilesSSE2;
+		encode = (NESTileKernel)NESEncodeTilesSSE2;
+		name = "sse2";
+	}
+#endif
+	
+	NESKernelName = name;
+	NESEncodeKernel = encode;
+	NESDecodeKernel = decode;
+	
+	v_printf(VERBOSE_TRACE, "Tile codec: %s", name);
+}
+
+void NESDecodeTiles(uchar *composite, const uchar *tiles, int tile_count) {
+	if (!composite || !tiles || tile_count <= 0) return;
+	pthread_once(&NESTileKernelsOnce, NESPickTileKernels);
+	
+	NESDecodeKernel(composite, tiles, tile_count);
+}
+
+void NESEncodeTiles(uchar *tiles, const uchar *composite, int tile_count) {
+	if (!tiles || !composite || tile_count <= 0) return;
+	pthread_once(&NESTileKernelsOnce, NESPickTileKernels);
+	
+	NESEncodeKernel(tiles, composite, tile_count);
+}
+
+char *NESTileCodecName() {
+	pthread_once(&NESTileKernelsOnce, NESPickTileKernels);
+	
+	return NESKernelName;
+}
@@ -0,0 +1,32 @@
+/*
+**	tilecodec.h
+**	nesromtool
+**
+**	batch conversion between native (planar) tile data and composite (1 byte per pixel) data
+**	picks an SSE2, AVX2 or BMI2 kernel at runtime when the CPU has one, otherwise uses a
+**	portable table-driven version. all kernels produce identical output.
+*/
+
+#ifndef _TILECODEC_H_
+#define _TILECODEC_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//native -> composite: tile_count * NES_ROM_TILE_LENGTH bytes in, tile_count * NES_COMPOSITE_TILE_LENGTH bytes out
+void NESDecodeTiles(uchar *composite, const uchar *tiles, int tile_count);
+
+//composite -> native: only the low 2 bits of each composite pixel are used
+void NESEncodeTiles(uchar *tiles, const uchar *composite, int tile_count);
+
+//name of the kernel that was picked ("avx2", "bmi2", "sse2" or "scalar")
+char *NESTileCodecName();
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _TILECODEC_H_ */
@@ -0,0 +1,628 @@
+/*
+**	tileindex.c
+**	nesromtool
+**
+**	the inverted tile index (see tileindex.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "tileindex.h"
+#include "nesutils.h"
+#include "verbosity.h"
+
+#define NES_TILE_INDEX_ALIGN_UP(n)		(((n) + NES_TILE_INDEX_ALIGN - 1) & ~((u64)NES_TILE_INDEX_ALIGN - 1))
+#define NES_TILE_INDEX_RUN_BUFFER		(1024 * 1024)	/* stdio buffer per run while merging */
+
+#pragma mark *** Tiles ***
+
+static uchar NESTileReverseBits(uchar b) {
+	b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+	b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+	
+	return b;
+}
+
+static void NESTileFlip(const uchar *tile, uchar *flipped, int flip) {
+	/*
+	**	a tile is two 8-byte planes, one byte per row with the leftmost pixel in the high bit
+	**	so a horizontal flip reverses the bits of every byte, and a vertical one the rows of each plane
+	*/
+	
+	int plane = 0, row = 0;
+	
+	for (plane = 0; plane < 2; plane++) {
+		for (row = 0; row < NES_TILE_HEIGHT; row++) {
+			int source = (flip & NES_TILE_FLIP_VERTICAL) ? (NES_TILE_HEIGHT - 1 - row) : row;
+			uchar b = tile[(plane * NES_ROM_TILE_CHANNEL_LENGTH) + source];
+			
+			flipped[(plane * NES_ROM_TILE_CHANNEL_LENGTH) + row] = (flip & NES_TILE_FLIP_HORIZONTAL) ? NESTileReverseBits(b) : b;
+		}
+	}
+}
+
+int NESTileCanonicalize(const uchar *tile, uchar *canonical) {
+	/*
+	**	every flip undoes itself, so the flip that made canonical out of tile also turns it back
+	*/
+	
+	uchar flipped[NES_ROM_TILE_LENGTH];
+	int best = 0;
+	int flip = 0;
+	
+	memcpy(canonical, tile, NES_ROM_TILE_LENGTH);
+	
+	for (flip = 1; flip <= (NES_TILE_FLIP_HORIZONTAL | NES_TILE_FLIP_VERTICAL); flip++) {
+		NESTileFlip(tile, flipped, flip);
+		
+		if (memcmp(flipped, canonical, NES_ROM_TILE_LENGTH) < 0) {
+			memcpy(canonical, flipped, NES_ROM_TILE_LENGTH);
+			best = flip;
+		}
+	}
+	
+	return best;
+}
+
+static bool NESTileIsUniform(const uchar *tile) {
+	int i = 0;
+	
+	for (i = 1; i < NES_ROM_TILE_LENGTH; i++) {
+		if (tile[i] != tile[0]) return false;
+	}
+	
+	return true;
+}
+
+static int NESTilePostingCompare(const void *a, const void *b) {
+	const NESTilePosting *x = (const NESTilePosting*)a;
+	const NESTilePosting *y = (const NESTilePosting*)b;
+	int cmp = memcmp(x->tile, y->tile, NES_ROM_TILE_LENGTH);
+	
+	if (cmp) return cmp;
+	if (x->rom != y->rom) return (x->rom < y->rom) ? -1 : 1;
+	if (x->bank_type != y->bank_type) return (x->bank_type < y->bank_type) ? -1 : 1;
+	if (x->bank != y->bank) return (x->bank < y->bank) ? -1 : 1;
+	
+	return (int)x->index - (int)y->index;
+}
+
+#pragma mark -
+#pragma mark *** Building ***
+
+static char *NESTileIndexRunPath(NESTileIndexWriter *writer, int run) {
+	char *path = (char*)malloc(strlen(writer->path) + 48);
+	sprintf(path, "%s.run%d.%d", writer->path, run, (int)getpid());
+	
+	return path;
+}
+
+static void NESTileIndexRemoveRuns(NESTileIndexWriter *writer) {
+	int run = 0;
+	
+	for (run = 0; run < writer->run_count; run++) {
+		char *path = NESTileIndexRunPath(writer, run);
+		unlink(path);
+		free(path);
+	}
+}
+
+NESTileIndexWriter *NESTileIndexWriterOpen(char *path, u64 memory) {
+	NESTileIndexWriter *writer = (NESTileIndexWriter*)calloc(1, sizeof(NESTileIndexWriter));
+	
+	writer->path = strdup(path);
+	writer->capacity = memory / sizeof(NESTilePosting);
+	if (writer->capacity < NES_MAX_TILES_PRG) writer->capacity = NES_MAX_TILES_PRG;
+	writer->buffer = (NESTilePosting*)malloc(sizeof(NESTilePosting) * writer->capacity);
+	pthread_mutex_init(&(writer->lock), NULL);
+	
+	return writer;
+}
+
+static bool NESTileIndexWriteRun(NESTileIndexWriter *writer) {
+	/*
+	**	sorts the buffer and writes it out as the next run
+	**	called with the lock held
+	*/
+	
+	char *path = NESTileIndexRunPath(writer, writer->run_count);
+	FILE *ofile = fopen(path, "w");
+	bool ok = (ofile != NULL);
+	
+	free(path);
+	
+	qsort(writer->buffer, writer->length, sizeof(NESTilePosting), NESTilePostingCompare);
+	
+	if (ok) ok = (fwrite(writer->buffer, sizeof(NESTilePosting), writer->length, ofile) == writer->length);
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	//counted even if it failed, so it gets cleaned up
+	writer->run_count++;
+	
+	v_printf(VERBOSE_DEBUG, "run %d: %llu postings", writer->run_count, writer->length);
+	
+	writer->length = 0;
+	
+	return ok;
+}
+
+bool NESTileIndexWriterAdd(NESTileIndexWriter *writer, NESRom *rom, uint32_t rom_number, bool include_prg) {
+	/*
+	**	the tiles are canonicalized into a local list first, so the lock is only held to copy them in
+	*/
+	
+	NESBankType types[2] = { nes_chr_bank, nes_prg_bank };
+	int type = 0, bank = 0, tile = 0;
+	u64 count = 0;
+	u64 done = 0;
+	
+	u64 capacity = ((u64)rom->chr_count * NES_MAX_TILES_CHR) + (include_prg ? (u64)rom->prg_count * NES_MAX_TILES_PRG : 0);
+	NESTilePosting *postings = (NESTilePosting*)calloc(capacity ? capacity : 1, sizeof(NESTilePosting));
+	
+	for (type = 0; type < (include_prg ? 2 : 1); type++) {
+		int bank_count = (types[type] == nes_prg_bank) ? rom->prg_count : rom->chr_count;
+		int tile_count = NESRomBankLength(types[type]) / NES_ROM_TILE_LENGTH;
+		
+		for (bank = 0; bank < bank_count; bank++) {
+			uchar *data = NESRomGetBank(rom, types[type], bank);
+			if (!data) continue;
+			
+			for (tile = 0; tile < tile_count; tile++) {
+				uchar *tile_data = data + (tile * NES_ROM_TILE_LENGTH);
+				if (NESTileIsUniform(tile_data)) continue;
+				
+				NESTilePosting *posting = &postings[count++];
+				
+				posting->flip = NESTileCanonicalize(tile_data, posting->tile);
+				posting->rom = rom_number;
+				posting->bank = bank;
+				posting->index = tile;
+				posting->bank_type = types[type];
+			}
+		}
+	}
+	
+	pthread_mutex_lock(&(writer->lock));
+	
+	while (done < count && !writer->failed) {
+		u64 length = count - done;
+		if (length > writer->capacity - writer->length) length = writer->capacity - writer->length;
+		
+		memcpy(writer->buffer + writer->length, postings + done, sizeof(NESTilePosting) * length);
+		writer->length += length;
+		done += length;
+		
+		if (writer->length == writer->capacity && !NESTileIndexWriteRun(writer)) {
+			writer->failed = true;
+			writer->error = errno;
+		}
+	}
+	
+	writer->posting_count += count;
+	bool ok = !writer->failed;
+	
+	pthread_mutex_unlock(&(writer->lock));
+	
+	free(postings);
+	
+	return ok;
+}
+
+typedef struct nesTileIndexSource {
+	FILE *file;								/* a run on disk, or NULL for the writer's buffer */
+	NESTilePosting *memory;
+	u64 remaining;
+	NESTilePosting head;
+} NESTileIndexSource;
+
+static bool NESTileIndexSourceNext(NESTileIndexSource *source) {
+	/*
+	**	moves the source's next posting into head; false when it runs out
+	*/
+	
+	if (!source->remaining) return false;
+	
+	if (source->file) {
+		if (fread(&(source->head), sizeof(NESTilePosting), 1, source->file) != 1) {
+			source->remaining = 0;
+			return false;
+		}
+	} else {
+		source->head = *(source->memory++);
+	}
+	
+	source->remaining--;
+	
+	return true;
+}
+
+static void NESTileIndexHeapDown(NESTileIndexSource **heap, int count, int i) {
+	while (true) {
+		int smallest = i;
+		int left = (2 * i) + 1;
+		int right = left + 1;
+		
+		if (left < count && NESTilePostingCompare(&(heap[left]->head), &(heap[smallest]->head)) < 0) smallest = left;
+		if (right < count && NESTilePostingCompare(&(heap[right]->head), &(heap[smallest]->head)) < 0) smallest = right;
+		if (smallest == i) return;
+		
+		NESTileIndexSource *swap = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = swap;
+		i = smallest;
+	}
+}
+
+static int NESTileIndexTopCompare(const void *a, const void *b) {
+	/*
+	**	most ROMs first, then most postings; ties in tile order
+	*/
+	
+	const NESTileIndexTopEntry *x = (const NESTileIndexTopEntry*)a;
+	const NESTileIndexTopEntry *y = (const NESTileIndexTopEntry*)b;
+	
+	if (x->roms != y->roms) return (x->roms > y->roms) ? -1 : 1;
+	if (x->postings != y->postings) return (x->postings > y->postings) ? -1 : 1;
+	
+	return memcmp(x->tile, y->tile, NES_ROM_TILE_LENGTH);
+}
+
+static void NESTileIndexTopAdd(NESTileIndexTopEntry *top, uint64_t *count, NESTileIndexTopEntry *entry) {
+	/*
+	**	top is a heap with the least common of the kept tiles at the root
+	*/
+	
+	u64 i = 0;
+	
+	if (*count == NES_TILE_INDEX_TOP) {
+		if (NESTileIndexTopCompare(entry, &top[0]) >= 0) return;
+		top[0] = *entry;
+	} else {
+		//sift up
+		i = (*count)++;
+		while (i > 0 && NESTileIndexTopCompare(entry, &top[(i - 1) / 2]) > 0) {
+			top[i] = top[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		top[i] = *entry;
+		return;
+	}
+	
+	//sift down
+	while (true) {
+		u64 least = i;
+		u64 left = (2 * i) + 1;
+		u64 right = left + 1;
+		
+		if (left < *count && NESTileIndexTopCompare(&top[left], &top[least]) > 0) least = left;
+		if (right < *count && NESTileIndexTopCompare(&top[right], &top[least]) > 0) least = right;
+		if (least == i) return;
+		
+		NESTileIndexTopEntry swap = top[i];
+		top[i] = top[least];
+		top[least] = swap;
+		i = least;
+	}
+}
+
+static bool NESTileIndexPad(FILE *ofile, u64 *position, u64 target) {
+	static const uchar zeros[NES_TILE_INDEX_ALIGN] = { 0 };
+	
+	while (*position < target) {
+		u64 length = target - *position;
+		if (length > NES_TILE_INDEX_ALIGN) length = NES_TILE_INDEX_ALIGN;
+		
+		if (fwrite(zeros, 1, length, ofile) != length) return false;
+		*position += length;
+	}
+	
+	return true;
+}
+
+static bool NESTileIndexMerge(NESTileIndexWriter *writer, FILE *ofile, NESTileIndexHeader *header, NESTileIndexTopEntry *top) {
+	/*
+	**	merges the runs (and whatever is still in the buffer) into ofile, tallying the top tiles on the way
+	*/
+	
+	int source_count = writer->run_count + 1;
+	NESTileIndexSource *sources = (NESTileIndexSource*)calloc(source_count, sizeof(NESTileIndexSource));
+	NESTileIndexSource **heap = (NESTileIndexSource**)malloc(sizeof(NESTileIndexSource*) * source_count);
+	int heap_count = 0;
+	int i = 0;
+	bool ok = true;
+	
+	for (i = 0; ok && i < writer->run_count; i++) {
+		char *path = NESTileIndexRunPath(writer, i);
+		struct stat st;
+		
+		sources[i].file = fopen(path, "r");
+		ok = (sources[i].file != NULL) && fstat(fileno(sources[i].file), &st) == 0;
+		free(path);
+		
+		if (ok) {
+			setvbuf(sources[i].file, NULL, _IOFBF, NES_TILE_INDEX_RUN_BUFFER);
+			sources[i].remaining = st.st_size / sizeof(NESTilePosting);
+		}
+	}
+	
+	qsort(writer->buffer, writer->length, sizeof(NESTilePosting), NESTilePostingCompare);
+	sources[writer->run_count].memory = writer->buffer;
+	sources[writer->run_count].remaining = writer->length;
+	
+	for (i = 0; ok && i < source_count; i++) {
+		if (NESTileIndexSourceNext(&sources[i])) heap[heap_count++] = &sources[i];
+	}
+	
+	for (i = (heap_count / 2) - 1; i >= 0; i--) NESTileIndexHeapDown(heap, heap_count, i);
+	
+	NESTileIndexTopEntry group;
+	uint32_t last_rom = 0;
+	u64 written = 0;
+	
+	memset(&group, 0, sizeof(group));
+	
+	while (ok && heap_count) {
+		NESTilePosting *posting = &(heap[0]->head);
+		
+		if (written == 0 || memcmp(posting->tile, group.tile, NES_ROM_TILE_LENGTH) != 0) {
+			if (written) NESTileIndexTopAdd(top, &(header->top_count), &group);
+			
+			memcpy(group.tile, posting->tile, NES_ROM_TILE_LENGTH);
+			group.first = written;
+			group.postings = 0;
+			group.roms = 0;
+			header->tile_count++;
+		}
+		
+		group.postings++;
+		if (group.roms == 0 || posting->rom != last_rom) {
+			group.roms++;
+			last_rom = posting->rom;
+		}
+		
+		ok = (fwrite(posting, sizeof(NESTilePosting), 1, ofile) == 1);
+		written++;
+		
+		//replace the head with that source's next posting
+		if (!NESTileIndexSourceNext(heap[0])) {
+			if (heap[0]->file && ferror(heap[0]->file)) ok = false;
+			heap[0] = heap[--heap_count];
+		}
+		NESTileIndexHeapDown(heap, heap_count, 0);
+	}
+	
+	if (written) NESTileIndexTopAdd(top, &(header->top_count), &group);
+	
+	if (ok && written != writer->posting_count) {
+		//a run came back short
+		errno = EIO;
+		ok = false;
+	}
+	
+	header->posting_count = written;
+	
+	for (i = 0; i < writer->run_count; i++) {
+		if (sources[i].file) fclose(sources[i].file);
+	}
+	
+	free(sources);
+	free(heap);
+	
+	return ok;
+}
+
+static void NESTileIndexWriterFree(NESTileIndexWriter *writer) {
+	NESTileIndexRemoveRuns(writer);
+	pthread_mutex_destroy(&(writer->lock));
+	free(writer->buffer);
+	free(writer->path);
+	free(writer);
+}
+
+bool NESTileIndexWriterFinish(NESTileIndexWriter *writer, char **paths, u64 rom_count) {
+	/*
+	**	writes the index to a temporary file next to path, then renames it over path
+	*/
+	
+	NESTileIndexHeader header;
+	u64 i = 0;
+	
+	if (writer->failed) {
+		int error = writer->error;
+		NESTileIndexWriterFree(writer);
+		errno = error;
+		return false;
+	}
+	
+	//lay out everything but the postings and the top table, which come out of the merge
+	uint32_t *roms = (uint32_t*)malloc(sizeof(uint32_t) * (rom_count ? rom_count : 1));
+	u64 strings_length = 0;
+	
+	for (i = 0; i < rom_count; i++) {
+		roms[i] = strings_length;
+		strings_length += strlen(paths[i]) + 1;
+	}
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NES_TILE_INDEX_MAGIC, NES_TILE_INDEX_MAGIC_LENGTH);
+	header.version = NES_TILE_INDEX_VERSION;
+	header.posting_size = sizeof(NESTilePosting);
+	header.rom_count = rom_count;
+	header.roms_offset = NES_TILE_INDEX_ALIGN_UP(sizeof(header));
+	header.strings_offset = NES_TILE_INDEX_ALIGN_UP(header.roms_offset + (rom_count * sizeof(uint32_t)));
+	header.strings_length = strings_length;
+	header.postings_offset = NES_TILE_INDEX_ALIGN_UP(header.strings_offset + strings_length);
+	
+	char *temp_path = (char*)malloc(strlen(writer->path) + 32);
+	sprintf(temp_path, "%s.tmp.%d", writer->path, (int)getpid());
+	
+	NESTileIndexTopEntry *top = (NESTileIndexTopEntry*)malloc(sizeof(NESTileIndexTopEntry) * NES_TILE_INDEX_TOP);
+	FILE *ofile = fopen(temp_path, "w");
+	u64 position = 0;
+	bool ok = (ofile != NULL) && strings_length <= UINT32_MAX;
+	
+	if (ofile && !ok) errno = EFBIG;
+	
+	if (ok) ok = NESTileIndexPad(ofile, &position, header.roms_offset);
+	if (ok) ok = (fwrite(roms, sizeof(uint32_t), rom_count, ofile) == rom_count);
+	position += rom_count * sizeof(uint32_t);
+	
+	if (ok) ok = NESTileIndexPad(ofile, &position, header.strings_offset);
+	for (i = 0; ok && i < rom_count; i++) {
+		ok = (fwrite(paths[i], 1, strlen(paths[i]) + 1, ofile) == strlen(paths[i]) + 1);
+	}
+	position += strings_length;
+	
+	if (ok) ok = NESTileIndexPad(ofile, &position, header.postings_offset);
+	if (ok) ok = NESTileIndexMerge(writer, ofile, &header, top);
+	position += header.posting_count * sizeof(NESTilePosting);
+	
+	header.top_offset = NES_TILE_INDEX_ALIGN_UP(position);
+	qsort(top, header.top_count, sizeof(NESTileIndexTopEntry), NESTileIndexTopCompare);
+	
+	if (ok) ok = NESTileIndexPad(ofile, &position, header.top_offset);
+	if (ok) ok = (fwrite(top, sizeof(NESTileIndexTopEntry), header.top_count, ofile) == header.top_count);
+	
+	//now that the counts are known, the header goes in
+	if (ok) ok = (fseek(ofile, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, ofile) == 1);
+	
+	if (ok) ok = (fflush(ofile) == 0 && fsync(fileno(ofile)) == 0);
+	if (ofile && fclose(ofile) != 0) ok = false;
+	
+	if (ok) ok = (rename(temp_path, writer->path) == 0);
+	
+	int saved = errno;
+	
+	if (!ok) unlink(temp_path);
+	
+	v_printf(VERBOSE_DEBUG, "%llu postings of %llu tiles from %d runs", (u64)header.posting_count, (u64)header.tile_count, writer->run_count + 1);
+	
+	NESTileIndexWriterFree(writer);
+	free(temp_path);
+	free(roms);
+	free(top);
+	
+	errno = saved;
+	
+	return ok;
+}
+
+#pragma mark -
+#pragma mark *** Reading ***
+
+NESTileIndex *NESTileIndexOpen(char *path) {
+	/*
+	**	maps the index at path
+	**	returns NULL if it can't be opened (errno is set; EINVAL for a bad or old index)
+	*/
+	
+	struct stat st;
+	
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	
+	if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(NESTileIndexHeader)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	uchar *data = (uchar*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	
+	u64 size = st.st_size;
+	NESTileIndexHeader *header = (NESTileIndexHeader*)data;
+	bool ok = (memcmp(header->magic, NES_TILE_INDEX_MAGIC, NES_TILE_INDEX_MAGIC_LENGTH) == 0)
+		&& header->version == NES_TILE_INDEX_VERSION
+		&& header->posting_size == sizeof(NESTilePosting)
+		&& header->rom_count < size && header->posting_count < size && header->top_count <= NES_TILE_INDEX_TOP
+		&& header->roms_offset + (header->rom_count * sizeof(uint32_t)) <= size
+		&& header->strings_offset + header->strings_length <= size
+		&& header->postings_offset + (header->posting_count * sizeof(NESTilePosting)) <= size
+		&& header->top_offset + (header->top_count * sizeof(NESTileIndexTopEntry)) <= size;
+	
+	if (!ok) {
+		v_printf(VERBOSE_DEBUG, "%s: not a version %d tile index", path, NES_TILE_INDEX_VERSION);
+		munmap(data, st.st_size);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	NESTileIndex *index = (NESTileIndex*)calloc(1, sizeof(NESTileIndex));
+	
+	index->fd = fd;
+	index->data = data;
+	index->size = size;
+	index->header = header;
+	index->roms = (uint32_t*)(data + header->roms_offset);
+	index->postings = (NESTilePosting*)(data + header->postings_offset);
+	index->top = (NESTileIndexTopEntry*)(data + header->top_offset);
+	index->strings = (char*)(data + header->strings_offset);
+	
+	return index;
+}
+
+bool NESTileIndexHasMagic(char *path) {
+	char magic[NES_TILE_INDEX_MAGIC_LENGTH];
+	FILE *ifile = fopen(path, "r");
+	
+	if (!ifile) return false;
+	
+	bool ok = (fread(magic, 1, NES_TILE_INDEX_MAGIC_LENGTH, ifile) == NES_TILE_INDEX_MAGIC_LENGTH)
+		&& memcmp(magic, NES_TILE_INDEX_MAGIC, NES_TILE_INDEX_MAGIC_LENGTH) == 0;
+	
+	fclose(ifile);
+	
+	return ok;
+}
+
+void NESTileIndexClose(NESTileIndex *index) {
+	if (!index) return;
+	
+	munmap(index->data, index->size);
+	close(index->fd);
+	free(index);
+}
+
+char *NESTileIndexRomPath(NESTileIndex *index, uint32_t rom) {
+	if (rom >= index->header->rom_count || index->roms[rom] >= index->header->strings_length) return "";
+	
+	return index->strings + index->roms[rom];
+}
+
+NESTilePosting *NESTileIndexFind(NESTileIndex *index, const uchar *canonical, u64 *count) {
+	u64 low = 0;
+	u64 high = index->header->posting_count;
+	
+	*count = 0;
+	
+	while (low < high) {
+		u64 middle = low + ((high - low) / 2);
+		
+		if (memcmp(index->postings[middle].tile, canonical, NES_ROM_TILE_LENGTH) < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	
+	u64 end = low;
+	while (end < index->header->posting_count && memcmp(index->postings[end].tile, canonical, NES_ROM_TILE_LENGTH) == 0) end++;
+	
+	*count = end - low;
+	
+	return *count ? &(index->postings[low]) : NULL;
+}
@@ -0,0 +1,132 @@
+/*
+**	tileindex.h
+**	nesromtool
+**
+**	an inverted index from tiles to every place they occur across a ROM library
+**
+**	tiles are stored canonicalized for flips: of a tile and its horizontal, vertical and
+**	double flips, the smallest (by memcmp()) stands for all four, and each posting records
+**	which flip it was. tiles that are one byte repeated (blank, solid) are left out.
+**
+**	building is an external merge sort: postings collect in a fixed-size buffer that's
+**	sorted and written out as a run each time it fills, then the runs are merged into the
+**	index. memory use is the buffer size, whatever the size of the library
+**
+**	file layout (native byte order), each section starting on an NES_TILE_INDEX_ALIGN boundary:
+**		NESTileIndexHeader
+**		ROM table: one uint32_t string table offset (its path) per ROM
+**		string table (NUL-terminated paths)
+**		postings: NESTilePosting, sorted by tile, then ROM, bank type, bank and tile index
+**		top tiles: NESTileIndexTopEntry, the tiles found in the most ROMs, most first
+**	a lookup is a binary search of the postings
+*/
+
+#ifndef _TILEINDEX_H_
+#define _TILEINDEX_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "types.h"
+#include "nesrom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_TILE_INDEX_MAGIC			"NESTILES"
+#define NES_TILE_INDEX_MAGIC_LENGTH		8
+#define NES_TILE_INDEX_VERSION			1
+#define NES_TILE_INDEX_ALIGN			64
+
+#define NES_TILE_INDEX_MEMORY			(256 * 1024 * 1024)	/* default run buffer size, in bytes */
+#define NES_TILE_INDEX_TOP				4096		/* most common tiles kept in the top table */
+
+// bits in NESTilePosting.flip
+#define NES_TILE_FLIP_HORIZONTAL		0x01
+#define NES_TILE_FLIP_VERTICAL			0x02
+
+//one occurrence of a tile
+typedef struct nesTilePosting {
+	uchar tile[NES_ROM_TILE_LENGTH];		/* canonical form */
+	uint32_t rom;							/* index into the ROM table */
+	uint16_t bank;
+	uint16_t index;							/* tile index in the bank */
+	uint8_t bank_type;						/* NESBankType */
+	uint8_t flip;							/* NES_TILE_FLIP_* that turns the canonical tile into this one */
+	uint16_t reserved;
+} NESTilePosting;
+
+typedef struct nesTileIndexTopEntry {
+	uchar tile[NES_ROM_TILE_LENGTH];		/* canonical form */
+	uint64_t first;							/* its first posting */
+	uint32_t postings;
+	uint32_t roms;							/* distinct ROMs it's in */
+} NESTileIndexTopEntry;
+
+typedef struct nesTileIndexHeader {
+	char magic[NES_TILE_INDEX_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t posting_size;					/* sizeof(NESTilePosting) */
+	uint64_t rom_count;
+	uint64_t posting_count;
+	uint64_t tile_count;					/* distinct canonical tiles */
+	uint64_t top_count;
+	uint64_t roms_offset;
+	uint64_t postings_offset;
+	uint64_t top_offset;
+	uint64_t strings_offset;
+	uint64_t strings_length;
+} NESTileIndexHeader;
+
+//an opened (mapped) index
+typedef struct nesTileIndex {
+	int fd;
+	uchar *data;
+	u64 size;
+	NESTileIndexHeader *header;
+	uint32_t *roms;
+	NESTilePosting *postings;
+	NESTileIndexTopEntry *top;
+	char *strings;
+} NESTileIndex;
+
+//an index being built
+typedef struct nesTileIndexWriter {
+	char *path;
+	NESTilePosting *buffer;					/* the current run */
+	u64 length;
+	u64 capacity;
+	int run_count;
+	u64 posting_count;
+	pthread_mutex_t lock;					/* NESTileIndexWriterAdd() can be called from several threads */
+	bool failed;
+	int error;								/* errno of the first failure */
+} NESTileIndexWriter;
+
+//canonical form of a tile; returns the NES_TILE_FLIP_* that turns canonical back into tile
+int NESTileCanonicalize(const uchar *tile, uchar *canonical);
+
+//building
+NESTileIndexWriter *NESTileIndexWriterOpen(char *path, u64 memory);
+
+//adds every tile of a mapped ROM's CHR banks (and PRG banks, if include_prg) as ROM number rom
+bool NESTileIndexWriterAdd(NESTileIndexWriter *writer, NESRom *rom, uint32_t rom_number, bool include_prg);
+
+//merges the runs and replaces the file at path atomically; paths[n] is ROM number n
+//always frees writer; returns false on error (errno is set)
+bool NESTileIndexWriterFinish(NESTileIndexWriter *writer, char **paths, u64 rom_count);
+
+//reading
+NESTileIndex *NESTileIndexOpen(char *path);
+bool NESTileIndexHasMagic(char *path);	/* true if the file at path starts like a tile index (of any version) */
+void NESTileIndexClose(NESTileIndex *index);
+char *NESTileIndexRomPath(NESTileIndex *index, uint32_t rom);
+
+//returns the first posting of a canonical tile and sets *count (NULL if it isn't in the index)
+NESTilePosting *NESTileIndexFind(NESTileIndex *index, const uchar *canonical, u64 *count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _TILEINDEX_H_ */
@@ -0,0 +1,185 @@
+/*
+**	trim.c
+**	nesromtool
+**
+**	mirrored-bank and overdump trimming (see trim.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "trim.h"
+#include "hash.h"
+#include "nesutils.h"
+#include "verbosity.h"
+
+#define NES_TRIM_COPY_LENGTH		65536		/* bytes moved per pwrite() when CHR data slides down */
+
+static bool NESTrimBanksEqual(NESRom *rom, NESBankType bank_type, uint32_t *digests, int a, int b) {
+	/*
+	**	the CRCs rule out almost every pair; the memcmp() makes it exact
+	*/
+	
+	if (digests[a] != digests[b]) return false;
+	
+	return memcmp(NESRomGetBank(rom, bank_type, a), NESRomGetBank(rom, bank_type, b), NESRomBankLength(bank_type)) == 0;
+}
+
+static int NESTrimAnalyzeBanks(NESRom *rom, NESBankType bank_type, int count, int *duplicates) {
+	/*
+	**	returns the smallest power-of-two number of banks that the whole region repeats
+	**	(count if it doesn't), and sets *duplicates to the number of banks that copy an earlier one
+	*/
+	
+	int i = 0, j = 0, keep = 0;
+	u64 length = NESRomBankLength(bank_type);
+	
+	*duplicates = 0;
+	if (count < 2) return count;
+	
+	uint32_t *digests = (uint32_t*)malloc(sizeof(uint32_t) * count);
+	
+	for (i = 0; i < count; i++) {
+		digests[i] = crc32_update(0, NESRomGetBank(rom, bank_type, i), length);
+	}
+	
+	for (i = 1; i < count; i++) {
+		for (j = 0; j < i; j++) {
+			if (NESTrimBanksEqual(rom, bank_type, digests, i, j)) {
+				(*duplicates)++;
+				break;
+			}
+		}
+	}
+	
+	//no duplicates means no repeats
+	if (!*duplicates) {
+		free(digests);
+		return count;
+	}
+	
+	for (keep = 1; keep < count; keep <<= 1) {
+		bool repeats = (count % keep == 0);
+		
+		for (i = keep; repeats && i < count; i++) {
+			if (!NESTrimBanksEqual(rom, bank_type, digests, i, i % keep)) repeats = false;
+		}
+		
+		if (repeats) break;
+	}
+	
+	free(digests);
+	
+	return (keep < count) ? keep : count;
+}
+
+bool NESRomAnalyzeTrim(NESRom *rom, NESTrimInfo *info) {
+	/*
+	**	fills in info for a mapped ROM
+	*/
+	
+	memset(info, 0, sizeof(NESTrimInfo));
+	
+	if (!NESRomVerify(rom) || !rom->data) return false;
+	
+	NESRomDirectory *dir = &(rom->dir);
+	
+	info->size = rom->size;
+	info->prg_count = info->prg_keep = rom->prg_count;
+	info->chr_count = info->chr_keep = rom->chr_count;
+	info->trimmed_size = rom->size;
+	
+	if (rom->size < dir->title_offset) {
+		info->truncated = true;
+		return true;
+	}
+	
+	//NES 2.0 miscellaneous ROMs live past the CHR data, with no size given; leave those files alone
+	if (rom->info.format == nes_format_nes2 && rom->info.misc_roms) return true;
+	
+	//sizes in NES 2.0's exponent form would need re-encoding; those regions are left alone too
+	uchar msb = (rom->info.format == nes_format_nes2) ? rom->header[NES2_ROM_SIZE_MSB_OFFSET] : 0;
+	
+	if (rom->info.prg_size == (u64)rom->prg_count * NES_PRG_BANK_LENGTH && (msb & 0x0F) != NES2_SIZE_EXPONENT_MSB) {
+		info->prg_keep = NESTrimAnalyzeBanks(rom, nes_prg_bank, rom->prg_count, &(info->prg_duplicates));
+	}
+	
+	if (rom->info.chr_size == (u64)rom->chr_count * NES_CHR_BANK_LENGTH && (msb >> 4) != NES2_SIZE_EXPONENT_MSB) {
+		info->chr_keep = NESTrimAnalyzeBanks(rom, nes_chr_bank, rom->chr_count, &(info->chr_duplicates));
+	}
+	
+	info->overdump = dir->overdump_length;
+	
+	info->trimmed_size = rom->size - info->overdump
+		- ((u64)(info->prg_count - info->prg_keep) * NES_PRG_BANK_LENGTH)
+		- ((u64)(info->chr_count - info->chr_keep) * NES_CHR_BANK_LENGTH);
+	
+	return true;
+}
+
+static bool NESTrimMove(NESRom *rom, int fd, u64 source, u64 destination, u64 length) {
+	/*
+	**	copies length bytes of the file down from source to destination (destination <= source)
+	**	front to back, so nothing is overwritten before it's been read
+	*/
+	
+	uchar buffer[NES_TRIM_COPY_LENGTH];
+	u64 done = 0;
+	
+	if (source == destination) return true;
+	
+	while (done < length) {
+		u64 chunk = length - done;
+		if (chunk > NES_TRIM_COPY_LENGTH) chunk = NES_TRIM_COPY_LENGTH;
+		
+		memcpy(buffer, rom->data + source + done, chunk);
+		if (pwrite(fd, buffer, chunk, destination + done) != (ssize_t)chunk) return false;
+		
+		done += chunk;
+	}
+	
+	return true;
+}
+
+bool NESRomTrim(NESRom *rom, NESTrimInfo *info, int fd) {
+	/*
+	**	rewrites the bank counts, slides the kept CHR banks and the title block down behind
+	**	the kept PRG banks, and truncates the rest away
+	**	returns false on a write error (errno is set)
+	*/
+	
+	uchar header[NES_HEADER_SIZE];
+	NESRomDirectory *dir = &(rom->dir);
+	
+	if (info->truncated || info->trimmed_size == info->size) return true;
+	
+	memcpy(header, rom->header, NES_HEADER_SIZE);
+	
+	//the counts only ever shrink, so they still fit wherever the old ones did
+	header[NES_PRG_COUNT_OFFSET] = info->prg_keep & 0xFF;
+	header[NES_CHR_COUNT_OFFSET] = info->chr_keep & 0xFF;
+	
+	if (rom->info.format == nes_format_nes2) {
+		uchar msb = header[NES2_ROM_SIZE_MSB_OFFSET];
+		
+		if (info->prg_keep != info->prg_count) msb = (msb & 0xF0) | ((info->prg_keep >> 8) & 0x0F);
+		if (info->chr_keep != info->chr_count) msb = (msb & 0x0F) | (((info->chr_keep >> 8) & 0x0F) << 4);
+		
+		header[NES2_ROM_SIZE_MSB_OFFSET] = msb;
+	}
+	
+	u64 chr_source = NESRomBankOffset(rom, nes_chr_bank, 0);
+	u64 chr_destination = dir->trainer_offset + dir->trainer_length + ((u64)info->prg_keep * NES_PRG_BANK_LENGTH);
+	u64 chr_length = (info->chr_keep == info->chr_count) ? rom->info.chr_size : (u64)info->chr_keep * NES_CHR_BANK_LENGTH;
+	
+	bool ok = NESTrimMove(rom, fd, chr_source, chr_destination, chr_length)
+		&& NESTrimMove(rom, fd, dir->title_offset, chr_destination + chr_length, dir->title_length)
+		&& pwrite(fd, header, NES_HEADER_SIZE, NES_HEADER_PREFIX_OFFSET) == NES_HEADER_SIZE
+		&& ftruncate(fd, info->trimmed_size) == 0;
+	
+	v_printf(VERBOSE_DEBUG, "trimmed %llu -> %llu bytes", info->size, info->trimmed_size);
+	
+	return ok;
+}
@@ -0,0 +1,44 @@
+/*
+**	trim.h
+**	nesromtool
+**
+**	finding and removing dead weight in ROM files: PRG/CHR data that's just an earlier bank
+**	repeated (a 16KB game mirrored to 32KB), and overdump past the last bank
+**	trimming is lossless: mappers wrap the address lines, so a repeated image reads the same
+*/
+
+#ifndef _TRIM_H_
+#define _TRIM_H_
+
+#include "types.h"
+#include "nesrom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nesTrimInfo {
+	int prg_count;							/* PRG banks in the file now */
+	int prg_keep;							/* PRG banks left once the repeats are dropped */
+	int prg_duplicates;						/* PRG banks that are exact copies of an earlier one */
+	int chr_count;
+	int chr_keep;
+	int chr_duplicates;
+	u64 overdump;							/* bytes past the banks that aren't a title block */
+	u64 size;								/* filesize now */
+	u64 trimmed_size;						/* filesize after trimming (== size if there's nothing to do) */
+	bool truncated;							/* the banks aren't all there, so nothing gets trimmed */
+} NESTrimInfo;
+
+//hashes every bank of a mapped ROM and works out what could go; false if rom isn't an NES ROM
+bool NESRomAnalyzeTrim(NESRom *rom, NESTrimInfo *info);
+
+//trims the file rom was mapped from, in place: rewrites the header, moves the CHR data
+//and title block down, then ftruncate()s. fd must be open for writing on the same file
+bool NESRomTrim(NESRom *rom, NESTrimInfo *info, int fd);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _TRIM_H_ */
@@ -11,6 +11,7 @@
 #ifndef _TYPES_H_
 #define _TYPES_H_
 
+typedef unsigned long long u64;
 typedef unsigned long u32;
 typedef unsigned short u16;
 
@@ -0,0 +1,229 @@
+/*
+**	verify.c
+**	nesromtool
+**
+**	structural ROM checks (see verify.h)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "verify.h"
+#include "nesutils.h"
+
+void NESVerifyHeader(NESVerifyResult *result, uchar *header, u64 filesize, uchar *trailer) {
+	/*
+	**	fills in result for a file of filesize bytes that starts with header
+	*/
+	
+	NESRom rom;
+	
+	memset(result, 0, sizeof(NESVerifyResult));
+	result->size = filesize;
+	
+	if (filesize < NES_HEADER_SIZE || memcmp(header + NES_HEADER_PREFIX_OFFSET, NES_HEADER_PREFIX, NES_HEADER_PREFIX_SIZE) != 0) {
+		result->problems |= NES_VERIFY_NOT_ROM;
+		return;
+	}
+	
+	NESRomParseHeader(&rom, header, filesize);
+	NESHeader *info = &(rom.info);
+	uchar control_2 = header[NES_ROM_CONTROL_OFFSET + 1];
+	
+	result->format = info->format;
+	result->expected_size = rom.dir.title_offset;
+	
+	if (filesize < result->expected_size) result->problems |= NES_VERIFY_TRUNCATED;
+	if (info->prg_size == 0) result->problems |= NES_VERIFY_NO_PRG;
+	
+	//NESDecodeHeader() only believes a NES 2.0 identifier if the sizes fit; if they didn't, say so
+	if ((control_2 & NES2_IDENTIFIER_MASK) == NES2_IDENTIFIER && info->format != nes_format_nes2) {
+		result->problems |= NES_VERIFY_NES2_SIZE;
+	} else if (info->format == nes_format_archaic) {
+		result->problems |= NES_VERIFY_ARCHAIC;
+	}
+	
+	if (info->format == nes_format_nes2) {
+		bool nvram = info->prg_nvram_size || info->chr_nvram_size;
+		
+		if (nvram != info->battery) result->problems |= NES_VERIFY_NES2_BATTERY;
+		if (info->chr_size == 0 && info->chr_ram_size == 0 && info->chr_nvram_size == 0) result->problems |= NES_VERIFY_NES2_NO_CHR;
+		
+		if ((header[NES2_TIMING_OFFSET] & 0xFC) || (header[NES2_MISC_ROMS_OFFSET] & 0xFC) || (header[NES2_EXPANSION_OFFSET] & 0xC0)) {
+			result->problems |= NES_VERIFY_NES2_RESERVED;
+		}
+	}
+	
+	//whatever is past the ROM data: miscellaneous ROMs (NES 2.0 says how many, not how big), a title block or overdump
+	if (filesize <= result->expected_size || (info->format == nes_format_nes2 && info->misc_roms)) return;
+	
+	u64 trailing = filesize - result->expected_size;
+	
+	if (trailing > NES_TITLE_BLOCK_LENGTH) {
+		result->problems |= NES_VERIFY_OVERDUMP;
+		return;
+	}
+	
+	//a title block is exactly NES_TITLE_BLOCK_LENGTH bytes: printable text, then NUL padding
+	bool ok = (trailing == NES_TITLE_BLOCK_LENGTH && trailer != NULL);
+	u64 i = 0;
+	
+	for (i = 0; ok && i < trailing && trailer[i]; i++) {
+		if (trailer[i] < 32 || trailer[i] > 126) ok = false;
+	}
+	
+	for (; ok && i < trailing; i++) {
+		if (trailer[i]) ok = false;
+	}
+	
+	if (!ok) result->problems |= NES_VERIFY_BAD_TITLE;
+}
+
+bool NESVerifyDescriptor(NESVerifyResult *result, int fd) {
+	/*
+	**	fstat() for the size, pread() for the header, and another pread() for the title block if there may be one
+	**	returns false (with result->error set) on a read error
+	*/
+	
+	struct stat st;
+	uchar header[NES_HEADER_SIZE];
+	uchar trailer[NES_TITLE_BLOCK_LENGTH];
+	NESRom rom;
+	
+	memset(result, 0, sizeof(NESVerifyResult));
+	memset(header, 0, sizeof(header));
+	
+	if (fstat(fd, &st) != 0 || pread(fd, header, NES_HEADER_SIZE, NES_HEADER_PREFIX_OFFSET) < 0) {
+		result->error = errno;
+		return false;
+	}
+	
+	u64 filesize = st.st_size;
+	
+	//only go back for the trailer if there's a title block's worth (or less) of it
+	NESRomParseHeader(&rom, header, filesize);
+	u64 title_offset = rom.dir.title_offset;
+	uchar *title = NULL;
+	
+	if (filesize > title_offset && filesize - title_offset <= NES_TITLE_BLOCK_LENGTH) {
+		ssize_t length = pread(fd, trailer, filesize - title_offset, title_offset);
+		
+		if (length < 0) {
+			result->error = errno;
+			return false;
+		}
+		
+		if ((u64)length == filesize - title_offset) title = trailer;
+	}
+	
+	NESVerifyHeader(result, header, filesize, title);
+	
+	return true;
+}
+
+bool NESVerifyFile(NESVerifyResult *result, char *path) {
+	int fd = open(path, O_RDONLY);
+	
+	if (fd < 0) {
+		memset(result, 0, sizeof(NESVerifyResult));
+		result->error = errno;
+		return false;
+	}
+	
+	bool ok = NESVerifyDescriptor(result, fd);
+	
+	close(fd);
+	
+	return ok;
+}
+
+bool NESVerifyOpenRom(NESVerifyResult *result, NESRom *rom) {
+	if (rom->fd >= 0) return NESVerifyDescriptor(result, rom->fd);
+	
+	NESVerifyHeader(result, rom->header, rom->size, NULL);
+	
+	return true;
+}
+
+char *NESVerifyProblemName(int problem) {
+	switch (problem) {
+		case NES_VERIFY_NOT_ROM:			return "not-rom";
+		case NES_VERIFY_TRUNCATED:			return "truncated";
+		case NES_VERIFY_NO_PRG:				return "no-prg";
+		case NES_VERIFY_NES2_SIZE:			return "nes2-size";
+		case NES_VERIFY_OVERDUMP:			return "overdump";
+		case NES_VERIFY_BAD_TITLE:			return "bad-title";
+		case NES_VERIFY_ARCHAIC:			return "archaic-header";
+		case NES_VERIFY_NES2_BATTERY:		return "nes2-battery";
+		case NES_VERIFY_NES2_RESERVED:		return "nes2-reserved";
+		case NES_VERIFY_NES2_NO_CHR:		return "nes2-no-chr";
+		default:							return "unknown";
+	}
+}
+
+void NESVerifyDescribe(char *buf, int length, NESVerifyResult *result, int problem) {
+	/*
+	**	writes a human-readable description of one problem into buf
+	*/
+	
+	u64 trailing = (result->size > result->expected_size) ? result->size - result->expected_size : 0;
+	
+	switch (problem) {
+		case NES_VERIFY_NOT_ROM:
+			snprintf(buf, length, "no NES header");
+			break;
+		case NES_VERIFY_TRUNCATED:
+			snprintf(buf, length, "truncated: header needs %llu bytes, file has %llu (%llu missing)", result->expected_size, result->size, result->expected_size - result->size);
+			break;
+		case NES_VERIFY_NO_PRG:
+			snprintf(buf, length, "header says there is no PRG-ROM");
+			break;
+		case NES_VERIFY_NES2_SIZE:
+			snprintf(buf, length, "NES 2.0 header with ROM sizes that don't fit in the file (read as %s)", NESHeaderFormatName(result->format));
+			break;
+		case NES_VERIFY_OVERDUMP:
+			snprintf(buf, length, "overdump: %llu bytes past the end of the CHR data", trailing);
+			break;
+		case NES_VERIFY_BAD_TITLE:
+			snprintf(buf, length, "%llu trailing bytes don't look like a title block (%d bytes: text, then NUL padding)", trailing, NES_TITLE_BLOCK_LENGTH);
+			break;
+		case NES_VERIFY_ARCHAIC:
+			snprintf(buf, length, "garbage in header bytes 7-15");
+			break;
+		case NES_VERIFY_NES2_BATTERY:
+			snprintf(buf, length, "NES 2.0 battery bit doesn't match the NVRAM sizes");
+			break;
+		case NES_VERIFY_NES2_RESERVED:
+			snprintf(buf, length, "NES 2.0 reserved bits are set");
+			break;
+		case NES_VERIFY_NES2_NO_CHR:
+			snprintf(buf, length, "NES 2.0 header with neither CHR-ROM nor CHR-RAM");
+			break;
+		default:
+			snprintf(buf, length, "unknown problem");
+			break;
+	}
+}
+
+void NESVerifyDescribeError(char *buf, int length, NESVerifyResult *result) {
+	int problem = 0;
+	
+	if (result->error) {
+		snprintf(buf, length, "%s", strerror(result->error));
+		return;
+	}
+	
+	for (problem = 1; problem < (1 << NES_VERIFY_PROBLEM_COUNT); problem <<= 1) {
+		if (result->problems & problem & NES_VERIFY_ERRORS) {
+			NESVerifyDescribe(buf, length, result, problem);
+			return;
+		}
+	}
+	
+	snprintf(buf, length, "no errors");
+}
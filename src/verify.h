@@ -0,0 +1,76 @@
+/*
+**	verify.h
+**	nesromtool
+**
+**	structural checks for ROM files: does the file hold exactly what its header says it does?
+**	only the header and (if there is one) the trailing title block are read
+*/
+
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+#include "types.h"
+#include "nesrom.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// problems (bits in NESVerifyResult.problems)
+// errors: the file can't be used as-is
+#define NES_VERIFY_NOT_ROM				0x0001		/* shorter than a header, or no magic number */
+#define NES_VERIFY_TRUNCATED			0x0002		/* the file ends before the PRG/CHR data does */
+#define NES_VERIFY_NO_PRG				0x0004		/* the header says there's no PRG-ROM */
+#define NES_VERIFY_NES2_SIZE			0x0008		/* NES 2.0 identifier, but its ROM sizes don't fit in the file */
+// warnings: the ROM data is all there, but something around it is off
+#define NES_VERIFY_OVERDUMP				0x0010		/* more trailing data than a title block */
+#define NES_VERIFY_BAD_TITLE			0x0020		/* trailing data that isn't a well-formed title block */
+#define NES_VERIFY_ARCHAIC				0x0040		/* garbage in bytes 7-15 (see 'header normalize') */
+#define NES_VERIFY_NES2_BATTERY			0x0080		/* NES 2.0 battery bit and NVRAM sizes disagree */
+#define NES_VERIFY_NES2_RESERVED		0x0100		/* NES 2.0 reserved bits are set */
+#define NES_VERIFY_NES2_NO_CHR			0x0200		/* NES 2.0 header with neither CHR-ROM nor CHR-RAM */
+
+#define NES_VERIFY_PROBLEM_COUNT		10
+#define NES_VERIFY_ERRORS				(NES_VERIFY_NOT_ROM | NES_VERIFY_TRUNCATED | NES_VERIFY_NO_PRG | NES_VERIFY_NES2_SIZE)
+
+// exit codes for the verify action
+#define NES_VERIFY_EXIT_OK				0			/* every file is clean */
+#define NES_VERIFY_EXIT_INVALID			1			/* at least one file has an error (or couldn't be read) */
+#define NES_VERIFY_EXIT_WARNINGS		2			/* no errors, but at least one file has warnings */
+
+typedef struct nesVerifyResult {
+	int problems;							/* NES_VERIFY_* bits */
+	int error;								/* errno if the file couldn't be read, otherwise 0 */
+	u64 size;								/* filesize */
+	u64 expected_size;						/* header + trainer + PRG + CHR */
+	NESHeaderFormat format;
+} NESVerifyResult;
+
+//checks a header against the file it came from
+//trailer holds the bytes past expected_size when there are no more than a title block's worth (NULL otherwise)
+void NESVerifyHeader(NESVerifyResult *result, uchar *header, u64 filesize, uchar *trailer);
+
+//reads what's needed from fd (one fstat() and at most two pread()s) and checks it
+bool NESVerifyDescriptor(NESVerifyResult *result, int fd);
+
+//same, by path; returns false (with result->error set) if the file can't be read
+bool NESVerifyFile(NESVerifyResult *result, char *path);
+
+//same, for an opened ROM: through its descriptor if it has one, otherwise from the header and filesize it
+//was opened with (which finds the same errors; only the title block warnings need the file)
+bool NESVerifyOpenRom(NESVerifyResult *result, NESRom *rom);
+
+//short name for a single problem bit ("truncated", "overdump", ...)
+char *NESVerifyProblemName(int problem);
+
+//one line describing a single problem bit for this result
+void NESVerifyDescribe(char *buf, int length, NESVerifyResult *result, int problem);
+
+//one line describing the first error in result, or why the file couldn't be read
+void NESVerifyDescribeError(char *buf, int length, NESVerifyResult *result);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _VERIFY_H_ */
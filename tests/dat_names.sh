@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+#	dat_names.sh
+#	nesromtool
+#
+#	dat identify names games from the NES 2.0 database layout, where the name is a comment
+#	inside each <game> (tests/fixtures/nes20db.xml)
+#
+
+NESROMTOOL=${NESROMTOOL:-./nesromtool}
+FIXTURES=${srcdir:-.}/tests/fixtures
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/nesromtool-test.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+#two 1-bank NROM images: a 16-byte iNES header, then 16KB of PRG (all 0x00, then all 0xFF)
+make_rom() {
+	printf 'NES\032\001\000\000\000\000\000\000\000\000\000\000\000' > "$1"
+	head -c 16384 /dev/zero | tr '\000' "$2" >> "$1"
+}
+
+make_rom "$WORK/a.nes" '\000'
+make_rom "$WORK/b.nes" '\377'
+
+"$NESROMTOOL" dat build "$WORK/db.idx" "$FIXTURES/nes20db.xml" > /dev/null || exit 1
+"$NESROMTOOL" dat identify "$WORK/db.idx" "$WORK/a.nes" "$WORK/b.nes" > "$WORK/out" || exit 1
+
+#each file's block starts with its Filename: line; pair that with its Match: line
+awk '/^Filename:/ { file = $2 } /^Match:/ { sub(/^Match: */, ""); print file ": " $0 }' "$WORK/out" > "$WORK/matches"
+
+fail=0
+
+grep -qx ".*/a.nes: Alpha (USA)" "$WORK/matches" || { echo "a.nes wasn't named Alpha (USA)"; fail=1; }
+grep -qx ".*/b.nes: Beta (Japan)" "$WORK/matches" || { echo "b.nes wasn't named Beta (Japan)"; fail=1; }
+
+if [ $fail -ne 0 ]; then
+	cat "$WORK/out"
+	exit 1
+fi
+
+exit 0